@@ -53,6 +53,12 @@ void CloudTransport::sendData(const QList<QUuid> &clientIds, const QByteArray &d
     }
 }
 
+bool CloudTransport::supportsEncoding(TransportInterface::Encoding encoding) const
+{
+    // The remote proxy tunnels the connection through websocket text frames, binary data would not survive that
+    return encoding == EncodingJson;
+}
+
 void CloudTransport::terminateClientConnection(const QUuid &clientId)
 {
     foreach (const ConnectionContext &ctx, m_connections) {
@@ -38,6 +38,8 @@ public:
 
     void terminateClientConnection(const QUuid &clientId) override;
 
+    bool supportsEncoding(Encoding encoding) const override;
+
     bool startServer() override;
     bool stopServer() override;
 
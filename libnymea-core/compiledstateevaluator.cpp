@@ -0,0 +1,233 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::CompiledStateEvaluator
+    \brief Incrementally evaluates the state tree of a \l{Rule}.
+
+    \ingroup rules
+    \inmodule core
+
+    A \l StateEvaluator tree gets flattened into an array of nodes. Each node caches the truth value
+    of its \l StateDescriptor and the number of child nodes currently evaluating to true. A state change
+    only re-evaluates the descriptors subscribed to the changed (deviceId, stateTypeId) pair or to an
+    interface of the device, and propagates the result up to the root as long as a node value changes.
+
+    The result is the same as \l{StateEvaluator::evaluate()} on the original tree.
+
+    \sa StateEvaluator, RuleEngine
+*/
+
+#include "compiledstateevaluator.h"
+#include "nymeacore.h"
+#include "devicemanager.h"
+#include "loggingcategories.h"
+
+namespace nymeaserver {
+
+/*! Constructs an empty CompiledStateEvaluator which always evaluates to true. */
+CompiledStateEvaluator::CompiledStateEvaluator()
+{
+}
+
+/*! Constructs a CompiledStateEvaluator for the given \a stateEvaluator tree. Call \l{evaluate()}
+    to initialize the cached values. */
+CompiledStateEvaluator::CompiledStateEvaluator(const StateEvaluator &stateEvaluator)
+{
+    compile(stateEvaluator, -1);
+}
+
+/*! Returns the cached result of the whole state tree. */
+bool CompiledStateEvaluator::result() const
+{
+    if (m_nodes.isEmpty())
+        return true;
+
+    return m_nodes.first().value;
+}
+
+/*! Evaluates all state descriptors of this tree against the current device states and returns the result. */
+bool CompiledStateEvaluator::evaluate()
+{
+    for (int i = 0; i < m_nodes.count(); i++) {
+        Node &node = m_nodes[i];
+        node.trueChildCount = 0;
+        if (!node.hasDescriptor)
+            continue;
+
+        if (node.stateDescriptor.type() == StateDescriptor::TypeDevice) {
+            node.descriptorMatching = evaluateDeviceDescriptor(node.stateDescriptor);
+        } else {
+            node.matchingDevices.clear();
+            foreach (Device *device, NymeaCore::instance()->deviceManager()->configuredDevices()) {
+                DeviceClass deviceClass = NymeaCore::instance()->deviceManager()->findDeviceClass(device->deviceClassId());
+                if (!deviceClass.isValid()) {
+                    qCWarning(dcRuleEngine()) << "Could not find DeviceClass for Device" << device->name() << device->id();
+                    continue;
+                }
+                if (deviceClass.interfaces().contains(node.stateDescriptor.interface()) && evaluateInterfaceDescriptor(node.stateDescriptor, device, deviceClass)) {
+                    node.matchingDevices.append(device->id());
+                }
+            }
+            node.descriptorMatching = !node.matchingDevices.isEmpty();
+        }
+    }
+
+    // Children are always stored after their parent, so walking backwards evaluates bottom up
+    for (int i = m_nodes.count() - 1; i >= 0; i--) {
+        Node &node = m_nodes[i];
+        node.value = computeValue(node);
+        if (node.value && node.parent >= 0) {
+            m_nodes[node.parent].trueChildCount++;
+        }
+    }
+
+    qCDebug(dcRuleEngineDebug()) << "CompiledStateEvaluator: Evaluated" << m_nodes.count() << "nodes => Evaluation result:" << result();
+    return result();
+}
+
+/*! Re-evaluates the descriptors depending on the state with the given \a stateTypeId of the given \a device
+    with the given \a deviceClass and returns the updated result. */
+bool CompiledStateEvaluator::updateState(Device *device, const DeviceClass &deviceClass, const StateTypeId &stateTypeId)
+{
+    foreach (int index, m_deviceLeaves.value(QPair<QUuid, QUuid>(device->id(), stateTypeId))) {
+        setDescriptorMatching(index, evaluateDeviceDescriptor(m_nodes.at(index).stateDescriptor));
+    }
+
+    if (!m_interfaceLeaves.isEmpty()) {
+        StateType stateType = deviceClass.stateTypes().findById(stateTypeId);
+        foreach (const QString &interface, deviceClass.interfaces()) {
+            foreach (int index, m_interfaceLeaves.value(interface)) {
+                Node &node = m_nodes[index];
+                if (stateType.name() != node.stateDescriptor.interfaceState())
+                    continue;
+
+                if (evaluateInterfaceDescriptor(node.stateDescriptor, device, deviceClass)) {
+                    if (!node.matchingDevices.contains(device->id())) {
+                        node.matchingDevices.append(device->id());
+                    }
+                } else {
+                    node.matchingDevices.removeAll(device->id());
+                }
+                setDescriptorMatching(index, !node.matchingDevices.isEmpty());
+            }
+        }
+    }
+
+    return result();
+}
+
+/*! Forgets the device with the given \a deviceId for all interface based descriptors and returns the updated result. */
+bool CompiledStateEvaluator::removeDevice(const DeviceId &deviceId)
+{
+    foreach (const QList<int> &indexes, m_interfaceLeaves) {
+        foreach (int index, indexes) {
+            if (m_nodes[index].matchingDevices.removeAll(deviceId) > 0) {
+                setDescriptorMatching(index, !m_nodes.at(index).matchingDevices.isEmpty());
+            }
+        }
+    }
+    return result();
+}
+
+void CompiledStateEvaluator::compile(const StateEvaluator &stateEvaluator, int parent)
+{
+    int index = m_nodes.count();
+
+    Node node;
+    node.parent = parent;
+    node.operatorType = stateEvaluator.operatorType();
+    node.stateDescriptor = stateEvaluator.stateDescriptor();
+    node.hasDescriptor = node.stateDescriptor.isValid();
+    node.childCount = stateEvaluator.childEvaluators().count();
+    m_nodes.append(node);
+
+    if (node.hasDescriptor) {
+        if (node.stateDescriptor.type() == StateDescriptor::TypeDevice) {
+            m_deviceLeaves[QPair<QUuid, QUuid>(node.stateDescriptor.deviceId(), node.stateDescriptor.stateTypeId())].append(index);
+        } else {
+            m_interfaceLeaves[node.stateDescriptor.interface()].append(index);
+        }
+    }
+
+    foreach (const StateEvaluator &childEvaluator, stateEvaluator.childEvaluators()) {
+        compile(childEvaluator, index);
+    }
+}
+
+bool CompiledStateEvaluator::computeValue(const Node &node) const
+{
+    int inputCount = node.childCount + (node.hasDescriptor ? 1 : 0);
+    int trueCount = node.trueChildCount + (node.hasDescriptor && node.descriptorMatching ? 1 : 0);
+
+    if (node.operatorType == Types::StateOperatorOr)
+        return trueCount > 0;
+
+    return trueCount == inputCount;
+}
+
+void CompiledStateEvaluator::setDescriptorMatching(int index, bool matching)
+{
+    if (m_nodes.at(index).descriptorMatching == matching)
+        return;
+
+    m_nodes[index].descriptorMatching = matching;
+
+    // Propagate the change up the tree until a node value stays the same
+    while (index >= 0) {
+        Node &node = m_nodes[index];
+        bool value = computeValue(node);
+        if (value == node.value)
+            return;
+
+        node.value = value;
+        if (node.parent >= 0) {
+            m_nodes[node.parent].trueChildCount += value ? 1 : -1;
+        }
+        index = node.parent;
+    }
+}
+
+bool CompiledStateEvaluator::evaluateDeviceDescriptor(const StateDescriptor &stateDescriptor) const
+{
+    Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevice(stateDescriptor.deviceId());
+    if (!device) {
+        qCWarning(dcRuleEngine) << "CompiledStateEvaluator: Device not existing!";
+        return false;
+    }
+
+    if (!device->hasState(stateDescriptor.stateTypeId())) {
+        qCWarning(dcRuleEngine) << "CompiledStateEvaluator: Device found, but it does not appear to have such a state!";
+        return false;
+    }
+
+    return stateDescriptor == device->state(stateDescriptor.stateTypeId());
+}
+
+bool CompiledStateEvaluator::evaluateInterfaceDescriptor(const StateDescriptor &stateDescriptor, Device *device, const DeviceClass &deviceClass) const
+{
+    StateType stateType = deviceClass.stateTypes().findByName(stateDescriptor.interfaceState());
+    State state = device->state(stateType.id());
+    // As the StateDescriptor can't compare on it's own against interfaces, generate custom one, matching the device
+    StateDescriptor temporaryDescriptor(stateType.id(), device->id(), stateDescriptor.stateValue(), stateDescriptor.operatorType());
+    return temporaryDescriptor == state;
+}
+
+}
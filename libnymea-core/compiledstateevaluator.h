@@ -0,0 +1,75 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COMPILEDSTATEEVALUATOR_H
+#define COMPILEDSTATEEVALUATOR_H
+
+#include "stateevaluator.h"
+#include "types/deviceclass.h"
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+class Device;
+
+namespace nymeaserver {
+
+class CompiledStateEvaluator
+{
+public:
+    CompiledStateEvaluator();
+    explicit CompiledStateEvaluator(const StateEvaluator &stateEvaluator);
+
+    bool result() const;
+
+    bool evaluate();
+    bool updateState(Device *device, const DeviceClass &deviceClass, const StateTypeId &stateTypeId);
+    bool removeDevice(const DeviceId &deviceId);
+
+private:
+    class Node {
+    public:
+        int parent = -1;
+        Types::StateOperator operatorType = Types::StateOperatorAnd;
+        StateDescriptor stateDescriptor;
+        bool hasDescriptor = false;
+        bool descriptorMatching = false;
+        QList<QUuid> matchingDevices;
+        int childCount = 0;
+        int trueChildCount = 0;
+        bool value = false;
+    };
+
+    void compile(const StateEvaluator &stateEvaluator, int parent);
+    bool computeValue(const Node &node) const;
+    void setDescriptorMatching(int index, bool matching);
+
+    bool evaluateDeviceDescriptor(const StateDescriptor &stateDescriptor) const;
+    bool evaluateInterfaceDescriptor(const StateDescriptor &stateDescriptor, Device *device, const DeviceClass &deviceClass) const;
+
+    QVector<Node> m_nodes;
+    QHash<QPair<QUuid, QUuid>, QList<int> > m_deviceLeaves;
+    QHash<QString, QList<int> > m_interfaceLeaves;
+};
+
+}
+
+#endif // COMPILEDSTATEEVALUATOR_H
@@ -993,6 +993,48 @@ QByteArray DebugServerHandler::createDebugXmlDocument()
 
     writer.writeEndElement(); // table
 
+    // Plugins section
+    writer.writeEmptyElement("hr");
+    //: The plugins section of the debug interface
+    writer.writeTextElement("h2", tr("Plugins"));
+    writer.writeEmptyElement("hr");
+
+    //: The plugins section description of the debug interface
+    writer.writeTextElement("p", tr("The time in milliseconds it took to parse the metadata, to load the library and to initialize each plugin. "
+                                    "Plugins without configured devices are not loaded until they are needed."));
+
+    QMap<QString, PluginLoadInfo> pluginLoadInfos;
+    foreach (const PluginLoadInfo &loadInfo, NymeaCore::instance()->deviceManager()->pluginLoadInfos()) {
+        pluginLoadInfos.insert(loadInfo.pluginName(), loadInfo);
+    }
+
+    writer.writeStartElement("table");
+    writer.writeStartElement("tr");
+    //: The plugin name column in the plugins section of the debug interface
+    writer.writeTextElement("th", tr("Plugin"));
+    //: The metadata time column in the plugins section of the debug interface
+    writer.writeTextElement("th", tr("Metadata"));
+    //: The library load time column in the plugins section of the debug interface
+    writer.writeTextElement("th", tr("Load"));
+    //: The initialization time column in the plugins section of the debug interface
+    writer.writeTextElement("th", tr("Init"));
+    //: The load status column in the plugins section of the debug interface
+    writer.writeTextElement("th", tr("Status"));
+    writer.writeEndElement(); // tr
+
+    foreach (const PluginLoadInfo &loadInfo, pluginLoadInfos) {
+        writer.writeStartElement("tr");
+        writer.writeTextElement("td", loadInfo.pluginName());
+        writer.writeTextElement("td", QString::number(loadInfo.metaDataTime()));
+        writer.writeTextElement("td", loadInfo.loaded() ? QString::number(loadInfo.loadTime()) : "-");
+        writer.writeTextElement("td", loadInfo.loaded() ? QString::number(loadInfo.initTime()) : "-");
+        //: The load status of a plugin in the plugins section of the debug interface
+        writer.writeTextElement("td", loadInfo.loaded() ? tr("Loaded") : tr("Not loaded"));
+        writer.writeEndElement(); // tr
+    }
+
+    writer.writeEndElement(); // table
+
     // Generate report
     writer.writeEmptyElement("hr");
     //: In the server information section of the debug interface
@@ -0,0 +1,526 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::CborCodec
+    \brief Encodes and decodes JSON-RPC messages in the CBOR format (RFC 7049).
+
+    \ingroup json
+    \inmodule core
+
+    Clients can ask for CBOR instead of JSON in \c JSONRPC.Hello. The \l{CborCodec} converts the QVariant
+    messages of the JSON-RPC API from and to CBOR without going through QJsonDocument. Types are mapped the
+    same way as for JSON, with one exception: strings holding a UUID are encoded as 16 raw bytes, tagged
+    with the UUID tag 37. When decoding, tagged UUIDs are turned back into strings so the handlers see the
+    same data as with JSON.
+
+    \sa JsonRPCServer, TransportInterface::Encoding
+*/
+
+/*! \enum nymeaserver::CborCodec::DecodeResult
+
+    \value DecodeResultOk
+        A complete item has been decoded.
+    \value DecodeResultIncomplete
+        The data ends within the item. More data is needed to decode it.
+    \value DecodeResultInvalid
+        The data is not valid CBOR or contains items which can't be used in JSON-RPC messages.
+*/
+
+#include "cborcodec.h"
+
+#include <QUuid>
+#include <QStringList>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace nymeaserver {
+
+namespace {
+
+enum MajorType {
+    MajorTypeUnsigned = 0,
+    MajorTypeNegative = 1,
+    MajorTypeBytes = 2,
+    MajorTypeText = 3,
+    MajorTypeArray = 4,
+    MajorTypeMap = 5,
+    MajorTypeTag = 6,
+    MajorTypeSimple = 7
+};
+
+const quint64 uuidTag = 37;
+const int maxDepth = 64;
+const quint8 indefiniteLength = 31;
+const quint8 breakByte = 0xff;
+
+void appendBigEndian(QByteArray *out, quint64 value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--) {
+        out->append(static_cast<char>((value >> (i * 8)) & 0xff));
+    }
+}
+
+void writeHead(QByteArray *out, MajorType majorType, quint64 argument)
+{
+    char initial = static_cast<char>(majorType << 5);
+    if (argument < 24) {
+        out->append(static_cast<char>(initial | argument));
+    } else if (argument <= 0xff) {
+        out->append(static_cast<char>(initial | 24));
+        appendBigEndian(out, argument, 1);
+    } else if (argument <= 0xffff) {
+        out->append(static_cast<char>(initial | 25));
+        appendBigEndian(out, argument, 2);
+    } else if (argument <= 0xffffffff) {
+        out->append(static_cast<char>(initial | 26));
+        appendBigEndian(out, argument, 4);
+    } else {
+        out->append(static_cast<char>(initial | 27));
+        appendBigEndian(out, argument, 8);
+    }
+}
+
+void writeInteger(QByteArray *out, qint64 value)
+{
+    if (value < 0) {
+        writeHead(out, MajorTypeNegative, static_cast<quint64>(-1 - value));
+    } else {
+        writeHead(out, MajorTypeUnsigned, static_cast<quint64>(value));
+    }
+}
+
+void writeDouble(QByteArray *out, double value)
+{
+    // JSON doesn't distinguish integers from doubles, integral values use the shorter integer encoding
+    if (value == std::floor(value) && std::fabs(value) <= 9007199254740992.0) {
+        writeInteger(out, static_cast<qint64>(value));
+        return;
+    }
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    out->append(static_cast<char>(0xfb));
+    appendBigEndian(out, bits, 8);
+}
+
+void writeText(QByteArray *out, const QString &text)
+{
+    QByteArray utf8 = text.toUtf8();
+    writeHead(out, MajorTypeText, static_cast<quint64>(utf8.size()));
+    out->append(utf8);
+}
+
+void writeUuid(QByteArray *out, const QUuid &uuid)
+{
+    writeHead(out, MajorTypeTag, uuidTag);
+    writeHead(out, MajorTypeBytes, 16);
+    out->append(uuid.toRfc4122());
+}
+
+void writeString(QByteArray *out, const QString &string)
+{
+    // The API passes UUIDs around as strings, QUuid::toString() always produces this format
+    if (string.size() == 38 && string.at(0) == QLatin1Char('{') && string.at(37) == QLatin1Char('}')) {
+        QUuid uuid(string);
+        if (!uuid.isNull()) {
+            writeUuid(out, uuid);
+            return;
+        }
+    }
+    writeText(out, string);
+}
+
+void writeVariant(QByteArray *out, const QVariant &value)
+{
+    switch (value.userType()) {
+    case QMetaType::Bool:
+        out->append(static_cast<char>(value.toBool() ? 0xf5 : 0xf4));
+        break;
+    case QMetaType::Int:
+    case QMetaType::Short:
+    case QMetaType::Long:
+    case QMetaType::LongLong:
+        writeInteger(out, value.toLongLong());
+        break;
+    case QMetaType::UInt:
+    case QMetaType::UShort:
+    case QMetaType::ULong:
+    case QMetaType::ULongLong:
+        writeHead(out, MajorTypeUnsigned, value.toULongLong());
+        break;
+    case QMetaType::Float:
+    case QMetaType::Double:
+        writeDouble(out, value.toDouble());
+        break;
+    case QMetaType::QString:
+    case QMetaType::QByteArray:
+        // Byte arrays are sent as strings in JSON too
+        writeString(out, value.toString());
+        break;
+    case QMetaType::QUuid:
+        writeUuid(out, value.toUuid());
+        break;
+    case QMetaType::QVariantMap: {
+        const QVariantMap map = value.toMap();
+        writeHead(out, MajorTypeMap, static_cast<quint64>(map.count()));
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            writeText(out, it.key());
+            writeVariant(out, it.value());
+        }
+        break;
+    }
+    case QMetaType::QVariantHash: {
+        const QVariantHash hash = value.toHash();
+        writeHead(out, MajorTypeMap, static_cast<quint64>(hash.count()));
+        for (QVariantHash::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it) {
+            writeText(out, it.key());
+            writeVariant(out, it.value());
+        }
+        break;
+    }
+    case QMetaType::QVariantList: {
+        const QVariantList list = value.toList();
+        writeHead(out, MajorTypeArray, static_cast<quint64>(list.count()));
+        foreach (const QVariant &item, list) {
+            writeVariant(out, item);
+        }
+        break;
+    }
+    case QMetaType::QStringList: {
+        const QStringList list = value.toStringList();
+        writeHead(out, MajorTypeArray, static_cast<quint64>(list.count()));
+        foreach (const QString &item, list) {
+            writeString(out, item);
+        }
+        break;
+    }
+    default:
+        // Same fallback as QJsonValue::fromVariant()
+        if (value.isValid() && value.canConvert<QString>()) {
+            writeString(out, value.toString());
+        } else {
+            out->append(static_cast<char>(0xf6));
+        }
+        break;
+    }
+}
+
+double decodeHalf(quint16 half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 0) {
+        value = std::ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        value = mantissa == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+class Reader
+{
+public:
+    Reader(const QByteArray &data, int pos):
+        m_data(data.constData()),
+        m_size(data.size()),
+        m_pos(pos)
+    {
+    }
+
+    int pos() const
+    {
+        return m_pos;
+    }
+
+    CborCodec::DecodeResult read(QVariant *value, int depth)
+    {
+        if (depth > maxDepth) {
+            return CborCodec::DecodeResultInvalid;
+        }
+
+        quint8 majorType;
+        quint8 additional;
+        quint64 argument;
+        CborCodec::DecodeResult result = readHead(&majorType, &additional, &argument);
+        if (result != CborCodec::DecodeResultOk) {
+            return result;
+        }
+        bool indefinite = additional == indefiniteLength;
+
+        switch (majorType) {
+        case MajorTypeUnsigned:
+            if (indefinite) {
+                return CborCodec::DecodeResultInvalid;
+            }
+            if (argument <= static_cast<quint64>(std::numeric_limits<int>::max())) {
+                *value = static_cast<int>(argument);
+            } else if (argument <= static_cast<quint64>(std::numeric_limits<qint64>::max())) {
+                *value = static_cast<qlonglong>(argument);
+            } else {
+                *value = static_cast<qulonglong>(argument);
+            }
+            return CborCodec::DecodeResultOk;
+        case MajorTypeNegative: {
+            if (indefinite || argument > static_cast<quint64>(std::numeric_limits<qint64>::max())) {
+                return CborCodec::DecodeResultInvalid;
+            }
+            qint64 integer = -1 - static_cast<qint64>(argument);
+            if (integer >= std::numeric_limits<int>::min()) {
+                *value = static_cast<int>(integer);
+            } else {
+                *value = static_cast<qlonglong>(integer);
+            }
+            return CborCodec::DecodeResultOk;
+        }
+        case MajorTypeBytes:
+        case MajorTypeText: {
+            QByteArray string;
+            result = readString(majorType, indefinite, argument, &string);
+            if (result != CborCodec::DecodeResultOk) {
+                return result;
+            }
+            if (majorType == MajorTypeText) {
+                *value = QString::fromUtf8(string);
+            } else {
+                *value = string;
+            }
+            return CborCodec::DecodeResultOk;
+        }
+        case MajorTypeArray: {
+            QVariantList list;
+            for (quint64 i = 0; indefinite || i < argument; i++) {
+                if (indefinite) {
+                    if (m_pos >= m_size) {
+                        return CborCodec::DecodeResultIncomplete;
+                    }
+                    if (static_cast<quint8>(m_data[m_pos]) == breakByte) {
+                        m_pos++;
+                        break;
+                    }
+                }
+                QVariant item;
+                result = read(&item, depth + 1);
+                if (result != CborCodec::DecodeResultOk) {
+                    return result;
+                }
+                list.append(item);
+            }
+            *value = list;
+            return CborCodec::DecodeResultOk;
+        }
+        case MajorTypeMap: {
+            QVariantMap map;
+            for (quint64 i = 0; indefinite || i < argument; i++) {
+                if (indefinite) {
+                    if (m_pos >= m_size) {
+                        return CborCodec::DecodeResultIncomplete;
+                    }
+                    if (static_cast<quint8>(m_data[m_pos]) == breakByte) {
+                        m_pos++;
+                        break;
+                    }
+                }
+                QVariant key;
+                result = read(&key, depth + 1);
+                if (result != CborCodec::DecodeResultOk) {
+                    return result;
+                }
+                if (key.userType() != QMetaType::QString) {
+                    return CborCodec::DecodeResultInvalid;
+                }
+                QVariant item;
+                result = read(&item, depth + 1);
+                if (result != CborCodec::DecodeResultOk) {
+                    return result;
+                }
+                map.insert(key.toString(), item);
+            }
+            *value = map;
+            return CborCodec::DecodeResultOk;
+        }
+        case MajorTypeTag: {
+            if (indefinite) {
+                return CborCodec::DecodeResultInvalid;
+            }
+            QVariant item;
+            result = read(&item, depth + 1);
+            if (result != CborCodec::DecodeResultOk) {
+                return result;
+            }
+            if (argument == uuidTag && item.userType() == QMetaType::QByteArray && item.toByteArray().size() == 16) {
+                *value = QUuid::fromRfc4122(item.toByteArray()).toString();
+            } else {
+                // Other tags carry no meaning for the API, use the tagged item as is
+                *value = item;
+            }
+            return CborCodec::DecodeResultOk;
+        }
+        default:
+            return readSimple(additional, argument, value);
+        }
+    }
+
+private:
+    const char *m_data;
+    int m_size;
+    int m_pos;
+
+    CborCodec::DecodeResult readHead(quint8 *majorType, quint8 *additional, quint64 *argument)
+    {
+        if (m_pos >= m_size) {
+            return CborCodec::DecodeResultIncomplete;
+        }
+        quint8 initial = static_cast<quint8>(m_data[m_pos]);
+        *majorType = initial >> 5;
+        *additional = initial & 0x1f;
+
+        int argumentSize;
+        if (*additional < 24 || *additional == indefiniteLength) {
+            *argument = *additional < 24 ? *additional : 0;
+            m_pos++;
+            return CborCodec::DecodeResultOk;
+        } else if (*additional == 24) {
+            argumentSize = 1;
+        } else if (*additional == 25) {
+            argumentSize = 2;
+        } else if (*additional == 26) {
+            argumentSize = 4;
+        } else if (*additional == 27) {
+            argumentSize = 8;
+        } else {
+            return CborCodec::DecodeResultInvalid;
+        }
+
+        if (m_size - m_pos - 1 < argumentSize) {
+            return CborCodec::DecodeResultIncomplete;
+        }
+        *argument = 0;
+        for (int i = 1; i <= argumentSize; i++) {
+            *argument = (*argument << 8) | static_cast<quint8>(m_data[m_pos + i]);
+        }
+        m_pos += argumentSize + 1;
+        return CborCodec::DecodeResultOk;
+    }
+
+    CborCodec::DecodeResult readString(quint8 majorType, bool indefinite, quint64 length, QByteArray *string)
+    {
+        if (!indefinite) {
+            if (length > static_cast<quint64>(m_size - m_pos)) {
+                return CborCodec::DecodeResultIncomplete;
+            }
+            string->append(m_data + m_pos, static_cast<int>(length));
+            m_pos += static_cast<int>(length);
+            return CborCodec::DecodeResultOk;
+        }
+
+        // Indefinite length strings are a sequence of definite length chunks of the same type
+        forever {
+            if (m_pos >= m_size) {
+                return CborCodec::DecodeResultIncomplete;
+            }
+            if (static_cast<quint8>(m_data[m_pos]) == breakByte) {
+                m_pos++;
+                return CborCodec::DecodeResultOk;
+            }
+            quint8 chunkMajorType;
+            quint8 chunkAdditional;
+            quint64 chunkLength;
+            CborCodec::DecodeResult result = readHead(&chunkMajorType, &chunkAdditional, &chunkLength);
+            if (result != CborCodec::DecodeResultOk) {
+                return result;
+            }
+            if (chunkMajorType != majorType || chunkAdditional == indefiniteLength) {
+                return CborCodec::DecodeResultInvalid;
+            }
+            result = readString(majorType, false, chunkLength, string);
+            if (result != CborCodec::DecodeResultOk) {
+                return result;
+            }
+        }
+    }
+
+    CborCodec::DecodeResult readSimple(quint8 additional, quint64 argument, QVariant *value)
+    {
+        switch (additional) {
+        case 20:
+            *value = false;
+            return CborCodec::DecodeResultOk;
+        case 21:
+            *value = true;
+            return CborCodec::DecodeResultOk;
+        case 22:
+        case 23:
+            // null and undefined
+            *value = QVariant();
+            return CborCodec::DecodeResultOk;
+        case 25:
+            *value = decodeHalf(static_cast<quint16>(argument));
+            return CborCodec::DecodeResultOk;
+        case 26: {
+            quint32 bits = static_cast<quint32>(argument);
+            float single;
+            std::memcpy(&single, &bits, sizeof(single));
+            *value = static_cast<double>(single);
+            return CborCodec::DecodeResultOk;
+        }
+        case 27: {
+            double number;
+            std::memcpy(&number, &argument, sizeof(number));
+            *value = number;
+            return CborCodec::DecodeResultOk;
+        }
+        default:
+            // Unassigned simple values and a break outside of an indefinite length item
+            return CborCodec::DecodeResultInvalid;
+        }
+    }
+};
+
+}
+
+/*! Returns the CBOR encoding of the given \a value. */
+QByteArray CborCodec::encode(const QVariant &value)
+{
+    QByteArray data;
+    data.reserve(256);
+    writeVariant(&data, value);
+    return data;
+}
+
+/*! Decodes the item starting at \a pos in \a data into \a value. On success \a pos is advanced behind the
+    decoded item, otherwise it is left untouched. Returns DecodeResultIncomplete if \a data ends before the
+    item is complete.
+*/
+CborCodec::DecodeResult CborCodec::decode(const QByteArray &data, int *pos, QVariant *value)
+{
+    Reader reader(data, *pos);
+    DecodeResult result = reader.read(value, 0);
+    if (result == DecodeResultOk) {
+        *pos = reader.pos();
+    }
+    return result;
+}
+
+}
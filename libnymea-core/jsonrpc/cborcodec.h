@@ -0,0 +1,44 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef CBORCODEC_H
+#define CBORCODEC_H
+
+#include <QByteArray>
+#include <QVariant>
+
+namespace nymeaserver {
+
+class CborCodec
+{
+public:
+    enum DecodeResult {
+        DecodeResultOk,
+        DecodeResultIncomplete,
+        DecodeResultInvalid
+    };
+
+    static QByteArray encode(const QVariant &value);
+    static DecodeResult decode(const QByteArray &data, int *pos, QVariant *value);
+};
+
+}
+
+#endif // CBORCODEC_H
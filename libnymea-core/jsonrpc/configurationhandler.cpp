@@ -225,6 +225,29 @@ ConfigurationHandler::ConfigurationHandler(QObject *parent):
     returns.insert("configurationError", JsonTypes::configurationErrorRef());
     setReturns("DeleteMqttPolicy", returns);
 
+    params.clear(); returns.clear();
+    setDescription("GetStateLogPolicies", "Get all logging policies for state changes.");
+    setParams("GetStateLogPolicies", params);
+    returns.insert("stateLogPolicies", QVariantList() << JsonTypes::stateLogPolicyRef());
+    setReturns("GetStateLogPolicies", returns);
+
+    params.clear(); returns.clear();
+    setDescription("SetStateLogPolicy", "Configure which changes of a state type are written to the log. A state change "
+                   "is only logged if its value differs by more than deadband from the last logged value, at least "
+                   "minInterval seconds have passed since the last logged change and, if onChangeOnly is set, the value "
+                   "has changed. If there is already a policy for the given stateTypeId, it will be replaced.");
+    params.insert("policy", JsonTypes::stateLogPolicyRef());
+    setParams("SetStateLogPolicy", params);
+    returns.insert("configurationError", JsonTypes::configurationErrorRef());
+    setReturns("SetStateLogPolicy", returns);
+
+    params.clear(); returns.clear();
+    setDescription("DeleteStateLogPolicy", "Delete the logging policy of a state type. All changes of this state type will be logged again.");
+    params.insert("stateTypeId", JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    setParams("DeleteStateLogPolicy", params);
+    returns.insert("configurationError", JsonTypes::configurationErrorRef());
+    setReturns("DeleteStateLogPolicy", returns);
+
     // Notifications
     params.clear(); returns.clear();
     setDescription("BasicConfigurationChanged", "Emitted whenever the basic configuration of this server changes.");
@@ -291,6 +314,16 @@ ConfigurationHandler::ConfigurationHandler(QObject *parent):
     params.insert("clientId", JsonTypes::basicTypeToString(QVariant::String));
     setParams("MqttPolicyRemoved", params);
 
+    params.clear(); returns.clear();
+    setDescription("StateLogPolicyChanged", "Emitted whenever a logging policy for state changes is added or changed.");
+    params.insert("policy", JsonTypes::stateLogPolicyRef());
+    setParams("StateLogPolicyChanged", params);
+
+    params.clear(); returns.clear();
+    setDescription("StateLogPolicyRemoved", "Emitted whenever a logging policy for state changes is removed.");
+    params.insert("stateTypeId", JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    setParams("StateLogPolicyRemoved", params);
+
     connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::serverNameChanged, this, &ConfigurationHandler::onBasicConfigurationChanged);
     connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::timeZoneChanged, this, &ConfigurationHandler::onBasicConfigurationChanged);
     connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::localeChanged, this, &ConfigurationHandler::onBasicConfigurationChanged);
@@ -306,6 +339,8 @@ ConfigurationHandler::ConfigurationHandler(QObject *parent):
     connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::mqttServerConfigurationRemoved, this, &ConfigurationHandler::onMqttServerConfigurationRemoved);
     connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::mqttPolicyChanged, this, &ConfigurationHandler::onMqttPolicyChanged);
     connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::mqttPolicyRemoved, this, &ConfigurationHandler::onMqttPolicyRemoved);
+    connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::stateLogPolicyChanged, this, &ConfigurationHandler::onStateLogPolicyChanged);
+    connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::stateLogPolicyRemoved, this, &ConfigurationHandler::onStateLogPolicyRemoved);
     connect(NymeaCore::instance()->configuration(), &NymeaConfiguration::cloudEnabledChanged, this, &ConfigurationHandler::onCloudConfigurationChanged);
 }
 
@@ -561,6 +596,37 @@ JsonReply *ConfigurationHandler::DeleteMqttPolicy(const QVariantMap &params) con
     return createReply(statusToReply(success ? NymeaConfiguration::ConfigurationErrorNoError : NymeaConfiguration::ConfigurationErrorInvalidId));
 }
 
+JsonReply *ConfigurationHandler::GetStateLogPolicies(const QVariantMap &params) const
+{
+    Q_UNUSED(params)
+    QVariantList stateLogPolicies;
+    foreach (const StateLogPolicy &policy, NymeaCore::instance()->configuration()->stateLogPolicies()) {
+        stateLogPolicies << JsonTypes::packStateLogPolicy(policy);
+    }
+    QVariantMap ret;
+    ret.insert("stateLogPolicies", stateLogPolicies);
+    return createReply(ret);
+}
+
+JsonReply *ConfigurationHandler::SetStateLogPolicy(const QVariantMap &params) const
+{
+    StateLogPolicy policy = JsonTypes::unpackStateLogPolicy(params.value("policy").toMap());
+    if (policy.stateTypeId.isNull()) {
+        return createReply(statusToReply(NymeaConfiguration::ConfigurationErrorInvalidId));
+    }
+    policy.deadband = qMax(0.0, policy.deadband);
+    policy.minInterval = qMax(0, policy.minInterval);
+    NymeaCore::instance()->configuration()->updateStateLogPolicy(policy);
+    return createReply(statusToReply(NymeaConfiguration::ConfigurationErrorNoError));
+}
+
+JsonReply *ConfigurationHandler::DeleteStateLogPolicy(const QVariantMap &params) const
+{
+    StateTypeId stateTypeId = StateTypeId(params.value("stateTypeId").toString());
+    bool success = NymeaCore::instance()->configuration()->removeStateLogPolicy(stateTypeId);
+    return createReply(statusToReply(success ? NymeaConfiguration::ConfigurationErrorNoError : NymeaConfiguration::ConfigurationErrorInvalidId));
+}
+
 JsonReply *ConfigurationHandler::SetCloudEnabled(const QVariantMap &params) const
 {
     bool enabled = params.value("enabled").toBool();
@@ -663,6 +729,22 @@ void ConfigurationHandler::onMqttPolicyRemoved(const QString &clientId)
     emit MqttPolicyRemoved(params);
 }
 
+void ConfigurationHandler::onStateLogPolicyChanged(const StateTypeId &stateTypeId)
+{
+    qCDebug(dcJsonRpc()) << "Notification: state log policy changed";
+    QVariantMap params;
+    params.insert("policy", JsonTypes::packStateLogPolicy(NymeaCore::instance()->configuration()->stateLogPolicies().value(stateTypeId)));
+    emit StateLogPolicyChanged(params);
+}
+
+void ConfigurationHandler::onStateLogPolicyRemoved(const StateTypeId &stateTypeId)
+{
+    qCDebug(dcJsonRpc()) << "Notification: state log policy removed";
+    QVariantMap params;
+    params.insert("stateTypeId", stateTypeId.toString());
+    emit StateLogPolicyRemoved(params);
+}
+
 void ConfigurationHandler::onCloudConfigurationChanged(bool enabled)
 {
     qCDebug(dcJsonRpc()) << "Notification: cloud configuration changed";
@@ -56,6 +56,9 @@ public:
     Q_INVOKABLE JsonReply *GetMqttPolicies(const QVariantMap &params) const;
     Q_INVOKABLE JsonReply *SetMqttPolicy(const QVariantMap &params) const;
     Q_INVOKABLE JsonReply *DeleteMqttPolicy(const QVariantMap &params) const;
+    Q_INVOKABLE JsonReply *GetStateLogPolicies(const QVariantMap &params) const;
+    Q_INVOKABLE JsonReply *SetStateLogPolicy(const QVariantMap &params) const;
+    Q_INVOKABLE JsonReply *DeleteStateLogPolicy(const QVariantMap &params) const;
 
 signals:
     void BasicConfigurationChanged(const QVariantMap &params);
@@ -73,6 +76,8 @@ signals:
     void MqttServerConfigurationRemoved(const QVariantMap &params);
     void MqttPolicyChanged(const QVariantMap &params);
     void MqttPolicyRemoved(const QVariantMap &params);
+    void StateLogPolicyChanged(const QVariantMap &params);
+    void StateLogPolicyRemoved(const QVariantMap &params);
 
 private slots:
     void onBasicConfigurationChanged();
@@ -88,6 +93,8 @@ private slots:
     void onMqttServerConfigurationRemoved(const QString &id);
     void onMqttPolicyChanged(const QString &clientId);
     void onMqttPolicyRemoved(const QString &clientId);
+    void onStateLogPolicyChanged(const StateTypeId &stateTypeId);
+    void onStateLogPolicyRemoved(const StateTypeId &stateTypeId);
 };
 
 }
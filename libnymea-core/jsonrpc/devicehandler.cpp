@@ -38,6 +38,11 @@
     The \a params contain the map for the notification.
 */
 
+/*! \fn void nymeaserver::DeviceHandler::StatesChanged(const QVariantMap &params);
+    This signal is emitted to the API notifications when a batch of \l{State}{States} has changed.
+    The \a params contain the map for the notification.
+*/
+
 /*! \fn void nymeaserver::DeviceHandler::DeviceRemoved(const QVariantMap &params);
     This signal is emitted to the API notifications when a \l{Device} has been removed.
     The \a params contain the map for the notification.
@@ -278,6 +283,20 @@ DeviceHandler::DeviceHandler(QObject *parent) :
     params.insert("value", JsonTypes::basicTypeToString(JsonTypes::Variant));
     setParams("StateChanged", params);
 
+    params.clear(); returns.clear();
+    setDescription("StatesChanged", "Emitted once for all the State changes which happened at the same time, e.g. "
+                   "when a device reported several values at once. The changes are listed in the order they "
+                   "happened. This is only sent to connections which enabled batchStateChanges using "
+                   "JSONRPC.SetNotificationFilter. Those don't receive StateChanged notifications.");
+    QVariantList stateChanges;
+    QVariantMap stateChange;
+    stateChange.insert("deviceId", JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    stateChange.insert("stateTypeId", JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    stateChange.insert("value", JsonTypes::basicTypeToString(JsonTypes::Variant));
+    stateChanges.append(stateChange);
+    params.insert("states", stateChanges);
+    setParams("StatesChanged", params);
+
     params.clear(); returns.clear();
     setDescription("DeviceRemoved", "Emitted whenever a Device was removed.");
     params.insert("deviceId", JsonTypes::basicTypeToString(JsonTypes::Uuid));
@@ -295,6 +314,7 @@ DeviceHandler::DeviceHandler(QObject *parent) :
 
     connect(NymeaCore::instance(), &NymeaCore::pluginConfigChanged, this, &DeviceHandler::pluginConfigChanged);
     connect(NymeaCore::instance(), &NymeaCore::deviceStateChanged, this, &DeviceHandler::deviceStateChanged);
+    connect(NymeaCore::instance(), &NymeaCore::deviceStatesChanged, this, &DeviceHandler::deviceStatesChanged);
     connect(NymeaCore::instance(), &NymeaCore::deviceRemoved, this, &DeviceHandler::deviceRemovedNotification);
     connect(NymeaCore::instance(), &NymeaCore::deviceAdded, this, &DeviceHandler::deviceAddedNotification);
     connect(NymeaCore::instance(), &NymeaCore::deviceChanged, this, &DeviceHandler::deviceChangedNotification);
@@ -321,9 +341,17 @@ JsonReply* DeviceHandler::GetSupportedVendors(const QVariantMap &params) const
 
 JsonReply* DeviceHandler::GetSupportedDevices(const QVariantMap &params) const
 {
-    QVariantMap returns;
-    returns.insert("deviceClasses", JsonTypes::packSupportedDevices(VendorId(params.value("vendorId").toString())));
-    return createReply(returns);
+    VendorId vendorId = VendorId(params.value("vendorId").toString());
+    return createReply([vendorId]() {
+        QVariantMap returns;
+        returns.insert("deviceClasses", JsonTypes::packSupportedDevices(vendorId));
+        return returns;
+    }, [vendorId](JsonWriter &writer) {
+        writer.beginObject();
+        writer.writeKey("deviceClasses");
+        JsonTypes::writeSupportedDevices(writer, vendorId);
+        writer.endObject();
+    });
 }
 
 JsonReply *DeviceHandler::GetDiscoveredDevices(const QVariantMap &params) const
@@ -461,23 +489,33 @@ JsonReply *DeviceHandler::ConfirmPairing(const QVariantMap &params)
 
 JsonReply* DeviceHandler::GetConfiguredDevices(const QVariantMap &params) const
 {
-    QVariantMap returns;
-    QVariantList configuredDeviceList;
+    QList<Device *> devices;
     if (params.contains("deviceId")) {
         Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevice(DeviceId(params.value("deviceId").toString()));
         if (!device) {
+            QVariantMap returns;
             returns.insert("deviceError", JsonTypes::deviceErrorToString(DeviceManager::DeviceErrorDeviceNotFound));
             return createReply(returns);
         } else {
-            configuredDeviceList.append(JsonTypes::packDevice(device));
+            devices.append(device);
         }
     } else {
-        foreach (Device *device, NymeaCore::instance()->deviceManager()->configuredDevices()) {
+        devices = NymeaCore::instance()->deviceManager()->configuredDevices();
+    }
+    return createReply([devices]() {
+        QVariantList configuredDeviceList;
+        foreach (Device *device, devices) {
             configuredDeviceList.append(JsonTypes::packDevice(device));
         }
-    }
-    returns.insert("devices", configuredDeviceList);
-    return createReply(returns);
+        QVariantMap returns;
+        returns.insert("devices", configuredDeviceList);
+        return returns;
+    }, [devices](JsonWriter &writer) {
+        writer.beginObject();
+        writer.writeKey("devices");
+        JsonTypes::writeDevices(writer, devices);
+        writer.endObject();
+    });
 }
 
 JsonReply *DeviceHandler::ReconfigureDevice(const QVariantMap &params)
@@ -650,6 +688,22 @@ void DeviceHandler::deviceStateChanged(Device *device, const QUuid &stateTypeId,
     emit StateChanged(params);
 }
 
+void DeviceHandler::deviceStatesChanged(const QList<Event> &events)
+{
+    QVariantList states;
+    foreach (const Event &event, events) {
+        QVariantMap state;
+        state.insert("deviceId", event.deviceId());
+        state.insert("stateTypeId", event.eventTypeId());
+        state.insert("value", event.params().first().value());
+        states.append(state);
+    }
+
+    QVariantMap params;
+    params.insert("states", states);
+    emit StatesChanged(params);
+}
+
 void DeviceHandler::deviceRemovedNotification(const QUuid &deviceId)
 {
     QVariantMap params;
@@ -59,6 +59,7 @@ public:
 signals:
     void PluginConfigurationChanged(const QVariantMap &params);
     void StateChanged(const QVariantMap &params);
+    void StatesChanged(const QVariantMap &params);
     void DeviceRemoved(const QVariantMap &params);
     void DeviceAdded(const QVariantMap &params);
     void DeviceChanged(const QVariantMap &params);
@@ -68,6 +69,8 @@ private slots:
 
     void deviceStateChanged(Device *device, const QUuid &stateTypeId, const QVariant &value);
 
+    void deviceStatesChanged(const QList<Event> &events);
+
     void deviceRemovedNotification(const QUuid &deviceId);
 
     void deviceAddedNotification(Device *device);
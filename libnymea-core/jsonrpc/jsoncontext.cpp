@@ -0,0 +1,69 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::JsonContext
+    \brief Describes the client a JSON-RPC request has been received from.
+
+    \ingroup json
+    \inmodule core
+
+    Handler methods which need to know who called them can take a \l{JsonContext} as second argument
+    after the params. The \l{JsonRPCServer} passes it along with every request to such methods.
+
+    \sa JsonHandler, JsonRPCServer
+*/
+
+#include "jsoncontext.h"
+
+namespace nymeaserver {
+
+/*! Constructs an empty \l{JsonContext}. */
+JsonContext::JsonContext()
+{
+}
+
+/*! Constructs a \l{JsonContext} for a request of the client with the given \a clientId, sent with the given \a token over the given \a transport. */
+JsonContext::JsonContext(const QUuid &clientId, const QByteArray &token, TransportInterface *transport):
+    m_clientId(clientId),
+    m_token(token),
+    m_transport(transport)
+{
+}
+
+/*! Returns the ID of the client which sent the request. */
+QUuid JsonContext::clientId() const
+{
+    return m_clientId;
+}
+
+/*! Returns the token the request has been sent with. May be empty if authentication is disabled on the transport. */
+QByteArray JsonContext::token() const
+{
+    return m_token;
+}
+
+/*! Returns the transport interface the request has been received on. */
+TransportInterface *JsonContext::transport() const
+{
+    return m_transport;
+}
+
+}
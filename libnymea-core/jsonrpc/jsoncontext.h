@@ -0,0 +1,52 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef JSONCONTEXT_H
+#define JSONCONTEXT_H
+
+#include <QUuid>
+#include <QByteArray>
+#include <QMetaType>
+
+namespace nymeaserver {
+
+class TransportInterface;
+
+class JsonContext
+{
+public:
+    JsonContext();
+    JsonContext(const QUuid &clientId, const QByteArray &token, TransportInterface *transport);
+
+    QUuid clientId() const;
+    QByteArray token() const;
+    TransportInterface *transport() const;
+
+private:
+    QUuid m_clientId;
+    QByteArray m_token;
+    TransportInterface *m_transport = nullptr;
+};
+
+}
+
+Q_DECLARE_METATYPE(nymeaserver::JsonContext)
+
+#endif // JSONCONTEXT_H
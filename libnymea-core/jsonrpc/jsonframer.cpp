@@ -0,0 +1,124 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::JsonFramer
+    \brief Splits a stream of JSON messages into single messages.
+
+    \ingroup json
+    \inmodule core
+
+    The \l{JsonFramer} collects the data received from a client and hands out complete JSON messages as soon as
+    they are available. Messages don't need to be separated by newlines, the framer keeps track of nested objects
+    and arrays and ignores braces within strings.
+
+    Each byte is only scanned once, regardless of how the data is fragmented. Messages returned by \l{next()} are
+    not copied, they point into the internal buffer and stay valid until the next call to \l{append()}. Holding
+    a copy of \l{buffer()} keeps them valid even if the framer gets destroyed.
+
+    \sa JsonRPCServer
+*/
+
+#include "jsonframer.h"
+
+namespace nymeaserver {
+
+/*! Constructs an empty \l{JsonFramer}. */
+JsonFramer::JsonFramer()
+{
+    // Keeps the allocation when the buffer runs empty
+    m_buffer.reserve(4096);
+}
+
+/*! Appends the received \a data to the buffer. Messages returned by \l{next()} before are invalidated. */
+void JsonFramer::append(const QByteArray &data)
+{
+    // Consumed data is dropped lazily, the remaining tail is only moved once it is less than half of the buffer
+    if (m_readPos > 0 && m_readPos >= m_buffer.size() / 2) {
+        m_buffer.remove(0, m_readPos);
+        m_scanPos -= m_readPos;
+        if (m_messageStart >= 0) {
+            m_messageStart -= m_readPos;
+        }
+        m_readPos = 0;
+    }
+    m_buffer.append(data);
+}
+
+/*! Returns true and sets \a message to the next complete message if there is one. The returned message
+    references the internal buffer, see \l{append()}.
+*/
+bool JsonFramer::next(QByteArray *message)
+{
+    const char *data = m_buffer.constData();
+    int size = m_buffer.size();
+    for (; m_scanPos < size; m_scanPos++) {
+        char c = data[m_scanPos];
+        if (m_messageStart < 0) {
+            if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+                m_readPos = m_scanPos + 1;
+                continue;
+            }
+            m_messageStart = m_scanPos;
+        }
+
+        if (m_inString) {
+            if (m_escaped) {
+                m_escaped = false;
+            } else if (c == '\\') {
+                m_escaped = true;
+            } else if (c == '"') {
+                m_inString = false;
+            }
+            continue;
+        }
+
+        if (c == '"') {
+            m_inString = true;
+        } else if (c == '{' || c == '[') {
+            m_depth++;
+        } else if (c == '}' || c == ']') {
+            // Unbalanced closing braces end the message too, the parser will report the error
+            if (--m_depth <= 0) {
+                *message = QByteArray::fromRawData(data + m_messageStart, m_scanPos + 1 - m_messageStart);
+                m_scanPos++;
+                m_readPos = m_scanPos;
+                m_messageStart = -1;
+                m_depth = 0;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*! Returns the number of buffered bytes which don't belong to a complete message yet. */
+int JsonFramer::pendingSize() const
+{
+    return m_buffer.size() - m_readPos;
+}
+
+/*! Returns a shallow copy of the internal buffer. As long as it is held, the messages returned by \l{next()} stay valid. */
+QByteArray JsonFramer::buffer() const
+{
+    return m_buffer;
+}
+
+}
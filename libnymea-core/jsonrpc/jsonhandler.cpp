@@ -37,6 +37,28 @@
     This signal will be emitted when a reply with the given \a id and \a params is finished.
 */
 
+/*! \enum nymeaserver::JsonHandler::AuthExemption
+
+    This enum type specifies when a method may be called without a valid token on transports with authentication enabled.
+
+    \value AuthExemptionNone
+        The method always requires a valid token.
+    \value AuthExemptionNoUser
+        The method can be called without token as long as no user has been created.
+    \value AuthExemptionWithUser
+        The method can be called without token once a user has been created.
+*/
+
+/*!
+    \class nymeaserver::JsonMethod
+    \brief An entry in the dispatch table of the \l{JsonRPCServer}.
+
+    \ingroup json
+    \inmodule core
+
+    \sa JsonHandler::methods()
+*/
+
 
 #include "jsonhandler.h"
 #include "loggingcategories.h"
@@ -53,6 +75,13 @@ JsonHandler::JsonHandler(QObject *parent) :
 {
 }
 
+/*! Destroys this \l JsonHandler. */
+JsonHandler::~JsonHandler()
+{
+    qDeleteAll(m_paramValidators);
+    qDeleteAll(m_returnValidators);
+}
+
 /*! Returns a map with all supported methods, notifications and types for the given meta \a type. */
 QVariantMap JsonHandler::introspect(QMetaMethod::MethodType type)
 {
@@ -103,20 +132,71 @@ bool JsonHandler::hasMethod(const QString &methodName)
     return m_descriptions.contains(methodName) && m_params.contains(methodName) && m_returns.contains(methodName);
 }
 
+/*! Returns the dispatch table of this \l JsonHandler. Each \l{JsonMethod} holds the resolved meta method index and
+    the compiled \l{JsonValidator}{JsonValidators} of a method, so it can be called with \l{invoke()} without any
+    further lookups. Notifications get their validators compiled too.
+
+    Descriptions, params and returns can't be changed any more once this has been called.
+*/
+QList<JsonMethod> JsonHandler::methods()
+{
+    QList<JsonMethod> methods;
+    for (int i = 0; i < metaObject()->methodCount(); ++i) {
+        QMetaMethod metaMethod = metaObject()->method(i);
+        QString methodName = metaMethod.name();
+        if (!m_params.contains(methodName)) {
+            continue;
+        }
+
+        if (metaMethod.methodType() == QMetaMethod::Signal) {
+            validator(&m_paramValidators, m_params, methodName);
+            continue;
+        }
+        if (metaMethod.methodType() != QMetaMethod::Method || !hasMethod(methodName)) {
+            continue;
+        }
+
+        // Handler methods take the params and optionally the JsonContext of the request
+        Q_ASSERT_X(metaMethod.parameterCount() >= 1 && metaMethod.parameterCount() <= 2 && metaMethod.parameterType(0) == QMetaType::QVariantMap,
+                   "JsonHandler", QString("Invalid signature of %1.%2").arg(name()).arg(methodName).toLatin1().data());
+
+        JsonMethod method;
+        method.handler = this;
+        method.name = methodName;
+        method.methodIndex = i;
+        method.withContext = metaMethod.parameterCount() == 2;
+        method.authExemptions = m_authExemptions.value(methodName, AuthExemptionNone);
+        method.paramsValidator = validator(&m_paramValidators, m_params, methodName);
+        method.returnsValidator = validator(&m_returnValidators, m_returns, methodName);
+        methods.append(method);
+    }
+    return methods;
+}
+
+/*! Calls the given \a method of this handler with the given \a params. The \a context gets passed to methods which
+    accept a \l{JsonContext}. The params need to be validated before. Returns the \l{JsonReply} of the method. */
+JsonReply *JsonHandler::invoke(const JsonMethod &method, const QVariantMap &params, const JsonContext &context)
+{
+    Q_ASSERT(method.handler == this);
+
+    JsonReply *reply = nullptr;
+    void *args[] = { &reply, const_cast<QVariantMap *>(&params), const_cast<JsonContext *>(&context) };
+    QMetaObject::metacall(this, QMetaObject::InvokeMetaMethod, method.methodIndex, args);
+    return reply;
+}
+
 /*! Validates the given \a params for the given \a methodName. Returns the error string and false if
     the params are not valid. */
 QPair<bool, QString> JsonHandler::validateParams(const QString &methodName, const QVariantMap &params)
 {
-    QVariantMap paramTemplate = m_params.value(methodName);
-    return JsonTypes::validateMap(paramTemplate, params);
+    return validator(&m_paramValidators, m_params, methodName)->validate(params);
 }
 
 /*! Validates the given \a returns for the given \a methodName. Returns the error string and false if
     the params are not valid. */
 QPair<bool, QString> JsonHandler::validateReturns(const QString &methodName, const QVariantMap &returns)
 {
-    QVariantMap returnsTemplate = m_returns.value(methodName);
-    return JsonTypes::validateMap(returnsTemplate, returns);
+    return validator(&m_returnValidators, m_returns, methodName)->validate(returns);
 }
 
 
@@ -139,6 +219,10 @@ void JsonHandler::setParams(const QString &methodName, const QVariantMap &params
     for(int i = 0; i < metaObject()->methodCount(); ++i) {
         QMetaMethod method = metaObject()->method(i);
         if (method.name() == methodName) {
+            if (m_paramValidators.contains(methodName)) {
+                qCWarning(dcJsonRpc) << "Cannot set params. The method is in use already:" << methodName;
+                return;
+            }
             m_params.insert(methodName, params);
             return;
         }
@@ -152,6 +236,10 @@ void JsonHandler::setReturns(const QString &methodName, const QVariantMap &retur
     for(int i = 0; i < metaObject()->methodCount(); ++i) {
         QMetaMethod method = metaObject()->method(i);
         if (method.name() == methodName) {
+            if (m_returnValidators.contains(methodName)) {
+                qCWarning(dcJsonRpc) << "Cannot set returns. The method is in use already:" << methodName;
+                return;
+            }
             m_returns.insert(methodName, returns);
             return;
         }
@@ -159,12 +247,39 @@ void JsonHandler::setReturns(const QString &methodName, const QVariantMap &retur
     qCWarning(dcJsonRpc) << "Cannot set returns. No such method:" << methodName;
 }
 
+/*! Sets the \a authExemptions of the method with the given \a methodName. By default all methods require a valid
+    token on transports with authentication enabled. */
+void JsonHandler::setAuthExemptions(const QString &methodName, AuthExemptions authExemptions)
+{
+    m_authExemptions.insert(methodName, authExemptions);
+}
+
+JsonValidator *JsonHandler::validator(QHash<QString, JsonValidator *> *validators, const QHash<QString, QVariantMap> &templates, const QString &methodName)
+{
+    JsonValidator *validator = validators->value(methodName);
+    if (!validator) {
+        validator = new JsonValidator(templates.value(methodName));
+        validators->insert(methodName, validator);
+    }
+    return validator;
+}
+
 /*! Returns the pointer to a new \l{JsonReply} with the given \a data. */
 JsonReply *JsonHandler::createReply(const QVariantMap &data) const
 {
     return JsonReply::createReply(const_cast<JsonHandler*>(this), data);
 }
 
+/*! Returns the pointer to a new \l{JsonReply} whose data is packed by \a packer and written by \a writer
+    only when it is sent.
+
+    \sa JsonReply::hasDataWriter()
+*/
+JsonReply *JsonHandler::createReply(const JsonReply::DataPacker &packer, const JsonReply::DataWriter &writer) const
+{
+    return JsonReply::createReply(const_cast<JsonHandler*>(this), packer, writer);
+}
+
 /*! Returns the pointer to an asynchronous new \l{JsonReply} with the given \a method. */
 JsonReply* JsonHandler::createAsyncReply(const QString &method) const
 {
@@ -249,6 +364,15 @@ QVariantMap JsonHandler::statusToReply(TagsStorage::TagError status) const
         The response is asynchronous.
 */
 
+/*! \typedef nymeaserver::JsonReply::DataPacker
+    A function returning the data of a \l{JsonReply} as QVariantMap.
+*/
+
+/*! \typedef nymeaserver::JsonReply::DataWriter
+    A function writing the data of a \l{JsonReply} as JSON object into the given \l{JsonWriter}. It must
+    write exactly what \l{JsonWriter::writeVariant()} would write for the packed data.
+*/
+
 /*! \fn void nymeaserver::JsonReply::finished();
     This signal will be emitted when a JsonReply is finished. A JsonReply is finished when
     the response is ready or then the reply timed out.
@@ -273,6 +397,18 @@ JsonReply *JsonReply::createReply(JsonHandler *handler, const QVariantMap &data)
     return new JsonReply(TypeSync, handler, QString(), data);
 }
 
+/*! Returns the pointer to a new \l{JsonReply} for the given \a handler. Large replies can be sent to
+    JSON clients without building the QVariantMap first: the \a writer serializes the data straight into the
+    response. The \a packer is only called when \l{data()} is needed, e.g. for CBOR clients.
+*/
+JsonReply *JsonReply::createReply(JsonHandler *handler, const DataPacker &packer, const DataWriter &writer)
+{
+    JsonReply *reply = new JsonReply(TypeSync, handler, QString());
+    reply->m_dataPacker = packer;
+    reply->m_dataWriter = writer;
+    return reply;
+}
+
 /*! Returns the pointer to a new asynchronous \l{JsonReply} for the given \a handler and \a method. */
 JsonReply *JsonReply::createAsyncReply(JsonHandler *handler, const QString &method)
 {
@@ -288,6 +424,10 @@ JsonReply::Type JsonReply::type() const
 /*! Returns the data of this \l{JsonReply}.*/
 QVariantMap JsonReply::data() const
 {
+    if (m_dataPacker) {
+        m_data = m_dataPacker();
+        m_dataPacker = nullptr;
+    }
     return m_data;
 }
 
@@ -295,6 +435,24 @@ QVariantMap JsonReply::data() const
 void JsonReply::setData(const QVariantMap &data)
 {
     m_data = data;
+    m_dataPacker = nullptr;
+    m_dataWriter = nullptr;
+}
+
+/*! Returns true if the data of this \l{JsonReply} can be written with \l{writeData()} without packing it. */
+bool JsonReply::hasDataWriter() const
+{
+    return static_cast<bool>(m_dataWriter);
+}
+
+/*! Writes the data of this \l{JsonReply} into the given \a writer. */
+void JsonReply::writeData(JsonWriter &writer) const
+{
+    if (m_dataWriter) {
+        m_dataWriter(writer);
+    } else {
+        writer.writeVariant(data());
+    }
 }
 
 /*! Returns the handler of this \l{JsonReply}.*/
@@ -23,12 +23,17 @@
 #define JSONHANDLER_H
 
 #include "jsontypes.h"
+#include "jsonvalidator.h"
+#include "jsoncontext.h"
+#include "jsonwriter.h"
 
 #include <QObject>
 #include <QVariantMap>
 #include <QMetaMethod>
 #include <QTimer>
 
+#include <functional>
+
 namespace nymeaserver {
 
 class JsonHandler;
@@ -42,13 +47,20 @@ public:
         TypeAsync
     };
 
+    typedef std::function<QVariantMap()> DataPacker;
+    typedef std::function<void(JsonWriter &writer)> DataWriter;
+
     static JsonReply *createReply(JsonHandler *handler, const QVariantMap &data);
+    static JsonReply *createReply(JsonHandler *handler, const DataPacker &packer, const DataWriter &writer);
     static JsonReply *createAsyncReply(JsonHandler *handler, const QString &method);
 
     Type type() const;
     QVariantMap data() const;
     void setData(const QVariantMap &data);
 
+    bool hasDataWriter() const;
+    void writeData(JsonWriter &writer) const;
+
     JsonHandler *handler() const;
     QString method() const;
 
@@ -72,7 +84,9 @@ private slots:
 private:
     JsonReply(Type type, JsonHandler *handler, const QString &method, const QVariantMap &data = QVariantMap());
     Type m_type;
-    QVariantMap m_data;
+    mutable QVariantMap m_data;
+    mutable DataPacker m_dataPacker;
+    DataWriter m_dataWriter;
 
     JsonHandler *m_handler;
     QString m_method;
@@ -84,17 +98,30 @@ private:
 
 };
 
+class JsonMethod;
+
 class JsonHandler : public QObject
 {
     Q_OBJECT
 public:
+    enum AuthExemption {
+        AuthExemptionNone = 0x00,
+        AuthExemptionNoUser = 0x01,
+        AuthExemptionWithUser = 0x02
+    };
+    Q_DECLARE_FLAGS(AuthExemptions, AuthExemption)
+
     explicit JsonHandler(QObject *parent = nullptr);
+    ~JsonHandler();
 
     virtual QString name() const = 0;
 
     QVariantMap introspect(QMetaMethod::MethodType);
 
     bool hasMethod(const QString &methodName);
+    QList<JsonMethod> methods();
+    JsonReply *invoke(const JsonMethod &method, const QVariantMap &params, const JsonContext &context);
+
     QPair<bool, QString> validateParams(const QString &methodName, const QVariantMap &params);
     QPair<bool, QString> validateReturns(const QString &methodName, const QVariantMap &returns);
 
@@ -105,8 +132,10 @@ protected:
     void setDescription(const QString &methodName, const QString &description);
     void setParams(const QString &methodName, const QVariantMap &params);
     void setReturns(const QString &methodName, const QVariantMap &returns);
+    void setAuthExemptions(const QString &methodName, AuthExemptions authExemptions);
 
     JsonReply *createReply(const QVariantMap &data) const;
+    JsonReply *createReply(const JsonReply::DataPacker &packer, const JsonReply::DataWriter &writer) const;
     JsonReply *createAsyncReply(const QString &method) const;
     QVariantMap statusToReply(DeviceManager::DeviceError status) const;
     QVariantMap statusToReply(RuleEngine::RuleError status) const;
@@ -119,6 +148,25 @@ private:
     QHash<QString, QString> m_descriptions;
     QHash<QString, QVariantMap> m_params;
     QHash<QString, QVariantMap> m_returns;
+    QHash<QString, AuthExemptions> m_authExemptions;
+    QHash<QString, JsonValidator *> m_paramValidators;
+    QHash<QString, JsonValidator *> m_returnValidators;
+
+    JsonValidator *validator(QHash<QString, JsonValidator *> *validators, const QHash<QString, QVariantMap> &templates, const QString &methodName);
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(JsonHandler::AuthExemptions)
+
+class JsonMethod
+{
+public:
+    JsonHandler *handler = nullptr;
+    QString name;
+    int methodIndex = -1;
+    bool withContext = false;
+    JsonHandler::AuthExemptions authExemptions = JsonHandler::AuthExemptionNone;
+    JsonValidator *paramsValidator = nullptr;
+    JsonValidator *returnsValidator = nullptr;
 };
 
 }
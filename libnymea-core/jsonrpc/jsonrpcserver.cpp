@@ -39,6 +39,8 @@
 #include "jsonrpcserver.h"
 #include "jsontypes.h"
 #include "jsonhandler.h"
+#include "cborcodec.h"
+#include "jsonwriter.h"
 #include "nymeacore.h"
 #include "devicemanager.h"
 #include "plugin/deviceplugin.h"
@@ -60,7 +62,9 @@
 
 #include <QJsonDocument>
 #include <QStringList>
+#include <QBitArray>
 #include <QSslConfiguration>
+#include <QTimer>
 
 namespace nymeaserver {
 
@@ -75,7 +79,8 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     QVariantMap params;
 
     params.clear(); returns.clear();
-    setDescription("Hello", "Upon first connection, nymea will automatically send a welcome message containing information about the setup. If this message is lost for whatever reason (connections with multiple hops might drop this if nymea sends it too early), the exact same message can be retrieved multiple times by calling this Hello method. Note that the contents might change if the system changed its state in the meantime, e.g. initialSetupRequired might turn false if the initial setup has been performed in the meantime.");
+    setDescription("Hello", "Upon first connection, nymea will automatically send a welcome message containing information about the setup. If this message is lost for whatever reason (connections with multiple hops might drop this if nymea sends it too early), the exact same message can be retrieved multiple times by calling this Hello method. Note that the contents might change if the system changed its state in the meantime, e.g. initialSetupRequired might turn false if the initial setup has been performed in the meantime. Optionally, a client can request another encoding for this connection. The reply to Hello is still JSON encoded, all following messages in both directions use the encoding returned in the reply. If the transport doesn't support the requested encoding, the connection stays with JSON.");
+    params.insert("o:encoding", JsonTypes::encodingRef());
     setParams("Hello", params);
     returns.insert("id", JsonTypes::basicTypeToString(JsonTypes::Int));
     returns.insert("server", JsonTypes::basicTypeToString(JsonTypes::String));
@@ -87,7 +92,9 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     returns.insert("initialSetupRequired", JsonTypes::basicTypeToString(JsonTypes::Bool));
     returns.insert("authenticationRequired", JsonTypes::basicTypeToString(JsonTypes::Bool));
     returns.insert("pushButtonAuthAvailable", JsonTypes::basicTypeToString(JsonTypes::Bool));
+    returns.insert("o:encoding", JsonTypes::encodingRef());
     setReturns("Hello", returns);
+    setAuthExemptions("Hello", AuthExemptionNoUser | AuthExemptionWithUser);
 
     params.clear(); returns.clear();
     setDescription("Introspect", "Introspect this API.");
@@ -96,6 +103,7 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     returns.insert("notifications", JsonTypes::basicTypeToString(JsonTypes::Object));
     returns.insert("types", JsonTypes::basicTypeToString(JsonTypes::Object));
     setReturns("Introspect", returns);
+    setAuthExemptions("Introspect", AuthExemptionNoUser | AuthExemptionWithUser);
 
     params.clear(); returns.clear();
     setDescription("Version", "Version of this nymea/JSONRPC interface.");
@@ -111,6 +119,31 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     returns.insert("enabled", JsonTypes::basicTypeToString(JsonTypes::Bool));
     setReturns("SetNotificationStatus", returns);
 
+    params.clear(); returns.clear();
+    setDescription("SetNotificationFilter", "Limit the notifications for this connection to the given namespaces, devices and state types. "
+                   "Notifications which don't refer to a device or state type are only filtered by their namespace. "
+                   "A filter which is not given accepts everything, calling this without any params resets the filter. "
+                   "Unknown namespaces are ignored, the filter in use is returned. Device ids also match devices which are added "
+                   "later. If coalesceInterval is given, "
+                   "Devices.StateChanged notifications are held back for up to the given number of milliseconds (max. 10000) "
+                   "and repeated changes of the same state are merged into the latest value. Coalesced notifications may "
+                   "arrive after other notifications emitted in the meantime. If batchStateChanges is true, state changes "
+                   "happening at the same time are sent as a single Devices.StatesChanged notification instead of one "
+                   "Devices.StateChanged notification each. The coalesceInterval doesn't apply to those. Notifications "
+                   "still need to be enabled with SetNotificationStatus.");
+    params.insert("o:namespaces", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::String));
+    params.insert("o:deviceIds", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    params.insert("o:stateTypeIds", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    params.insert("o:coalesceInterval", JsonTypes::basicTypeToString(JsonTypes::Uint));
+    params.insert("o:batchStateChanges", JsonTypes::basicTypeToString(JsonTypes::Bool));
+    setParams("SetNotificationFilter", params);
+    returns.insert("o:namespaces", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::String));
+    returns.insert("o:deviceIds", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    returns.insert("o:stateTypeIds", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    returns.insert("coalesceInterval", JsonTypes::basicTypeToString(JsonTypes::Uint));
+    returns.insert("batchStateChanges", JsonTypes::basicTypeToString(JsonTypes::Bool));
+    setReturns("SetNotificationFilter", returns);
+
     params.clear(); returns.clear();
     setDescription("CreateUser", "Create a new user in the API. Currently this is only allowed to be called once when a new nymea instance is set up. Call Authenticate after this to obtain a device token for this user.");
     params.insert("username", JsonTypes::basicTypeToString(JsonTypes::String));
@@ -118,6 +151,7 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     setParams("CreateUser", params);
     returns.insert("error", JsonTypes::userErrorRef());
     setReturns("CreateUser", returns);
+    setAuthExemptions("CreateUser", AuthExemptionNoUser);
 
     params.clear(); returns.clear();
     setDescription("Authenticate", "Authenticate a client to the api via user & password challenge. Provide "
@@ -131,6 +165,7 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     returns.insert("success", JsonTypes::basicTypeToString(JsonTypes::Bool));
     returns.insert("o:token", JsonTypes::basicTypeToString(JsonTypes::String));
     setReturns("Authenticate", returns);
+    setAuthExemptions("Authenticate", AuthExemptionWithUser);
 
     params.clear(); returns.clear();
     setDescription("RequestPushButtonAuth", "Authenticate a client to the api via Push Button method. "
@@ -151,6 +186,7 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     returns.insert("success", JsonTypes::basicTypeToString(JsonTypes::Bool));
     returns.insert("transactionId", JsonTypes::basicTypeToString(JsonTypes::Int));
     setReturns("RequestPushButtonAuth", returns);
+    setAuthExemptions("RequestPushButtonAuth", AuthExemptionNoUser | AuthExemptionWithUser);
 
     params.clear(); returns.clear();
     setDescription("Tokens", "Return a list of TokenInfo objects of all the tokens for the current user.");
@@ -216,6 +252,7 @@ JsonRPCServer::JsonRPCServer(const QSslConfiguration &sslConfiguration, QObject
     QMetaObject::invokeMethod(this, "setup", Qt::QueuedConnection);
 
     connect(NymeaCore::instance()->userManager(), &UserManager::pushButtonAuthFinished, this, &JsonRPCServer::onPushButtonAuthFinished);
+    connect(NymeaCore::instance()->userManager(), &UserManager::tokensRemoved, this, &JsonRPCServer::onTokensRemoved);
 }
 
 /*! Returns the \e namespace of \l{JsonHandler}. */
@@ -224,32 +261,50 @@ QString JsonRPCServer::name() const
     return QStringLiteral("JSONRPC");
 }
 
-JsonReply *JsonRPCServer::Hello(const QVariantMap &params) const
+JsonReply *JsonRPCServer::Hello(const QVariantMap &params, const JsonContext &context)
 {
-    Q_UNUSED(params);
-    TransportInterface *interface = reinterpret_cast<TransportInterface*>(property("transportInterface").toLongLong());
-    return createReply(createWelcomeMessage(interface));
+    QVariantMap returns = createWelcomeMessage(context.transport());
+    if (params.contains("encoding")) {
+        QMetaEnum metaEnum = QMetaEnum::fromType<TransportInterface::Encoding>();
+        TransportInterface::Encoding encoding = static_cast<TransportInterface::Encoding>(metaEnum.keyToValue(params.value("encoding").toByteArray().constData()));
+        if (!context.transport()->supportsEncoding(encoding)) {
+            qCDebug(dcJsonRpc()) << "Encoding" << encoding << "not supported by the transport of client" << context.clientId();
+            encoding = TransportInterface::EncodingJson;
+        }
+        // Switched once the reply has been sent, see processRequest()
+        m_pendingEncodings.insert(context.clientId(), encoding);
+        returns.insert("encoding", JsonTypes::encodingToString(encoding));
+    }
+    return createReply(returns);
 }
 
 JsonReply* JsonRPCServer::Introspect(const QVariantMap &params) const
 {
     Q_UNUSED(params)
 
-    QVariantMap data;
-    data.insert("types", JsonTypes::allTypes());
-    QVariantMap methods;
-    foreach (JsonHandler *handler, m_handlers)
-        methods.unite(handler->introspect(QMetaMethod::Method));
+    if (m_introspection.isEmpty()) {
+        m_introspection.insert("types", JsonTypes::allTypes());
+        QVariantMap methods;
+        foreach (JsonHandler *handler, m_handlers)
+            methods.unite(handler->introspect(QMetaMethod::Method));
 
-    data.insert("methods", methods);
+        m_introspection.insert("methods", methods);
 
-    QVariantMap signalsMap;
-    foreach (JsonHandler *handler, m_handlers)
-        signalsMap.unite(handler->introspect(QMetaMethod::Signal));
+        QVariantMap signalsMap;
+        foreach (JsonHandler *handler, m_handlers)
+            signalsMap.unite(handler->introspect(QMetaMethod::Signal));
 
-    data.insert("notifications", signalsMap);
+        m_introspection.insert("notifications", signalsMap);
+        m_introspectionJson = JsonWriter::toJson(m_introspection);
+    }
 
-    return createReply(data);
+    QVariantMap introspection = m_introspection;
+    QByteArray introspectionJson = m_introspectionJson;
+    return createReply([introspection]() {
+        return introspection;
+    }, [introspectionJson](JsonWriter &writer) {
+        writer.writeJson(introspectionJson);
+    });
 }
 
 JsonReply* JsonRPCServer::Version(const QVariantMap &params) const
@@ -262,15 +317,92 @@ JsonReply* JsonRPCServer::Version(const QVariantMap &params) const
     return createReply(data);
 }
 
-JsonReply* JsonRPCServer::SetNotificationStatus(const QVariantMap &params)
+JsonReply* JsonRPCServer::SetNotificationStatus(const QVariantMap &params, const JsonContext &context)
 {
-    QUuid clientId = this->property("clientId").toUuid();
+    QUuid clientId = context.clientId();
     m_clientNotifications[clientId] = params.value("enabled").toBool();
     QVariantMap returns;
     returns.insert("enabled", m_clientNotifications[clientId]);
     return createReply(returns);
 }
 
+JsonReply *JsonRPCServer::SetNotificationFilter(const QVariantMap &params, const JsonContext &context)
+{
+    QUuid clientId = context.clientId();
+    NotificationFilter filter;
+    QVariantMap returns;
+
+    if (params.contains("namespaces")) {
+        QList<int> namespaceIndexes;
+        QVariantList namespaces;
+        foreach (const QVariant &namespaceName, params.value("namespaces").toList()) {
+            if (!m_namespaceIndexes.contains(namespaceName.toString())) {
+                qCDebug(dcJsonRpc()) << "Ignoring unknown namespace in notification filter:" << namespaceName.toString();
+                continue;
+            }
+            namespaceIndexes.append(m_namespaceIndexes.value(namespaceName.toString()));
+            namespaces.append(namespaceName.toString());
+        }
+        filter.setNamespaces(namespaceIndexes);
+        returns.insert("namespaces", namespaces);
+    }
+
+    // The indexes of the previous filter are not needed any more
+    releaseSubscriptionIndexes(clientId);
+
+    if (params.contains("deviceIds")) {
+        QList<int> deviceIndexes;
+        foreach (const QVariant &deviceId, params.value("deviceIds").toList()) {
+            deviceIndexes.append(acquireSubscriptionIndex(clientId, deviceId.toUuid()));
+        }
+        filter.setDevices(deviceIndexes);
+        returns.insert("deviceIds", params.value("deviceIds"));
+    }
+
+    if (params.contains("stateTypeIds")) {
+        QList<int> stateTypeIndexes;
+        foreach (const QVariant &stateTypeId, params.value("stateTypeIds").toList()) {
+            stateTypeIndexes.append(acquireSubscriptionIndex(clientId, stateTypeId.toUuid()));
+        }
+        filter.setStateTypes(stateTypeIndexes);
+        returns.insert("stateTypeIds", params.value("stateTypeIds"));
+    }
+
+    if (filter.isEmpty()) {
+        m_clientFilters.remove(clientId);
+    } else {
+        m_clientFilters.insert(clientId, filter);
+    }
+
+    int coalesceInterval = qMin(params.value("coalesceInterval", 0).toInt(), 10000);
+    if (coalesceInterval > 0) {
+        QTimer *coalesceTimer = m_coalesceTimers.value(clientId);
+        if (!coalesceTimer) {
+            coalesceTimer = new QTimer(this);
+            coalesceTimer->setSingleShot(true);
+            connect(coalesceTimer, &QTimer::timeout, this, [this, clientId](){
+                sendCoalescedNotifications(clientId);
+            });
+            m_coalesceTimers.insert(clientId, coalesceTimer);
+        }
+        coalesceTimer->setInterval(coalesceInterval);
+    } else if (m_coalesceTimers.contains(clientId)) {
+        sendCoalescedNotifications(clientId);
+        delete m_coalesceTimers.take(clientId);
+    }
+    returns.insert("coalesceInterval", coalesceInterval);
+
+    bool batchStateChanges = params.value("batchStateChanges", false).toBool();
+    if (batchStateChanges) {
+        m_batchStateChangeClients.insert(clientId);
+    } else {
+        m_batchStateChangeClients.remove(clientId);
+    }
+    returns.insert("batchStateChanges", batchStateChanges);
+
+    return createReply(returns);
+}
+
 JsonReply *JsonRPCServer::CreateUser(const QVariantMap &params)
 {
     QString username = params.value("username").toString();
@@ -298,10 +430,10 @@ JsonReply *JsonRPCServer::Authenticate(const QVariantMap &params)
     return createReply(ret);
 }
 
-JsonReply *JsonRPCServer::RequestPushButtonAuth(const QVariantMap &params)
+JsonReply *JsonRPCServer::RequestPushButtonAuth(const QVariantMap &params, const JsonContext &context)
 {
     QString deviceName = params.value("deviceName").toString();
-    QUuid clientId = this->property("clientId").toUuid();
+    QUuid clientId = context.clientId();
 
     int transactionId = NymeaCore::instance()->userManager()->requestPushButtonAuth(deviceName);
     m_pushButtonTransactions.insert(transactionId, clientId);
@@ -313,10 +445,10 @@ JsonReply *JsonRPCServer::RequestPushButtonAuth(const QVariantMap &params)
     return createReply(data);
 }
 
-JsonReply *JsonRPCServer::Tokens(const QVariantMap &params) const
+JsonReply *JsonRPCServer::Tokens(const QVariantMap &params, const JsonContext &context) const
 {
     Q_UNUSED(params)
-    QByteArray token = property("token").toByteArray();
+    QByteArray token = context.token();
 
     QString username = NymeaCore::instance()->userManager()->userForToken(token);
     if (username.isEmpty()) {
@@ -420,6 +552,19 @@ void JsonRPCServer::unregisterTransportInterface(TransportInterface *interface)
     m_interfaces.take(interface);
 }
 
+/*! Send the \a message to the client with the given \a clientId, encoded as requested by the client. */
+void JsonRPCServer::sendMessage(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message)
+{
+    QByteArray data;
+    if (interface->clientEncoding(clientId) == TransportInterface::EncodingCbor) {
+        data = CborCodec::encode(message);
+    } else {
+        data = JsonWriter::toJson(message);
+    }
+    qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
+    interface->sendData(clientId, data);
+}
+
 /*! Send a JSON success response to the client with the given \a clientId,
  * \a commandId and \a params to the inerted \l{TransportInterface}.
  */
@@ -430,7 +575,31 @@ void JsonRPCServer::sendResponse(TransportInterface *interface, const QUuid &cli
     response.insert("status", "success");
     response.insert("params", params);
 
-    QByteArray data = QJsonDocument::fromVariant(response).toJson(QJsonDocument::Compact);
+    sendMessage(interface, clientId, response);
+}
+
+/*! Send the data of the \a reply as success response to the client with the given \a clientId and
+ * \a commandId. JSON clients get replies with a data writer serialized directly, without packing the data.
+ */
+void JsonRPCServer::sendResponse(TransportInterface *interface, const QUuid &clientId, int commandId, JsonReply *reply)
+{
+    if (!reply->hasDataWriter() || interface->clientEncoding(clientId) == TransportInterface::EncodingCbor) {
+        sendResponse(interface, clientId, commandId, reply->data());
+        return;
+    }
+
+    // Same member order as the QVariantMap built by sendResponse()
+    JsonWriter writer;
+    writer.beginObject();
+    writer.writeKey("id");
+    writer.writeInteger(commandId);
+    writer.writeKey("params");
+    reply->writeData(writer);
+    writer.writeKey("status");
+    writer.writeString("success");
+    writer.endObject();
+
+    QByteArray data = writer.data();
     qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
     interface->sendData(clientId, data);
 }
@@ -445,9 +614,7 @@ void JsonRPCServer::sendErrorResponse(TransportInterface *interface, const QUuid
     errorResponse.insert("status", "error");
     errorResponse.insert("error", error);
 
-    QByteArray data = QJsonDocument::fromVariant(errorResponse).toJson(QJsonDocument::Compact);
-    qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
-    interface->sendData(clientId, data);
+    sendMessage(interface, clientId, errorResponse);
 }
 
 void JsonRPCServer::sendUnauthorizedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error)
@@ -457,9 +624,7 @@ void JsonRPCServer::sendUnauthorizedResponse(TransportInterface *interface, cons
     errorResponse.insert("status", "unauthorized");
     errorResponse.insert("error", error);
 
-    QByteArray data = QJsonDocument::fromVariant(errorResponse).toJson(QJsonDocument::Compact);
-    qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
-    interface->sendData(clientId, data);
+    sendMessage(interface, clientId, errorResponse);
 }
 
 QVariantMap JsonRPCServer::createWelcomeMessage(TransportInterface *interface) const
@@ -492,6 +657,7 @@ void JsonRPCServer::setup()
     registerHandler(new TagsHandler(this));
 
     connect(NymeaCore::instance()->cloudManager(), &CloudManager::pairingReply, this, &JsonRPCServer::pairingFinished);
+    connect(NymeaCore::instance()->deviceManager(), &DeviceManager::deviceRemoved, this, &JsonRPCServer::onDeviceRemoved);
     connect(NymeaCore::instance()->cloudManager(), &CloudManager::connectionStateChanged, this, &JsonRPCServer::onCloudConnectionStateChanged);
 }
 
@@ -501,22 +667,42 @@ void JsonRPCServer::processData(const QUuid &clientId, const QByteArray &data)
 
     TransportInterface *interface = qobject_cast<TransportInterface *>(sender());
 
-    // Handle packet fragmentation
-    QByteArray buffer = m_clientBuffers[clientId];
-    buffer.append(data);
-    int splitIndex = buffer.indexOf("}\n{");
-    while (splitIndex > -1) {
-        processJsonPacket(interface, clientId, buffer.left(splitIndex + 1));
-        buffer = buffer.right(buffer.length() - splitIndex - 2);
-        splitIndex = buffer.indexOf("}\n{");
-    }
-    if (buffer.trimmed().endsWith("}")) {
-        processJsonPacket(interface, clientId, buffer);
-        buffer.clear();
+    if (interface->clientEncoding(clientId) == TransportInterface::EncodingCbor) {
+        processCborData(interface, clientId, data);
+        return;
+    }
+
+    // Handle packet fragmentation. The messages point into the framer's buffer, holding on to the buffer
+    // keeps them valid even if the client disconnects while they are processed.
+    JsonFramer &framer = m_clientFramers[clientId];
+    framer.append(data);
+    QList<QByteArray> messages;
+    QByteArray message;
+    while (framer.next(&message)) {
+        messages.append(message);
+    }
+    QByteArray buffer = framer.buffer();
+    int pendingSize = framer.pendingSize();
+
+    foreach (const QByteArray &packet, messages) {
+        processJsonPacket(interface, clientId, packet);
+
+        // The client may switch to CBOR with Hello and send CBOR data right after it. Whatever follows the
+        // Hello message has been framed as JSON by mistake, hand it to the CBOR decoder instead.
+        if (interface->clientEncoding(clientId) == TransportInterface::EncodingCbor) {
+            int end = packet.constData() + packet.size() - buffer.constData();
+            // A CBOR message always starts with a map, whitespace is left over from the JSON message
+            while (end < buffer.size() && QByteArray(" \n\r\t").contains(buffer.at(end))) {
+                end++;
+            }
+            if (end < buffer.size()) {
+                processCborData(interface, clientId, buffer.mid(end));
+            }
+            return;
+        }
     }
-    m_clientBuffers[clientId] = buffer;
 
-    if (buffer.size() > 1024 * 10) {
+    if (pendingSize > 1024 * 10) {
         qCWarning(dcJsonRpc()) << "Client buffer larger than 10KB and no valid data. Dropping client connection.";
         interface->terminateClientConnection(clientId);
     }
@@ -533,8 +719,50 @@ void JsonRPCServer::processJsonPacket(TransportInterface *interface, const QUuid
         return;
     }
 
-    QVariantMap message = jsonDoc.toVariant().toMap();
+    processRequest(interface, clientId, jsonDoc.toVariant().toMap());
+}
+
+void JsonRPCServer::processCborData(TransportInterface *interface, const QUuid &clientId, const QByteArray &data)
+{
+    // CBOR items carry their own length, complete ones are decoded right away and the rest stays buffered
+    QByteArray &buffer = m_clientCborBuffers[clientId];
+    buffer.append(data);
+    QList<QVariant> messages;
+    int pos = 0;
+    CborCodec::DecodeResult result = CborCodec::DecodeResultOk;
+    while (pos < buffer.size()) {
+        QVariant message;
+        result = CborCodec::decode(buffer, &pos, &message);
+        if (result != CborCodec::DecodeResultOk) {
+            break;
+        }
+        messages.append(message);
+    }
+    if (result == CborCodec::DecodeResultInvalid) {
+        // There is no way to find the start of the next message in the stream, drop everything received so far
+        qCWarning(dcJsonRpc()) << "Failed to parse CBOR data from client" << clientId;
+        buffer.clear();
+    } else {
+        buffer.remove(0, pos);
+    }
+    int pendingSize = buffer.size();
+
+    // The buffer is not accessed anymore from here on, processing a request might disconnect the client
+    foreach (const QVariant &message, messages) {
+        processRequest(interface, clientId, message.toMap());
+    }
+    if (result == CborCodec::DecodeResultInvalid) {
+        sendErrorResponse(interface, clientId, -1, "Failed to parse CBOR data");
+    }
+
+    if (pendingSize > 1024 * 10) {
+        qCWarning(dcJsonRpc()) << "Client buffer larger than 10KB and no valid data. Dropping client connection.";
+        interface->terminateClientConnection(clientId);
+    }
+}
 
+void JsonRPCServer::processRequest(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message)
+{
     bool success;
     int commandId = message.value("id").toInt(&success);
     if (!success) {
@@ -543,63 +771,57 @@ void JsonRPCServer::processJsonPacket(TransportInterface *interface, const QUuid
         return;
     }
 
-    QStringList commandList = message.value("method").toString().split('.');
-    if (commandList.count() != 2) {
-        qCWarning(dcJsonRpc) << "Error parsing method.\nGot:" << message.value("method").toString() << "\nExpected: \"Namespace.method\"";
-        sendErrorResponse(interface, clientId, commandId, QString("Error parsing method. Got: '%1'', Expected: 'Namespace.method'").arg(message.value("method").toString()));
+    QString methodName = message.value("method").toString();
+    if (methodName.count('.') != 1) {
+        qCWarning(dcJsonRpc) << "Error parsing method.\nGot:" << methodName << "\nExpected: \"Namespace.method\"";
+        sendErrorResponse(interface, clientId, commandId, QString("Error parsing method. Got: '%1'', Expected: 'Namespace.method'").arg(methodName));
         return;
     }
-    QString targetNamespace = commandList.first();
-    QString method = commandList.last();
-
-    // check if authentication is required for this transport
-    if (m_interfaces.value(interface)) {
-        QByteArray token = message.value("token").toByteArray();
-        QStringList authExemptMethodsNoUser = {"Introspect", "Hello", "CreateUser", "RequestPushButtonAuth"};
-        QStringList authExemptMethodsWithUser = {"Introspect", "Hello", "Authenticate", "RequestPushButtonAuth"};
-        // if there is no user in the system yet, let's fail unless this is special method for authentication itself
-        if (NymeaCore::instance()->userManager()->initRequired()) {
-            if (!(targetNamespace == "JSONRPC" && authExemptMethodsNoUser.contains(method)) && (token.isEmpty() || !NymeaCore::instance()->userManager()->verifyToken(token))) {
-                sendUnauthorizedResponse(interface, clientId, commandId, "Initial setup required. Call CreateUser first.");
-                return;
-            }
-        } else {
-            // ok, we have a user. if there isn't a valid token, let's fail unless this is a Authenticate, Introspect  Hello call
-            if (!(targetNamespace == "JSONRPC" && authExemptMethodsWithUser.contains(method)) && (token.isEmpty() || !NymeaCore::instance()->userManager()->verifyToken(token))) {
-                sendUnauthorizedResponse(interface, clientId, commandId, "Forbidden: Invalid token.");
+
+    // Unknown methods are reported after the authentication check, so they don't leak to unauthorized clients
+    QHash<QString, JsonMethod>::const_iterator methodIt = m_methods.constFind(methodName);
+    JsonHandler::AuthExemptions authExemptions = methodIt != m_methods.constEnd() ? methodIt->authExemptions : JsonHandler::AuthExemptionNone;
+    QByteArray token = message.value("token").toByteArray();
+
+    // check if authentication is required for this transport. A token which has been verified on this connection
+    // before is accepted right away, until tokens get removed.
+    if (m_interfaces.value(interface) && (token.isEmpty() || m_clientTokens.value(clientId) != token)) {
+        // if there is no user in the system yet, let's fail unless this is special method for authentication itself.
+        // if we have a user, let's fail unless this is a Authenticate, Introspect or Hello call
+        bool initRequired = NymeaCore::instance()->userManager()->initRequired();
+        bool exempt = initRequired ? authExemptions.testFlag(AuthExemptionNoUser) : authExemptions.testFlag(AuthExemptionWithUser);
+        if (!exempt) {
+            if (token.isEmpty() || !NymeaCore::instance()->userManager()->verifyToken(token)) {
+                sendUnauthorizedResponse(interface, clientId, commandId, initRequired ? "Initial setup required. Call CreateUser first." : "Forbidden: Invalid token.");
                 return;
             }
+            m_clientTokens.insert(clientId, token);
         }
     }
     // At this point we can assume all the calls are authorized
 
-    JsonHandler *handler = m_handlers.value(targetNamespace);
-    if (!handler) {
-        sendErrorResponse(interface, clientId, commandId, "No such namespace");
-        return;
-    }
-    if (!handler->hasMethod(method)) {
+    if (methodIt == m_methods.constEnd()) {
+        if (!m_handlers.contains(methodName.section('.', 0, 0))) {
+            sendErrorResponse(interface, clientId, commandId, "No such namespace");
+            return;
+        }
         sendErrorResponse(interface, clientId, commandId, "No such method");
         return;
     }
+    JsonMethod method = methodIt.value();
 
     QVariantMap params = message.value("params").toMap();
 
-    QPair<bool, QString> validationResult = handler->validateParams(method, params);
+    QPair<bool, QString> validationResult = method.paramsValidator->validate(params);
     if (!validationResult.first) {
         sendErrorResponse(interface, clientId, commandId, "Invalid params: " + validationResult.second);
         return;
     }
 
-    // Hack: attach some properties to the handler to be able to handle the JSONRPC methods. Do not use this outside of jsonrpcserver
-    handler->setProperty("clientId", clientId);
-    handler->setProperty("token", message.value("token").toByteArray());
-    handler->setProperty("transportInterface", reinterpret_cast<qint64>(interface));
+    qCDebug(dcJsonRpc()) << "Invoking method" << qUtf8Printable(methodName);
 
-    qCDebug(dcJsonRpc()) << "Invoking method" << targetNamespace << method.toLatin1().data();
-
-    JsonReply *reply;
-    QMetaObject::invokeMethod(handler, method.toLatin1().data(), Q_RETURN_ARG(JsonReply*, reply), Q_ARG(QVariantMap, params));
+    JsonHandler *handler = method.handler;
+    JsonReply *reply = handler->invoke(method, params, JsonContext(clientId, token, interface));
     if (reply->type() == JsonReply::TypeAsync) {
         m_asyncReplies.insert(reply, interface);
         reply->setClientId(clientId);
@@ -607,11 +829,20 @@ void JsonRPCServer::processJsonPacket(TransportInterface *interface, const QUuid
         connect(reply, &JsonReply::finished, this, &JsonRPCServer::asyncReplyFinished);
         reply->startWait();
     } else {
-        Q_ASSERT_X((targetNamespace == "JSONRPC" && method == "Introspect") || handler->validateReturns(method, reply->data()).first
-                   ,"validating return value", formatAssertion(targetNamespace, method, QMetaMethod::Method, handler, reply->data()).toLatin1().data());
-        sendResponse(interface, clientId, commandId, reply->data());
+        Q_ASSERT_X((handler == this && method.name == "Introspect") || method.returnsValidator->validate(reply->data()).first
+                   ,"validating return value", formatAssertion(handler->name(), method.name, QMetaMethod::Method, handler, reply->data()).toLatin1().data());
+        sendResponse(interface, clientId, commandId, reply);
         reply->deleteLater();
     }
+
+    if (m_pendingEncodings.contains(clientId)) {
+        TransportInterface::Encoding encoding = m_pendingEncodings.take(clientId);
+        qCDebug(dcJsonRpc()) << "Switching client" << clientId << "to" << JsonTypes::encodingToString(encoding);
+        interface->setClientEncoding(clientId, encoding);
+        // Data already received after this request is passed on by processData()
+        m_clientFramers.remove(clientId);
+        m_clientCborBuffers.remove(clientId);
+    }
 }
 
 QString JsonRPCServer::formatAssertion(const QString &targetNamespace, const QString &method, QMetaMethod::MethodType methodType, JsonHandler *handler, const QVariantMap &data) const
@@ -635,11 +866,170 @@ void JsonRPCServer::sendNotification(const QVariantMap &params)
     notification.insert("params", params);
 
     Q_ASSERT_X(handler->validateParams(method.name(), params).first, "validating return value", formatAssertion(handler->name(), method.name(), QMetaMethod::Signal, handler, notification).toLatin1().data());
-    QByteArray data = QJsonDocument::fromVariant(notification).toJson(QJsonDocument::Compact);
-    qCDebug(dcJsonRpcTraffic()) << "Sending notification:" << data;
+    // Each encoding is produced once, on demand, and shared by all clients using it
+    QByteArray jsonData;
+    QByteArray cborData;
+
+    // Resolve what the notification is about once, clients with a filter only need to test their bits
+    int namespaceIndex = m_namespaceIndexes.value(handler->name());
+    int deviceIndex = NotificationFilter::IndexNone;
+    int stateTypeIndex = NotificationFilter::IndexNone;
+    if (!m_clientFilters.isEmpty()) {
+        if (params.contains("deviceId")) {
+            deviceIndex = m_subscriptionIndexes.value(params.value("deviceId").toUuid(), NotificationFilter::IndexUnknown);
+        }
+        if (params.contains("stateTypeId")) {
+            stateTypeIndex = m_subscriptionIndexes.value(params.value("stateTypeId").toUuid(), NotificationFilter::IndexUnknown);
+        }
+    }
+
+    // Clients get either one Devices.StateChanged per change or one Devices.StatesChanged per batch
+    bool stateChanged = false;
+    bool statesChanged = false;
+    if (qobject_cast<DeviceHandler *>(handler)) {
+        stateChanged = method.name() == "StateChanged";
+        statesChanged = method.name() == "StatesChanged";
+    }
+    if (statesChanged && m_batchStateChangeClients.isEmpty()) {
+        return;
+    }
+
+    // Filters are applied per change of a batch. The changes are resolved once, when the first client with a
+    // filter needs them, and clients accepting the same subset of the changes share its encodings.
+    QVariantList states;
+    QVector<QPair<int, int> > stateChangeIndexes;
+    QHash<QBitArray, QByteArray> subsetJsonData;
+    QHash<QBitArray, QByteArray> subsetCborData;
+
+    QString coalesceKey;
+    if (!m_coalesceTimers.isEmpty() && stateChanged) {
+        coalesceKey = params.value("deviceId").toString() + params.value("stateTypeId").toString();
+    }
 
     foreach (const QUuid &clientId, m_clientNotifications.keys(true)) {
-        m_clientTransports.value(clientId)->sendData(clientId, data);
+        if ((stateChanged || statesChanged) && m_batchStateChangeClients.contains(clientId) != statesChanged) {
+            continue;
+        }
+
+        QHash<QUuid, NotificationFilter>::const_iterator filterIt = m_clientFilters.constFind(clientId);
+        if (filterIt != m_clientFilters.constEnd() && !filterIt->accepts(namespaceIndex, deviceIndex, stateTypeIndex)) {
+            continue;
+        }
+
+        TransportInterface *transport = m_clientTransports.value(clientId);
+        bool cbor = transport->clientEncoding(clientId) == TransportInterface::EncodingCbor;
+
+        if (statesChanged && filterIt != m_clientFilters.constEnd()) {
+            if (stateChangeIndexes.isEmpty()) {
+                states = params.value("states").toList();
+                stateChangeIndexes.reserve(states.count());
+                foreach (const QVariant &stateChange, states) {
+                    QVariantMap stateChangeMap = stateChange.toMap();
+                    stateChangeIndexes.append(qMakePair(m_subscriptionIndexes.value(stateChangeMap.value("deviceId").toUuid(), NotificationFilter::IndexUnknown),
+                                                        m_subscriptionIndexes.value(stateChangeMap.value("stateTypeId").toUuid(), NotificationFilter::IndexUnknown)));
+                }
+            }
+
+            QBitArray accepted(states.count());
+            int acceptedCount = 0;
+            for (int i = 0; i < states.count(); i++) {
+                if (filterIt->accepts(namespaceIndex, stateChangeIndexes.at(i).first, stateChangeIndexes.at(i).second)) {
+                    accepted.setBit(i);
+                    acceptedCount++;
+                }
+            }
+            if (acceptedCount == 0) {
+                continue;
+            }
+            if (acceptedCount < states.count()) {
+                QByteArray &subsetData = cbor ? subsetCborData[accepted] : subsetJsonData[accepted];
+                if (subsetData.isEmpty()) {
+                    QVariantList acceptedStates;
+                    for (int i = 0; i < states.count(); i++) {
+                        if (accepted.testBit(i)) {
+                            acceptedStates.append(states.at(i));
+                        }
+                    }
+                    QVariantMap subsetParams;
+                    subsetParams.insert("states", acceptedStates);
+                    QVariantMap subsetNotification = notification;
+                    subsetNotification.insert("params", subsetParams);
+                    subsetData = cbor ? CborCodec::encode(subsetNotification) : JsonWriter::toJson(subsetNotification);
+                }
+                transport->sendData(clientId, subsetData);
+                continue;
+            }
+        }
+
+        QByteArray &data = cbor ? cborData : jsonData;
+        if (data.isEmpty()) {
+            data = cbor ? CborCodec::encode(notification) : JsonWriter::toJson(notification);
+            qCDebug(dcJsonRpcTraffic()) << "Sending notification:" << data;
+        }
+
+        QTimer *coalesceTimer = coalesceKey.isEmpty() ? nullptr : m_coalesceTimers.value(clientId);
+        if (coalesceTimer) {
+            // Replace a pending change of the same state with the latest one
+            QList<QPair<QString, QByteArray> > &pending = m_coalescedNotifications[clientId];
+            bool replaced = false;
+            for (int i = 0; i < pending.count(); i++) {
+                if (pending.at(i).first == coalesceKey) {
+                    pending[i].second = data;
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced) {
+                pending.append(qMakePair(coalesceKey, data));
+            }
+            if (!coalesceTimer->isActive()) {
+                coalesceTimer->start();
+            }
+            continue;
+        }
+
+        transport->sendData(clientId, data);
+    }
+}
+
+int JsonRPCServer::acquireSubscriptionIndex(const QUuid &clientId, const QUuid &id)
+{
+    int index = m_subscriptionIndexes.value(id, NotificationFilter::IndexUnknown);
+    if (index == NotificationFilter::IndexUnknown) {
+        // Reuse released indexes, so the filter bit arrays only grow with the ids in use
+        index = m_freeSubscriptionIndexes.isEmpty() ? m_subscriptionIndexes.count() : m_freeSubscriptionIndexes.takeLast();
+        m_subscriptionIndexes.insert(id, index);
+    }
+    m_subscriptionRefCounts[id]++;
+    m_clientSubscriptions[clientId].append(id);
+    return index;
+}
+
+void JsonRPCServer::releaseSubscriptionIndexes(const QUuid &clientId)
+{
+    foreach (const QUuid &id, m_clientSubscriptions.take(clientId)) {
+        releaseSubscriptionIndex(id);
+    }
+}
+
+void JsonRPCServer::releaseSubscriptionIndex(const QUuid &id)
+{
+    if (--m_subscriptionRefCounts[id] > 0) {
+        return;
+    }
+    m_subscriptionRefCounts.remove(id);
+    m_freeSubscriptionIndexes.append(m_subscriptionIndexes.take(id));
+}
+
+void JsonRPCServer::sendCoalescedNotifications(const QUuid &clientId)
+{
+    QList<QPair<QString, QByteArray> > pending = m_coalescedNotifications.take(clientId);
+    TransportInterface *transport = m_clientTransports.value(clientId);
+    if (!transport) {
+        return;
+    }
+    for (int i = 0; i < pending.count(); i++) {
+        transport->sendData(clientId, pending.at(i).second);
     }
 }
 
@@ -655,7 +1045,7 @@ void JsonRPCServer::asyncReplyFinished()
     if (!reply->timedOut()) {
         Q_ASSERT_X(reply->handler()->validateReturns(reply->method(), reply->data()).first
                    ,"validating return value", formatAssertion(reply->handler()->name(), reply->method(), QMetaMethod::Method, reply->handler(), reply->data()).toLatin1().data());
-        sendResponse(interface, reply->clientId(), reply->commandId(), reply->data());
+        sendResponse(interface, reply->clientId(), reply->commandId(), reply);
     } else {
         sendErrorResponse(interface, reply->clientId(), reply->commandId(), "Command timed out");
     }
@@ -710,12 +1100,47 @@ void JsonRPCServer::onPushButtonAuthFinished(int transactionId, bool success, co
     notification.insert("notification", "JSONRPC.PushButtonAuthFinished");
     notification.insert("params", params);
 
-    transport->sendData(clientId, QJsonDocument::fromVariant(notification).toJson(QJsonDocument::Compact));
+    sendMessage(transport, clientId, notification);
+}
+
+void JsonRPCServer::onTokensRemoved()
+{
+    // The token of any connection might be gone, verify them again on their next call
+    m_clientTokens.clear();
+}
+
+void JsonRPCServer::onDeviceRemoved(const DeviceId &deviceId)
+{
+    int index = m_subscriptionIndexes.value(deviceId, NotificationFilter::IndexUnknown);
+    if (index == NotificationFilter::IndexUnknown) {
+        return;
+    }
+
+    // Drop the device from all filters before its index can be handed out again
+    foreach (const QUuid &clientId, m_clientSubscriptions.keys()) {
+        int count = m_clientSubscriptions[clientId].removeAll(deviceId);
+        if (count == 0) {
+            continue;
+        }
+        QHash<QUuid, NotificationFilter>::iterator filterIt = m_clientFilters.find(clientId);
+        if (filterIt != m_clientFilters.end()) {
+            filterIt->removeDevice(index);
+        }
+        for (int i = 0; i < count; i++) {
+            releaseSubscriptionIndex(deviceId);
+        }
+    }
 }
 
 void JsonRPCServer::registerHandler(JsonHandler *handler)
 {
     m_handlers.insert(handler->name(), handler);
+    m_introspection.clear();
+    m_introspectionJson.clear();
+    m_namespaceIndexes.insert(handler->name(), m_namespaceIndexes.count());
+    foreach (const JsonMethod &method, handler->methods()) {
+        m_methods.insert(handler->name() + "." + method.name, method);
+    }
     for (int i = 0; i < handler->metaObject()->methodCount(); ++i) {
         QMetaMethod method = handler->metaObject()->method(i);
         if (method.methodType() == QMetaMethod::Signal && QString(method.name()).contains(QRegExp("^[A-Z]"))) {
@@ -733,7 +1158,7 @@ void JsonRPCServer::clientConnected(const QUuid &clientId)
     // If authentication is required, notifications are disabled by default. Clients must enable them with a valid token
     m_clientNotifications.insert(clientId, !interface->configuration().authenticationEnabled);
 
-    interface->sendData(clientId, QJsonDocument::fromVariant(createWelcomeMessage(interface)).toJson(QJsonDocument::Compact));
+    sendMessage(interface, clientId, createWelcomeMessage(interface));
 }
 
 void JsonRPCServer::clientDisconnected(const QUuid &clientId)
@@ -741,7 +1166,15 @@ void JsonRPCServer::clientDisconnected(const QUuid &clientId)
     qCDebug(dcJsonRpc()) << "Client disconnected:" << clientId;
     m_clientTransports.remove(clientId);
     m_clientNotifications.remove(clientId);
-    m_clientBuffers.remove(clientId);
+    m_clientFramers.remove(clientId);
+    m_clientCborBuffers.remove(clientId);
+    m_pendingEncodings.remove(clientId);
+    m_clientFilters.remove(clientId);
+    releaseSubscriptionIndexes(clientId);
+    m_clientTokens.remove(clientId);
+    m_coalescedNotifications.remove(clientId);
+    delete m_coalesceTimers.take(clientId);
+    m_batchStateChangeClients.remove(clientId);
     if (m_pushButtonTransactions.values().contains(clientId)) {
         NymeaCore::instance()->userManager()->cancelPushButtonAuth(m_pushButtonTransactions.key(clientId));
     }
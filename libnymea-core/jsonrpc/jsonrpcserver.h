@@ -23,6 +23,8 @@
 #define JSONRPCSERVER_H
 
 #include "jsonhandler.h"
+#include "jsonframer.h"
+#include "notificationfilter.h"
 #include "transportinterface.h"
 #include "usermanager.h"
 
@@ -32,6 +34,7 @@
 
 #include <QObject>
 #include <QVariantMap>
+#include <QSet>
 #include <QString>
 #include <QSslConfiguration>
 
@@ -47,15 +50,16 @@ public:
 
     // JsonHandler API implementation
     QString name() const;
-    Q_INVOKABLE JsonReply *Hello(const QVariantMap &params) const;
+    Q_INVOKABLE JsonReply *Hello(const QVariantMap &params, const JsonContext &context);
     Q_INVOKABLE JsonReply *Introspect(const QVariantMap &params) const;
     Q_INVOKABLE JsonReply *Version(const QVariantMap &params) const;
-    Q_INVOKABLE JsonReply *SetNotificationStatus(const QVariantMap &params);
+    Q_INVOKABLE JsonReply *SetNotificationStatus(const QVariantMap &params, const JsonContext &context);
+    Q_INVOKABLE JsonReply *SetNotificationFilter(const QVariantMap &params, const JsonContext &context);
 
     Q_INVOKABLE JsonReply *CreateUser(const QVariantMap &params);
     Q_INVOKABLE JsonReply *Authenticate(const QVariantMap &params);
-    Q_INVOKABLE JsonReply *RequestPushButtonAuth(const QVariantMap &params);
-    Q_INVOKABLE JsonReply *Tokens(const QVariantMap &params) const;
+    Q_INVOKABLE JsonReply *RequestPushButtonAuth(const QVariantMap &params, const JsonContext &context);
+    Q_INVOKABLE JsonReply *Tokens(const QVariantMap &params, const JsonContext &context) const;
     Q_INVOKABLE JsonReply *RemoveToken(const QVariantMap &params);
     Q_INVOKABLE JsonReply *SetupCloudConnection(const QVariantMap &params);
     Q_INVOKABLE JsonReply *SetupRemoteAccess(const QVariantMap &params);
@@ -74,12 +78,21 @@ public:
 private:
     QHash<QString, JsonHandler *> handlers() const;
 
+    void sendMessage(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message);
     void sendResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QVariantMap &params = QVariantMap());
+    void sendResponse(TransportInterface *interface, const QUuid &clientId, int commandId, JsonReply *reply);
     void sendErrorResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error);
     void sendUnauthorizedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error);
     QVariantMap createWelcomeMessage(TransportInterface *interface) const;
 
     void processJsonPacket(TransportInterface *interface, const QUuid &clientId, const QByteArray &data);
+    void processCborData(TransportInterface *interface, const QUuid &clientId, const QByteArray &data);
+    void processRequest(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message);
+
+    int acquireSubscriptionIndex(const QUuid &clientId, const QUuid &id);
+    void releaseSubscriptionIndexes(const QUuid &clientId);
+    void releaseSubscriptionIndex(const QUuid &id);
+    void sendCoalescedNotifications(const QUuid &clientId);
 
 private slots:
     void setup();
@@ -96,19 +109,39 @@ private slots:
     void pairingFinished(QString cognitoUserId, int status, const QString &message);
     void onCloudConnectionStateChanged();
     void onPushButtonAuthFinished(int transactionId, bool success, const QByteArray &token);
+    void onTokensRemoved();
+    void onDeviceRemoved(const DeviceId &deviceId);
 
 private:
     QMap<TransportInterface*, bool> m_interfaces; // Interface, authenticationRequired
     QHash<QString, JsonHandler *> m_handlers;
+    QHash<QString, JsonMethod> m_methods; // Namespace.Method, JsonMethod
     QHash<JsonReply *, TransportInterface *> m_asyncReplies;
 
     QHash<QUuid, TransportInterface*> m_clientTransports;
-    QHash<QUuid, QByteArray> m_clientBuffers;
+    QHash<QUuid, JsonFramer> m_clientFramers;
+    QHash<QUuid, QByteArray> m_clientCborBuffers;
+    QHash<QUuid, TransportInterface::Encoding> m_pendingEncodings; // ClientId, encoding to switch to after the Hello reply
     QHash<QUuid, bool> m_clientNotifications;
+    QHash<QUuid, QByteArray> m_clientTokens; // ClientId, token verified on this connection
+    QHash<QUuid, NotificationFilter> m_clientFilters;
+    QHash<QUuid, QTimer *> m_coalesceTimers;
+    QHash<QUuid, QList<QPair<QString, QByteArray> > > m_coalescedNotifications; // ClientId, (DeviceId + StateTypeId, notification)
+    QSet<QUuid> m_batchStateChangeClients; // Clients receiving Devices.StatesChanged instead of Devices.StateChanged
+
+    QHash<QString, int> m_namespaceIndexes;
+    QHash<QUuid, int> m_subscriptionIndexes; // DeviceId or StateTypeId, bit in the NotificationFilter
+    QHash<QUuid, int> m_subscriptionRefCounts; // DeviceId or StateTypeId, number of filter entries using it
+    QList<int> m_freeSubscriptionIndexes;
+    QHash<QUuid, QList<QUuid> > m_clientSubscriptions; // ClientId, DeviceIds and StateTypeIds in its filter
     QHash<int, QUuid> m_pushButtonTransactions;
 
     QHash<QString, JsonReply*> m_pairingRequests;
 
+    // The API doesn't change after the handlers are registered, Introspect replies are built once
+    mutable QVariantMap m_introspection;
+    mutable QByteArray m_introspectionJson;
+
     int m_notificationId;
 
     void registerHandler(JsonHandler *handler);
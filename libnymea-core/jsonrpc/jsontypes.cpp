@@ -49,6 +49,7 @@
 */
 
 #include "jsontypes.h"
+#include "jsonwriter.h"
 
 #include "plugin/device.h"
 #include "devicemanager.h"
@@ -91,6 +92,7 @@ QVariantList JsonTypes::s_networkDeviceState;
 QVariantList JsonTypes::s_userError;
 QVariantList JsonTypes::s_tagError;
 QVariantList JsonTypes::s_cloudConnectionState;
+QVariantList JsonTypes::s_encoding;
 
 QVariantMap JsonTypes::s_paramType;
 QVariantMap JsonTypes::s_param;
@@ -114,6 +116,7 @@ QVariantMap JsonTypes::s_deviceDescriptor;
 QVariantMap JsonTypes::s_rule;
 QVariantMap JsonTypes::s_ruleDescription;
 QVariantMap JsonTypes::s_logEntry;
+QVariantMap JsonTypes::s_logAggregate;
 QVariantMap JsonTypes::s_timeDescriptor;
 QVariantMap JsonTypes::s_calendarItem;
 QVariantMap JsonTypes::s_timeEventItem;
@@ -126,6 +129,7 @@ QVariantMap JsonTypes::s_serverConfiguration;
 QVariantMap JsonTypes::s_webServerConfiguration;
 QVariantMap JsonTypes::s_tag;
 QVariantMap JsonTypes::s_mqttPolicy;
+QVariantMap JsonTypes::s_stateLogPolicy;
 
 void JsonTypes::init()
 {
@@ -154,6 +158,7 @@ void JsonTypes::init()
     s_userError = enumToStrings(UserManager::staticMetaObject, "UserError");
     s_tagError = enumToStrings(TagsStorage::staticMetaObject, "TagError");
     s_cloudConnectionState = enumToStrings(CloudManager::staticMetaObject, "CloudConnectionState");
+    s_encoding = enumToStrings(TransportInterface::staticMetaObject, "Encoding");
 
     // ParamType
     s_paramType.insert("id", basicTypeToString(Uuid));
@@ -337,6 +342,14 @@ void JsonTypes::init()
     s_logEntry.insert("o:eventType", loggingEventTypeRef());
     s_logEntry.insert("o:errorCode", basicTypeToString(String));
 
+    // LogAggregate
+    s_logAggregate.insert("timestamp", basicTypeToString(Int));
+    s_logAggregate.insert("minimum", basicTypeToString(Double));
+    s_logAggregate.insert("maximum", basicTypeToString(Double));
+    s_logAggregate.insert("average", basicTypeToString(Double));
+    s_logAggregate.insert("last", basicTypeToString(Double));
+    s_logAggregate.insert("count", basicTypeToString(Int));
+
     // TimeDescriptor
     s_timeDescriptor.insert("o:calendarItems", QVariantList() << calendarItemRef());
     s_timeDescriptor.insert("o:timeEventItems", QVariantList() << timeEventItemRef());
@@ -401,6 +414,12 @@ void JsonTypes::init()
     s_mqttPolicy.insert("allowedPublishTopicFilters", basicTypeToString(QVariant::StringList));
     s_mqttPolicy.insert("allowedSubscribeTopicFilters", basicTypeToString(QVariant::StringList));
 
+    // StateLogPolicy
+    s_stateLogPolicy.insert("stateTypeId", basicTypeToString(Uuid));
+    s_stateLogPolicy.insert("o:deadband", basicTypeToString(Double));
+    s_stateLogPolicy.insert("o:minInterval", basicTypeToString(Int));
+    s_stateLogPolicy.insert("o:onChangeOnly", basicTypeToString(Bool));
+
     // Tag
     s_tag.insert("o:deviceId", basicTypeToString(QVariant::Uuid));
     s_tag.insert("o:ruleId", basicTypeToString(QVariant::Uuid));
@@ -458,6 +477,7 @@ QVariantMap JsonTypes::allTypes()
     allTypes.insert("UserError", userError());
     allTypes.insert("TagError", tagError());
     allTypes.insert("CloudConnectionState", cloudConnectionState());
+    allTypes.insert("Encoding", encoding());
 
     allTypes.insert("StateType", stateTypeDescription());
     allTypes.insert("StateDescriptor", stateDescriptorDescription());
@@ -480,6 +500,7 @@ QVariantMap JsonTypes::allTypes()
     allTypes.insert("Rule", ruleDescription());
     allTypes.insert("RuleDescription", ruleDescriptionDescription());
     allTypes.insert("LogEntry", logEntryDescription());
+    allTypes.insert("LogAggregate", logAggregateDescription());
     allTypes.insert("TimeDescriptor", timeDescriptorDescription());
     allTypes.insert("CalendarItem", calendarItemDescription());
     allTypes.insert("TimeEventItem", timeEventItemDescription());
@@ -492,6 +513,7 @@ QVariantMap JsonTypes::allTypes()
     allTypes.insert("WebServerConfiguration", serverConfigurationDescription());
     allTypes.insert("Tag", tagDescription());
     allTypes.insert("MqttPolicy", mqttPolicyDescription());
+    allTypes.insert("StateLogPolicy", stateLogPolicyDescription());
 
     return allTypes;
 }
@@ -820,16 +842,16 @@ QVariantMap JsonTypes::packDeviceClass(const DeviceClass &deviceClass)
     return variant;
 }
 
-/*! Returns a variant map of the given \a plugin. */
-QVariantMap JsonTypes::packPlugin(DevicePlugin *plugin)
+/*! Returns a variant map of the plugin described by the given \a pluginDescription. */
+QVariantMap JsonTypes::packPlugin(const PluginDescription &pluginDescription)
 {
     QVariantMap pluginMap;
-    pluginMap.insert("id", plugin->pluginId());
-    pluginMap.insert("name", plugin->pluginName());
-    pluginMap.insert("displayName", plugin->pluginDisplayName());
+    pluginMap.insert("id", pluginDescription.pluginId());
+    pluginMap.insert("name", pluginDescription.name());
+    pluginMap.insert("displayName", pluginDescription.displayName());
 
     QVariantList params;
-    foreach (const ParamType &param, plugin->configurationDescription())
+    foreach (const ParamType &param, pluginDescription.configurationDescription())
         params.append(packParamType(param));
 
     pluginMap.insert("paramTypes", params);
@@ -976,6 +998,19 @@ QVariantMap JsonTypes::packLogEntry(const LogEntry &logEntry)
     return logEntryMap;
 }
 
+/*! Returns a variant map of the given \a logAggregate. */
+QVariantMap JsonTypes::packLogAggregate(const LogAggregate &logAggregate)
+{
+    QVariantMap logAggregateMap;
+    logAggregateMap.insert("timestamp", logAggregate.timestamp().toMSecsSinceEpoch());
+    logAggregateMap.insert("minimum", logAggregate.minimum());
+    logAggregateMap.insert("maximum", logAggregate.maximum());
+    logAggregateMap.insert("average", logAggregate.average());
+    logAggregateMap.insert("last", logAggregate.last());
+    logAggregateMap.insert("count", logAggregate.count());
+    return logAggregateMap;
+}
+
 /*! Returns a variant map of the given \a tag. */
 QVariantMap JsonTypes::packTag(const Tag &tag)
 {
@@ -1223,6 +1258,17 @@ QVariantMap JsonTypes::packMqttPolicy(const MqttPolicy &policy)
     return policyMap;
 }
 
+/*! Returns a variant map of the given state logging \a policy. */
+QVariantMap JsonTypes::packStateLogPolicy(const StateLogPolicy &policy)
+{
+    QVariantMap policyMap;
+    policyMap.insert("stateTypeId", policy.stateTypeId.toString());
+    policyMap.insert("deadband", policy.deadband);
+    policyMap.insert("minInterval", policy.minInterval);
+    policyMap.insert("onChangeOnly", policy.onChangeOnly);
+    return policyMap;
+}
+
 /*! Returns a variant list containing all rule descriptions. */
 QVariantList JsonTypes::packRuleDescriptions()
 {
@@ -1277,8 +1323,8 @@ QVariantList JsonTypes::packEventTypes(const DeviceClass &deviceClass)
 QVariantList JsonTypes::packPlugins()
 {
     QVariantList pluginsList;
-    foreach (DevicePlugin *plugin, NymeaCore::instance()->deviceManager()->plugins()) {
-        QVariantMap pluginMap = packPlugin(plugin);
+    foreach (const PluginDescription &pluginDescription, NymeaCore::instance()->deviceManager()->pluginDescriptions()) {
+        QVariantMap pluginMap = packPlugin(pluginDescription);
         pluginsList.append(pluginMap);
     }
     return pluginsList;
@@ -1294,6 +1340,270 @@ QVariantMap JsonTypes::packTokenInfo(const TokenInfo &tokenInfo)
     return ret;
 }
 
+/*! Writes the given \a paramType into the \a writer, producing the same JSON as \l{packParamType()}. */
+void JsonTypes::writeParamType(JsonWriter &writer, const ParamType &paramType)
+{
+    // Members are written in the key order of a QVariantMap
+    writer.beginObject();
+    if (!paramType.allowedValues().isEmpty()) {
+        writer.writeKey("allowedValues");
+        writer.writeVariant(paramType.allowedValues());
+    }
+    if (paramType.defaultValue().isValid()) {
+        writer.writeKey("defaultValue");
+        writer.writeVariant(paramType.defaultValue());
+    }
+    writer.writeKey("displayName");
+    writer.writeString(paramType.displayName());
+    writer.writeKey("id");
+    writer.writeString(paramType.id().toString());
+    writer.writeKey("index");
+    writer.writeInteger(paramType.index());
+    if (paramType.inputType() != Types::InputTypeNone) {
+        writer.writeKey("inputType");
+        writer.writeVariant(s_inputType.at(paramType.inputType()));
+    }
+    if (paramType.maxValue().isValid()) {
+        writer.writeKey("maxValue");
+        writer.writeVariant(paramType.maxValue());
+    }
+    if (paramType.minValue().isValid()) {
+        writer.writeKey("minValue");
+        writer.writeVariant(paramType.minValue());
+    }
+    writer.writeKey("name");
+    writer.writeString(paramType.name());
+    if (paramType.readOnly()) {
+        writer.writeKey("readOnly");
+        writer.writeBool(true);
+    }
+    writer.writeKey("type");
+    writer.writeString(basicTypeToString(paramType.type()));
+    if (paramType.unit() != Types::UnitNone) {
+        writer.writeKey("unit");
+        writer.writeVariant(s_unit.at(paramType.unit()));
+    }
+    writer.endObject();
+}
+
+/*! Writes the given \a stateType into the \a writer, producing the same JSON as \l{packStateType()}. */
+void JsonTypes::writeStateType(JsonWriter &writer, const StateType &stateType)
+{
+    writer.beginObject();
+    writer.writeKey("defaultValue");
+    writer.writeVariant(stateType.defaultValue());
+    writer.writeKey("displayName");
+    writer.writeString(stateType.displayName());
+    if (stateType.graphRelevant()) {
+        writer.writeKey("graphRelevant");
+        writer.writeBool(true);
+    }
+    writer.writeKey("id");
+    writer.writeString(stateType.id().toString());
+    writer.writeKey("index");
+    writer.writeInteger(stateType.index());
+    if (stateType.maxValue().isValid()) {
+        writer.writeKey("maxValue");
+        writer.writeVariant(stateType.maxValue());
+    }
+    if (stateType.minValue().isValid()) {
+        writer.writeKey("minValue");
+        writer.writeVariant(stateType.minValue());
+    }
+    writer.writeKey("name");
+    writer.writeString(stateType.name());
+    if (!stateType.possibleValues().isEmpty()) {
+        writer.writeKey("possibleValues");
+        writer.writeVariant(stateType.possibleValues());
+    }
+    if (!stateType.ruleRelevant()) {
+        writer.writeKey("ruleRelevant");
+        writer.writeBool(false);
+    }
+    writer.writeKey("type");
+    writer.writeString(basicTypeToString(stateType.type()));
+    if (stateType.unit() != Types::UnitNone) {
+        writer.writeKey("unit");
+        writer.writeVariant(s_unit.at(stateType.unit()));
+    }
+    writer.endObject();
+}
+
+/*! Writes the given \a eventType into the \a writer, producing the same JSON as \l{packEventType()}. */
+void JsonTypes::writeEventType(JsonWriter &writer, const EventType &eventType)
+{
+    writer.beginObject();
+    writer.writeKey("displayName");
+    writer.writeString(eventType.displayName());
+    if (eventType.graphRelevant()) {
+        writer.writeKey("graphRelevant");
+        writer.writeBool(true);
+    }
+    writer.writeKey("id");
+    writer.writeString(eventType.id().toString());
+    writer.writeKey("index");
+    writer.writeInteger(eventType.index());
+    writer.writeKey("name");
+    writer.writeString(eventType.name());
+    writer.writeKey("paramTypes");
+    writer.beginArray();
+    foreach (const ParamType &paramType, eventType.paramTypes())
+        writeParamType(writer, paramType);
+    writer.endArray();
+    if (!eventType.ruleRelevant()) {
+        writer.writeKey("ruleRelevant");
+        writer.writeBool(false);
+    }
+    writer.endObject();
+}
+
+/*! Writes the given \a actionType into the \a writer, producing the same JSON as \l{packActionType()}. */
+void JsonTypes::writeActionType(JsonWriter &writer, const ActionType &actionType)
+{
+    writer.beginObject();
+    writer.writeKey("displayName");
+    writer.writeString(actionType.displayName());
+    writer.writeKey("id");
+    writer.writeString(actionType.id().toString());
+    writer.writeKey("index");
+    writer.writeInteger(actionType.index());
+    writer.writeKey("name");
+    writer.writeString(actionType.name());
+    writer.writeKey("paramTypes");
+    writer.beginArray();
+    foreach (const ParamType &paramType, actionType.paramTypes())
+        writeParamType(writer, paramType);
+    writer.endArray();
+    writer.endObject();
+}
+
+/*! Writes the given \a deviceClass into the \a writer, producing the same JSON as \l{packDeviceClass()}. */
+void JsonTypes::writeDeviceClass(JsonWriter &writer, const DeviceClass &deviceClass)
+{
+    writer.beginObject();
+    writer.writeKey("actionTypes");
+    writer.beginArray();
+    foreach (const ActionType &actionType, deviceClass.actionTypes())
+        writeActionType(writer, actionType);
+    writer.endArray();
+    writer.writeKey("basicTags");
+    writer.beginArray();
+    foreach (const DeviceClass::BasicTag &basicTag, deviceClass.basicTags())
+        writer.writeVariant(s_basicTag.at(basicTag));
+    writer.endArray();
+    writer.writeKey("createMethods");
+    writer.writeVariant(packCreateMethods(deviceClass.createMethods()));
+    if (!deviceClass.criticalStateTypeId().isNull()) {
+        writer.writeKey("criticalStateTypeId");
+        writer.writeString(deviceClass.criticalStateTypeId().toString());
+    }
+    writer.writeKey("deviceIcon");
+    writer.writeVariant(s_deviceIcon.at(deviceClass.deviceIcon()));
+    writer.writeKey("discoveryParamTypes");
+    writer.beginArray();
+    foreach (const ParamType &paramType, deviceClass.discoveryParamTypes())
+        writeParamType(writer, paramType);
+    writer.endArray();
+    writer.writeKey("displayName");
+    writer.writeString(deviceClass.displayName());
+    writer.writeKey("eventTypes");
+    writer.beginArray();
+    foreach (const EventType &eventType, deviceClass.eventTypes())
+        writeEventType(writer, eventType);
+    writer.endArray();
+    writer.writeKey("id");
+    writer.writeString(deviceClass.id().toString());
+    writer.writeKey("interfaces");
+    writer.writeVariant(deviceClass.interfaces());
+    writer.writeKey("name");
+    writer.writeString(deviceClass.name());
+    writer.writeKey("paramTypes");
+    writer.beginArray();
+    foreach (const ParamType &paramType, deviceClass.paramTypes())
+        writeParamType(writer, paramType);
+    writer.endArray();
+    writer.writeKey("pluginId");
+    writer.writeString(deviceClass.pluginId().toString());
+    if (!deviceClass.primaryActionTypeId().isNull()) {
+        writer.writeKey("primaryActionTypeId");
+        writer.writeString(deviceClass.primaryActionTypeId().toString());
+    }
+    if (!deviceClass.primaryStateTypeId().isNull()) {
+        writer.writeKey("primaryStateTypeId");
+        writer.writeString(deviceClass.primaryStateTypeId().toString());
+    }
+    writer.writeKey("setupMethod");
+    writer.writeVariant(s_setupMethod.at(deviceClass.setupMethod()));
+    writer.writeKey("stateTypes");
+    writer.beginArray();
+    foreach (const StateType &stateType, deviceClass.stateTypes())
+        writeStateType(writer, stateType);
+    writer.endArray();
+    writer.writeKey("vendorId");
+    writer.writeString(deviceClass.vendorId().toString());
+    writer.endObject();
+}
+
+/*! Writes the given \a device into the \a writer, producing the same JSON as \l{packDevice()}. */
+void JsonTypes::writeDevice(JsonWriter &writer, Device *device)
+{
+    writer.beginObject();
+    writer.writeKey("deviceClassId");
+    writer.writeString(device->deviceClassId().toString());
+    writer.writeKey("id");
+    writer.writeString(device->id().toString());
+    writer.writeKey("name");
+    writer.writeString(device->name());
+    writer.writeKey("params");
+    writer.beginArray();
+    foreach (const Param &param, device->params()) {
+        writer.beginObject();
+        writer.writeKey("paramTypeId");
+        writer.writeString(param.paramTypeId().toString());
+        writer.writeKey("value");
+        writer.writeVariant(param.value());
+        writer.endObject();
+    }
+    writer.endArray();
+    if (!device->parentId().isNull()) {
+        writer.writeKey("parentId");
+        writer.writeString(device->parentId().toString());
+    }
+    writer.writeKey("setupComplete");
+    writer.writeBool(device->setupComplete());
+    writer.writeKey("states");
+    writer.beginArray();
+    DeviceClass deviceClass = NymeaCore::instance()->deviceManager()->findDeviceClass(device->deviceClassId());
+    foreach (const StateType &stateType, deviceClass.stateTypes()) {
+        writer.beginObject();
+        writer.writeKey("stateTypeId");
+        writer.writeString(stateType.id().toString());
+        writer.writeKey("value");
+        writer.writeVariant(device->stateValue(stateType.id()));
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.endObject();
+}
+
+/*! Writes the supported devices with the given \a vendorId into the \a writer, producing the same JSON as \l{packSupportedDevices()}. */
+void JsonTypes::writeSupportedDevices(JsonWriter &writer, const VendorId &vendorId)
+{
+    writer.beginArray();
+    foreach (const DeviceClass &deviceClass, NymeaCore::instance()->deviceManager()->supportedDevices(vendorId))
+        writeDeviceClass(writer, deviceClass);
+    writer.endArray();
+}
+
+/*! Writes the given \a devices into the \a writer as list of \l{Device}{Devices}. */
+void JsonTypes::writeDevices(JsonWriter &writer, const QList<Device *> &devices)
+{
+    writer.beginArray();
+    foreach (Device *device, devices)
+        writeDevice(writer, device);
+    writer.endArray();
+}
+
 /*! Returns the type string for the given \a type. */
 QString JsonTypes::basicTypeToString(const QVariant::Type &type)
 {
@@ -1578,6 +1888,9 @@ LogFilter JsonTypes::unpackLogFilter(const QVariantMap &logFilterMap)
     if (logFilterMap.contains("offset")) {
         filter.setOffset(logFilterMap.value("offset").toInt());
     }
+    if (logFilterMap.contains("cursor")) {
+        filter.setCursor(logFilterMap.value("cursor").toString());
+    }
 
     return filter;
 }
@@ -1712,6 +2025,17 @@ MqttPolicy JsonTypes::unpackMqttPolicy(const QVariantMap &mqttPolicyMap)
     return policy;
 }
 
+/*! Returns a \l{StateLogPolicy} created from the given \a stateLogPolicyMap. */
+StateLogPolicy JsonTypes::unpackStateLogPolicy(const QVariantMap &stateLogPolicyMap)
+{
+    StateLogPolicy policy;
+    policy.stateTypeId = StateTypeId(stateLogPolicyMap.value("stateTypeId").toString());
+    policy.deadband = stateLogPolicyMap.value("deadband", 0).toDouble();
+    policy.minInterval = stateLogPolicyMap.value("minInterval", 0).toInt();
+    policy.onChangeOnly = stateLogPolicyMap.value("onChangeOnly", false).toBool();
+    return policy;
+}
+
 /*! Compairs the given \a map with the given \a templateMap. Returns the error string and false if
     the params are not valid. */
 QPair<bool, QString> JsonTypes::validateMap(const QVariantMap &templateMap, const QVariantMap &map)
@@ -1956,6 +2280,12 @@ QPair<bool, QString> JsonTypes::validateVariant(const QVariant &templateVariant,
                     qCWarning(dcJsonRpc) << "LogEntry not matching";
                     return result;
                 }
+            } else if (refName == logAggregateRef()) {
+                QPair<bool, QString> result = validateMap(logAggregateDescription(), variant.toMap());
+                if (!result.first) {
+                    qCWarning(dcJsonRpc) << "LogAggregate not matching";
+                    return result;
+                }
             } else if (refName == timeDescriptorRef()) {
                 QPair<bool, QString> result = validateMap(timeDescriptorDescription(), variant.toMap());
                 if (!result.first) {
@@ -2028,6 +2358,12 @@ QPair<bool, QString> JsonTypes::validateVariant(const QVariant &templateVariant,
                     qCWarning(dcJsonRpc) << "MqttPolicy not matching";
                     return result;
                 }
+            } else if (refName == stateLogPolicyRef()) {
+                QPair<bool, QString> result = validateMap(stateLogPolicyDescription(), variant.toMap());
+                if (!result.first) {
+                    qCWarning(dcJsonRpc) << "StateLogPolicy not matching";
+                    return result;
+                }
             } else if (refName == tagRef()) {
                 QPair<bool, QString> result = validateMap(tagDescription(), variant.toMap());
                 if (!result.first) {
@@ -2178,6 +2514,12 @@ QPair<bool, QString> JsonTypes::validateVariant(const QVariant &templateVariant,
                     qCWarning(dcJsonRpc()) << QString("Value %1 not allowed in %2").arg(variant.toString()).arg(cloudConnectionStateRef());
                     return result;
                 }
+            } else if (refName == encodingRef()) {
+                QPair<bool, QString> result = validateEnum(s_encoding, variant);
+                if (!result.first) {
+                    qCWarning(dcJsonRpc()) << QString("Value %1 not allowed in %2").arg(variant.toString()).arg(encodingRef());
+                    return result;
+                }
             } else {
                 Q_ASSERT_X(false, "JsonTypes", QString("Unhandled ref: %1").arg(refName).toLatin1().data());
                 return report(false, QString("Unhandled ref %1. Server implementation incomplete.").arg(refName));
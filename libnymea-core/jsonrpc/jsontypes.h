@@ -29,6 +29,7 @@
 #include "ruleengine.h"
 #include "nymeaconfiguration.h"
 #include "usermanager.h"
+#include "transportinterface.h"
 
 #include "types/deviceclass.h"
 #include "types/event.h"
@@ -40,6 +41,7 @@
 
 #include "logging/logging.h"
 #include "logging/logentry.h"
+#include "logging/logaggregate.h"
 #include "logging/logfilter.h"
 
 #include "tagging/tagsstorage.h"
@@ -69,6 +71,8 @@ class Device;
 
 namespace nymeaserver {
 
+class JsonWriter;
+
 #define DECLARE_OBJECT(typeName, jsonName) \
     public: \
     static QString typeName##Ref() { return QStringLiteral("$ref:") + QStringLiteral(jsonName); } \
@@ -143,6 +147,7 @@ public:
     DECLARE_TYPE(userError, "UserError", UserManager, UserError)
     DECLARE_TYPE(tagError, "TagError", TagsStorage, TagError)
     DECLARE_TYPE(cloudConnectionState, "CloudConnectionState", CloudManager, CloudConnectionState)
+    DECLARE_TYPE(encoding, "Encoding", TransportInterface, Encoding)
 
     DECLARE_OBJECT(paramType, "ParamType")
     DECLARE_OBJECT(param, "Param")
@@ -166,6 +171,7 @@ public:
     DECLARE_OBJECT(rule, "Rule")
     DECLARE_OBJECT(ruleDescription, "RuleDescription")
     DECLARE_OBJECT(logEntry, "LogEntry")
+    DECLARE_OBJECT(logAggregate, "LogAggregate")
     DECLARE_OBJECT(timeDescriptor, "TimeDescriptor")
     DECLARE_OBJECT(calendarItem, "CalendarItem")
     DECLARE_OBJECT(timeEventItem, "TimeEventItem")
@@ -178,6 +184,7 @@ public:
     DECLARE_OBJECT(webServerConfiguration, "WebServerConfiguration")
     DECLARE_OBJECT(tag, "Tag")
     DECLARE_OBJECT(mqttPolicy, "MqttPolicy")
+    DECLARE_OBJECT(stateLogPolicy, "StateLogPolicy")
 
     // pack types
     static QVariantMap packEventType(const EventType &eventType);
@@ -196,12 +203,13 @@ public:
     static QVariantMap packParamDescriptor(const ParamDescriptor &paramDescriptor);
     static QVariantMap packVendor(const Vendor &vendor);
     static QVariantMap packDeviceClass(const DeviceClass &deviceClass);
-    static QVariantMap packPlugin(DevicePlugin *plugin);
+    static QVariantMap packPlugin(const PluginDescription &pluginDescription);
     static QVariantMap packDevice(Device *device);
     static QVariantMap packDeviceDescriptor(const DeviceDescriptor &descriptor);
     static QVariantMap packRule(const Rule &rule);
     static QVariantMap packRuleDescription(const Rule &rule);
     static QVariantMap packLogEntry(const LogEntry &logEntry);
+    static QVariantMap packLogAggregate(const LogAggregate &logAggregate);
     static QVariantMap packTag(const Tag &tag);
     static QVariantMap packRepeatingOption(const RepeatingOption &option);
     static QVariantMap packCalendarItem(const CalendarItem &calendarItem);
@@ -223,6 +231,7 @@ public:
     static QVariantMap packServerConfiguration(const ServerConfiguration &config);
     static QVariantMap packWebServerConfiguration(const WebServerConfiguration &config);
     static QVariantMap packMqttPolicy(const MqttPolicy &policy);
+    static QVariantMap packStateLogPolicy(const StateLogPolicy &policy);
 
     static QVariantList packRuleDescriptions();
     static QVariantList packRuleDescriptions(const QList<Rule> &rules);
@@ -234,6 +243,16 @@ public:
 
     static QVariantMap packTokenInfo(const TokenInfo &tokenInfo);
 
+    // write types
+    static void writeParamType(JsonWriter &writer, const ParamType &paramType);
+    static void writeStateType(JsonWriter &writer, const StateType &stateType);
+    static void writeEventType(JsonWriter &writer, const EventType &eventType);
+    static void writeActionType(JsonWriter &writer, const ActionType &actionType);
+    static void writeDeviceClass(JsonWriter &writer, const DeviceClass &deviceClass);
+    static void writeDevice(JsonWriter &writer, Device *device);
+    static void writeSupportedDevices(JsonWriter &writer, const VendorId &vendorId);
+    static void writeDevices(JsonWriter &writer, const QList<Device *> &devices);
+
     static QString basicTypeToString(const QVariant::Type &type);
 
     // unpack Types
@@ -258,6 +277,7 @@ public:
     static ServerConfiguration unpackServerConfiguration(const QVariantMap &serverConfigurationMap);
     static WebServerConfiguration unpackWebServerConfiguration(const QVariantMap &webServerConfigurationMap);
     static MqttPolicy unpackMqttPolicy(const QVariantMap &mqttPolicyMap);
+    static StateLogPolicy unpackStateLogPolicy(const QVariantMap &stateLogPolicyMap);
 
     // validate
     static QPair<bool, QString> validateMap(const QVariantMap &templateMap, const QVariantMap &map);
@@ -0,0 +1,390 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::JsonValidator
+    \brief Validates JSON-RPC params and returns against a precompiled template.
+
+    \ingroup json
+    \inmodule core
+
+    The \l{JsonValidator} compiles a params or returns template, as set with \l{JsonHandler::setParams()}, once into a
+    tree of typed validator nodes. \c $ref: types are resolved to their compiled nodes while compiling and enums are
+    kept as hashed sets, so validating a message doesn't need to interpret the template again. The result is the
+    same as with \l{JsonTypes::validateMap()}.
+
+    Compiled \c $ref: types are shared by all validators and live as long as the process.
+
+    \sa JsonHandler, JsonTypes
+*/
+
+/*! \class nymeaserver::JsonValidator::Node
+    \brief A single node in the compiled validator tree of a \l{JsonValidator}.
+
+    \ingroup json
+    \inmodule core
+*/
+
+/*! \fn QPair<bool, QString> nymeaserver::JsonValidator::Node::validate(const QVariant &value) const;
+    Validates the given \a value. Returns the error string and false if the \a value is not valid.
+*/
+
+#include "jsonvalidator.h"
+#include "jsontypes.h"
+#include "loggingcategories.h"
+
+#include <QJsonDocument>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+
+namespace nymeaserver {
+
+namespace {
+
+typedef JsonValidator::Node Node;
+
+QPair<bool, QString> report(bool status, const QString &message)
+{
+    return qMakePair<bool, QString>(status, message);
+}
+
+class AnyNode: public Node
+{
+public:
+    QPair<bool, QString> validate(const QVariant &value) const override
+    {
+        Q_UNUSED(value)
+        return report(true, QString());
+    }
+};
+
+class FailNode: public Node
+{
+public:
+    explicit FailNode(const QString &error): m_error(error) { }
+
+    QPair<bool, QString> validate(const QVariant &value) const override
+    {
+        Q_UNUSED(value)
+        return report(false, m_error);
+    }
+
+private:
+    QString m_error;
+};
+
+class PropertyNode: public Node
+{
+public:
+    PropertyNode(QVariant::Type type, const QString &typeName):
+        m_type(type),
+        m_typeName(typeName)
+    {
+    }
+
+    QPair<bool, QString> validate(const QVariant &value) const override
+    {
+        if (value.canConvert(m_type)) {
+            return report(true, QString());
+        }
+        qCWarning(dcJsonRpc) << "property not matching:" << m_typeName << "!=" << value;
+        return report(false, QString("Param %1 is not a %2.").arg(value.toString()).arg(m_typeName));
+    }
+
+private:
+    QVariant::Type m_type;
+    QString m_typeName;
+};
+
+class BasicTypeNode: public Node
+{
+public:
+    QPair<bool, QString> validate(const QVariant &value) const override
+    {
+        return JsonTypes::validateBasicType(value);
+    }
+};
+
+class EnumNode: public Node
+{
+public:
+    EnumNode(const QString &refName, const QVariantList &enumValues):
+        m_refName(refName)
+    {
+        QStringList enumStrings;
+        foreach (const QVariant &enumValue, enumValues) {
+            m_values.insert(enumValue.toString());
+            enumStrings.append(enumValue.toString());
+        }
+        m_allowedValues = enumStrings.join(", ");
+    }
+
+    QPair<bool, QString> validate(const QVariant &value) const override
+    {
+        QString stringValue = value.toString();
+        if (m_values.contains(stringValue)) {
+            return report(true, QString());
+        }
+        qCWarning(dcJsonRpc) << QString("Value %1 not allowed in %2").arg(stringValue).arg(m_refName);
+        return report(false, QString("Value %1 not allowed in %2").arg(stringValue).arg(m_allowedValues));
+    }
+
+private:
+    QString m_refName;
+    QSet<QString> m_values;
+    QString m_allowedValues;
+};
+
+class ListNode: public Node
+{
+public:
+    explicit ListNode(const Node *entryNode): m_entryNode(entryNode) { }
+
+    QPair<bool, QString> validate(const QVariant &value) const override
+    {
+        foreach (const QVariant &entry, value.toList()) {
+            QPair<bool, QString> result = m_entryNode->validate(entry);
+            if (!result.first) {
+                qCWarning(dcJsonRpc) << "List entry not matching template";
+                return result;
+            }
+        }
+        return report(true, QString());
+    }
+
+private:
+    const Node *m_entryNode;
+};
+
+class MapNode: public Node
+{
+public:
+    void addField(const QString &templateKey, const QVariant &fieldTemplate, const Node *node)
+    {
+        Field field;
+        field.templateKey = templateKey;
+        field.optional = templateKey.startsWith("o:");
+        field.key = field.optional ? templateKey.mid(2) : templateKey;
+        field.fieldTemplate = fieldTemplate;
+        field.node = node;
+        m_fields.append(field);
+        m_keys.insert(field.key);
+    }
+
+    QPair<bool, QString> validate(const QVariant &value) const override
+    {
+        QVariantMap map = value.toMap();
+
+        // Make sure all values defined in the template are around
+        int matchingKeys = 0;
+        foreach (const Field &field, m_fields) {
+            QVariantMap::const_iterator it = map.constFind(field.key);
+            if (it == map.constEnd()) {
+                if (field.optional) {
+                    continue;
+                }
+                qCWarning(dcJsonRpc) << "*** missing key" << field.templateKey;
+                qCWarning(dcJsonRpc) << "Got:           " << map;
+                QJsonDocument jsonDoc = QJsonDocument::fromVariant(map);
+                return report(false, QString("Missing key %1 in %2").arg(field.templateKey).arg(QString(jsonDoc.toJson(QJsonDocument::Compact))));
+            }
+            matchingKeys++;
+            QPair<bool, QString> result = field.node->validate(it.value());
+            if (!result.first) {
+                QJsonDocument templateDoc = QJsonDocument::fromVariant(field.fieldTemplate);
+                QJsonDocument mapDoc = QJsonDocument::fromVariant(it.value());
+                qCWarning(dcJsonRpc).nospace() << "Object\n" << qUtf8Printable(mapDoc.toJson(QJsonDocument::Indented)) << "not matching template\n" << qUtf8Printable(templateDoc.toJson(QJsonDocument::Indented));
+                return result;
+            }
+        }
+
+        // Make sure there aren't any other parameters than the allowed ones
+        if (matchingKeys < map.count()) {
+            for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+                if (!m_keys.contains(it.key())) {
+                    qCWarning(dcJsonRpc) << "Forbidden param" << it.key() << "in params";
+                    QJsonDocument jsonDoc = QJsonDocument::fromVariant(map);
+                    return report(false, QString("Forbidden key \"%1\" in %2").arg(it.key()).arg(QString(jsonDoc.toJson(QJsonDocument::Compact))));
+                }
+            }
+        }
+
+        return report(true, QString());
+    }
+
+private:
+    class Field
+    {
+    public:
+        QString key;
+        QString templateKey;
+        bool optional;
+        QVariant fieldTemplate;
+        const Node *node;
+    };
+
+    QVector<Field> m_fields;
+    QSet<QString> m_keys;
+};
+
+class Compiler
+{
+public:
+    explicit Compiler(QList<Node *> *nodes): m_nodes(nodes) { }
+
+    const Node *compile(const QVariant &templateVariant);
+    void compileMap(const QVariantMap &templateMap, MapNode *node);
+
+private:
+    template<typename T> T *add(T *node)
+    {
+        m_nodes->append(node);
+        return node;
+    }
+
+    const Node *compileProperty(const QString &typeName);
+    static const Node *compileRef(const QString &refName);
+
+    QList<Node *> *m_nodes;
+};
+
+const Node *Compiler::compile(const QVariant &templateVariant)
+{
+    switch (templateVariant.type()) {
+    case QVariant::String: {
+        QString typeName = templateVariant.toString();
+        if (typeName.startsWith("$ref:")) {
+            return compileRef(typeName);
+        }
+        return compileProperty(typeName);
+    }
+    case QVariant::Map: {
+        MapNode *node = add(new MapNode());
+        compileMap(templateVariant.toMap(), node);
+        return node;
+    }
+    case QVariant::List: {
+        QVariantList templateList = templateVariant.toList();
+        Q_ASSERT(templateList.count() == 1);
+        return add(new ListNode(compile(templateList.value(0))));
+    }
+    default:
+        qCWarning(dcJsonRpc) << "Unhandled value" << templateVariant;
+        return add(new FailNode(QString("Unhandled value %1.").arg(templateVariant.toString())));
+    }
+}
+
+void Compiler::compileMap(const QVariantMap &templateMap, MapNode *node)
+{
+    for (QVariantMap::const_iterator it = templateMap.constBegin(); it != templateMap.constEnd(); ++it) {
+        node->addField(it.key(), it.value(), compile(it.value()));
+    }
+}
+
+const Node *Compiler::compileProperty(const QString &typeName)
+{
+    if (typeName == JsonTypes::basicTypeToString(JsonTypes::Variant)) {
+        return add(new AnyNode());
+    }
+
+    static const QList<QPair<QVariant::Type, QString> > propertyTypes = {
+        qMakePair(QVariant::Uuid, QString("uuid")),
+        qMakePair(QVariant::String, QString("string")),
+        qMakePair(QVariant::StringList, QString("string list")),
+        qMakePair(QVariant::Bool, QString("bool")),
+        qMakePair(QVariant::Int, QString("int")),
+        qMakePair(QVariant::UInt, QString("uint")),
+        qMakePair(QVariant::Double, QString("double")),
+        qMakePair(QVariant::Time, QString("time (hh:mm)"))
+    };
+    for (int i = 0; i < propertyTypes.count(); i++) {
+        if (typeName == JsonTypes::basicTypeToString(propertyTypes.at(i).first)) {
+            return add(new PropertyNode(propertyTypes.at(i).first, propertyTypes.at(i).second));
+        }
+    }
+
+    qCWarning(dcJsonRpc) << "Unhandled property type in template:" << typeName;
+    return add(new FailNode(QString("Unhandled property type (expected: %1)").arg(typeName)));
+}
+
+const Node *Compiler::compileRef(const QString &refName)
+{
+    // Compiled types are shared between all validators
+    static QHash<QString, const Node *> s_types;
+    static QList<Node *> s_typeNodes;
+    static QVariantMap s_typeTemplates;
+
+    QHash<QString, const Node *>::const_iterator it = s_types.constFind(refName);
+    if (it != s_types.constEnd()) {
+        return it.value();
+    }
+
+    if (s_typeTemplates.isEmpty()) {
+        s_typeTemplates = JsonTypes::allTypes();
+        // The introspection announces the plain ServerConfiguration here, validation uses the full one
+        s_typeTemplates.insert("WebServerConfiguration", JsonTypes::webServerConfigurationDescription());
+    }
+
+    Compiler compiler(&s_typeNodes);
+    QString typeName = refName.mid(5);
+
+    if (refName == JsonTypes::basicTypeRef()) {
+        s_types.insert(refName, compiler.add(new BasicTypeNode()));
+    } else if (refName == JsonTypes::paramRef()) {
+        // The value of a param depends on its ParamType and gets verified by the DeviceManager
+        s_types.insert(refName, compiler.add(new AnyNode()));
+    } else if (s_typeTemplates.value(typeName).type() == QVariant::Map) {
+        // Register the node before compiling its fields, types may contain themselves (e.g. StateEvaluator)
+        MapNode *node = compiler.add(new MapNode());
+        s_types.insert(refName, node);
+        compiler.compileMap(s_typeTemplates.value(typeName).toMap(), node);
+    } else if (s_typeTemplates.value(typeName).type() == QVariant::List) {
+        s_types.insert(refName, compiler.add(new EnumNode(refName, s_typeTemplates.value(typeName).toList())));
+    } else {
+        Q_ASSERT_X(false, "JsonValidator", QString("Unhandled ref: %1").arg(refName).toLatin1().data());
+        s_types.insert(refName, compiler.add(new FailNode(QString("Unhandled ref %1. Server implementation incomplete.").arg(refName))));
+    }
+    return s_types.value(refName);
+}
+
+}
+
+/*! Constructs a \l{JsonValidator} for the given \a templateMap. */
+JsonValidator::JsonValidator(const QVariantMap &templateMap)
+{
+    Compiler compiler(&m_nodes);
+    m_root = compiler.compile(templateMap);
+}
+
+/*! Destroys this \l{JsonValidator}. */
+JsonValidator::~JsonValidator()
+{
+    qDeleteAll(m_nodes);
+}
+
+/*! Validates the given \a map. Returns the error string and false if the \a map does not match the template. */
+QPair<bool, QString> JsonValidator::validate(const QVariantMap &map) const
+{
+    return m_root->validate(map);
+}
+
+}
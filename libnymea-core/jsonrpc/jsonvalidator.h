@@ -0,0 +1,54 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef JSONVALIDATOR_H
+#define JSONVALIDATOR_H
+
+#include <QVariant>
+#include <QPair>
+#include <QList>
+
+namespace nymeaserver {
+
+class JsonValidator
+{
+public:
+    class Node
+    {
+    public:
+        virtual ~Node() = default;
+        virtual QPair<bool, QString> validate(const QVariant &value) const = 0;
+    };
+
+    explicit JsonValidator(const QVariantMap &templateMap);
+    ~JsonValidator();
+
+    QPair<bool, QString> validate(const QVariantMap &map) const;
+
+private:
+    Q_DISABLE_COPY(JsonValidator)
+
+    QList<Node *> m_nodes;
+    const Node *m_root = nullptr;
+};
+
+}
+
+#endif // JSONVALIDATOR_H
@@ -0,0 +1,343 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::JsonWriter
+    \brief Serializes JSON straight into a byte array.
+
+    \ingroup json
+    \inmodule core
+
+    QJsonDocument::fromVariant() converts the whole QVariant tree into a QJsonObject tree before it can be
+    written, which doubles the allocations for large replies like \c Devices.GetSupportedDevices. The
+    \l{JsonWriter} appends to a single buffer instead, either driven element by element or from a QVariant
+    using \l{writeVariant()}.
+
+    For the values used in the API, the output is identical to the output of QJsonDocument::toJson()
+    in the same format.
+
+    \sa JsonRPCServer, CborCodec
+*/
+
+#include "jsonwriter.h"
+
+#include <QUuid>
+#include <QStringList>
+#include <QLocale>
+
+#include <cmath>
+#include <limits>
+
+namespace nymeaserver {
+
+/*! Constructs an empty \l{JsonWriter} writing in the given \a format. */
+JsonWriter::JsonWriter(QJsonDocument::JsonFormat format):
+    m_indented(format == QJsonDocument::Indented)
+{
+    m_data.reserve(1024);
+}
+
+/*! Starts a new object. */
+void JsonWriter::beginObject()
+{
+    separate();
+    m_data.append('{');
+    m_depth++;
+    m_needsSeparator = false;
+}
+
+/*! Ends the current object. */
+void JsonWriter::endObject()
+{
+    m_depth--;
+    indent();
+    m_data.append('}');
+    m_needsSeparator = true;
+}
+
+/*! Starts a new array. */
+void JsonWriter::beginArray()
+{
+    separate();
+    m_data.append('[');
+    m_depth++;
+    m_needsSeparator = false;
+}
+
+/*! Ends the current array. */
+void JsonWriter::endArray()
+{
+    m_depth--;
+    indent();
+    m_data.append(']');
+    m_needsSeparator = true;
+}
+
+/*! Writes the \a key of the next member of the current object. */
+void JsonWriter::writeKey(const QString &key)
+{
+    separate();
+    m_data.append('"');
+    appendEscaped(key.toUtf8());
+    if (m_indented) {
+        m_data.append("\": ", 3);
+    } else {
+        m_data.append("\":", 2);
+    }
+    m_needsSeparator = false;
+    m_afterKey = true;
+}
+
+/*! Writes the string \a value. */
+void JsonWriter::writeString(const QString &value)
+{
+    separate();
+    m_data.append('"');
+    appendEscaped(value.toUtf8());
+    m_data.append('"');
+    m_needsSeparator = true;
+}
+
+/*! Writes the boolean \a value. */
+void JsonWriter::writeBool(bool value)
+{
+    separate();
+    m_data.append(value ? "true" : "false");
+    m_needsSeparator = true;
+}
+
+/*! Writes the integer \a value. */
+void JsonWriter::writeInteger(qint64 value)
+{
+    separate();
+    m_data.append(QByteArray::number(value));
+    m_needsSeparator = true;
+}
+
+/*! Writes the number \a value. Infinite values and NaN are written as null, like QJsonDocument does. */
+void JsonWriter::writeDouble(double value)
+{
+    if (!std::isfinite(value)) {
+        writeNull();
+        return;
+    }
+    separate();
+    bool integral = std::fabs(value) <= 9007199254740992.0 && value == std::floor(value);
+    m_data.append(QByteArray::number(value, integral ? 'f' : 'g', QLocale::FloatingPointShortest));
+    m_needsSeparator = true;
+}
+
+/*! Writes null. */
+void JsonWriter::writeNull()
+{
+    separate();
+    m_data.append("null");
+    m_needsSeparator = true;
+}
+
+/*! Writes the \a value, mapping the types the same way QJsonValue::fromVariant() does. */
+void JsonWriter::writeVariant(const QVariant &value)
+{
+    switch (value.userType()) {
+    case QMetaType::Bool:
+        writeBool(value.toBool());
+        break;
+    case QMetaType::Int:
+    case QMetaType::Short:
+    case QMetaType::Long:
+    case QMetaType::LongLong:
+    case QMetaType::UInt:
+    case QMetaType::UShort:
+    case QMetaType::ULong:
+        writeInteger(value.toLongLong());
+        break;
+    case QMetaType::ULongLong:
+        if (value.toULongLong() <= static_cast<qulonglong>(std::numeric_limits<qint64>::max())) {
+            writeInteger(value.toLongLong());
+        } else {
+            writeDouble(value.toDouble());
+        }
+        break;
+    case QMetaType::Float:
+    case QMetaType::Double:
+        writeDouble(value.toDouble());
+        break;
+    case QMetaType::QString:
+        writeString(value.toString());
+        break;
+    case QMetaType::QByteArray:
+        separate();
+        m_data.append('"');
+        appendEscaped(value.toByteArray());
+        m_data.append('"');
+        m_needsSeparator = true;
+        break;
+    case QMetaType::QUuid:
+        writeString(value.toUuid().toString());
+        break;
+    case QMetaType::QVariantMap: {
+        const QVariantMap map = value.toMap();
+        beginObject();
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            writeKey(it.key());
+            writeVariant(it.value());
+        }
+        endObject();
+        break;
+    }
+    case QMetaType::QVariantHash: {
+        // JSON objects are sorted by key, like a QVariantMap
+        const QVariantHash hash = value.toHash();
+        QStringList keys = hash.keys();
+        keys.sort();
+        beginObject();
+        foreach (const QString &key, keys) {
+            writeKey(key);
+            writeVariant(hash.value(key));
+        }
+        endObject();
+        break;
+    }
+    case QMetaType::QVariantList: {
+        const QVariantList list = value.toList();
+        beginArray();
+        foreach (const QVariant &item, list) {
+            writeVariant(item);
+        }
+        endArray();
+        break;
+    }
+    case QMetaType::QStringList: {
+        const QStringList list = value.toStringList();
+        beginArray();
+        foreach (const QString &item, list) {
+            writeString(item);
+        }
+        endArray();
+        break;
+    }
+    default:
+        if (value.isValid() && value.canConvert<QString>()) {
+            writeString(value.toString());
+        } else {
+            writeNull();
+        }
+        break;
+    }
+}
+
+/*! Writes the already serialized \a json as the next value. The \a json must be compact, it is copied as is. */
+void JsonWriter::writeJson(const QByteArray &json)
+{
+    separate();
+    m_data.append(json);
+    m_needsSeparator = true;
+}
+
+/*! Returns the JSON written so far. */
+QByteArray JsonWriter::data() const
+{
+    return m_data;
+}
+
+/*! Returns the JSON representation of \a value in the given \a format. */
+QByteArray JsonWriter::toJson(const QVariant &value, QJsonDocument::JsonFormat format)
+{
+    JsonWriter writer(format);
+    writer.writeVariant(value);
+    // Like QJsonDocument, end indented documents with a line break
+    if (writer.m_indented && (writer.m_data.startsWith('{') || writer.m_data.startsWith('['))) {
+        writer.m_data.append('\n');
+    }
+    return writer.data();
+}
+
+void JsonWriter::separate()
+{
+    // A member value follows its key directly
+    if (m_afterKey) {
+        m_afterKey = false;
+        return;
+    }
+    if (m_needsSeparator) {
+        m_data.append(',');
+    }
+    if (m_depth > 0) {
+        indent();
+    }
+}
+
+void JsonWriter::indent()
+{
+    if (m_indented) {
+        m_data.append('\n');
+        m_data.append(QByteArray(4 * m_depth, ' '));
+    }
+}
+
+void JsonWriter::appendEscaped(const QByteArray &utf8)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    const char *data = utf8.constData();
+    int size = utf8.size();
+
+    // Copy runs of characters which don't need escaping in one go
+    int runStart = 0;
+    for (int i = 0; i < size; i++) {
+        uchar c = static_cast<uchar>(data[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        m_data.append(data + runStart, i - runStart);
+        runStart = i + 1;
+        m_data.append('\\');
+        switch (c) {
+        case '"':
+            m_data.append('"');
+            break;
+        case '\\':
+            m_data.append('\\');
+            break;
+        case '\b':
+            m_data.append('b');
+            break;
+        case '\f':
+            m_data.append('f');
+            break;
+        case '\n':
+            m_data.append('n');
+            break;
+        case '\r':
+            m_data.append('r');
+            break;
+        case '\t':
+            m_data.append('t');
+            break;
+        default:
+            m_data.append("u00", 3);
+            m_data.append(hexDigits[c >> 4]);
+            m_data.append(hexDigits[c & 0xf]);
+            break;
+        }
+    }
+    m_data.append(data + runStart, size - runStart);
+}
+
+}
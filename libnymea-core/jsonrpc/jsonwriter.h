@@ -0,0 +1,68 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+#include <QJsonDocument>
+
+namespace nymeaserver {
+
+class JsonWriter
+{
+public:
+    explicit JsonWriter(QJsonDocument::JsonFormat format = QJsonDocument::Compact);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void writeKey(const QString &key);
+    void writeString(const QString &value);
+    void writeBool(bool value);
+    void writeInteger(qint64 value);
+    void writeDouble(double value);
+    void writeNull();
+    void writeVariant(const QVariant &value);
+    void writeJson(const QByteArray &json);
+
+    QByteArray data() const;
+
+    static QByteArray toJson(const QVariant &value, QJsonDocument::JsonFormat format = QJsonDocument::Compact);
+
+private:
+    QByteArray m_data;
+    bool m_indented = false;
+    int m_depth = 0;
+    bool m_needsSeparator = false;
+    bool m_afterKey = false;
+
+    void separate();
+    void indent();
+    void appendEscaped(const QByteArray &utf8);
+};
+
+}
+
+#endif // JSONWRITER_H
@@ -48,6 +48,8 @@
 #include "loggingcategories.h"
 #include "nymeacore.h"
 
+#include <QSharedPointer>
+
 namespace nymeaserver {
 
 /*! Constructs a new \l LoggingHandler with the given \a parent. */
@@ -73,7 +75,10 @@ LoggingHandler::LoggingHandler(QObject *parent) :
                    "1) offset 0, maxCount 1000: Entries 0 to 9999\n"
                    "2) offset 10000, maxCount 1000: Entries 10000 - 19999\n"
                    "3) offset 20000, maxCount 1000: Entries 20000 - 29999\n"
-                   "...");
+                   "...\n\n"
+                   "For large result sets, paging with a cursor is a lot cheaper than using the offset. "
+                   "If the limit has been reached, the result contains a nextCursor which can be passed "
+                   "as cursor in the next request in order to continue right after the last returned entry.");
     timeFilter.insert("o:startDate", JsonTypes::basicTypeToString(JsonTypes::Int));
     timeFilter.insert("o:endDate", JsonTypes::basicTypeToString(JsonTypes::Int));
     params.insert("o:timeFilters", QVariantList() << timeFilter);
@@ -85,13 +90,32 @@ LoggingHandler::LoggingHandler(QObject *parent) :
     params.insert("o:values", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::Variant));
     params.insert("o:limit", JsonTypes::basicTypeToString(JsonTypes::Int));
     params.insert("o:offset", JsonTypes::basicTypeToString(JsonTypes::Int));
+    params.insert("o:cursor", JsonTypes::basicTypeToString(JsonTypes::String));
     setParams("GetLogEntries", params);
     returns.insert("loggingError", JsonTypes::loggingErrorRef());
     returns.insert("o:logEntries", QVariantList() << JsonTypes::logEntryRef());
     returns.insert("count", JsonTypes::basicTypeToString(JsonTypes::Int));
     returns.insert("offset", JsonTypes::basicTypeToString(JsonTypes::Int));
+    returns.insert("o:nextCursor", JsonTypes::basicTypeToString(JsonTypes::String));
     setReturns("GetLogEntries", returns);
 
+    params.clear(); returns.clear();
+    setDescription("GetAggregatedStateValues", "Get the minimum, maximum, average and last value of a numeric state "
+                   "for each time bucket between startDate and endDate (unix timestamps in seconds). The bucketSize "
+                   "is given in seconds and defaults to one hour. Buckets are aligned to multiples of the bucketSize "
+                   "since the epoch (UTC), buckets without any values are omitted. Bucket sizes which are a multiple "
+                   "of 5 minutes are answered from precomputed rollups and don't depend on the log entries still "
+                   "being in the database.");
+    params.insert("deviceId", JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    params.insert("stateTypeId", JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    params.insert("startDate", JsonTypes::basicTypeToString(JsonTypes::Int));
+    params.insert("endDate", JsonTypes::basicTypeToString(JsonTypes::Int));
+    params.insert("o:bucketSize", JsonTypes::basicTypeToString(JsonTypes::Int));
+    setParams("GetAggregatedStateValues", params);
+    returns.insert("loggingError", JsonTypes::loggingErrorRef());
+    returns.insert("o:aggregates", QVariantList() << JsonTypes::logAggregateRef());
+    setReturns("GetAggregatedStateValues", returns);
+
     // Notifications
     params.clear();
     setDescription("LogEntryAdded", "Emitted whenever an entry is appended to the logging system. ");
@@ -136,16 +160,63 @@ JsonReply* LoggingHandler::GetLogEntries(const QVariantMap &params) const
 
     LogFilter filter = JsonTypes::unpackLogFilter(params);
 
-    QVariantList entries;
-    foreach (const LogEntry &entry, NymeaCore::instance()->logEngine()->logEntries(filter)) {
-        entries.append(JsonTypes::packLogEntry(entry));
+    if (params.contains("cursor") && !filter.hasCursor()) {
+        QVariantMap returns = statusToReply(Logging::LoggingErrorInvalidFilterParameter);
+        returns.insert("offset", filter.offset());
+        returns.insert("count", 0);
+        return createReply(returns);
+    }
+
+    // The entries arrive in chunks and are packed right away, so the LogEntry objects of a chunk can be freed.
+    // The packed entries of the whole page are still collected for the reply, large results need a limit.
+    LogEntriesFetchJob *job = NymeaCore::instance()->logEngine()->fetchLogEntries(filter, true);
+    JsonReply *reply = createAsyncReply("GetLogEntries");
+    QSharedPointer<QVariantList> entries(new QVariantList());
+    connect(job, &LogEntriesFetchJob::entriesAvailable, reply, [entries](const QList<LogEntry> &chunk){
+        foreach (const LogEntry &entry, chunk) {
+            entries->append(JsonTypes::packLogEntry(entry));
+        }
+    });
+    connect(job, &LogEntriesFetchJob::finished, reply, [this, reply, job, entries, filter](){
+        QVariantMap returns = statusToReply(Logging::LoggingErrorNoError);
+
+        returns.insert("logEntries", *entries);
+        returns.insert("offset", filter.offset());
+        returns.insert("count", entries->count());
+        if (!job->nextCursor().isEmpty()) {
+            returns.insert("nextCursor", job->nextCursor());
+        }
+        reply->setData(returns);
+        reply->finished();
+    });
+    return reply;
+}
+
+JsonReply *LoggingHandler::GetAggregatedStateValues(const QVariantMap &params) const
+{
+    DeviceId deviceId = DeviceId(params.value("deviceId").toString());
+    QUuid stateTypeId = params.value("stateTypeId").toUuid();
+    QDateTime startDate = QDateTime::fromTime_t(params.value("startDate").toUInt());
+    QDateTime endDate = QDateTime::fromTime_t(params.value("endDate").toUInt());
+    int bucketSize = params.value("bucketSize", 3600).toInt();
+
+    if (bucketSize <= 0 || endDate < startDate) {
+        return createReply(statusToReply(Logging::LoggingErrorInvalidFilterParameter));
     }
-    QVariantMap returns = statusToReply(Logging::LoggingErrorNoError);
 
-    returns.insert("logEntries", entries);
-    returns.insert("offset", filter.offset());
-    returns.insert("count", entries.count());
-    return createReply(returns);
+    LogAggregatesFetchJob *job = NymeaCore::instance()->logEngine()->fetchAggregates(deviceId, stateTypeId, startDate, endDate, bucketSize);
+    JsonReply *reply = createAsyncReply("GetAggregatedStateValues");
+    connect(job, &LogAggregatesFetchJob::finished, reply, [this, reply, job](){
+        QVariantList aggregates;
+        foreach (const LogAggregate &aggregate, job->aggregates()) {
+            aggregates.append(JsonTypes::packLogAggregate(aggregate));
+        }
+        QVariantMap returns = statusToReply(Logging::LoggingErrorNoError);
+        returns.insert("aggregates", aggregates);
+        reply->setData(returns);
+        reply->finished();
+    });
+    return reply;
 }
 
 }
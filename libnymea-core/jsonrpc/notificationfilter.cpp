@@ -0,0 +1,126 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::NotificationFilter
+    \brief Holds the notification subscriptions of a JSON-RPC client.
+
+    \ingroup json
+    \inmodule core
+
+    Namespaces, devices and state types are referred to by small indexes assigned by the \l{JsonRPCServer}, so each
+    part of the filter is a compact bit array and checking a notification against it is a few bit tests. A part of
+    the filter which has not been set accepts everything.
+
+    \sa JsonRPCServer
+*/
+
+/*! \enum nymeaserver::NotificationFilter::Index
+
+    Special values for the device and state type indexes passed to \l{accepts()}.
+
+    \value IndexNone
+        The notification does not refer to a device or state type.
+    \value IndexUnknown
+        The device or state type has no index, because no client subscribed to it.
+*/
+
+#include "notificationfilter.h"
+
+namespace nymeaserver {
+
+/*! Constructs a \l{NotificationFilter} which accepts all notifications. */
+NotificationFilter::NotificationFilter()
+{
+}
+
+/*! Returns true if this filter accepts all notifications. */
+bool NotificationFilter::isEmpty() const
+{
+    return !m_filterNamespaces && !m_filterDevices && !m_filterStateTypes;
+}
+
+/*! Only accept notifications from the namespaces with the given \a namespaceIndexes. */
+void NotificationFilter::setNamespaces(const QList<int> &namespaceIndexes)
+{
+    m_namespaces = toBitArray(namespaceIndexes);
+    m_filterNamespaces = true;
+}
+
+/*! Only accept notifications about the devices with the given \a deviceIndexes. Notifications which don't refer to a device are not affected. */
+void NotificationFilter::setDevices(const QList<int> &deviceIndexes)
+{
+    m_devices = toBitArray(deviceIndexes);
+    m_filterDevices = true;
+}
+
+/*! Only accept notifications about the state types with the given \a stateTypeIndexes. Notifications which don't refer to a state type are not affected. */
+void NotificationFilter::setStateTypes(const QList<int> &stateTypeIndexes)
+{
+    m_stateTypes = toBitArray(stateTypeIndexes);
+    m_filterStateTypes = true;
+}
+
+/*! Stops accepting notifications about the device with the given \a deviceIndex, e.g. because it has been removed. */
+void NotificationFilter::removeDevice(int deviceIndex)
+{
+    if (deviceIndex >= 0 && deviceIndex < m_devices.size()) {
+        m_devices.clearBit(deviceIndex);
+    }
+}
+
+/*! Returns true if a notification from the namespace with the given \a namespaceIndex about the given \a deviceIndex and
+    \a stateTypeIndex passes this filter. Use \l{IndexNone} if the notification doesn't refer to a device or state type. */
+bool NotificationFilter::accepts(int namespaceIndex, int deviceIndex, int stateTypeIndex) const
+{
+    if (m_filterNamespaces && !contains(m_namespaces, namespaceIndex)) {
+        return false;
+    }
+    if (m_filterDevices && deviceIndex != IndexNone && !contains(m_devices, deviceIndex)) {
+        return false;
+    }
+    if (m_filterStateTypes && stateTypeIndex != IndexNone && !contains(m_stateTypes, stateTypeIndex)) {
+        return false;
+    }
+    return true;
+}
+
+QBitArray NotificationFilter::toBitArray(const QList<int> &indexes)
+{
+    int size = 0;
+    foreach (int index, indexes) {
+        size = qMax(size, index + 1);
+    }
+
+    QBitArray bits(size);
+    foreach (int index, indexes) {
+        if (index >= 0) {
+            bits.setBit(index);
+        }
+    }
+    return bits;
+}
+
+bool NotificationFilter::contains(const QBitArray &bits, int index)
+{
+    return index >= 0 && index < bits.size() && bits.testBit(index);
+}
+
+}
@@ -0,0 +1,62 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef NOTIFICATIONFILTER_H
+#define NOTIFICATIONFILTER_H
+
+#include <QBitArray>
+#include <QList>
+
+namespace nymeaserver {
+
+class NotificationFilter
+{
+public:
+    enum Index {
+        IndexNone = -1,
+        IndexUnknown = -2
+    };
+
+    NotificationFilter();
+
+    bool isEmpty() const;
+
+    void setNamespaces(const QList<int> &namespaceIndexes);
+    void setDevices(const QList<int> &deviceIndexes);
+    void setStateTypes(const QList<int> &stateTypeIndexes);
+    void removeDevice(int deviceIndex);
+
+    bool accepts(int namespaceIndex, int deviceIndex, int stateTypeIndex) const;
+
+private:
+    QBitArray m_namespaces;
+    QBitArray m_devices;
+    QBitArray m_stateTypes;
+    bool m_filterNamespaces = false;
+    bool m_filterDevices = false;
+    bool m_filterStateTypes = false;
+
+    static QBitArray toBitArray(const QList<int> &indexes);
+    static bool contains(const QBitArray &bits, int index);
+};
+
+}
+
+#endif // NOTIFICATIONFILTER_H
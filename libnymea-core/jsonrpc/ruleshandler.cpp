@@ -141,6 +141,13 @@ RulesHandler::RulesHandler(QObject *parent) :
     returns.insert("ruleIds", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::Uuid));
     setReturns("FindRules", returns);
 
+    params.clear(); returns.clear();
+    setDescription("GetActiveRules", "Get the ids of all rules which are currently active. Only state based rules can be active. "
+                   "Changes of the active state are announced by the notification \"Rules.RuleActiveChanged\".");
+    setParams("GetActiveRules", params);
+    returns.insert("ruleIds", QVariantList() << JsonTypes::basicTypeToString(JsonTypes::Uuid));
+    setReturns("GetActiveRules", returns);
+
     params.clear(); returns.clear();
     setDescription("EnableRule", "Enabled a rule that has previously been disabled."
                    "If successful, the notification \"Rule.RuleConfigurationChanged\" will be emitted.");
@@ -277,6 +284,20 @@ JsonReply *RulesHandler::FindRules(const QVariantMap &params)
     return createReply(returns);
 }
 
+JsonReply *RulesHandler::GetActiveRules(const QVariantMap &params)
+{
+    Q_UNUSED(params)
+
+    QVariantList rulesList;
+    foreach (const RuleId &ruleId, NymeaCore::instance()->ruleEngine()->activeRules()) {
+        rulesList.append(ruleId);
+    }
+
+    QVariantMap returns;
+    returns.insert("ruleIds", rulesList);
+    return createReply(returns);
+}
+
 JsonReply *RulesHandler::EnableRule(const QVariantMap &params)
 {
     return createReply(statusToReply(NymeaCore::instance()->ruleEngine()->enableRule(RuleId(params.value("ruleId").toString()))));
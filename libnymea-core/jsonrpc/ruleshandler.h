@@ -41,6 +41,7 @@ public:
     Q_INVOKABLE JsonReply *EditRule(const QVariantMap &params);
     Q_INVOKABLE JsonReply *RemoveRule(const QVariantMap &params);
     Q_INVOKABLE JsonReply *FindRules(const QVariantMap &params);
+    Q_INVOKABLE JsonReply *GetActiveRules(const QVariantMap &params);
 
     Q_INVOKABLE JsonReply *EnableRule(const QVariantMap &params);
     Q_INVOKABLE JsonReply *DisableRule(const QVariantMap &params);
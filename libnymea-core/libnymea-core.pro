@@ -19,6 +19,7 @@ HEADERS += nymeacore.h \
     ruleengine.h \
     rule.h \
     stateevaluator.h \
+    compiledstateevaluator.h \
     transportinterface.h \
     nymeaconfiguration.h \
     servermanager.h \
@@ -39,6 +40,12 @@ HEADERS += nymeacore.h \
     servers/websocketserver.h \
     servers/mqttbroker.h \
     jsonrpc/jsonrpcserver.h \
+    jsonrpc/jsonframer.h \
+    jsonrpc/jsonvalidator.h \
+    jsonrpc/jsoncontext.h \
+    jsonrpc/notificationfilter.h \
+    jsonrpc/cborcodec.h \
+    jsonrpc/jsonwriter.h \
     jsonrpc/jsonhandler.h \
     jsonrpc/devicehandler.h \
     jsonrpc/jsontypes.h \
@@ -51,8 +58,11 @@ HEADERS += nymeacore.h \
     jsonrpc/networkmanagerhandler.h \
     logging/logging.h \
     logging/logengine.h \
+    logging/logdatabase.h \
     logging/logfilter.h \
     logging/logentry.h \
+    logging/logaggregate.h \
+    logging/logarchive.h \
     logging/logvaluetool.h \
     time/timedescriptor.h \
     time/calendaritem.h \
@@ -106,6 +116,7 @@ SOURCES += nymeacore.cpp \
     ruleengine.cpp \
     rule.cpp \
     stateevaluator.cpp \
+    compiledstateevaluator.cpp \
     transportinterface.cpp \
     nymeaconfiguration.cpp \
     servermanager.cpp \
@@ -126,6 +137,12 @@ SOURCES += nymeacore.cpp \
     servers/rest/rulesresource.cpp \
     servers/mqttbroker.cpp \
     jsonrpc/jsonrpcserver.cpp \
+    jsonrpc/jsonframer.cpp \
+    jsonrpc/jsonvalidator.cpp \
+    jsonrpc/jsoncontext.cpp \
+    jsonrpc/notificationfilter.cpp \
+    jsonrpc/cborcodec.cpp \
+    jsonrpc/jsonwriter.cpp \
     jsonrpc/jsonhandler.cpp \
     jsonrpc/devicehandler.cpp \
     jsonrpc/jsontypes.cpp \
@@ -137,8 +154,11 @@ SOURCES += nymeacore.cpp \
     jsonrpc/configurationhandler.cpp \
     jsonrpc/networkmanagerhandler.cpp \
     logging/logengine.cpp \
+    logging/logdatabase.cpp \
     logging/logfilter.cpp \
     logging/logentry.cpp \
+    logging/logaggregate.cpp \
+    logging/logarchive.cpp \
     logging/logvaluetool.cpp \
     time/timedescriptor.cpp \
     time/calendaritem.cpp \
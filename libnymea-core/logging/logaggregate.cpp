@@ -0,0 +1,156 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::LogAggregate
+    \brief Represents the aggregated numeric values of a state within a time bucket.
+
+    \ingroup logs
+    \inmodule core
+
+    A \l{LogAggregate} summarizes all values logged for a state between \l{timestamp()} and the start of the
+    next bucket. Aggregates of smaller buckets can be combined to bigger ones using \l{merge()}.
+
+    \sa LogEngine, LogEntry
+*/
+
+#include "logaggregate.h"
+
+namespace nymeaserver {
+
+/*! Constructs an empty, invalid \l{LogAggregate}. */
+LogAggregate::LogAggregate()
+{
+
+}
+
+/*! Constructs an empty \l{LogAggregate} for the bucket starting at the given \a timestamp. */
+LogAggregate::LogAggregate(const QDateTime &timestamp):
+    m_timestamp(timestamp)
+{
+
+}
+
+/*! Returns the start of the bucket of this \l{LogAggregate}. */
+QDateTime LogAggregate::timestamp() const
+{
+    return m_timestamp;
+}
+
+/*! Returns the smallest value within this bucket. */
+double LogAggregate::minimum() const
+{
+    return m_minimum;
+}
+
+/*! Returns the biggest value within this bucket. */
+double LogAggregate::maximum() const
+{
+    return m_maximum;
+}
+
+/*! Returns the average of all values within this bucket. */
+double LogAggregate::average() const
+{
+    if (m_count == 0)
+        return 0;
+
+    return m_sum / m_count;
+}
+
+/*! Returns the sum of all values within this bucket. */
+double LogAggregate::sum() const
+{
+    return m_sum;
+}
+
+/*! Returns the number of values within this bucket. */
+int LogAggregate::count() const
+{
+    return m_count;
+}
+
+/*! Returns the most recent value within this bucket. */
+double LogAggregate::last() const
+{
+    return m_last;
+}
+
+/*! Returns the time of the most recent value within this bucket. */
+QDateTime LogAggregate::lastTimestamp() const
+{
+    return m_lastTimestamp;
+}
+
+/*! Adds the given \a value logged at \a timestamp to this bucket. */
+void LogAggregate::addValue(const QDateTime &timestamp, double value)
+{
+    if (m_count == 0) {
+        m_minimum = value;
+        m_maximum = value;
+    } else {
+        m_minimum = qMin(m_minimum, value);
+        m_maximum = qMax(m_maximum, value);
+    }
+    m_sum += value;
+    m_count++;
+
+    if (!m_lastTimestamp.isValid() || timestamp >= m_lastTimestamp) {
+        m_last = value;
+        m_lastTimestamp = timestamp;
+    }
+}
+
+/*! Adds all values of the \a other bucket to this one. */
+void LogAggregate::merge(const LogAggregate &other)
+{
+    if (other.count() == 0)
+        return;
+
+    if (m_count == 0) {
+        m_minimum = other.minimum();
+        m_maximum = other.maximum();
+    } else {
+        m_minimum = qMin(m_minimum, other.minimum());
+        m_maximum = qMax(m_maximum, other.maximum());
+    }
+    m_sum += other.sum();
+    m_count += other.count();
+
+    if (!m_lastTimestamp.isValid() || other.lastTimestamp() >= m_lastTimestamp) {
+        m_last = other.last();
+        m_lastTimestamp = other.lastTimestamp();
+    }
+}
+
+/*! Returns a \l{LogAggregate} for the bucket starting at \a timestamp with the given precomputed values. */
+LogAggregate LogAggregate::fromValues(const QDateTime &timestamp, double minimum, double maximum, double sum, int count, double last, const QDateTime &lastTimestamp)
+{
+    LogAggregate aggregate(timestamp);
+    aggregate.m_minimum = minimum;
+    aggregate.m_maximum = maximum;
+    aggregate.m_sum = sum;
+    aggregate.m_count = count;
+    aggregate.m_last = last;
+    aggregate.m_lastTimestamp = lastTimestamp;
+    return aggregate;
+}
+
+}
@@ -0,0 +1,66 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef LOGAGGREGATE_H
+#define LOGAGGREGATE_H
+
+#include <QDateTime>
+#include <QList>
+#include <QMetaType>
+
+namespace nymeaserver {
+
+class LogAggregate
+{
+public:
+    LogAggregate();
+    LogAggregate(const QDateTime &timestamp);
+
+    QDateTime timestamp() const;
+
+    double minimum() const;
+    double maximum() const;
+    double average() const;
+    double sum() const;
+    int count() const;
+
+    double last() const;
+    QDateTime lastTimestamp() const;
+
+    void addValue(const QDateTime &timestamp, double value);
+    void merge(const LogAggregate &other);
+
+    static LogAggregate fromValues(const QDateTime &timestamp, double minimum, double maximum, double sum, int count, double last, const QDateTime &lastTimestamp);
+
+private:
+    QDateTime m_timestamp;
+    double m_minimum = 0;
+    double m_maximum = 0;
+    double m_sum = 0;
+    int m_count = 0;
+    double m_last = 0;
+    QDateTime m_lastTimestamp;
+};
+
+}
+
+Q_DECLARE_METATYPE(QList<nymeaserver::LogAggregate>)
+
+#endif // LOGAGGREGATE_H
@@ -0,0 +1,820 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::LogArchive
+    \brief Compact long term storage for log entries removed from the log database.
+
+    \ingroup logs
+    \inmodule core
+
+    Instead of discarding the entries removed by the retention of the \l{LogDatabase}, they can be moved into
+    a \l{LogArchive}. The archive is a directory of append-only segment files. Each segment is a sequence of
+    blocks which store their entries column by column: timestamps and row ids are delta encoded, device and type
+    ids are replaced by indexes into small dictionaries in front of each block and all other columns are packed
+    as variable length integers and compressed.
+
+    Each block starts with a header containing its time range, so queries only decompress blocks which may
+    contain matching entries. Segments are memory mapped for reading. Once the archive grows beyond its maximum
+    size, the oldest segments are deleted.
+
+    The archive is not thread safe, it is owned and used by the \l{LogDatabase} in the database thread.
+
+    \sa LogDatabase
+*/
+
+#include "logarchive.h"
+#include "logvaluetool.h"
+#include "loggingcategories.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include <QDateTime>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+namespace nymeaserver {
+
+// File layout: segment header, followed by blocks of [header][dictionaries][compressed columns]
+static const char segmentMagic[] = "NYLA";
+static const quint32 segmentVersion = 1;
+static const int segmentHeaderSize = 8;
+static const quint32 blockMagic = 0x4e4c4231;
+static const int blockHeaderSize = 32;
+static const int maxBlockRecords = 1024;
+
+static void writeVarint(QByteArray &data, quint64 value)
+{
+    while (value >= 0x80) {
+        data.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    data.append(static_cast<char>(value));
+}
+
+static quint64 zigZag(qint64 value)
+{
+    return (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+}
+
+static qint64 unZigZag(quint64 value)
+{
+    return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+}
+
+class PayloadReader
+{
+public:
+    PayloadReader(const QByteArray &data): m_data(data) {}
+
+    bool ok() const { return m_ok; }
+    void fail() { m_ok = false; }
+    int remaining() const { return m_data.size() - m_pos; }
+
+    quint64 readVarint() {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64 && m_pos < m_data.size(); shift += 7) {
+            quint8 byte = static_cast<quint8>(m_data.at(m_pos++));
+            value |= static_cast<quint64>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        m_ok = false;
+        return 0;
+    }
+
+    QByteArray readBytes(int length) {
+        if (length < 0 || m_pos + length > m_data.size()) {
+            m_ok = false;
+            return QByteArray();
+        }
+        QByteArray bytes = m_data.mid(m_pos, length);
+        m_pos += length;
+        return bytes;
+    }
+
+private:
+    const QByteArray &m_data;
+    int m_pos = 0;
+    bool m_ok = true;
+};
+
+static bool recordLessThan(const LogArchive::Record &a, const LogArchive::Record &b)
+{
+    return a.timestamp < b.timestamp || (a.timestamp == b.timestamp && a.rowId < b.rowId);
+}
+
+static bool recordGreaterThan(const LogArchive::Record &a, const LogArchive::Record &b)
+{
+    return recordLessThan(b, a);
+}
+
+static void writeDictionary(QByteArray &data, const QList<QUuid> &dictionary)
+{
+    writeVarint(data, dictionary.count());
+    foreach (const QUuid &uuid, dictionary) {
+        data.append(uuid.toRfc4122());
+    }
+}
+
+static QList<QUuid> readDictionary(PayloadReader &reader)
+{
+    QList<QUuid> dictionary;
+    quint64 size = reader.readVarint();
+    if (size > static_cast<quint64>(reader.remaining())) {
+        reader.fail();
+        return dictionary;
+    }
+    for (quint64 i = 0; i < size && reader.ok(); i++) {
+        dictionary.append(QUuid::fromRfc4122(reader.readBytes(16)));
+    }
+    return dictionary;
+}
+
+static QByteArray encodeBlock(const QList<LogArchive::Record> &records)
+{
+    QList<QUuid> deviceIds;
+    QList<QUuid> typeIds;
+    QHash<QUuid, int> deviceIndexes;
+    QHash<QUuid, int> typeIndexes;
+    foreach (const LogArchive::Record &record, records) {
+        if (!deviceIndexes.contains(record.deviceId)) {
+            deviceIndexes.insert(record.deviceId, deviceIds.count());
+            deviceIds.append(record.deviceId);
+        }
+        if (!typeIndexes.contains(record.typeId)) {
+            typeIndexes.insert(record.typeId, typeIds.count());
+            typeIds.append(record.typeId);
+        }
+    }
+
+    // The dictionaries stay uncompressed so they can be scanned without unpacking the block
+    QByteArray block;
+    writeDictionary(block, deviceIds);
+    writeDictionary(block, typeIds);
+
+    // Store column by column, similar values next to each other compress a lot better
+    QByteArray columns;
+    qint64 previousTimestamp = 0;
+    qint64 previousRowId = 0;
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, zigZag(record.timestamp - previousTimestamp));
+        previousTimestamp = record.timestamp;
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, zigZag(record.rowId - previousRowId));
+        previousRowId = record.rowId;
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, deviceIndexes.value(record.deviceId));
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, typeIndexes.value(record.typeId));
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, record.source);
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, record.level);
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, record.eventType);
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, record.active ? 1 : 0);
+    }
+    foreach (const LogArchive::Record &record, records) {
+        writeVarint(columns, zigZag(record.errorCode));
+    }
+    foreach (const LogArchive::Record &record, records) {
+        QByteArray value = record.value.toUtf8();
+        writeVarint(columns, value.size());
+        columns.append(value);
+    }
+
+    block.append(qCompress(columns, 9));
+    return block;
+}
+
+static bool decodeBlock(const QByteArray &block, int count, QList<LogArchive::Record> *records)
+{
+    PayloadReader blockReader(block);
+    QList<QUuid> deviceIds = readDictionary(blockReader);
+    QList<QUuid> typeIds = readDictionary(blockReader);
+    if (!blockReader.ok()) {
+        return false;
+    }
+
+    QByteArray columns = qUncompress(blockReader.readBytes(blockReader.remaining()));
+    PayloadReader reader(columns);
+    QVector<LogArchive::Record> decoded(count);
+    qint64 timestamp = 0;
+    qint64 rowId = 0;
+    for (int i = 0; i < count; i++) {
+        timestamp += unZigZag(reader.readVarint());
+        decoded[i].timestamp = timestamp;
+    }
+    for (int i = 0; i < count; i++) {
+        rowId += unZigZag(reader.readVarint());
+        decoded[i].rowId = rowId;
+    }
+    for (int i = 0; i < count; i++) {
+        decoded[i].deviceId = deviceIds.value(static_cast<int>(reader.readVarint()));
+    }
+    for (int i = 0; i < count; i++) {
+        decoded[i].typeId = typeIds.value(static_cast<int>(reader.readVarint()));
+    }
+    for (int i = 0; i < count; i++) {
+        decoded[i].source = static_cast<int>(reader.readVarint());
+    }
+    for (int i = 0; i < count; i++) {
+        decoded[i].level = static_cast<int>(reader.readVarint());
+    }
+    for (int i = 0; i < count; i++) {
+        decoded[i].eventType = static_cast<int>(reader.readVarint());
+    }
+    for (int i = 0; i < count; i++) {
+        decoded[i].active = reader.readVarint() != 0;
+    }
+    for (int i = 0; i < count; i++) {
+        decoded[i].errorCode = static_cast<int>(unZigZag(reader.readVarint()));
+    }
+    for (int i = 0; i < count && reader.ok(); i++) {
+        decoded[i].value = QString::fromUtf8(reader.readBytes(static_cast<int>(reader.readVarint())));
+    }
+
+    if (!reader.ok()) {
+        return false;
+    }
+    records->append(decoded.toList());
+    return true;
+}
+
+static bool recordMatches(const LogFilter &filter, const LogArchive::Record &record, const QStringList &values, qint64 now)
+{
+    // Mirrors LogFilter::queryString()
+    if (!filter.timeFilters().isEmpty()) {
+        bool inTime = false;
+        for (int i = 0; i < filter.timeFilters().count() && !inTime; i++) {
+            const QPair<QDateTime, QDateTime> &timeFilter = filter.timeFilters().at(i);
+            qint64 start = timeFilter.first.isValid() ? timeFilter.first.toTime_t() : -1;
+            qint64 end = timeFilter.second.isValid() ? timeFilter.second.toTime_t() : -1;
+            if (start >= 0 && end < 0) {
+                inTime = record.timestamp >= start && record.timestamp <= now;
+            } else if (start < 0 && end >= 0) {
+                inTime = record.timestamp < end || record.timestamp > now;
+            } else if (start >= 0 && end >= 0) {
+                inTime = record.timestamp >= start && record.timestamp <= end;
+            }
+        }
+        if (!inTime) {
+            return false;
+        }
+    }
+    if (!filter.loggingSources().isEmpty() && !filter.loggingSources().contains(static_cast<Logging::LoggingSource>(record.source))) {
+        return false;
+    }
+    if (!filter.loggingLevels().isEmpty() && !filter.loggingLevels().contains(static_cast<Logging::LoggingLevel>(record.level))) {
+        return false;
+    }
+    if (!filter.loggingEventTypes().isEmpty() && !filter.loggingEventTypes().contains(static_cast<Logging::LoggingEventType>(record.eventType))) {
+        return false;
+    }
+    if (!filter.typeIds().isEmpty() && !filter.typeIds().contains(record.typeId)) {
+        return false;
+    }
+    if (!filter.deviceIds().isEmpty() && !filter.deviceIds().contains(DeviceId::fromUuid(record.deviceId))) {
+        return false;
+    }
+    if (!values.isEmpty() && !values.contains(record.value)) {
+        return false;
+    }
+    if (filter.hasCursor()) {
+        return record.timestamp < filter.cursorTimestamp() || (record.timestamp == filter.cursorTimestamp() && record.rowId < filter.cursorRowId());
+    }
+    return true;
+}
+
+/*! Constructs a closed \l{LogArchive}. */
+LogArchive::LogArchive()
+{
+
+}
+
+LogArchive::~LogArchive()
+{
+    close();
+}
+
+/*! Opens the archive in the directory \a path, which will be created if needed. The oldest segments are deleted
+    once the archive exceeds \a maxSize bytes. Returns false if the directory can't be used.
+*/
+bool LogArchive::open(const QString &path, qint64 maxSize)
+{
+    close();
+
+    QDir dir(path);
+    if (!dir.exists() && !dir.mkpath(path)) {
+        qCWarning(dcLogEngine()) << "Could not create log archive directory" << path;
+        return false;
+    }
+
+    m_path = dir.absolutePath();
+    m_maxSize = maxSize;
+    // Segments are the unit of deletion, keep them small compared to the archive
+    m_segmentSize = qBound<qint64>(64 * 1024, maxSize / 8, 4 * 1024 * 1024);
+
+    // Leftovers of an interrupted rewrite
+    foreach (const QString &fileName, dir.entryList(QStringList() << "segment-*.nla.tmp", QDir::Files)) {
+        dir.remove(fileName);
+    }
+
+    QList<int> indexes;
+    foreach (const QString &fileName, dir.entryList(QStringList() << "segment-*.nla", QDir::Files)) {
+        bool ok = false;
+        int index = fileName.mid(8, fileName.length() - 12).toInt(&ok);
+        if (ok) {
+            indexes.append(index);
+        }
+    }
+    std::sort(indexes.begin(), indexes.end());
+
+    foreach (int index, indexes) {
+        Segment segment;
+        segment.index = index;
+        if (loadSegment(&segment)) {
+            m_segments.append(segment);
+        }
+    }
+
+    qCDebug(dcLogEngine()) << "Opened log archive" << m_path << "with" << count() << "entries in" << m_segments.count() << "segments," << size() << "bytes.";
+    enforceMaxSize();
+    return true;
+}
+
+/*! Closes the archive. */
+void LogArchive::close()
+{
+    m_path.clear();
+    m_segments.clear();
+}
+
+/*! Returns true if the archive has been opened successfully. */
+bool LogArchive::isOpen() const
+{
+    return !m_path.isEmpty();
+}
+
+/*! Appends the given \a records to the newest segment. Returns false if they could not be written. */
+bool LogArchive::append(const QList<Record> &records)
+{
+    if (!isOpen()) {
+        return false;
+    }
+    if (records.isEmpty()) {
+        return true;
+    }
+
+    QList<Record> sortedRecords = records;
+    std::sort(sortedRecords.begin(), sortedRecords.end(), recordLessThan);
+
+    if (m_segments.isEmpty() || m_segments.last().size >= m_segmentSize) {
+        Segment segment;
+        segment.index = m_segments.isEmpty() ? 1 : m_segments.last().index + 1;
+        m_segments.append(segment);
+    }
+
+    Segment &segment = m_segments.last();
+    if (!writeBlocks(segmentFileName(segment.index), sortedRecords, false, &segment)) {
+        if (segment.blocks.isEmpty()) {
+            QFile::remove(segmentFileName(segment.index));
+            m_segments.removeLast();
+        }
+        return false;
+    }
+
+    enforceMaxSize();
+    return true;
+}
+
+/*! Returns the newest archived records matching the given \a filter, sorted like the queries of the \l{LogDatabase}
+    (newest first). At most \a maxResults records are returned, -1 returns all of them. Limit and offset of the
+    \a filter are not applied.
+*/
+QList<LogArchive::Record> LogArchive::query(const LogFilter &filter, int maxResults) const
+{
+    QList<Record> results;
+    if (!isOpen() || maxResults == 0) {
+        return results;
+    }
+
+    qint64 now = QDateTime::currentDateTime().toTime_t();
+    QStringList values;
+    foreach (const QString &value, filter.values()) {
+        values.append(LogValueTool::serializeValue(value));
+    }
+
+    // Only decompress blocks whose time range can contain matching records, newest first
+    QList<QPair<int, int> > candidates;
+    for (int i = 0; i < m_segments.count(); i++) {
+        for (int j = 0; j < m_segments.at(i).blocks.count(); j++) {
+            const Block &block = m_segments.at(i).blocks.at(j);
+            if (filter.hasCursor() && block.minTimestamp > filter.cursorTimestamp()) {
+                continue;
+            }
+            bool inTime = filter.timeFilters().isEmpty();
+            for (int k = 0; k < filter.timeFilters().count() && !inTime; k++) {
+                const QPair<QDateTime, QDateTime> &timeFilter = filter.timeFilters().at(k);
+                qint64 start = timeFilter.first.isValid() ? timeFilter.first.toTime_t() : -1;
+                qint64 end = timeFilter.second.isValid() ? timeFilter.second.toTime_t() : -1;
+                if (start >= 0 && end < 0) {
+                    inTime = block.maxTimestamp >= start && block.minTimestamp <= now;
+                } else if (start < 0 && end >= 0) {
+                    inTime = block.minTimestamp < end || block.maxTimestamp > now;
+                } else if (start >= 0 && end >= 0) {
+                    inTime = block.maxTimestamp >= start && block.minTimestamp <= end;
+                }
+            }
+            if (inTime) {
+                candidates.append(qMakePair(i, j));
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](const QPair<int, int> &a, const QPair<int, int> &b) {
+        return m_segments.at(a.first).blocks.at(a.second).maxTimestamp > m_segments.at(b.first).blocks.at(b.second).maxTimestamp;
+    });
+
+    QHash<int, QFile *> files;
+    QHash<int, uchar *> maps;
+    for (int i = 0; i < candidates.count(); i++) {
+        const Segment &segment = m_segments.at(candidates.at(i).first);
+        const Block &block = segment.blocks.at(candidates.at(i).second);
+
+        // Remaining blocks only contain older records than the ones we have already
+        if (maxResults > 0 && results.count() >= maxResults && block.maxTimestamp < results.last().timestamp) {
+            break;
+        }
+
+        if (!maps.contains(segment.index)) {
+            QFile *file = new QFile(segmentFileName(segment.index));
+            files.insert(segment.index, file);
+            uchar *data = nullptr;
+            if (file->open(QFile::ReadOnly)) {
+                data = file->map(0, segment.size);
+            }
+            if (!data) {
+                qCWarning(dcLogEngine()) << "Could not map log archive segment" << file->fileName() << file->errorString();
+            }
+            maps.insert(segment.index, data);
+        }
+        uchar *data = maps.value(segment.index);
+        if (!data) {
+            continue;
+        }
+
+        QList<Record> records;
+        if (!readBlock(data, block, &records)) {
+            continue;
+        }
+        foreach (const Record &record, records) {
+            if (recordMatches(filter, record, values, now)) {
+                results.append(record);
+            }
+        }
+
+        if (maxResults > 0) {
+            std::sort(results.begin(), results.end(), recordGreaterThan);
+            while (results.count() > maxResults) {
+                results.removeLast();
+            }
+        }
+    }
+    qDeleteAll(files);
+
+    if (maxResults < 0) {
+        std::sort(results.begin(), results.end(), recordGreaterThan);
+    }
+    return results;
+}
+
+/*! Removes all records of the devices \a deviceIds and all records with one of the given \a typeIds. Segments
+    containing such records are rewritten. Returns the number of removed records.
+*/
+int LogArchive::remove(const QList<QUuid> &deviceIds, const QList<QUuid> &typeIds)
+{
+    int removed = 0;
+    for (int i = m_segments.count() - 1; i >= 0; i--) {
+        if (m_segments.at(i).blocks.isEmpty()) {
+            continue;
+        }
+        QString fileName = segmentFileName(m_segments.at(i).index);
+
+        // Check the dictionaries first, most segments won't be affected
+        bool affected = false;
+        QFile file(fileName);
+        uchar *data = file.open(QFile::ReadOnly) ? file.map(0, m_segments.at(i).size) : nullptr;
+        if (!data) {
+            qCWarning(dcLogEngine()) << "Could not map log archive segment" << fileName << file.errorString();
+            continue;
+        }
+        foreach (const Block &block, m_segments.at(i).blocks) {
+            QList<QUuid> blockDeviceIds;
+            QList<QUuid> blockTypeIds;
+            readDictionaries(data, block, &blockDeviceIds, &blockTypeIds);
+            foreach (const QUuid &deviceId, deviceIds) {
+                affected |= blockDeviceIds.contains(deviceId);
+            }
+            foreach (const QUuid &typeId, typeIds) {
+                affected |= blockTypeIds.contains(typeId);
+            }
+            if (affected) {
+                break;
+            }
+        }
+        file.unmap(data);
+        file.close();
+        if (!affected) {
+            continue;
+        }
+
+        QList<Record> records = readBlocks(m_segments.at(i));
+        QList<Record> remaining;
+        foreach (const Record &record, records) {
+            if (!deviceIds.contains(record.deviceId) && !typeIds.contains(record.typeId)) {
+                remaining.append(record);
+            }
+        }
+        removed += records.count() - remaining.count();
+
+        if (remaining.isEmpty()) {
+            QFile::remove(fileName);
+            m_segments.removeAt(i);
+            continue;
+        }
+
+        Segment segment;
+        segment.index = m_segments.at(i).index;
+        if (!writeBlocks(fileName + ".tmp", remaining, true, &segment)) {
+            QFile::remove(fileName + ".tmp");
+            continue;
+        }
+        QFile::remove(fileName);
+        QFile::rename(fileName + ".tmp", fileName);
+        m_segments[i] = segment;
+    }
+    return removed;
+}
+
+/*! Returns the ids of all devices with archived records. Only the dictionaries of the blocks are read. */
+QList<QUuid> LogArchive::deviceIds() const
+{
+    QList<QUuid> deviceIds;
+    foreach (const Segment &segment, m_segments) {
+        if (segment.blocks.isEmpty()) {
+            continue;
+        }
+        QFile file(segmentFileName(segment.index));
+        uchar *data = file.open(QFile::ReadOnly) ? file.map(0, segment.size) : nullptr;
+        if (!data) {
+            qCWarning(dcLogEngine()) << "Could not map log archive segment" << file.fileName() << file.errorString();
+            continue;
+        }
+        foreach (const Block &block, segment.blocks) {
+            QList<QUuid> blockDeviceIds;
+            QList<QUuid> blockTypeIds;
+            readDictionaries(data, block, &blockDeviceIds, &blockTypeIds);
+            foreach (const QUuid &deviceId, blockDeviceIds) {
+                if (!deviceIds.contains(deviceId)) {
+                    deviceIds.append(deviceId);
+                }
+            }
+        }
+        file.unmap(data);
+    }
+    return deviceIds;
+}
+
+/*! Deletes all segments of the archive. */
+void LogArchive::clear()
+{
+    foreach (const Segment &segment, m_segments) {
+        QFile::remove(segmentFileName(segment.index));
+    }
+    m_segments.clear();
+}
+
+/*! Returns the size of all segments of the archive in bytes. */
+qint64 LogArchive::size() const
+{
+    qint64 size = 0;
+    foreach (const Segment &segment, m_segments) {
+        size += segment.size;
+    }
+    return size;
+}
+
+/*! Returns the number of archived records. */
+int LogArchive::count() const
+{
+    int count = 0;
+    foreach (const Segment &segment, m_segments) {
+        foreach (const Block &block, segment.blocks) {
+            count += block.count;
+        }
+    }
+    return count;
+}
+
+QString LogArchive::segmentFileName(int index) const
+{
+    return QString("%1/segment-%2.nla").arg(m_path).arg(index, 8, 10, QChar('0'));
+}
+
+bool LogArchive::loadSegment(Segment *segment)
+{
+    QFile file(segmentFileName(segment->index));
+    if (!file.open(QFile::ReadWrite)) {
+        qCWarning(dcLogEngine()) << "Could not open log archive segment" << file.fileName() << file.errorString();
+        return false;
+    }
+
+    qint64 fileSize = file.size();
+    if (fileSize < segmentHeaderSize) {
+        // Created right before a crash, nothing has been written yet
+        file.remove();
+        return false;
+    }
+
+    uchar *data = file.map(0, fileSize);
+    if (!data || memcmp(data, segmentMagic, 4) != 0 || qFromBigEndian<quint32>(data + 4) != segmentVersion) {
+        qCWarning(dcLogEngine()) << "Ignoring invalid log archive segment" << file.fileName();
+        return false;
+    }
+
+    qint64 offset = segmentHeaderSize;
+    while (offset + blockHeaderSize <= fileSize) {
+        const uchar *header = data + offset;
+        Block block;
+        block.offset = offset;
+        block.size = qFromBigEndian<quint32>(header + 4);
+        block.count = qFromBigEndian<quint32>(header + 8);
+        block.minTimestamp = qFromBigEndian<qint64>(header + 16);
+        block.maxTimestamp = qFromBigEndian<qint64>(header + 24);
+        if (qFromBigEndian<quint32>(header) != blockMagic || offset + blockHeaderSize + block.size > fileSize) {
+            break;
+        }
+        segment->blocks.append(block);
+        offset += blockHeaderSize + block.size;
+    }
+
+    // Only the last block can be torn by a crash while appending
+    if (!segment->blocks.isEmpty()) {
+        const Block &last = segment->blocks.last();
+        const char *payload = reinterpret_cast<const char *>(data + last.offset + blockHeaderSize);
+        if (qChecksum(payload, last.size) != qFromBigEndian<quint32>(data + last.offset + 12)) {
+            offset = last.offset;
+            segment->blocks.removeLast();
+        }
+    }
+    file.unmap(data);
+
+    if (offset < fileSize) {
+        qCWarning(dcLogEngine()) << "Truncating incomplete log archive segment" << file.fileName() << "from" << fileSize << "to" << offset << "bytes";
+        file.resize(offset);
+    }
+    segment->size = offset;
+    return true;
+}
+
+bool LogArchive::writeBlocks(const QString &fileName, const QList<Record> &records, bool truncate, Segment *segment)
+{
+    QFile file(fileName);
+    if (!file.open(truncate ? (QFile::WriteOnly | QFile::Truncate) : (QFile::WriteOnly | QFile::Append))) {
+        qCWarning(dcLogEngine()) << "Could not open log archive segment" << fileName << "for writing:" << file.errorString();
+        return false;
+    }
+
+    // Don't append behind garbage which has been left over by a failed write
+    if (!truncate && file.size() != segment->size) {
+        file.resize(segment->size);
+        file.seek(segment->size);
+    }
+
+    if (file.size() == 0) {
+        QByteArray header(segmentMagic, 4);
+        header.resize(segmentHeaderSize);
+        qToBigEndian<quint32>(segmentVersion, reinterpret_cast<uchar *>(header.data() + 4));
+        if (file.write(header) != header.size()) {
+            qCWarning(dcLogEngine()) << "Error writing log archive segment" << fileName << file.errorString();
+            return false;
+        }
+        segment->size = segmentHeaderSize;
+    }
+
+    for (int i = 0; i < records.count(); i += maxBlockRecords) {
+        QList<Record> blockRecords = records.mid(i, maxBlockRecords);
+        QByteArray payload = encodeBlock(blockRecords);
+
+        Block block;
+        block.offset = segment->size;
+        block.size = payload.size();
+        block.count = blockRecords.count();
+        block.minTimestamp = blockRecords.first().timestamp;
+        block.maxTimestamp = blockRecords.last().timestamp;
+
+        QByteArray header(blockHeaderSize, 0);
+        uchar *headerData = reinterpret_cast<uchar *>(header.data());
+        qToBigEndian<quint32>(blockMagic, headerData);
+        qToBigEndian<quint32>(block.size, headerData + 4);
+        qToBigEndian<quint32>(block.count, headerData + 8);
+        qToBigEndian<quint32>(qChecksum(payload.constData(), payload.size()), headerData + 12);
+        qToBigEndian<qint64>(block.minTimestamp, headerData + 16);
+        qToBigEndian<qint64>(block.maxTimestamp, headerData + 24);
+
+        if (file.write(header) != header.size() || file.write(payload) != payload.size() || !file.flush()) {
+            qCWarning(dcLogEngine()) << "Error writing log archive segment" << fileName << file.errorString();
+            return false;
+        }
+        segment->blocks.append(block);
+        segment->size += blockHeaderSize + block.size;
+    }
+    return true;
+}
+
+QList<LogArchive::Record> LogArchive::readBlocks(const Segment &segment) const
+{
+    QList<Record> records;
+    if (segment.blocks.isEmpty()) {
+        return records;
+    }
+    QFile file(segmentFileName(segment.index));
+    uchar *data = nullptr;
+    if (file.open(QFile::ReadOnly)) {
+        data = file.map(0, segment.size);
+    }
+    if (!data) {
+        qCWarning(dcLogEngine()) << "Could not map log archive segment" << file.fileName() << file.errorString();
+        return records;
+    }
+    foreach (const Block &block, segment.blocks) {
+        readBlock(data, block, &records);
+    }
+    file.unmap(data);
+    return records;
+}
+
+bool LogArchive::readBlock(const uchar *data, const Block &block, QList<Record> *records)
+{
+    const char *payload = reinterpret_cast<const char *>(data + block.offset + blockHeaderSize);
+    if (qChecksum(payload, block.size) != qFromBigEndian<quint32>(data + block.offset + 12)) {
+        qCWarning(dcLogEngine()) << "Skipping corrupt log archive block at offset" << block.offset;
+        return false;
+    }
+    if (!decodeBlock(QByteArray::fromRawData(payload, block.size), block.count, records)) {
+        qCWarning(dcLogEngine()) << "Skipping undecodable log archive block at offset" << block.offset;
+        return false;
+    }
+    return true;
+}
+
+bool LogArchive::readDictionaries(const uchar *data, const Block &block, QList<QUuid> *deviceIds, QList<QUuid> *typeIds)
+{
+    QByteArray payload = QByteArray::fromRawData(reinterpret_cast<const char *>(data + block.offset + blockHeaderSize), block.size);
+    PayloadReader reader(payload);
+    *deviceIds = readDictionary(reader);
+    *typeIds = readDictionary(reader);
+    return reader.ok();
+}
+
+void LogArchive::enforceMaxSize()
+{
+    while (m_segments.count() > 1 && size() > m_maxSize) {
+        qCDebug(dcLogEngine()) << "Log archive exceeds" << m_maxSize << "bytes. Deleting" << m_segments.first().blocks.count() << "blocks.";
+        QFile::remove(segmentFileName(m_segments.first().index));
+        m_segments.removeFirst();
+    }
+}
+
+}
@@ -0,0 +1,99 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef LOGARCHIVE_H
+#define LOGARCHIVE_H
+
+#include "logfilter.h"
+
+#include <QList>
+#include <QString>
+#include <QUuid>
+
+namespace nymeaserver {
+
+class LogArchive
+{
+public:
+    // An archived row of the entries table, the value stays serialized
+    class Record {
+    public:
+        qint64 rowId = 0;
+        qint64 timestamp = 0;
+        QUuid typeId;
+        QUuid deviceId;
+        int source = 0;
+        int level = 0;
+        int eventType = 0;
+        bool active = false;
+        int errorCode = 0;
+        QString value;
+    };
+
+    LogArchive();
+    ~LogArchive();
+
+    bool open(const QString &path, qint64 maxSize);
+    void close();
+    bool isOpen() const;
+
+    bool append(const QList<Record> &records);
+    QList<Record> query(const LogFilter &filter, int maxResults) const;
+    int remove(const QList<QUuid> &deviceIds, const QList<QUuid> &typeIds);
+    QList<QUuid> deviceIds() const;
+    void clear();
+
+    qint64 size() const;
+    int count() const;
+
+private:
+    class Block {
+    public:
+        qint64 offset = 0;
+        quint32 size = 0;
+        quint32 count = 0;
+        qint64 minTimestamp = 0;
+        qint64 maxTimestamp = 0;
+    };
+
+    class Segment {
+    public:
+        int index = 0;
+        qint64 size = 0;
+        QList<Block> blocks;
+    };
+
+    QString segmentFileName(int index) const;
+    bool loadSegment(Segment *segment);
+    bool writeBlocks(const QString &fileName, const QList<Record> &records, bool truncate, Segment *segment);
+    QList<Record> readBlocks(const Segment &segment) const;
+    static bool readBlock(const uchar *data, const Block &block, QList<Record> *records);
+    static bool readDictionaries(const uchar *data, const Block &block, QList<QUuid> *deviceIds, QList<QUuid> *typeIds);
+    void enforceMaxSize();
+
+    QString m_path;
+    qint64 m_maxSize = 0;
+    qint64 m_segmentSize = 0;
+    QList<Segment> m_segments;
+};
+
+}
+
+#endif // LOGARCHIVE_H
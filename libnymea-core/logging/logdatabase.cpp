@@ -0,0 +1,1311 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class nymeaserver::LogDatabase
+    \brief The worker which owns the connection to the log database.
+
+    \ingroup logs
+    \inmodule core
+
+    The \l{LogDatabase} lives in the database thread of the \l{LogEngine}. All methods are meant to be invoked
+    through queued connections from the \l{LogEngine}, which makes sure the database connection is only ever
+    used from the thread that opened it.
+
+    Numeric state values are additionally summarized in rollup buckets of 5 minutes, 1 hour and 1 day while
+    they are written. Aggregate queries are answered from the coarsest rollup fitting the requested bucket size,
+    so long ranges only need to read a few hundred rows. Fine grained rollups are only kept for a limited time.
+
+    Old entries are removed by a retention pass which runs on an idle timer in the database thread. It enforces
+    the overall size limit, an optional maximum age and optional per source quotas by deleting small batches of
+    the oldest rows. Each pass stops once its time budget is used up and continues as soon as the thread is idle
+    again, so writes and queries never wait for a long running cleanup.
+
+    If an archive has been configured with \l{setArchive()}, the entries removed by the retention are moved into a
+    compressed \l{LogArchive} instead of being discarded. Queries transparently include archived entries.
+
+    \sa LogEngine
+*/
+
+#include "logdatabase.h"
+#include "loggingcategories.h"
+#include "logging.h"
+#include "logvaluetool.h"
+
+#include <QCoreApplication>
+#include <QSqlDriver>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QMetaEnum>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QTime>
+#include <QStringList>
+
+#define DB_SCHEMA_VERSION 5
+
+namespace nymeaserver {
+
+// Rollup bucket sizes in seconds and how long they are kept in seconds (-1 = forever)
+struct RollupResolution {
+    int resolution;
+    qint64 maxAge;
+};
+
+static const RollupResolution rollupResolutions[] = {
+    { 300, 14 * 24 * 3600 },
+    { 3600, 400 * 24 * 3600 },
+    { 86400, -1 }
+};
+static const int rollupResolutionCount = sizeof(rollupResolutions) / sizeof(RollupResolution);
+
+// Rows deleted at once by the retention and the interval for checking the maximum age
+static const int retentionBatchSize = 200;
+static const int retentionInterval = 60 * 60 * 1000;
+
+struct RollupBucket {
+    DeviceId deviceId;
+    QUuid typeId;
+    int resolution = 0;
+    LogAggregate aggregate;
+};
+
+static bool numericValue(const QVariant &value, double *number)
+{
+    switch (value.userType()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Float:
+    case QMetaType::Double:
+        *number = value.toDouble();
+        return true;
+    default:
+        return false;
+    }
+}
+
+static LogEntry archivedEntry(const LogArchive::Record &record)
+{
+    LogEntry entry(QDateTime::fromTime_t(record.timestamp),
+                   (Logging::LoggingLevel)record.level,
+                   (Logging::LoggingSource)record.source,
+                   record.errorCode);
+    entry.setTypeId(record.typeId);
+    entry.setDeviceId(DeviceId::fromUuid(record.deviceId));
+    entry.setValue(LogValueTool::convertVariantToString(LogValueTool::deserializeValue(record.value)));
+    entry.setEventType((Logging::LoggingEventType)record.eventType);
+    entry.setActive(record.active);
+    return entry;
+}
+
+static QByteArray rollupKey(const DeviceId &deviceId, const QUuid &typeId, int resolution)
+{
+    return deviceId.toRfc4122() + typeId.toRfc4122() + QByteArray::number(resolution);
+}
+
+/*! Constructs the \l{LogDatabase} with the given parameters. The database will not be opened before \l{open()} is called. */
+LogDatabase::LogDatabase(const QString &driver, const QString &dbName, const QString &hostname, const QString &username, const QString &password, int maxDBSize):
+    QObject(nullptr),
+    m_driver(driver),
+    m_dbName(dbName),
+    m_hostname(hostname),
+    m_username(username),
+    m_password(password),
+    m_dbMaxSize(maxDBSize)
+{
+    if (QCoreApplication::instance()->organizationName() == "nymea-test") {
+        m_dbMaxSize = 20;
+        qCDebug(dcLogEngine) << "Set logging dab max size to" << m_dbMaxSize << "for testing.";
+    }
+}
+
+/*! Opens the database connection in the calling thread. Broken databases will be backed up and recreated. */
+void LogDatabase::open()
+{
+    // Each instance gets its own connection, the connection is bound to the database thread
+    m_connectionName = QUuid::createUuid().toString();
+    m_db = QSqlDatabase::addDatabase(m_driver, m_connectionName);
+    m_db.setDatabaseName(m_dbName);
+    m_db.setHostName(m_hostname);
+
+    qCDebug(dcLogEngine) << "Opening logging database" << m_db.databaseName();
+
+    if (!m_db.isValid()) {
+        qCWarning(dcLogEngine) << "Database not valid:" << m_db.lastError().driverText() << m_db.lastError().databaseText();
+        rotate(m_db.databaseName());
+    }
+
+    if (!initDB()) {
+        qCWarning(dcLogEngine()) << "Error initializing database. Trying to correct it.";
+        if (QFileInfo(m_db.databaseName()).exists()) {
+            rotate(m_db.databaseName());
+            if (!initDB()) {
+                qCWarning(dcLogEngine()) << "Error fixing log database. Giving up. Logs can't be stored.";
+            }
+        }
+    }
+
+    countEntries();
+
+    m_retentionTimer = new QTimer(this);
+    m_retentionTimer->setSingleShot(true);
+    connect(m_retentionTimer, &QTimer::timeout, this, &LogDatabase::runRetention);
+    scheduleRetention();
+}
+
+/*! Closes the database connection. Must be called from the same thread as \l{open()}. */
+void LogDatabase::close()
+{
+    delete m_retentionTimer;
+    m_retentionTimer = nullptr;
+    m_archive.close();
+    m_insertQuery = QSqlQuery();
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+void LogDatabase::setMaxLogEntries(int maxLogEntries, int overflow)
+{
+    m_dbMaxSize = maxLogEntries;
+    m_overflow = overflow;
+    scheduleRetention();
+}
+
+/*! Limits the number of entries kept for the given logging \a source to \a maxEntries. The oldest entries of this
+    source will be removed first. A value of 0 disables the quota, the overall limit still applies.
+*/
+void LogDatabase::setMaxSourceEntries(int source, int maxEntries)
+{
+    if (maxEntries > 0) {
+        m_sourceLimits.insert(source, maxEntries);
+    } else {
+        m_sourceLimits.remove(source);
+    }
+    scheduleRetention();
+}
+
+/*! Removes entries older than \a maxAge days, 0 keeps entries regardless of their age. A single retention pass
+    will not run for longer than \a budget milliseconds at once.
+*/
+void LogDatabase::setRetentionPolicy(int maxAge, int budget)
+{
+    m_maxAge = qMax(0, maxAge);
+    m_retentionBudget = qMax(1, budget);
+    scheduleRetention();
+}
+
+/*! Moves entries removed by the retention into an archive in the directory \a path instead of discarding them.
+    Once the archive grows beyond \a maxSize megabytes, its oldest entries will be deleted. A \a maxSize of 0 closes
+    the archive, already archived entries are kept on disk but won't show up in queries any more.
+*/
+void LogDatabase::setArchive(const QString &path, int maxSize)
+{
+    if (maxSize <= 0) {
+        m_archive.close();
+        return;
+    }
+    if (!m_archive.open(path, static_cast<qint64>(maxSize) * 1024 * 1024)) {
+        qCWarning(dcLogEngine()) << "Could not open log archive" << path << ". Trimmed log entries will be discarded.";
+    }
+}
+
+/*! Writes the given \a entries to the database using a single transaction. Entries which can't be written
+    are dropped, the others will be retried.
+*/
+void LogDatabase::writeEntries(const QList<LogEntry> &entries)
+{
+    QList<LogEntry> pendingEntries = entries;
+    while (!pendingEntries.isEmpty()) {
+        if (!m_db.isOpen()) {
+            qCWarning(dcLogEngine()) << "Log database not open. Discarding" << pendingEntries.count() << "log entries.";
+            break;
+        }
+
+        bool transaction = pendingEntries.count() > 1 && m_db.transaction();
+
+        int written = 0;
+        while (written < pendingEntries.count()) {
+            const LogEntry &entry = pendingEntries.at(written);
+            m_insertQuery.bindValue(":timestamp", entry.timestamp().toTime_t());
+            m_insertQuery.bindValue(":loggingEventType", entry.eventType());
+            m_insertQuery.bindValue(":loggingLevel", entry.level());
+            m_insertQuery.bindValue(":sourceType", entry.source());
+            m_insertQuery.bindValue(":typeId", entry.typeId().toRfc4122());
+            m_insertQuery.bindValue(":deviceId", entry.deviceId().toRfc4122());
+            m_insertQuery.bindValue(":value", LogValueTool::serializeValue(entry.value()));
+            m_insertQuery.bindValue(":active", entry.active());
+            m_insertQuery.bindValue(":errorCode", entry.errorCode());
+
+            if (!m_insertQuery.exec()) {
+                qCWarning(dcLogEngine) << "Error writing log entry. Driver error:" << m_insertQuery.lastError().driverText() << "Database error:" << m_insertQuery.lastError().databaseText();
+                qCWarning(dcLogEngine) << entry;
+                break;
+            }
+
+            // SQLite hands out max(ROWID) + 1, which may already be taken by an archived entry once the newest
+            // rows have been archived. Move the row behind the archive, the following ones continue from there.
+            qint64 rowId = m_insertQuery.lastInsertId().toLongLong();
+            if (rowId <= m_lastArchivedRowId) {
+                m_db.exec(QString("UPDATE entries SET ROWID = %1 WHERE ROWID = %2;").arg(m_lastArchivedRowId + 1).arg(rowId));
+                if (m_db.lastError().isValid()) {
+                    qCWarning(dcLogEngine) << "Error moving log entry behind the archive. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+                    break;
+                }
+            }
+            written++;
+        }
+
+        if (written < pendingEntries.count()) {
+            // Drop the broken entry and retry the others
+            if (transaction) {
+                m_db.rollback();
+                pendingEntries.removeAt(written);
+            } else {
+                addEntryCounts(pendingEntries.mid(0, written));
+                updateRollups(pendingEntries.mid(0, written));
+                pendingEntries.erase(pendingEntries.begin(), pendingEntries.begin() + written + 1);
+            }
+            continue;
+        }
+
+        updateRollups(pendingEntries);
+
+        if (transaction && !m_db.commit()) {
+            qCWarning(dcLogEngine) << "Error committing log entries. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            m_db.rollback();
+            m_rollupCache.clear();
+            break;
+        }
+
+        addEntryCounts(pendingEntries);
+        break;
+    }
+    m_insertQuery.finish();
+
+    emit entriesProcessed(entries.count());
+
+    if (retentionDue()) {
+        scheduleRetention();
+    }
+}
+
+QList<LogEntry> LogDatabase::logEntries(const LogFilter &filter)
+{
+    return queryLogEntries(filter, nullptr);
+}
+
+void LogDatabase::fetchLogEntries(int fetchId, const LogFilter &filter)
+{
+    QString nextCursor;
+    QList<LogEntry> entries = queryLogEntries(filter, &nextCursor);
+    emit logEntriesFetched(fetchId, entries, nextCursor);
+}
+
+QList<LogEntry> LogDatabase::queryLogEntries(const LogFilter &filter, QString *nextCursor)
+{
+    QList<LogEntry> results;
+    QList<QPair<qint64, qint64> > keys;
+    QSqlQuery query(m_db);
+
+    // Archived entries are merged into the result, limit and offset can only be applied after merging
+    bool archived = m_archive.isOpen() && m_archive.count() > 0;
+    int maxResults = filter.limit() >= 0 ? filter.limit() + filter.offset() : -1;
+
+    QString limitString;
+    if (archived) {
+        if (maxResults >= 0) {
+            limitString.append(QString("LIMIT %1 ").arg(maxResults));
+        }
+    } else {
+        if (filter.limit() >= 0) {
+            limitString.append(QString("LIMIT %1 ").arg(filter.limit()));
+        }
+        if (filter.offset() > 0) {
+            limitString.append(QString("OFFSET %1").arg(QString::number(filter.offset())));
+        }
+    }
+
+    QString queryString;
+    if (filter.isEmpty()) {
+        queryString = QString("SELECT ROWID, * FROM entries ORDER BY timestamp DESC, ROWID DESC %1;").arg(limitString);
+    } else {
+        queryString = QString("SELECT ROWID, * FROM entries WHERE %1 ORDER BY timestamp DESC, ROWID DESC %2;").arg(filter.queryString()).arg(limitString);
+    }
+    qCDebug(dcLogEngine()) << "Preparing query:" << queryString;
+    query.prepare(queryString);
+
+    foreach (const QString &value, filter.values()) {
+        query.addBindValue(LogValueTool::serializeValue(value));
+        qCDebug(dcLogEngine()) << "Binding value to query:" << LogValueTool::serializeValue(value);
+    }
+
+    query.exec();
+
+    if (m_db.lastError().isValid()) {
+        qCWarning(dcLogEngine) << "Error fetching log entries. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return QList<LogEntry>();
+    }
+
+    while (query.next()) {
+        keys.append(qMakePair(query.value("timestamp").toLongLong(), query.value(0).toLongLong()));
+        LogEntry entry(
+                    QDateTime::fromTime_t(query.value("timestamp").toLongLong()),
+                    (Logging::LoggingLevel)query.value("loggingLevel").toInt(),
+                    (Logging::LoggingSource)query.value("sourceType").toInt(),
+                    query.value("errorCode").toInt());
+        entry.setTypeId(QUuid::fromRfc4122(query.value("typeId").toByteArray()));
+        entry.setDeviceId(DeviceId::fromUuid(QUuid::fromRfc4122(query.value("deviceId").toByteArray())));
+        entry.setValue(LogValueTool::convertVariantToString(LogValueTool::deserializeValue(query.value("value").toString())));
+        entry.setEventType((Logging::LoggingEventType)query.value("loggingEventType").toInt());
+        entry.setActive(query.value("active").toBool());
+        results.append(entry);
+    }
+//    qCDebug(dcLogEngine) << "Fetched" << results.count() << "entries for db query:" << query.executedQuery();
+
+    if (archived) {
+        // Archived entries keep their row ids, so both sources sort and page the same way
+        QList<LogArchive::Record> records = m_archive.query(filter, maxResults);
+        QList<LogEntry> mergedResults;
+        QList<QPair<qint64, qint64> > mergedKeys;
+        int i = 0;
+        int j = 0;
+        while (i < results.count() || j < records.count()) {
+            if (j >= records.count() || (i < results.count() && keys.at(i) > qMakePair(records.at(j).timestamp, records.at(j).rowId))) {
+                mergedResults.append(results.at(i));
+                mergedKeys.append(keys.at(i));
+                i++;
+            } else {
+                mergedResults.append(archivedEntry(records.at(j)));
+                mergedKeys.append(qMakePair(records.at(j).timestamp, records.at(j).rowId));
+                j++;
+            }
+        }
+        results = mergedResults.mid(filter.offset(), filter.limit());
+        keys = mergedKeys.mid(filter.offset(), filter.limit());
+    }
+
+    // A full page means there might be more entries
+    if (nextCursor && filter.limit() > 0 && results.count() == filter.limit()) {
+        *nextCursor = LogFilter::createCursor(keys.last().first, keys.last().second);
+    }
+
+    return results;
+}
+
+/*! Aggregates the numeric values of the state \a typeId of the device \a deviceId between \a startDate and \a endDate
+    into buckets of \a bucketSize seconds. Buckets are aligned to multiples of \a bucketSize since the epoch (UTC), buckets
+    without values are omitted. The result is emitted with \l{aggregatesFetched()} using the given \a fetchId.
+*/
+void LogDatabase::fetchAggregates(int fetchId, const DeviceId &deviceId, const QUuid &typeId, const QDateTime &startDate, const QDateTime &endDate, int bucketSize)
+{
+    qint64 start = startDate.toTime_t();
+    start -= start % bucketSize;
+    qint64 end = endDate.toTime_t();
+    end = end - end % bucketSize + bucketSize;
+
+    // Use the coarsest rollup which fits into the requested buckets and is still kept for the requested range
+    qint64 now = QDateTime::currentDateTime().toTime_t();
+    int resolution = 0;
+    for (int i = 0; i < rollupResolutionCount; i++) {
+        if (bucketSize % rollupResolutions[i].resolution != 0)
+            continue;
+
+        if (rollupResolutions[i].maxAge != -1 && start < now - rollupResolutions[i].maxAge)
+            continue;
+
+        resolution = rollupResolutions[i].resolution;
+    }
+
+    QList<LogAggregate> aggregates;
+    if (resolution > 0) {
+        aggregates = aggregateRollups(deviceId, typeId, resolution, start, end, bucketSize);
+    } else {
+        aggregates = aggregateEntries(deviceId, typeId, start, end, bucketSize);
+    }
+    emit aggregatesFetched(fetchId, aggregates);
+}
+
+QList<LogAggregate> LogDatabase::aggregateRollups(const DeviceId &deviceId, const QUuid &typeId, int resolution, qint64 start, qint64 end, int bucketSize)
+{
+    QList<LogAggregate> aggregates;
+
+    QSqlQuery query(m_db);
+    query.prepare("SELECT bucket, minimum, maximum, sum, count, last, lastTimestamp FROM rollups "
+                  "WHERE deviceId = ? AND typeId = ? AND resolution = ? AND bucket >= ? AND bucket < ? ORDER BY bucket ASC;");
+    query.addBindValue(deviceId.toRfc4122());
+    query.addBindValue(typeId.toRfc4122());
+    query.addBindValue(resolution);
+    query.addBindValue(start);
+    query.addBindValue(end);
+    if (!query.exec()) {
+        qCWarning(dcLogEngine) << "Error fetching log rollups. Driver error:" << query.lastError().driverText() << "Database error:" << query.lastError().databaseText();
+        return aggregates;
+    }
+
+    while (query.next()) {
+        qint64 rollupBucket = query.value("bucket").toLongLong();
+        QDateTime bucket = QDateTime::fromTime_t(rollupBucket - rollupBucket % bucketSize);
+        if (aggregates.isEmpty() || aggregates.last().timestamp() != bucket) {
+            aggregates.append(LogAggregate(bucket));
+        }
+        aggregates.last().merge(LogAggregate::fromValues(QDateTime::fromTime_t(rollupBucket),
+                                                         query.value("minimum").toDouble(),
+                                                         query.value("maximum").toDouble(),
+                                                         query.value("sum").toDouble(),
+                                                         query.value("count").toInt(),
+                                                         query.value("last").toDouble(),
+                                                         QDateTime::fromTime_t(query.value("lastTimestamp").toLongLong())));
+    }
+    return aggregates;
+}
+
+QList<LogAggregate> LogDatabase::aggregateEntries(const DeviceId &deviceId, const QUuid &typeId, qint64 start, qint64 end, int bucketSize)
+{
+    QList<LogAggregate> aggregates;
+
+    QSqlQuery query(m_db);
+    query.prepare("SELECT timestamp, value FROM entries "
+                  "WHERE deviceId = ? AND typeId = ? AND sourceType = ? AND timestamp >= ? AND timestamp < ? ORDER BY timestamp ASC;");
+    query.addBindValue(deviceId.toRfc4122());
+    query.addBindValue(typeId.toRfc4122());
+    query.addBindValue(Logging::LoggingSourceStates);
+    query.addBindValue(start);
+    query.addBindValue(end);
+    if (!query.exec()) {
+        qCWarning(dcLogEngine) << "Error fetching log entries for aggregation. Driver error:" << query.lastError().driverText() << "Database error:" << query.lastError().databaseText();
+        return aggregates;
+    }
+
+    while (query.next()) {
+        double value = 0;
+        if (!numericValue(LogValueTool::deserializeValue(query.value("value").toString()), &value))
+            continue;
+
+        qint64 timestamp = query.value("timestamp").toLongLong();
+        QDateTime bucket = QDateTime::fromTime_t(timestamp - timestamp % bucketSize);
+        if (aggregates.isEmpty() || aggregates.last().timestamp() != bucket) {
+            aggregates.append(LogAggregate(bucket));
+        }
+        aggregates.last().addValue(QDateTime::fromTime_t(timestamp), value);
+    }
+    return aggregates;
+}
+
+void LogDatabase::updateRollups(const QList<LogEntry> &entries)
+{
+    // Collect all touched buckets first so each of them gets written only once per batch
+    QHash<QByteArray, RollupBucket> buckets;
+    QSqlQuery selectQuery(m_db);
+    bool selectPrepared = false;
+
+    foreach (const LogEntry &entry, entries) {
+        double value = 0;
+        if (entry.source() != Logging::LoggingSourceStates || !numericValue(entry.value(), &value))
+            continue;
+
+        qint64 timestamp = entry.timestamp().toTime_t();
+        for (int i = 0; i < rollupResolutionCount; i++) {
+            int resolution = rollupResolutions[i].resolution;
+            QDateTime bucketStart = QDateTime::fromTime_t(timestamp - timestamp % resolution);
+            QByteArray seriesKey = rollupKey(entry.deviceId(), entry.typeId(), resolution);
+            QByteArray bucketKey = seriesKey + ':' + QByteArray::number(bucketStart.toTime_t());
+
+            if (!buckets.contains(bucketKey)) {
+                RollupBucket rollup;
+                rollup.deviceId = entry.deviceId();
+                rollup.typeId = entry.typeId();
+                rollup.resolution = resolution;
+                rollup.aggregate = m_rollupCache.value(seriesKey);
+                if (rollup.aggregate.timestamp() != bucketStart) {
+                    // Not the current bucket of this state, continue with what is in the database
+                    rollup.aggregate = LogAggregate(bucketStart);
+                    if (!selectPrepared) {
+                        selectQuery.prepare("SELECT minimum, maximum, sum, count, last, lastTimestamp FROM rollups "
+                                            "WHERE deviceId = ? AND typeId = ? AND resolution = ? AND bucket = ?;");
+                        selectPrepared = true;
+                    }
+                    selectQuery.addBindValue(entry.deviceId().toRfc4122());
+                    selectQuery.addBindValue(entry.typeId().toRfc4122());
+                    selectQuery.addBindValue(resolution);
+                    selectQuery.addBindValue(bucketStart.toTime_t());
+                    if (selectQuery.exec() && selectQuery.next()) {
+                        rollup.aggregate = LogAggregate::fromValues(bucketStart,
+                                                                    selectQuery.value("minimum").toDouble(),
+                                                                    selectQuery.value("maximum").toDouble(),
+                                                                    selectQuery.value("sum").toDouble(),
+                                                                    selectQuery.value("count").toInt(),
+                                                                    selectQuery.value("last").toDouble(),
+                                                                    QDateTime::fromTime_t(selectQuery.value("lastTimestamp").toLongLong()));
+                    }
+                    selectQuery.finish();
+                }
+                buckets.insert(bucketKey, rollup);
+            }
+            buckets[bucketKey].aggregate.addValue(entry.timestamp(), value);
+        }
+    }
+
+    if (buckets.isEmpty())
+        return;
+
+    QSqlQuery insertQuery(m_db);
+    insertQuery.prepare("INSERT OR REPLACE INTO rollups (deviceId, typeId, resolution, bucket, minimum, maximum, sum, count, last, lastTimestamp) "
+                        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);");
+    foreach (const RollupBucket &rollup, buckets) {
+        insertQuery.addBindValue(rollup.deviceId.toRfc4122());
+        insertQuery.addBindValue(rollup.typeId.toRfc4122());
+        insertQuery.addBindValue(rollup.resolution);
+        insertQuery.addBindValue(rollup.aggregate.timestamp().toTime_t());
+        insertQuery.addBindValue(rollup.aggregate.minimum());
+        insertQuery.addBindValue(rollup.aggregate.maximum());
+        insertQuery.addBindValue(rollup.aggregate.sum());
+        insertQuery.addBindValue(rollup.aggregate.count());
+        insertQuery.addBindValue(rollup.aggregate.last());
+        insertQuery.addBindValue(rollup.aggregate.lastTimestamp().toTime_t());
+        if (!insertQuery.exec()) {
+            qCWarning(dcLogEngine) << "Error writing log rollups. Driver error:" << insertQuery.lastError().driverText() << "Database error:" << insertQuery.lastError().databaseText();
+            m_rollupCache.clear();
+            return;
+        }
+
+        QByteArray seriesKey = rollupKey(rollup.deviceId, rollup.typeId, rollup.resolution);
+        if (!m_rollupCache.contains(seriesKey) || m_rollupCache.value(seriesKey).timestamp() <= rollup.aggregate.timestamp()) {
+            m_rollupCache.insert(seriesKey, rollup.aggregate);
+        }
+    }
+}
+
+void LogDatabase::trimRollups()
+{
+    qint64 now = QDateTime::currentDateTime().toTime_t();
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM rollups WHERE resolution = ? AND bucket < ?;");
+    for (int i = 0; i < rollupResolutionCount; i++) {
+        if (rollupResolutions[i].maxAge == -1)
+            continue;
+
+        query.addBindValue(rollupResolutions[i].resolution);
+        query.addBindValue(now - rollupResolutions[i].maxAge);
+        if (!query.exec()) {
+            qCWarning(dcLogEngine) << "Error deleting old log rollups. Driver error:" << query.lastError().driverText() << "Database error:" << query.lastError().databaseText();
+        }
+    }
+}
+
+void LogDatabase::clearDatabase()
+{
+    qCWarning(dcLogEngine) << "Clear logging database.";
+
+    QString queryDeleteString = QString("DELETE FROM entries;");
+    if (m_db.exec(queryDeleteString).lastError().type() != QSqlError::NoError) {
+        qCWarning(dcLogEngine) << "Could not clear logging database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+    }
+    if (m_db.exec("DELETE FROM rollups;").lastError().type() != QSqlError::NoError) {
+        qCWarning(dcLogEngine) << "Could not clear logging rollups. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+    }
+    m_rollupCache.clear();
+    m_entryCount = 0;
+    m_sourceCounts.clear();
+    m_archive.clear();
+
+    emit logDatabaseUpdated();
+}
+
+void LogDatabase::removeDeviceLogs(const DeviceId &deviceId)
+{
+    removeDeviceEntries(deviceId);
+    m_archive.remove(QList<QUuid>() << deviceId, QList<QUuid>());
+}
+
+void LogDatabase::removeDeviceEntries(const DeviceId &deviceId)
+{
+    qCDebug(dcLogEngine) << "Deleting log entries from device" << deviceId.toString();
+
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM entries WHERE deviceId = ?;");
+    query.addBindValue(deviceId.toRfc4122());
+    if (!query.exec()) {
+        qCWarning(dcLogEngine) << "Error deleting log entries from device" << deviceId.toString() << ". Driver error:" << query.lastError().driverText() << "Database error:" << query.lastError().databaseText();
+    } else {
+        countEntries();
+        emit logDatabaseUpdated();
+    }
+
+    QSqlQuery rollupQuery(m_db);
+    rollupQuery.prepare("DELETE FROM rollups WHERE deviceId = ?;");
+    rollupQuery.addBindValue(deviceId.toRfc4122());
+    if (!rollupQuery.exec()) {
+        qCWarning(dcLogEngine) << "Error deleting log rollups from device" << deviceId.toString() << ". Driver error:" << rollupQuery.lastError().driverText() << "Database error:" << rollupQuery.lastError().databaseText();
+    }
+    m_rollupCache.clear();
+}
+
+void LogDatabase::removeRuleLogs(const RuleId &ruleId)
+{
+    qCDebug(dcLogEngine) << "Deleting log entries from rule" << ruleId.toString();
+
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM entries WHERE typeId = ?;");
+    query.addBindValue(ruleId.toRfc4122());
+    if (!query.exec()) {
+        qCWarning(dcLogEngine) << "Error deleting log entries from rule" << ruleId.toString() << ". Driver error:" << query.lastError().driverText() << "Database error:" << query.lastError().databaseText();
+    } else {
+        countEntries();
+        emit logDatabaseUpdated();
+    }
+    m_archive.remove(QList<QUuid>(), QList<QUuid>() << ruleId);
+}
+
+void LogDatabase::removeStaleDeviceLogs(const QList<DeviceId> &configuredDeviceIds)
+{
+    foreach (const DeviceId &deviceId, devicesInLogs()) {
+        if (!configuredDeviceIds.contains(deviceId)) {
+            qCDebug(dcLogEngine()) << "Cleaning stale device entries from log DB for device id" << deviceId;
+            removeDeviceEntries(deviceId);
+        }
+    }
+
+    // Rewriting the archive is expensive, do it once for all devices
+    QList<QUuid> staleDeviceIds;
+    foreach (const QUuid &deviceId, m_archive.deviceIds()) {
+        if (!deviceId.isNull() && !configuredDeviceIds.contains(DeviceId::fromUuid(deviceId))) {
+            staleDeviceIds.append(deviceId);
+        }
+    }
+    if (!staleDeviceIds.isEmpty()) {
+        qCDebug(dcLogEngine()) << "Cleaning stale device entries of" << staleDeviceIds.count() << "devices from the log archive";
+        m_archive.remove(staleDeviceIds, QList<QUuid>());
+    }
+}
+
+QList<DeviceId> LogDatabase::devicesInLogs()
+{
+    // Covered by the deviceId index, no need to touch the table itself
+    QSqlQuery result(m_db);
+    result.prepare("SELECT DISTINCT deviceId FROM entries WHERE deviceId != ?;");
+    result.addBindValue(QUuid().toRfc4122());
+    QList<DeviceId> ret;
+    if (!result.exec()) {
+        qCWarning(dcLogEngine()) << "Error fetching device entries from log database:" << result.lastError().driverText() << result.lastError().databaseText();
+        return ret;
+    }
+    if (!result.first()) {
+        return ret;
+    }
+    do {
+        ret.append(DeviceId::fromUuid(QUuid::fromRfc4122(result.value("deviceId").toByteArray())));
+    } while (result.next());
+    return ret;
+}
+
+void LogDatabase::countEntries()
+{
+    // Covered by the sourceType index, only needed on startup and after removing entries selectively
+    QSqlQuery result = m_db.exec("SELECT sourceType, COUNT(*) FROM entries GROUP BY sourceType;");
+    if (m_db.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcLogEngine()) << "Failed to query entry count in db:" << m_db.lastError().databaseText();
+        return;
+    }
+
+    m_entryCount = 0;
+    m_sourceCounts.clear();
+    while (result.next()) {
+        m_sourceCounts.insert(result.value(0).toInt(), result.value(1).toInt());
+        m_entryCount += result.value(1).toInt();
+    }
+}
+
+void LogDatabase::addEntryCounts(const QList<LogEntry> &entries)
+{
+    foreach (const LogEntry &entry, entries) {
+        m_sourceCounts[entry.source()]++;
+    }
+    m_entryCount += entries.count();
+}
+
+bool LogDatabase::retentionDue() const
+{
+    // Allow some overflow so the retention doesn't kick in for each written batch
+    if (m_dbMaxSize != -1 && m_entryCount > m_dbMaxSize + m_overflow) {
+        return true;
+    }
+    foreach (int source, m_sourceLimits.keys()) {
+        if (m_sourceCounts.value(source) > m_sourceLimits.value(source) + m_overflow) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LogDatabase::scheduleRetention()
+{
+    if (!m_retentionTimer) {
+        return;
+    }
+    m_retentionTimer->start(0);
+}
+
+void LogDatabase::runRetention()
+{
+    QElapsedTimer budgetTimer;
+    budgetTimer.start();
+
+    // Rollups outlive the raw entries, they are only limited by their age
+    if (!m_rollupTrimTimer.isValid() || m_rollupTrimTimer.hasExpired(retentionInterval)) {
+        trimRollups();
+        m_rollupTrimTimer.start();
+    }
+
+    int deleted = 0;
+    bool done = false;
+    while (!done && !budgetTimer.hasExpired(m_retentionBudget)) {
+        int batch = trimBatch();
+        deleted += batch;
+        done = batch == 0;
+    }
+
+    if (deleted > 0) {
+        qCDebug(dcLogEngine()) << "Retention removed" << deleted << "log entries in" << budgetTimer.elapsed() << "ms." << (done ? "Done." : "Continuing when idle.");
+        emit logDatabaseUpdated();
+    }
+
+    // Continue as soon as the queued writes and queries have been processed, otherwise check the age again later
+    m_retentionTimer->start(done ? retentionInterval : 0);
+}
+
+int LogDatabase::trimBatch()
+{
+    if (m_maxAge > 0) {
+        qint64 cutoff = QDateTime::currentDateTime().addDays(-m_maxAge).toTime_t();
+        int deleted = deleteEntries("WHERE timestamp < ? ORDER BY timestamp ASC LIMIT ?",
+                                    QVariantList() << cutoff << retentionBatchSize);
+        if (deleted > 0) {
+            return deleted;
+        }
+    }
+
+    foreach (int source, m_sourceLimits.keys()) {
+        int excess = m_sourceCounts.value(source) - m_sourceLimits.value(source);
+        if (excess <= 0) {
+            continue;
+        }
+        int deleted = deleteEntries("WHERE sourceType = ? ORDER BY timestamp ASC LIMIT ?",
+                                    QVariantList() << source << qMin(excess, retentionBatchSize));
+        if (deleted > 0) {
+            return deleted;
+        }
+        // The counters are off, nothing left to delete for this source
+        countEntries();
+    }
+
+    if (m_dbMaxSize != -1 && m_entryCount > m_dbMaxSize) {
+        // The rowid follows the insertion order, walking it from the start doesn't need to sort anything
+        int deleted = deleteEntries("ORDER BY ROWID ASC LIMIT ?",
+                                    QVariantList() << qMin(m_entryCount - m_dbMaxSize, retentionBatchSize));
+        if (deleted == 0) {
+            countEntries();
+        }
+        return deleted;
+    }
+
+    return 0;
+}
+
+int LogDatabase::deleteEntries(const QString &selection, const QVariantList &bindValues)
+{
+    // The whole rows are only needed for archiving them
+    QSqlQuery query(m_db);
+    query.prepare(QString("SELECT ROWID, %1 FROM entries %2;").arg(m_archive.isOpen() ? "*" : "sourceType").arg(selection));
+    foreach (const QVariant &value, bindValues) {
+        query.addBindValue(value);
+    }
+    if (!query.exec()) {
+        qCWarning(dcLogEngine) << "Error selecting log entries for removal. Driver error:" << query.lastError().driverText() << "Database error:" << query.lastError().databaseText();
+        return 0;
+    }
+
+    QStringList rowIds;
+    QHash<int, int> removedPerSource;
+    QList<LogArchive::Record> records;
+    while (query.next()) {
+        rowIds.append(query.value(0).toString());
+        removedPerSource[query.value("sourceType").toInt()]++;
+        if (m_archive.isOpen()) {
+            LogArchive::Record record;
+            record.rowId = query.value(0).toLongLong();
+            record.timestamp = query.value("timestamp").toLongLong();
+            record.typeId = QUuid::fromRfc4122(query.value("typeId").toByteArray());
+            record.deviceId = QUuid::fromRfc4122(query.value("deviceId").toByteArray());
+            record.source = query.value("sourceType").toInt();
+            record.level = query.value("loggingLevel").toInt();
+            record.eventType = query.value("loggingEventType").toInt();
+            record.active = query.value("active").toBool();
+            record.errorCode = query.value("errorCode").toInt();
+            record.value = query.value("value").toString();
+            records.append(record);
+        }
+    }
+    query.finish();
+
+    if (rowIds.isEmpty()) {
+        return 0;
+    }
+
+    // Archive first, a crash in between leaves duplicates rather than holes
+    if (!records.isEmpty()) {
+        if (!m_archive.append(records)) {
+            qCWarning(dcLogEngine()) << "Could not archive" << records.count() << "log entries. Discarding them.";
+        } else {
+            qint64 lastRowId = m_lastArchivedRowId;
+            foreach (const LogArchive::Record &record, records) {
+                lastRowId = qMax(lastRowId, record.rowId);
+            }
+            if (lastRowId > m_lastArchivedRowId) {
+                m_lastArchivedRowId = lastRowId;
+                m_db.exec(QString("UPDATE metadata SET data = '%1' WHERE `key` = 'lastRowId';").arg(m_lastArchivedRowId));
+            }
+        }
+    }
+
+    m_db.exec(QString("DELETE FROM entries WHERE ROWID IN (%1);").arg(rowIds.join(',')));
+    if (m_db.lastError().isValid()) {
+        qCWarning(dcLogEngine) << "Error deleting old log entries. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return 0;
+    }
+
+    foreach (int source, removedPerSource.keys()) {
+        m_sourceCounts[source] -= removedPerSource.value(source);
+    }
+    m_entryCount -= rowIds.count();
+    return rowIds.count();
+}
+
+void LogDatabase::rotate(const QString &dbName)
+{
+    int index = 1;
+    while (QFileInfo(QString("%1.%2").arg(dbName).arg(index)).exists()) {
+        index++;
+    }
+    qCDebug(dcLogEngine()) << "Backing up old database file to" << QString("%1.%2").arg(dbName).arg(index);
+    QFile f(dbName);
+    if (!f.rename(QString("%1.%2").arg(dbName).arg(index))) {
+        qCWarning(dcLogEngine()) << "Error backing up old database.";
+    } else {
+        qCDebug(dcLogEngine()) << "Successfully moved old database";
+    }
+}
+
+bool LogDatabase::migrateDatabaseVersion2to3()
+{
+    // Changelog: serialize values of logentries in order to prevent typecast errors
+    qCDebug(dcLogEngine()) << "Start migration of log database from version 2 to version 3";
+
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    int migrationCounter = 0;
+    int migrationProgress = 0;
+    int entryCount = 0;
+
+    // Count entries we have to migrate
+    QString queryString = "SELECT COUNT(*) FROM entries WHERE value != '';";
+    QSqlQuery countQuery = m_db.exec(queryString);
+    if (m_db.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcLogEngine()) << "Failed to query entry count in db:" << m_db.lastError().databaseText();
+        return false;
+    }
+    if (!countQuery.first()) {
+        qCWarning(dcLogEngine()) << "Migration: Failed retrieving entry count.";
+        return false;
+    }
+    entryCount = countQuery.value(0).toInt();
+
+    qCDebug(dcLogEngine()) << "Found" << entryCount << "entries to migrate.";
+
+    // Select all entries
+    QSqlQuery selectQuery = m_db.exec("SELECT * FROM entries;");
+    if (m_db.lastError().isValid()) {
+        qCWarning(dcLogEngine) << "Error migrating database verion 2 -> 3. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return false;
+    }
+
+    // Migrate all selected entries
+    while (selectQuery.next()) {
+        QString oldValue = selectQuery.value("value").toString();
+        QString newValue = LogValueTool::serializeValue(QVariant(oldValue));
+        if (oldValue.isEmpty())
+            continue;
+
+        QString updateCall = QString("UPDATE entries SET value = '%1' WHERE timestamp = '%2' AND loggingLevel = '%3' AND sourceType = '%4' AND errorCode = '%5' AND typeId = '%6' AND deviceId = '%7' AND value = '%8' AND loggingEventType = '%9'AND active = '%10';")
+                .arg(newValue)
+                .arg(selectQuery.value("timestamp").toLongLong())
+                .arg(selectQuery.value("loggingLevel").toInt())
+                .arg(selectQuery.value("sourceType").toInt())
+                .arg(selectQuery.value("errorCode").toInt())
+                .arg(selectQuery.value("typeId").toUuid().toString())
+                .arg(selectQuery.value("deviceId").toString())
+                .arg(selectQuery.value("value").toString())
+                .arg(selectQuery.value("loggingEventType").toInt())
+                .arg(selectQuery.value("active").toBool());
+
+        m_db.exec(updateCall);
+        if (m_db.lastError().isValid()) {
+            qCWarning(dcLogEngine) << "Error migrating database verion 2 -> 3. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            return false;
+        }
+
+        migrationCounter++;
+
+        double percentage = migrationCounter * 100.0 / entryCount;
+        if (qRound(percentage) != migrationProgress) {
+            migrationProgress = qRound(percentage);
+            qCDebug(dcLogEngine()) << QString("Migration progress: %1\%").arg(migrationProgress).toLatin1().data();
+        }
+    }
+
+    QTime runTime = QTime(0,0,0,0).addMSecs(startTime.msecsTo(QDateTime::currentDateTime()));
+    qCDebug(dcLogEngine()) << "Migration of" << migrationCounter << "done in" << runTime.toString("mm:ss.zzz");
+    qCDebug(dcLogEngine()) << "Updating database version to" << 3;
+    m_db.exec("UPDATE metadata SET data = 3 WHERE key = 'version';");
+    if (m_db.lastError().isValid()) {
+        qCWarning(dcLogEngine) << "Error updating database verion 2 -> 3. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return false;
+    }
+
+    qCDebug(dcLogEngine()) << "Migrated" << migrationCounter << "entries from database verion 2 -> 3 successfully.";
+    return true;
+}
+
+bool LogDatabase::migrateDatabaseVersion3to4()
+{
+    // Changelog: store typeId and deviceId as 16 byte blobs instead of strings and add indexes
+    qCDebug(dcLogEngine()) << "Start migration of log database from version 3 to version 4";
+
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    int migrationCounter = 0;
+
+    if (!m_db.transaction()) {
+        qCWarning(dcLogEngine) << "Error migrating database verion 3 -> 4. Could not start transaction:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return false;
+    }
+
+    if (m_db.tables().contains("entries")) {
+        m_db.exec("ALTER TABLE entries RENAME TO entriesV3;");
+        if (m_db.lastError().isValid() || !createEntriesTable()) {
+            qCWarning(dcLogEngine) << "Error migrating database verion 3 -> 4. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            m_db.rollback();
+            return false;
+        }
+
+        QSqlQuery selectQuery = m_db.exec("SELECT * FROM entriesV3;");
+        QSqlQuery insertQuery(m_db);
+        insertQuery.prepare("INSERT INTO entries (timestamp, loggingLevel, sourceType, typeId, deviceId, value, loggingEventType, active, errorCode) "
+                            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);");
+        while (selectQuery.next()) {
+            insertQuery.addBindValue(selectQuery.value("timestamp").toLongLong());
+            insertQuery.addBindValue(selectQuery.value("loggingLevel").toInt());
+            insertQuery.addBindValue(selectQuery.value("sourceType").toInt());
+            insertQuery.addBindValue(QUuid(selectQuery.value("typeId").toString()).toRfc4122());
+            insertQuery.addBindValue(QUuid(selectQuery.value("deviceId").toString()).toRfc4122());
+            insertQuery.addBindValue(selectQuery.value("value").toString());
+            insertQuery.addBindValue(selectQuery.value("loggingEventType").toInt());
+            insertQuery.addBindValue(selectQuery.value("active").toBool());
+            insertQuery.addBindValue(selectQuery.value("errorCode").toInt());
+            if (!insertQuery.exec()) {
+                qCWarning(dcLogEngine) << "Error migrating database verion 3 -> 4. Driver error:" << insertQuery.lastError().driverText() << "Database error:" << insertQuery.lastError().databaseText();
+                m_db.rollback();
+                return false;
+            }
+            migrationCounter++;
+        }
+        selectQuery.finish();
+
+        m_db.exec("DROP TABLE entriesV3;");
+        // Creating the indexes after copying is a lot faster than updating them for each row
+        if (m_db.lastError().isValid() || !createEntriesIndexes()) {
+            qCWarning(dcLogEngine) << "Error migrating database verion 3 -> 4. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            m_db.rollback();
+            return false;
+        }
+    }
+
+    m_db.exec("UPDATE metadata SET data = 4 WHERE key = 'version';");
+    if (m_db.lastError().isValid() || !m_db.commit()) {
+        qCWarning(dcLogEngine) << "Error updating database verion 3 -> 4. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        m_db.rollback();
+        return false;
+    }
+
+    QTime runTime = QTime(0,0,0,0).addMSecs(startTime.msecsTo(QDateTime::currentDateTime()));
+    qCDebug(dcLogEngine()) << "Migrated" << migrationCounter << "entries from database verion 3 -> 4 successfully in" << runTime.toString("mm:ss.zzz");
+    return true;
+}
+
+bool LogDatabase::migrateDatabaseVersion4to5()
+{
+    // Changelog: add rollups of numeric state values
+    qCDebug(dcLogEngine()) << "Start migration of log database from version 4 to version 5";
+
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    int migrationCounter = 0;
+
+    if (!m_db.transaction()) {
+        qCWarning(dcLogEngine) << "Error migrating database verion 4 -> 5. Could not start transaction:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return false;
+    }
+
+    if (!createRollupsTable()) {
+        qCWarning(dcLogEngine) << "Error migrating database verion 4 -> 5. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        m_db.rollback();
+        return false;
+    }
+
+    // Build the rollups for the existing state entries
+    if (m_db.tables().contains("entries")) {
+        QSqlQuery selectQuery(m_db);
+        selectQuery.prepare("SELECT timestamp, typeId, deviceId, value FROM entries WHERE sourceType = ? ORDER BY timestamp ASC;");
+        selectQuery.addBindValue(Logging::LoggingSourceStates);
+        if (!selectQuery.exec()) {
+            qCWarning(dcLogEngine) << "Error migrating database verion 4 -> 5. Driver error:" << selectQuery.lastError().driverText() << "Database error:" << selectQuery.lastError().databaseText();
+            m_db.rollback();
+            return false;
+        }
+
+        QList<LogEntry> entries;
+        while (selectQuery.next()) {
+            LogEntry entry(QDateTime::fromTime_t(selectQuery.value("timestamp").toLongLong()), Logging::LoggingLevelInfo, Logging::LoggingSourceStates);
+            entry.setTypeId(QUuid::fromRfc4122(selectQuery.value("typeId").toByteArray()));
+            entry.setDeviceId(DeviceId::fromUuid(QUuid::fromRfc4122(selectQuery.value("deviceId").toByteArray())));
+            entry.setValue(LogValueTool::deserializeValue(selectQuery.value("value").toString()));
+            entries.append(entry);
+            if (entries.count() == 1000) {
+                updateRollups(entries);
+                migrationCounter += entries.count();
+                entries.clear();
+            }
+        }
+        updateRollups(entries);
+        migrationCounter += entries.count();
+        selectQuery.finish();
+    }
+
+    m_db.exec("UPDATE metadata SET data = 5 WHERE key = 'version';");
+    if (m_db.lastError().isValid() || !m_db.commit()) {
+        qCWarning(dcLogEngine) << "Error updating database verion 4 -> 5. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        m_db.rollback();
+        m_rollupCache.clear();
+        return false;
+    }
+
+    QTime runTime = QTime(0,0,0,0).addMSecs(startTime.msecsTo(QDateTime::currentDateTime()));
+    qCDebug(dcLogEngine()) << "Migrated" << migrationCounter << "state entries from database verion 4 -> 5 successfully in" << runTime.toString("mm:ss.zzz");
+    return true;
+}
+
+bool LogDatabase::createEntriesTable()
+{
+    m_db.exec("CREATE TABLE entries "
+              "("
+              "timestamp int,"
+              "loggingLevel int,"
+              "sourceType int,"
+              "typeId blob,"
+              "deviceId blob,"
+              "value varchar(100),"
+              "loggingEventType int,"
+              "active bool,"
+              "errorCode int,"
+              "FOREIGN KEY(sourceType) REFERENCES sourceTypes(id),"
+              "FOREIGN KEY(loggingEventType) REFERENCES loggingEventTypes(id)"
+              ");");
+    return !m_db.lastError().isValid();
+}
+
+bool LogDatabase::createEntriesIndexes()
+{
+    // All queries are sorted by timestamp, so each index ends with it to serve filter and order at once
+    QStringList indexes;
+    indexes << "CREATE INDEX IF NOT EXISTS entriesTimestamp ON entries (timestamp);";
+    indexes << "CREATE INDEX IF NOT EXISTS entriesDeviceId ON entries (deviceId, timestamp);";
+    indexes << "CREATE INDEX IF NOT EXISTS entriesTypeId ON entries (typeId, timestamp);";
+    indexes << "CREATE INDEX IF NOT EXISTS entriesSourceType ON entries (sourceType, timestamp);";
+    foreach (const QString &index, indexes) {
+        m_db.exec(index);
+        if (m_db.lastError().isValid()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LogDatabase::createRollupsTable()
+{
+    m_db.exec("CREATE TABLE IF NOT EXISTS rollups "
+              "("
+              "deviceId blob,"
+              "typeId blob,"
+              "resolution int,"
+              "bucket int,"
+              "minimum real,"
+              "maximum real,"
+              "sum real,"
+              "count int,"
+              "last real,"
+              "lastTimestamp int,"
+              "PRIMARY KEY(deviceId, typeId, resolution, bucket)"
+              ");");
+    if (m_db.lastError().isValid()) {
+        return false;
+    }
+    m_db.exec("CREATE INDEX IF NOT EXISTS rollupsBucket ON rollups (resolution, bucket);");
+    return !m_db.lastError().isValid();
+}
+
+bool LogDatabase::initDB()
+{
+    m_db.close();
+    bool opened = m_db.open(m_username, m_password);
+    if (!opened) {
+        qCWarning(dcLogEngine()) << "Can't open Log DB. Init failed.";
+        return false;
+    }
+
+    if (!m_db.tables().contains("metadata")) {
+        qCDebug(dcLogEngine()) << "Empty Database. Setting up metadata...";
+        m_db.exec("CREATE TABLE metadata (`key` VARCHAR(10), data VARCHAR(40));");
+        if (m_db.lastError().isValid()) {
+            qCWarning(dcLogEngine) << "Error initualizing database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            return false;
+        }
+        m_db.exec(QString("INSERT INTO metadata (`key`, data) VALUES('version', '%1');").arg(DB_SCHEMA_VERSION));
+    }
+
+    QSqlQuery query = m_db.exec("SELECT data FROM metadata WHERE `key` = 'version';");
+    if (query.next()) {
+        int version = query.value("data").toInt();
+
+        // Migration from 2 -> 3 (serialize values in order to store QVariant information)
+        if (version == 2) {
+            if (!migrateDatabaseVersion2to3()) {
+                qCWarning(dcLogEngine()) << "Migration process failed.";
+                return false;
+            } else {
+                // Successfully migrated
+                version = 3;
+            }
+        }
+
+        // Migration from 3 -> 4 (compact uuids and indexes)
+        if (version == 3) {
+            if (!migrateDatabaseVersion3to4()) {
+                qCWarning(dcLogEngine()) << "Migration process failed.";
+                return false;
+            } else {
+                // Successfully migrated
+                version = 4;
+            }
+        }
+
+        // Migration from 4 -> 5 (rollups of numeric state values)
+        if (version == 4) {
+            if (!migrateDatabaseVersion4to5()) {
+                qCWarning(dcLogEngine()) << "Migration process failed.";
+                return false;
+            } else {
+                // Successfully migrated
+                version = 5;
+            }
+        }
+
+        if (version != DB_SCHEMA_VERSION) {
+            qCWarning(dcLogEngine) << "Log schema version not matching! Schema upgrade not implemented yet. Logging might fail.";
+        } else {
+            qCDebug(dcLogEngine) << QString("Log database schema version \"%1\" matches").arg(DB_SCHEMA_VERSION).toLatin1().data();
+        }
+    } else {
+        qCWarning(dcLogEngine) << "Broken log database. Version not found in metadata table.";
+        return false;
+    }
+
+    if (!m_db.tables().contains("sourceTypes")) {
+        m_db.exec("CREATE TABLE sourceTypes (id int, name varchar(20), PRIMARY KEY(id));");
+        //qCDebug(dcLogEngine) << m_db.lastError().databaseText();
+        QMetaEnum logTypes = Logging::staticMetaObject.enumerator(Logging::staticMetaObject.indexOfEnumerator("LoggingSource"));
+        Q_ASSERT_X(logTypes.isValid(), "LogEngine", "Logging has no enum LoggingSource");
+        for (int i = 0; i < logTypes.keyCount(); i++) {
+            m_db.exec(QString("INSERT INTO sourceTypes (id, name) VALUES(%1, '%2');").arg(i).arg(logTypes.key(i)));
+        }
+    }
+
+    if (!m_db.tables().contains("loggingEventTypes")) {
+        m_db.exec("CREATE TABLE loggingEventTypes (id int, name varchar(40), PRIMARY KEY(id));");
+        //qCDebug(dcLogEngine) << m_db.lastError().databaseText();
+        QMetaEnum logTypes = Logging::staticMetaObject.enumerator(Logging::staticMetaObject.indexOfEnumerator("LoggingEventType"));
+        Q_ASSERT_X(logTypes.isValid(), "LogEngine", "Logging has no enum LoggingEventType");
+        for (int i = 0; i < logTypes.keyCount(); i++) {
+            m_db.exec(QString("INSERT INTO loggingEventTypes (id, name) VALUES(%1, '%2');").arg(i).arg(logTypes.key(i)));
+            if (m_db.lastError().isValid()) {
+                qCWarning(dcLogEngine()) << "Failed to insert loggingEventTypes into DB. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            }
+        }
+    }
+
+    if (!m_db.tables().contains("entries")) {
+        if (!createEntriesTable()) {
+            qCWarning(dcLogEngine) << "Error creating log table in database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            return false;
+        }
+    }
+
+    if (!createEntriesIndexes()) {
+        qCWarning(dcLogEngine) << "Error creating log table indexes in database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return false;
+    }
+
+    if (!createRollupsTable()) {
+        qCWarning(dcLogEngine) << "Error creating log rollups table in database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return false;
+    }
+
+    // Row ids of archived entries stay in use even after they have been removed from the entries table
+    query = m_db.exec("SELECT data FROM metadata WHERE `key` = 'lastRowId';");
+    if (query.next()) {
+        m_lastArchivedRowId = query.value("data").toLongLong();
+    } else {
+        m_db.exec("INSERT INTO metadata (`key`, data) VALUES('lastRowId', '0');");
+        m_lastArchivedRowId = 0;
+    }
+
+    m_insertQuery = QSqlQuery(m_db);
+    if (!m_insertQuery.prepare("INSERT INTO entries (timestamp, loggingEventType, loggingLevel, sourceType, typeId, deviceId, value, active, errorCode) "
+                               "VALUES (:timestamp, :loggingEventType, :loggingLevel, :sourceType, :typeId, :deviceId, :value, :active, :errorCode);")) {
+        qCWarning(dcLogEngine) << "Error preparing log entry insert query. Driver error:" << m_insertQuery.lastError().driverText() << "Database error:" << m_insertQuery.lastError().databaseText();
+        return false;
+    }
+
+    qCDebug(dcLogEngine) << "Initialized logging DB successfully. (maximum DB size:" << m_dbMaxSize << ")";
+    return true;
+}
+
+}
@@ -0,0 +1,130 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef LOGDATABASE_H
+#define LOGDATABASE_H
+
+#include "logentry.h"
+#include "logaggregate.h"
+#include "logfilter.h"
+#include "logarchive.h"
+#include "typeutils.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QElapsedTimer>
+#include <QTimer>
+
+namespace nymeaserver {
+
+class LogDatabase: public QObject
+{
+    Q_OBJECT
+public:
+    LogDatabase(const QString &driver, const QString &dbName, const QString &hostname, const QString &username, const QString &password, int maxDBSize);
+
+    Q_INVOKABLE void open();
+    Q_INVOKABLE void close();
+
+    Q_INVOKABLE void setMaxLogEntries(int maxLogEntries, int overflow);
+    Q_INVOKABLE void setMaxSourceEntries(int source, int maxEntries);
+    Q_INVOKABLE void setRetentionPolicy(int maxAge, int budget);
+    Q_INVOKABLE void setArchive(const QString &path, int maxSize);
+
+    Q_INVOKABLE void writeEntries(const QList<LogEntry> &entries);
+    Q_INVOKABLE QList<LogEntry> logEntries(const LogFilter &filter);
+    Q_INVOKABLE void fetchLogEntries(int fetchId, const LogFilter &filter);
+    Q_INVOKABLE void fetchAggregates(int fetchId, const DeviceId &deviceId, const QUuid &typeId, const QDateTime &startDate, const QDateTime &endDate, int bucketSize);
+
+    Q_INVOKABLE void clearDatabase();
+    Q_INVOKABLE void removeDeviceLogs(const DeviceId &deviceId);
+    Q_INVOKABLE void removeRuleLogs(const RuleId &ruleId);
+    Q_INVOKABLE void removeStaleDeviceLogs(const QList<DeviceId> &configuredDeviceIds);
+
+signals:
+    void entriesProcessed(int count);
+    void logEntriesFetched(int fetchId, const QList<LogEntry> &entries, const QString &nextCursor);
+    void aggregatesFetched(int fetchId, const QList<LogAggregate> &aggregates);
+    void logDatabaseUpdated();
+
+private slots:
+    void runRetention();
+
+private:
+    bool initDB();
+    void rotate(const QString &dbName);
+    void countEntries();
+    void addEntryCounts(const QList<LogEntry> &entries);
+    bool retentionDue() const;
+    void scheduleRetention();
+    int trimBatch();
+    int deleteEntries(const QString &selection, const QVariantList &bindValues);
+    void removeDeviceEntries(const DeviceId &deviceId);
+    QList<DeviceId> devicesInLogs();
+    QList<LogEntry> queryLogEntries(const LogFilter &filter, QString *nextCursor);
+
+    void updateRollups(const QList<LogEntry> &entries);
+    void trimRollups();
+    QList<LogAggregate> aggregateRollups(const DeviceId &deviceId, const QUuid &typeId, int resolution, qint64 start, qint64 end, int bucketSize);
+    QList<LogAggregate> aggregateEntries(const DeviceId &deviceId, const QUuid &typeId, qint64 start, qint64 end, int bucketSize);
+
+    bool migrateDatabaseVersion2to3();
+    bool migrateDatabaseVersion3to4();
+    bool migrateDatabaseVersion4to5();
+    bool createEntriesTable();
+    bool createEntriesIndexes();
+    bool createRollupsTable();
+
+private:
+    QString m_driver;
+    QString m_dbName;
+    QString m_hostname;
+    QString m_username;
+    QString m_password;
+
+    QString m_connectionName;
+    QSqlDatabase m_db;
+    QSqlQuery m_insertQuery;
+    int m_dbMaxSize;
+    int m_overflow = 100;
+    int m_entryCount = 0;
+
+    // Retention
+    QTimer *m_retentionTimer = nullptr;
+    QHash<int, int> m_sourceCounts;
+    QHash<int, int> m_sourceLimits;
+    int m_maxAge = 0;
+    int m_retentionBudget = 20;
+    QElapsedTimer m_rollupTrimTimer;
+
+    // Entries removed by the retention are moved here if enabled
+    LogArchive m_archive;
+    // The highest row id which has been archived, new rows must not reuse it
+    qint64 m_lastArchivedRowId = 0;
+
+    // The most recent rollup bucket of each state and resolution
+    QHash<QByteArray, LogAggregate> m_rollupCache;
+};
+
+}
+
+#endif // LOGDATABASE_H
@@ -30,6 +30,10 @@
     happening in the system. The database can be accessed from the API's. To control the size of the database the
     limit of the databse are 8000 entries.
 
+    All database access happens in a dedicated thread owned by the \l{LogEngine}, so neither writing log entries
+    nor long running queries or housekeeping will block the main event loop. Use \l{fetchLogEntries()} to query
+    the database asynchronously.
+
 
     \sa LogEntry, LogFilter, LogsResource, LoggingHandler
 */
@@ -110,150 +114,294 @@
         This \l{LogEntry} represents the enable/disable event from an \l{Rule}.
 */
 
-#include "nymeasettings.h"
 #include "logengine.h"
+#include "logdatabase.h"
 #include "loggingcategories.h"
 #include "logging.h"
-#include "logvaluetool.h"
-
-#include <QCoreApplication>
-#include <QSqlDatabase>
-#include <QSqlDriver>
-#include <QSqlQuery>
-#include <QSqlRecord>
-#include <QSqlError>
-#include <QMetaEnum>
-#include <QDateTime>
-#include <QFileInfo>
-#include <QTime>
 
-#define DB_SCHEMA_VERSION 3
+#include <QMetaObject>
 
 namespace nymeaserver {
 
+static const int fetchChunkSize = 1000;
+
+/*!
+    \class nymeaserver::LogEntriesFetchJob
+    \brief Represents an asynchronous query of the log database.
+
+    \ingroup logs
+    \inmodule core
+
+    The job is created by \l{LogEngine::fetchLogEntries()} and deletes itself after the \l{finished()} signal
+    has been emitted.
+
+    A streaming job delivers the result set in chunks using \l{entriesAvailable()} and does not keep the entries
+    around. The next chunk will only be read from the database once the previous one has been delivered.
+*/
+
+/*! \fn void nymeaserver::LogEntriesFetchJob::entriesAvailable(const QList<LogEntry> &entries);
+    This signal is emitted for each chunk of \a entries read from the database.
+*/
+
+/*! \fn void nymeaserver::LogEntriesFetchJob::finished();
+    This signal is emitted when all entries have been fetched from the database.
+*/
+
+LogEntriesFetchJob::LogEntriesFetchJob(const LogFilter &filter, bool streaming, QObject *parent):
+    QObject(parent),
+    m_filter(filter),
+    m_streaming(streaming),
+    m_remaining(filter.limit())
+{
+
+}
+
+/*! Returns the \l{LogEntry}{LogEntries} fetched by this job. Streaming jobs don't collect their entries,
+    use \l{entriesAvailable()} instead.
+*/
+QList<LogEntry> LogEntriesFetchJob::entries() const
+{
+    return m_entries;
+}
+
+/*! Returns the cursor to continue fetching after the last returned entry, or an empty string if
+    the result set has been fetched completely.
+
+    \sa LogFilter::setCursor()
+*/
+QString LogEntriesFetchJob::nextCursor() const
+{
+    return m_nextCursor;
+}
+
+/*!
+    \class nymeaserver::LogAggregatesFetchJob
+    \brief Represents an asynchronous aggregation of numeric state values in the log database.
+
+    \ingroup logs
+    \inmodule core
+
+    The job is created by \l{LogEngine::fetchAggregates()} and deletes itself after the \l{finished()} signal
+    has been emitted.
+*/
+
+/*! \fn void nymeaserver::LogAggregatesFetchJob::finished();
+    This signal is emitted when the aggregates have been calculated.
+*/
+
+LogAggregatesFetchJob::LogAggregatesFetchJob(QObject *parent):
+    QObject(parent)
+{
+
+}
+
+/*! Returns the \l{LogAggregate}{LogAggregates} fetched by this job, sorted by their timestamp. */
+QList<LogAggregate> LogAggregatesFetchJob::aggregates() const
+{
+    return m_aggregates;
+}
+
 /*! Constructs the log engine with the given parameters.
     The Qt Database backend to be used. Depending on the installed Qt modules this can be any of QDB2 QIBASE QMYSQL QOCI QODBC QPSQL QSQLITE QSQLITE2 QTDS.
     \a dbName is the name of the database. In case of SQLITE this should contain a file path. The Driver will create the file if required. In case of using a
     database server like MYSQL, the database must exist on the host given by \a hostname and be accessible with the given \a username and \a password.
 */
 LogEngine::LogEngine(const QString &driver, const QString &dbName, const QString &hostname, const QString &username, const QString &password, int maxDBSize, QObject *parent):
-    QObject(parent),
-    m_dbMaxSize(maxDBSize)
+    QObject(parent)
 {
-    m_db = QSqlDatabase::addDatabase(driver, "logs");
-    m_db.setDatabaseName(dbName);
-    m_db.setHostName(hostname);
-    m_overflow = 100;
+    qRegisterMetaType<LogFilter>("LogFilter");
+    qRegisterMetaType<QList<LogEntry> >("QList<LogEntry>");
+    qRegisterMetaType<QList<LogAggregate> >("QList<LogAggregate>");
+    qRegisterMetaType<DeviceId>("DeviceId");
+    qRegisterMetaType<RuleId>("RuleId");
+    qRegisterMetaType<QList<DeviceId> >("QList<DeviceId>");
+
+    m_dbThread.setObjectName("LogEngine");
+
+    m_database = new LogDatabase(driver, dbName, hostname, username, password, maxDBSize);
+    m_database->moveToThread(&m_dbThread);
+    connect(m_database, &LogDatabase::entriesProcessed, this, &LogEngine::onEntriesProcessed);
+    connect(m_database, &LogDatabase::logEntriesFetched, this, &LogEngine::onLogEntriesFetched);
+    connect(m_database, &LogDatabase::aggregatesFetched, this, &LogEngine::onAggregatesFetched);
+    connect(m_database, &LogDatabase::logDatabaseUpdated, this, &LogEngine::logDatabaseUpdated);
+    m_dbThread.start();
+
+    // Opening might migrate or rotate the database. Wait for it so the database is in a defined state afterwards.
+    QMetaObject::invokeMethod(m_database, "open", Qt::BlockingQueuedConnection);
+
+    connect(&m_flushTimer, &QTimer::timeout, this, &LogEngine::flush);
+    m_flushTimer.setInterval(1000);
+    m_flushTimer.setSingleShot(true);
+}
 
-    if (QCoreApplication::instance()->organizationName() == "nymea-test") {
-        m_dbMaxSize = 20;
-        qCDebug(dcLogEngine) << "Set logging dab max size to" << m_dbMaxSize << "for testing.";
-    }
+/*! Destructs the \l{LogEngine}. Pending log entries will be written to the database before closing it. */
+LogEngine::~LogEngine()
+{
+    flush();
+    QMetaObject::invokeMethod(m_database, "close", Qt::BlockingQueuedConnection);
+    m_dbThread.quit();
+    m_dbThread.wait();
+    delete m_database;
+}
 
-    qCDebug(dcLogEngine) << "Opening logging database" << m_db.databaseName();
+/*! Starts an asynchronous query for all \l{LogEntry}{LogEntries} of the database matching the given \a filter.
+    The returned \l{LogEntriesFetchJob} emits \l{LogEntriesFetchJob::finished()} once the entries are available.
 
-    if (!m_db.isValid()) {
-        qCWarning(dcLogEngine) << "Database not valid:" << m_db.lastError().driverText() << m_db.lastError().databaseText();
-        rotate(m_db.databaseName());
-    }
+    If \a streaming is true, the result set will be read in chunks so memory stays bounded for large results.
 
-    if (!initDB(username, password)) {
-        qCWarning(dcLogEngine()) << "Error initializing database. Trying to correct it.";
-        if (QFileInfo(m_db.databaseName()).exists()) {
-            rotate(m_db.databaseName());
-            if (!initDB(username, password)) {
-                qCWarning(dcLogEngine()) << "Error fixing log database. Giving up. Logs can't be stored.";
-            }
-        }
-    }
+  \sa LogEntry, LogFilter
+*/
+LogEntriesFetchJob *LogEngine::fetchLogEntries(const LogFilter &filter, bool streaming)
+{
+    flush();
 
-    connect(&m_housekeepingTimer, &QTimer::timeout, this, &LogEngine::checkDBSize);
-    m_housekeepingTimer.setInterval(1); // Trigger on next idle event loop run
-    m_housekeepingTimer.setSingleShot(true);
+    LogEntriesFetchJob *job = new LogEntriesFetchJob(filter, streaming, this);
+    int fetchId = ++m_lastFetchId;
+    m_fetchJobs.insert(fetchId, job);
+    requestLogEntries(fetchId, job);
+    return job;
+}
+
+/*! Returns the list of \l{LogEntry}{LogEntries} of the database matching the given \a filter.
+    This method blocks until the database thread has processed the query. Prefer \l{fetchLogEntries()}.
 
-    checkDBSize();
+  \sa LogEntry, LogFilter
+*/
+QList<LogEntry> LogEngine::logEntries(const LogFilter &filter)
+{
+    flush();
+
+    QList<LogEntry> entries;
+    QMetaObject::invokeMethod(m_database, "logEntries", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QList<LogEntry>, entries), Q_ARG(LogFilter, filter));
+    return entries;
 }
 
-/*! Destructs the \l{LogEngine}. */
-LogEngine::~LogEngine()
+/*! Starts an asynchronous aggregation of the numeric values logged for the state \a typeId of the device \a deviceId
+    between \a startDate and \a endDate. The values are summarized in buckets of \a bucketSize seconds, which are aligned
+    to multiples of \a bucketSize since the epoch (UTC). Buckets without any values are omitted.
+
+    Bucket sizes which are a multiple of 5 minutes are answered from precomputed rollups, others have to read all
+    matching log entries.
+
+  \sa LogAggregate
+*/
+LogAggregatesFetchJob *LogEngine::fetchAggregates(const DeviceId &deviceId, const QUuid &typeId, const QDateTime &startDate, const QDateTime &endDate, int bucketSize)
 {
-    m_db.close();
+    flush();
+
+    LogAggregatesFetchJob *job = new LogAggregatesFetchJob(this);
+    int fetchId = ++m_lastFetchId;
+    m_aggregateJobs.insert(fetchId, job);
+    QMetaObject::invokeMethod(m_database, "fetchAggregates", Qt::QueuedConnection,
+                              Q_ARG(int, fetchId),
+                              Q_ARG(DeviceId, deviceId),
+                              Q_ARG(QUuid, typeId),
+                              Q_ARG(QDateTime, startDate),
+                              Q_ARG(QDateTime, endDate),
+                              Q_ARG(int, qMax(1, bucketSize)));
+    return job;
 }
 
-/*! Returns the list of \l{LogEntry}{LogEntries} of the database matching the given \a filter.
+void LogEngine::setMaxLogEntries(int maxLogEntries, int overflow)
+{
+    QMetaObject::invokeMethod(m_database, "setMaxLogEntries", Qt::QueuedConnection, Q_ARG(int, maxLogEntries), Q_ARG(int, overflow));
+}
 
-  \sa LogEntry, LogFilter
+/*! Keeps at most \a maxEntries log entries from the given \a source. This allows for example to keep the rule history
+    for longer than state changes. A value of 0 removes the quota, the overall limit of the database still applies.
+
+    Old entries are removed in the background, see \l{setRetentionPolicy()}.
 */
-QList<LogEntry> LogEngine::logEntries(const LogFilter &filter) const
+void LogEngine::setMaxSourceEntries(Logging::LoggingSource source, int maxEntries)
 {
-    QList<LogEntry> results;
-    QSqlQuery query(m_db);
+    QMetaObject::invokeMethod(m_database, "setMaxSourceEntries", Qt::QueuedConnection, Q_ARG(int, source), Q_ARG(int, maxEntries));
+}
 
-    QString limitString;
-    if (filter.limit() >= 0) {
-        limitString.append(QString("LIMIT %1 ").arg(filter.limit()));
-    }
-    if (filter.offset() > 0) {
-        limitString.append(QString("OFFSET %1").arg(QString::number(filter.offset())));
-    }
+/*! Removes log entries older than \a maxAge days, a value of 0 keeps entries regardless of their age.
 
-    QString queryString;
-    if (filter.isEmpty()) {
-        queryString = QString("SELECT * FROM entries ORDER BY timestamp DESC %1;").arg(limitString);
-    } else {
-        queryString = QString("SELECT * FROM entries WHERE %1 ORDER BY timestamp DESC %2;").arg(filter.queryString()).arg(limitString);
-    }
-    qCDebug(dcLogEngine()) << "Preparing query:" << queryString;
-    query.prepare(queryString);
+    The retention runs in small batches whenever the database is idle. A single run will not take longer than
+    \a budget milliseconds, so queued writes and queries are delayed by at most this time.
+*/
+void LogEngine::setRetentionPolicy(int maxAge, int budget)
+{
+    QMetaObject::invokeMethod(m_database, "setRetentionPolicy", Qt::QueuedConnection, Q_ARG(int, maxAge), Q_ARG(int, budget));
+}
 
-    foreach (const QString &value, filter.values()) {
-        query.addBindValue(LogValueTool::serializeValue(value));
-        qCDebug(dcLogEngine()) << "Binding value to query:" << LogValueTool::serializeValue(value);
-    }
+/*! Moves entries removed by the retention into a compressed archive in the directory \a path instead of deleting them.
+    Archived entries are still returned by \l{fetchLogEntries()}. The archive will not grow beyond \a maxSize megabytes,
+    a value of 0 disables the archive.
+
+    \sa setRetentionPolicy()
+*/
+void LogEngine::setArchive(const QString &path, int maxSize)
+{
+    QMetaObject::invokeMethod(m_database, "setArchive", Qt::QueuedConnection, Q_ARG(QString, path), Q_ARG(int, maxSize));
+}
+
+/*! Configures the write behind queue of this \l{LogEngine}. New entries are collected and written to the database
+    in a single transaction once \a batchSize entries are pending or \a flushInterval milliseconds after the first
+    pending entry has been queued, whichever comes first. A \a flushInterval of 0 writes each entry immediately.
+
+    If the database can't keep up, at most \a maxPendingEntries will be held back. Older entries are dropped when
+    this limit is exceeded.
+
+    \sa flush(), droppedEntries()
+*/
+void LogEngine::setFlushPolicy(int batchSize, int flushInterval, int maxPendingEntries)
+{
+    m_flushBatchSize = qMax(1, batchSize);
+    m_maxPendingEntries = qMax(m_flushBatchSize, maxPendingEntries);
+    m_flushTimer.setInterval(qMax(0, flushInterval));
+    if (flushInterval <= 0) {
+        m_flushBatchSize = 1;
+    }
+    qCDebug(dcLogEngine()) << "Flushing log entries every" << m_flushBatchSize << "entries or" << m_flushTimer.interval() << "ms. Holding back at most" << m_maxPendingEntries << "entries.";
+    flush();
+}
 
-    query.exec();
+/*! Applies the given logging \a policy to all state changes of the policy's state type. State changes
+    which don't pass the policy won't be written to the database. The first value of a state is always logged.
+
+    \sa removeStateLogPolicy()
+*/
+void LogEngine::setStateLogPolicy(const StateLogPolicy &policy)
+{
+    m_stateLogPolicies.insert(policy.stateTypeId, policy);
+}
 
-    if (m_db.lastError().isValid()) {
-        qCWarning(dcLogEngine) << "Error fetching log entries. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-        return QList<LogEntry>();
+/*! Removes the logging policy for \a stateTypeId, all following state changes of this type will be logged again. */
+void LogEngine::removeStateLogPolicy(const StateTypeId &stateTypeId)
+{
+    m_stateLogPolicies.remove(stateTypeId);
+    foreach (const DeviceId &deviceId, m_loggedStates.keys()) {
+        m_loggedStates[deviceId].remove(stateTypeId);
     }
+}
 
-    while (query.next()) {
-        LogEntry entry(
-                    QDateTime::fromTime_t(query.value("timestamp").toLongLong()),
-                    (Logging::LoggingLevel)query.value("loggingLevel").toInt(),
-                    (Logging::LoggingSource)query.value("sourceType").toInt(),
-                    query.value("errorCode").toInt());
-        entry.setTypeId(query.value("typeId").toUuid());
-        entry.setDeviceId(DeviceId(query.value("deviceId").toString()));
-        entry.setValue(LogValueTool::convertVariantToString(LogValueTool::deserializeValue(query.value("value").toString())));
-        entry.setEventType((Logging::LoggingEventType)query.value("loggingEventType").toInt());
-        entry.setActive(query.value("active").toBool());
-        results.append(entry);
+/*! Hands all pending log entries over to the database thread. */
+void LogEngine::flush()
+{
+    m_flushTimer.stop();
+    if (m_pendingEntries.isEmpty()) {
+        return;
     }
-//    qCDebug(dcLogEngine) << "Fetched" << results.count() << "entries for db query:" << query.executedQuery();
 
-    return results;
+    m_queuedEntries += m_pendingEntries.count();
+    QMetaObject::invokeMethod(m_database, "writeEntries", Qt::QueuedConnection, Q_ARG(QList<LogEntry>, m_pendingEntries));
+    m_pendingEntries.clear();
 }
 
-void LogEngine::setMaxLogEntries(int maxLogEntries, int overflow)
+/*! Returns the number of log entries which have been dropped because the write behind queue was full. */
+int LogEngine::droppedEntries() const
 {
-    m_dbMaxSize = maxLogEntries;
-    m_overflow = overflow;
-    checkDBSize();
+    return m_droppedEntries;
 }
 
 /*! Removes all entries from the database. This method will be used for the tests. */
 void LogEngine::clearDatabase()
 {
-    qCWarning(dcLogEngine) << "Clear logging database.";
-
-    QString queryDeleteString = QString("DELETE FROM entries;");
-    if (m_db.exec(queryDeleteString).lastError().type() != QSqlError::NoError) {
-        qCWarning(dcLogEngine) << "Could not clear logging database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-    }
-
-    emit logDatabaseUpdated();
+    flush();
+    QMetaObject::invokeMethod(m_database, "clearDatabase", Qt::QueuedConnection);
 }
 
 void LogEngine::logSystemEvent(const QDateTime &dateTime, bool active, Logging::LoggingLevel level)
@@ -274,6 +422,10 @@ void LogEngine::logEvent(const Event &event)
         if (!event.params().isEmpty())
             valueList << event.params().first().value();
 
+        if (!filterStateChange(event.deviceId(), StateTypeId::fromUuid(event.eventTypeId()), valueList.value(0))) {
+            return;
+        }
+
     } else {
         sourceType = Logging::LoggingSourceEvents;
         foreach (const Param &param, event.params()) {
@@ -292,6 +444,22 @@ void LogEngine::logEvent(const Event &event)
     appendLogEntry(entry);
 }
 
+/*! Logs all \a events. The resulting entries are passed to the database together and written in a single
+    transaction, regardless of the configured batch size.
+*/
+void LogEngine::logEvents(const QList<Event> &events)
+{
+    m_holdFlush = true;
+    foreach (const Event &event, events) {
+        logEvent(event);
+    }
+    m_holdFlush = false;
+
+    if (m_pendingEntries.count() >= m_flushBatchSize) {
+        flush();
+    }
+}
+
 void LogEngine::logAction(const Action &action, Logging::LoggingLevel level, int errorCode)
 {
     LogEntry entry(level, Logging::LoggingSourceActions, errorCode);
@@ -356,295 +524,142 @@ void LogEngine::logRuleExitActionsExecuted(const Rule &rule)
 
 void LogEngine::removeDeviceLogs(const DeviceId &deviceId)
 {
-    qCDebug(dcLogEngine) << "Deleting log entries from device" << deviceId.toString();
-
-    QString queryDeleteString = QString("DELETE FROM entries WHERE deviceId = '%1';").arg(deviceId.toString());
-    if (m_db.exec(queryDeleteString).lastError().type() != QSqlError::NoError) {
-        qCWarning(dcLogEngine) << "Error deleting log entries from device" << deviceId.toString() << ". Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-    } else {
-        emit logDatabaseUpdated();
-    }
+    m_loggedStates.remove(deviceId);
+    flush();
+    QMetaObject::invokeMethod(m_database, "removeDeviceLogs", Qt::QueuedConnection, Q_ARG(DeviceId, deviceId));
 }
 
 void LogEngine::removeRuleLogs(const RuleId &ruleId)
 {
-    qCDebug(dcLogEngine) << "Deleting log entries from rule" << ruleId.toString();
-
-    QString queryDeleteString = QString("DELETE FROM entries WHERE typeId = '%1';").arg(ruleId.toString());
-    if (m_db.exec(queryDeleteString).lastError().type() != QSqlError::NoError) {
-        qCWarning(dcLogEngine) << "Error deleting log entries from rule" << ruleId.toString() << ". Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-    } else {
-        emit logDatabaseUpdated();
-    }
+    flush();
+    QMetaObject::invokeMethod(m_database, "removeRuleLogs", Qt::QueuedConnection, Q_ARG(RuleId, ruleId));
 }
 
-QList<DeviceId> LogEngine::devicesInLogs() const
+/*! Removes all log entries of devices which are not contained in the given list of \a configuredDeviceIds. */
+void LogEngine::removeStaleDeviceLogs(const QList<DeviceId> &configuredDeviceIds)
 {
-    QString queryString = QString("SELECT deviceId FROM entries WHERE deviceId != \"%1\" GROUP BY deviceId;").arg(QUuid().toString());
-    QSqlQuery result = m_db.exec(queryString);
-    QList<DeviceId> ret;
-    if (result.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcLogEngine()) << "Error fetching device entries from log database:" << m_db.lastError().driverText() << m_db.lastError().databaseText();
-        return ret;
-    }
-    if (!result.first()) {
-        return ret;
-    }
-    do {
-        ret.append(DeviceId::fromUuid(result.value("deviceId").toUuid()));
-    } while (result.next());
-    return ret;
+    flush();
+    QMetaObject::invokeMethod(m_database, "removeStaleDeviceLogs", Qt::QueuedConnection, Q_ARG(QList<DeviceId>, configuredDeviceIds));
 }
 
 void LogEngine::appendLogEntry(const LogEntry &entry)
 {
-    QString queryString = QString("INSERT INTO entries (timestamp, loggingEventType, loggingLevel, sourceType, typeId, deviceId, value, active, errorCode) values ('%1', '%2', '%3', '%4', '%5', '%6', '%7', '%8', '%9');")
-            .arg(entry.timestamp().toTime_t())
-            .arg(entry.eventType())
-            .arg(entry.level())
-            .arg(entry.source())
-            .arg(entry.typeId().toString())
-            .arg(entry.deviceId().toString())
-            .arg(LogValueTool::serializeValue(entry.value()))
-            .arg(entry.active())
-            .arg(entry.errorCode());
-
-    if (m_db.exec(queryString).lastError().type() != QSqlError::NoError) {
-        qCWarning(dcLogEngine) << "Error writing log entry. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-        qCWarning(dcLogEngine) << entry;
-        return;
+    if (m_pendingEntries.count() + m_queuedEntries >= m_maxPendingEntries) {
+        m_droppedEntries++;
+        if (m_unreportedDrops++ == 0) {
+            qCWarning(dcLogEngine()) << "Log database is not keeping up. Dropping log entries.";
+        }
+        if (!m_pendingEntries.isEmpty()) {
+            m_pendingEntries.removeFirst();
+            m_pendingEntries.append(entry);
+        }
+    } else {
+        m_pendingEntries.append(entry);
     }
 
     emit logEntryAdded(entry);
 
-    if (++m_entryCount > m_dbMaxSize + m_overflow) {
-        m_housekeepingTimer.start();
+    if (m_pendingEntries.count() >= m_flushBatchSize && !m_holdFlush) {
+        flush();
+    } else if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
     }
 }
 
-void LogEngine::checkDBSize()
+bool LogEngine::filterStateChange(const DeviceId &deviceId, const StateTypeId &stateTypeId, const QVariant &value)
 {
-    if (m_dbMaxSize == -1) {
-        // No tripping required
-        return;
-    }
-    QDateTime startTime = QDateTime::currentDateTime();
-    QString queryString = "SELECT COUNT(*) FROM entries;";
-    QSqlQuery result = m_db.exec(queryString);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qWarning(dcLogEngine()) << "Failed to query entry count in db:" << m_db.lastError().databaseText();
-        return;
-    }
-    if (!result.first()) {
-        qWarning(dcLogEngine()) << "Failed retrieving entry count.";
-        return;
+    if (!m_stateLogPolicies.contains(stateTypeId)) {
+        return true;
     }
-    m_entryCount = result.value(0).toInt();
+    const StateLogPolicy &policy = m_stateLogPolicies[stateTypeId];
+    QDateTime now = QDateTime::currentDateTime();
 
-    if (m_entryCount >= m_dbMaxSize) {
-        // keep only the latest m_dbMaxSize entries
-        if (!m_trimWarningPrinted) {
-            qCDebug(dcLogEngine) << "Deleting oldest entries" << (m_entryCount - m_dbMaxSize) << "and keep only the latest" << m_dbMaxSize << "entries.";
-            m_trimWarningPrinted = true;
+    QHash<StateTypeId, LoggedState> &loggedStates = m_loggedStates[deviceId];
+    if (loggedStates.contains(stateTypeId)) {
+        const LoggedState &last = loggedStates.value(stateTypeId);
+        if (policy.onChangeOnly && last.value == value) {
+            return false;
         }
-        QString queryDeleteString = QString("DELETE FROM entries WHERE ROWID IN (SELECT ROWID FROM entries ORDER BY timestamp DESC LIMIT -1 OFFSET %1);").arg(QString::number(m_dbMaxSize));
-        if (m_db.exec(queryDeleteString).lastError().type() != QSqlError::NoError) {
-            qCWarning(dcLogEngine) << "Error deleting oldest log entries to keep size. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        if (policy.deadband > 0) {
+            bool lastOk = false, ok = false;
+            double lastNumber = last.value.toDouble(&lastOk);
+            double number = value.toDouble(&ok);
+            if (lastOk && ok && qAbs(number - lastNumber) <= policy.deadband) {
+                return false;
+            }
+        }
+        if (policy.minInterval > 0 && last.timestamp.secsTo(now) < policy.minInterval) {
+            return false;
         }
-        m_entryCount = m_dbMaxSize;
-        emit logDatabaseUpdated();
     }
-    qCDebug(dcLogEngine()) << "Ran housekeeping on log database in" << startTime.msecsTo(QDateTime::currentDateTime()) << "ms.";
-}
 
-void LogEngine::rotate(const QString &dbName)
-{
-    int index = 1;
-    while (QFileInfo(QString("%1.%2").arg(dbName).arg(index)).exists()) {
-        index++;
-    }
-    qCDebug(dcLogEngine()) << "Backing up old database file to" << QString("%1.%2").arg(dbName).arg(index);
-    QFile f(dbName);
-    if (!f.rename(QString("%1.%2").arg(dbName).arg(index))) {
-        qCWarning(dcLogEngine()) << "Error backing up old database.";
-    } else {
-        qCDebug(dcLogEngine()) << "Successfully moved old database";
-    }
+    LoggedState loggedState;
+    loggedState.value = value;
+    loggedState.timestamp = now;
+    loggedStates.insert(stateTypeId, loggedState);
+    return true;
 }
 
-bool LogEngine::migrateDatabaseVersion2to3()
+void LogEngine::onEntriesProcessed(int count)
 {
-    // Changelog: serialize values of logentries in order to prevent typecast errors
-    qCDebug(dcLogEngine()) << "Start migration of log database from version 2 to version 3";
-
-    QDateTime startTime = QDateTime::currentDateTime();
-
-    int migrationCounter = 0;
-    int migrationProgress = 0;
-    int entryCount = 0;
-
-    // Count entries we have to migrate
-    QString queryString = "SELECT COUNT(*) FROM entries WHERE value != '';";
-    QSqlQuery countQuery = m_db.exec(queryString);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcLogEngine()) << "Failed to query entry count in db:" << m_db.lastError().databaseText();
-        return false;
-    }
-    if (!countQuery.first()) {
-        qCWarning(dcLogEngine()) << "Migration: Failed retrieving entry count.";
-        return false;
-    }
-    entryCount = countQuery.value(0).toInt();
-
-    qCDebug(dcLogEngine()) << "Found" << entryCount << "entries to migrate.";
+    m_queuedEntries -= count;
 
-    // Select all entries
-    QSqlQuery selectQuery = m_db.exec("SELECT * FROM entries;");
-    if (m_db.lastError().isValid()) {
-        qCWarning(dcLogEngine) << "Error migrating database verion 2 -> 3. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-        return false;
+    if (m_unreportedDrops > 0) {
+        qCWarning(dcLogEngine()) << "Dropped" << m_unreportedDrops << "log entries while the log database was not keeping up." << m_droppedEntries << "entries dropped in total.";
+        m_unreportedDrops = 0;
     }
-
-    // Migrate all selected entries
-    while (selectQuery.next()) {
-        QString oldValue = selectQuery.value("value").toString();
-        QString newValue = LogValueTool::serializeValue(QVariant(oldValue));
-        if (oldValue.isEmpty())
-            continue;
-
-        QString updateCall = QString("UPDATE entries SET value = '%1' WHERE timestamp = '%2' AND loggingLevel = '%3' AND sourceType = '%4' AND errorCode = '%5' AND typeId = '%6' AND deviceId = '%7' AND value = '%8' AND loggingEventType = '%9'AND active = '%10';")
-                .arg(newValue)
-                .arg(selectQuery.value("timestamp").toLongLong())
-                .arg(selectQuery.value("loggingLevel").toInt())
-                .arg(selectQuery.value("sourceType").toInt())
-                .arg(selectQuery.value("errorCode").toInt())
-                .arg(selectQuery.value("typeId").toUuid().toString())
-                .arg(selectQuery.value("deviceId").toString())
-                .arg(selectQuery.value("value").toString())
-                .arg(selectQuery.value("loggingEventType").toInt())
-                .arg(selectQuery.value("active").toBool());
-
-        m_db.exec(updateCall);
-        if (m_db.lastError().isValid()) {
-            qCWarning(dcLogEngine) << "Error migrating database verion 2 -> 3. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-            return false;
-        }
-
-        migrationCounter++;
-
-        double percentage = migrationCounter * 100.0 / entryCount;
-        if (qRound(percentage) != migrationProgress) {
-            migrationProgress = qRound(percentage);
-            qCDebug(dcLogEngine()) << QString("Migration progress: %1\%").arg(migrationProgress).toLatin1().data();
-        }
-    }
-
-    QTime runTime = QTime(0,0,0,0).addMSecs(startTime.msecsTo(QDateTime::currentDateTime()));
-    qCDebug(dcLogEngine()) << "Migration of" << migrationCounter << "done in" << runTime.toString("mm:ss.zzz");
-    qCDebug(dcLogEngine()) << "Updating database version to" << DB_SCHEMA_VERSION;
-    m_db.exec(QString("UPDATE metadata SET data = %1 WHERE key = 'version';").arg(DB_SCHEMA_VERSION));
-    if (m_db.lastError().isValid()) {
-        qCWarning(dcLogEngine) << "Error updating database verion 2 -> 3. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-        return false;
-    }
-
-    qCDebug(dcLogEngine()) << "Migrated" << migrationCounter << "entries from database verion 2 -> 3 successfully.";
-    return true;
 }
 
-bool LogEngine::initDB(const QString &username, const QString &password)
+void LogEngine::requestLogEntries(int fetchId, LogEntriesFetchJob *job)
 {
-    m_db.close();
-    bool opened = m_db.open(username, password);
-    if (!opened) {
-        qCWarning(dcLogEngine()) << "Can't open Log DB. Init failed.";
-        return false;
+    LogFilter filter = job->m_filter;
+    if (job->m_streaming) {
+        filter.setLimit(job->m_remaining < 0 ? fetchChunkSize : qMin(job->m_remaining, fetchChunkSize));
     }
+    QMetaObject::invokeMethod(m_database, "fetchLogEntries", Qt::QueuedConnection, Q_ARG(int, fetchId), Q_ARG(LogFilter, filter));
+}
 
-    if (!m_db.tables().contains("metadata")) {
-        qCDebug(dcLogEngine()) << "Empty Database. Setting up metadata...";
-        m_db.exec("CREATE TABLE metadata (`key` VARCHAR(10), data VARCHAR(40));");
-        if (m_db.lastError().isValid()) {
-            qCWarning(dcLogEngine) << "Error initualizing database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-            return false;
-        }
-        m_db.exec(QString("INSERT INTO metadata (`key`, data) VALUES('version', '%1');").arg(DB_SCHEMA_VERSION));
+void LogEngine::onLogEntriesFetched(int fetchId, const QList<LogEntry> &entries, const QString &nextCursor)
+{
+    LogEntriesFetchJob *job = m_fetchJobs.value(fetchId);
+    if (!job) {
+        return;
     }
 
-    QSqlQuery query = m_db.exec("SELECT data FROM metadata WHERE `key` = 'version';");
-    if (query.next()) {
-        int version = query.value("data").toInt();
-
-        // Migration from 2 -> 3 (serialize values in order to store QVariant information)
-        if (DB_SCHEMA_VERSION == 3 && version == 2) {
-            if (!migrateDatabaseVersion2to3()) {
-                qCWarning(dcLogEngine()) << "Migration process failed.";
-                return false;
-            } else {
-                // Successfully migrated
-                version = DB_SCHEMA_VERSION;
-            }
-        }
-
-        if (version != DB_SCHEMA_VERSION) {
-            qCWarning(dcLogEngine) << "Log schema version not matching! Schema upgrade not implemented yet. Logging might fail.";
-        } else {
-            qCDebug(dcLogEngine) << QString("Log database schema version \"%1\" matches").arg(DB_SCHEMA_VERSION).toLatin1().data();
-        }
-    } else {
-        qCWarning(dcLogEngine) << "Broken log database. Version not found in metadata table.";
-        return false;
+    job->m_nextCursor = nextCursor;
+    if (!job->m_streaming) {
+        job->m_entries = entries;
     }
+    emit job->entriesAvailable(entries);
 
-    if (!m_db.tables().contains("sourceTypes")) {
-        m_db.exec("CREATE TABLE sourceTypes (id int, name varchar(20), PRIMARY KEY(id));");
-        //qCDebug(dcLogEngine) << m_db.lastError().databaseText();
-        QMetaEnum logTypes = Logging::staticMetaObject.enumerator(Logging::staticMetaObject.indexOfEnumerator("LoggingSource"));
-        Q_ASSERT_X(logTypes.isValid(), "LogEngine", "Logging has no enum LoggingSource");
-        for (int i = 0; i < logTypes.keyCount(); i++) {
-            m_db.exec(QString("INSERT INTO sourceTypes (id, name) VALUES(%1, '%2');").arg(i).arg(logTypes.key(i)));
+    if (job->m_streaming && !nextCursor.isEmpty()) {
+        if (job->m_remaining > 0) {
+            job->m_remaining -= entries.count();
         }
-    }
-
-    if (!m_db.tables().contains("loggingEventTypes")) {
-        m_db.exec("CREATE TABLE loggingEventTypes (id int, name varchar(40), PRIMARY KEY(id));");
-        //qCDebug(dcLogEngine) << m_db.lastError().databaseText();
-        QMetaEnum logTypes = Logging::staticMetaObject.enumerator(Logging::staticMetaObject.indexOfEnumerator("LoggingEventType"));
-        Q_ASSERT_X(logTypes.isValid(), "LogEngine", "Logging has no enum LoggingEventType");
-        for (int i = 0; i < logTypes.keyCount(); i++) {
-            m_db.exec(QString("INSERT INTO loggingEventTypes (id, name) VALUES(%1, '%2');").arg(i).arg(logTypes.key(i)));
-            if (m_db.lastError().isValid()) {
-                qCWarning(dcLogEngine()) << "Failed to insert loggingEventTypes into DB. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-            }
+        if (job->m_remaining != 0) {
+            // Seek to the next chunk, the offset has been applied already
+            job->m_filter.setOffset(0);
+            job->m_filter.setCursor(nextCursor);
+            requestLogEntries(fetchId, job);
+            return;
         }
     }
 
-    if (!m_db.tables().contains("entries")) {
-        m_db.exec("CREATE TABLE entries "
-                  "("
-                  "timestamp int,"
-                  "loggingLevel int,"
-                  "sourceType int,"
-                  "typeId varchar(38),"
-                  "deviceId varchar(38),"
-                  "value varchar(100),"
-                  "loggingEventType int,"
-                  "active bool,"
-                  "errorCode int,"
-                  "FOREIGN KEY(sourceType) REFERENCES sourceTypes(id),"
-                  "FOREIGN KEY(loggingEventType) REFERENCES loggingEventTypes(id)"
-                  ");");
-
-        if (m_db.lastError().isValid()) {
-            qCWarning(dcLogEngine) << "Error creating log table in database. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
-            return false;
-        }
-
+    m_fetchJobs.remove(fetchId);
+    emit job->finished();
+    job->deleteLater();
+}
 
+void LogEngine::onAggregatesFetched(int fetchId, const QList<LogAggregate> &aggregates)
+{
+    LogAggregatesFetchJob *job = m_aggregateJobs.take(fetchId);
+    if (!job) {
+        return;
     }
 
-    qCDebug(dcLogEngine) << "Initialized logging DB successfully. (maximum DB size:" << m_dbMaxSize << ")";
-    return true;
+    job->m_aggregates = aggregates;
+    emit job->finished();
+    job->deleteLater();
 }
 
 }
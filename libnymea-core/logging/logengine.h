@@ -23,17 +23,60 @@
 #define LOGENGINE_H
 
 #include "logentry.h"
+#include "logaggregate.h"
 #include "logfilter.h"
 #include "types/event.h"
 #include "types/action.h"
 #include "rule.h"
+#include "nymeaconfiguration.h"
 
 #include <QObject>
-#include <QSqlDatabase>
+#include <QThread>
 #include <QTimer>
+#include <QHash>
 
 namespace nymeaserver {
 
+class LogDatabase;
+
+class LogEntriesFetchJob: public QObject
+{
+    Q_OBJECT
+public:
+    QList<LogEntry> entries() const;
+    QString nextCursor() const;
+
+signals:
+    void entriesAvailable(const QList<LogEntry> &entries);
+    void finished();
+
+private:
+    friend class LogEngine;
+    explicit LogEntriesFetchJob(const LogFilter &filter, bool streaming, QObject *parent = nullptr);
+
+    LogFilter m_filter;
+    bool m_streaming = false;
+    int m_remaining = -1;
+    QList<LogEntry> m_entries;
+    QString m_nextCursor;
+};
+
+class LogAggregatesFetchJob: public QObject
+{
+    Q_OBJECT
+public:
+    QList<LogAggregate> aggregates() const;
+
+signals:
+    void finished();
+
+private:
+    friend class LogEngine;
+    explicit LogAggregatesFetchJob(QObject *parent = nullptr);
+
+    QList<LogAggregate> m_aggregates;
+};
+
 class LogEngine: public QObject
 {
     Q_OBJECT
@@ -41,13 +84,24 @@ public:
     LogEngine(const QString &driver, const QString &dbName, const QString &hostname = QString("127.0.0.1"), const QString &username = QString(), const QString &password = QString(), int maxDBSize = 50000, QObject *parent = 0);
     ~LogEngine();
 
-    QList<LogEntry> logEntries(const LogFilter &filter = LogFilter()) const;
+    LogEntriesFetchJob *fetchLogEntries(const LogFilter &filter = LogFilter(), bool streaming = false);
+    QList<LogEntry> logEntries(const LogFilter &filter = LogFilter());
+    LogAggregatesFetchJob *fetchAggregates(const DeviceId &deviceId, const QUuid &typeId, const QDateTime &startDate, const QDateTime &endDate, int bucketSize);
 
     void setMaxLogEntries(int maxLogEntries, int overflow);
+    void setMaxSourceEntries(Logging::LoggingSource source, int maxEntries);
+    void setRetentionPolicy(int maxAge, int budget);
+    void setArchive(const QString &path, int maxSize);
+    void setFlushPolicy(int batchSize, int flushInterval, int maxPendingEntries);
+    void setStateLogPolicy(const StateLogPolicy &policy);
+    void removeStateLogPolicy(const StateTypeId &stateTypeId);
+    void flush();
+    int droppedEntries() const;
     void clearDatabase();
 
     void logSystemEvent(const QDateTime &dateTime, bool active, Logging::LoggingLevel level = Logging::LoggingLevelInfo);
     void logEvent(const Event &event);
+    void logEvents(const QList<Event> &events);
     void logAction(const Action &action, Logging::LoggingLevel level = Logging::LoggingLevelInfo, int errorCode = 0);
     void logRuleTriggered(const Rule &rule);
     void logRuleActiveChanged(const Rule &rule);
@@ -56,30 +110,48 @@ public:
     void logRuleExitActionsExecuted(const Rule &rule);
     void removeDeviceLogs(const DeviceId &deviceId);
     void removeRuleLogs(const RuleId &ruleId);
-    QList<DeviceId> devicesInLogs() const;
+    void removeStaleDeviceLogs(const QList<DeviceId> &configuredDeviceIds);
 
 signals:
     void logEntryAdded(const LogEntry &logEntry);
     void logDatabaseUpdated();
 
 private:
-    bool initDB(const QString &username, const QString &password);
     void appendLogEntry(const LogEntry &entry);
-    void rotate(const QString &dbName);
-
-
-    bool migrateDatabaseVersion2to3();
+    bool filterStateChange(const DeviceId &deviceId, const StateTypeId &stateTypeId, const QVariant &value);
+    void requestLogEntries(int fetchId, LogEntriesFetchJob *job);
 
 private slots:
-    void checkDBSize();
+    void onEntriesProcessed(int count);
+    void onLogEntriesFetched(int fetchId, const QList<LogEntry> &entries, const QString &nextCursor);
+    void onAggregatesFetched(int fetchId, const QList<LogAggregate> &aggregates);
 
 private:
-    QSqlDatabase m_db;
-    int m_dbMaxSize;
-    int m_overflow;
-    bool m_trimWarningPrinted = false;
-    int m_entryCount = 0;
-    QTimer m_housekeepingTimer;
+    QThread m_dbThread;
+    LogDatabase *m_database = nullptr;
+
+    QHash<int, LogEntriesFetchJob *> m_fetchJobs;
+    QHash<int, LogAggregatesFetchJob *> m_aggregateJobs;
+    int m_lastFetchId = 0;
+
+    // Write behind queue
+    QList<LogEntry> m_pendingEntries;
+    QTimer m_flushTimer;
+    int m_flushBatchSize = 100;
+    int m_maxPendingEntries = 10000;
+    int m_queuedEntries = 0;
+    int m_droppedEntries = 0;
+    int m_unreportedDrops = 0;
+    bool m_holdFlush = false;
+
+    // State sampling
+    class LoggedState {
+    public:
+        QVariant value;
+        QDateTime timestamp;
+    };
+    QHash<StateTypeId, StateLogPolicy> m_stateLogPolicies;
+    QHash<DeviceId, QHash<StateTypeId, LoggedState> > m_loggedStates;
 };
 
 }
@@ -86,4 +86,6 @@ QDebug operator<<(QDebug dbg, const LogEntry &entry);
 
 }
 
+Q_DECLARE_METATYPE(QList<nymeaserver::LogEntry>)
+
 #endif
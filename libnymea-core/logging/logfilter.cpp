@@ -34,6 +34,8 @@
 #include "logfilter.h"
 #include "loggingcategories.h"
 
+#include <QStringList>
+
 namespace nymeaserver {
 
 /*! Constructs a new \l{LogFilter}.*/
@@ -82,6 +84,11 @@ QString LogFilter::queryString() const
     }
     query.append(createValuesString());
 
+    if (!query.isEmpty() && hasCursor()) {
+        query.append("AND ");
+    }
+    query.append(createCursorString());
+
     return query;
 }
 
@@ -218,6 +225,64 @@ int LogFilter::offset() const
     return m_offset;
 }
 
+/*! Set the \a cursor for the result set. The result set will start right after the entry the cursor has been created for.
+    In contrast to the \l{offset}, the database can seek directly to the cursor position which makes paging through large
+    result sets a lot cheaper. Returns false if the \a cursor could not be parsed.
+
+    \sa createCursor()
+*/
+bool LogFilter::setCursor(const QString &cursor)
+{
+    QStringList parts = cursor.split(':');
+    bool timestampOk = false;
+    bool rowIdOk = false;
+    if (parts.count() == 2) {
+        qint64 timestamp = parts.first().toLongLong(&timestampOk);
+        qint64 rowId = parts.last().toLongLong(&rowIdOk);
+        if (timestampOk && rowIdOk && timestamp >= 0 && rowId >= 0) {
+            m_cursorTimestamp = timestamp;
+            m_cursorRowId = rowId;
+            return true;
+        }
+    }
+    m_cursorTimestamp = -1;
+    m_cursorRowId = -1;
+    return false;
+}
+
+/*! Returns the cursor of this \l{LogFilter} or an empty string if no cursor is set. */
+QString LogFilter::cursor() const
+{
+    if (!hasCursor()) {
+        return QString();
+    }
+    return createCursor(m_cursorTimestamp, m_cursorRowId);
+}
+
+/*! Returns true if a cursor is set on this \l{LogFilter}. */
+bool LogFilter::hasCursor() const
+{
+    return m_cursorTimestamp >= 0 && m_cursorRowId >= 0;
+}
+
+/*! Returns the timestamp of the entry the cursor points to, or -1 if no cursor is set. */
+qint64 LogFilter::cursorTimestamp() const
+{
+    return m_cursorTimestamp;
+}
+
+/*! Returns the database row of the entry the cursor points to, or -1 if no cursor is set. */
+qint64 LogFilter::cursorRowId() const
+{
+    return m_cursorRowId;
+}
+
+/*! Returns a cursor pointing to the log entry with the given \a timestamp and \a rowId in the database. */
+QString LogFilter::createCursor(qint64 timestamp, qint64 rowId)
+{
+    return QString("%1:%2").arg(timestamp).arg(rowId);
+}
+
 /*! Returns true if this \l{LogFilter} is empty. */
 bool LogFilter::isEmpty() const
 {
@@ -227,7 +292,8 @@ bool LogFilter::isEmpty() const
             m_eventTypes.isEmpty() &&
             m_typeIds.isEmpty() &&
             m_deviceIds.isEmpty() &&
-            m_values.isEmpty();
+            m_values.isEmpty() &&
+            !hasCursor();
 }
 
 QString LogFilter::createDateString() const
@@ -342,11 +408,11 @@ QString LogFilter::createTypeIdsString() const
     QString query;
     if (!m_typeIds.isEmpty()) {
         if (m_typeIds.count() == 1) {
-            query.append(QString("typeId = '%1' ").arg(m_typeIds.first().toString()));
+            query.append(QString("typeId = X'%1' ").arg(QString(m_typeIds.first().toRfc4122().toHex())));
         } else {
             query.append("( ");
             foreach (const QUuid &typeId, m_typeIds) {
-                query.append(QString("typeId = '%1' ").arg(typeId.toString()));
+                query.append(QString("typeId = X'%1' ").arg(QString(typeId.toRfc4122().toHex())));
                 if (typeId != m_typeIds.last())
                     query.append("OR ");
             }
@@ -361,11 +427,11 @@ QString LogFilter::createDeviceIdString() const
     QString query;
     if (!m_deviceIds.isEmpty()) {
         if (m_deviceIds.count() == 1) {
-            query.append(QString("deviceId = '%1' ").arg(m_deviceIds.first().toString()));
+            query.append(QString("deviceId = X'%1' ").arg(QString(m_deviceIds.first().toRfc4122().toHex())));
         } else {
             query.append("( ");
             foreach (const DeviceId &deviceId, m_deviceIds) {
-                query.append(QString("deviceId = '%1' ").arg(deviceId.toString()));
+                query.append(QString("deviceId = X'%1' ").arg(QString(deviceId.toRfc4122().toHex())));
                 if (deviceId != m_deviceIds.last())
                     query.append("OR ");
             }
@@ -396,4 +462,13 @@ QString LogFilter::createValuesString() const
     return query;
 }
 
+QString LogFilter::createCursorString() const
+{
+    // Matches the sort order of the queries (timestamp DESC, ROWID DESC)
+    if (!hasCursor()) {
+        return QString();
+    }
+    return QString("(timestamp < %1 OR (timestamp = %1 AND ROWID < %2)) ").arg(m_cursorTimestamp).arg(m_cursorRowId);
+}
+
 }
@@ -68,6 +68,14 @@ public:
     void setOffset(int offset);
     int offset() const;
 
+    // Keyset pagination, continues after the entry the cursor points to
+    bool setCursor(const QString &cursor);
+    QString cursor() const;
+    bool hasCursor() const;
+    qint64 cursorTimestamp() const;
+    qint64 cursorRowId() const;
+    static QString createCursor(qint64 timestamp, qint64 rowId);
+
     bool isEmpty() const;
 
 private:
@@ -80,6 +88,8 @@ private:
     QList<QString> m_values;
     int m_limit = -1;
     int m_offset = 0;
+    qint64 m_cursorTimestamp = -1;
+    qint64 m_cursorRowId = -1;
 
     QString createDateString() const;
     QString createTimeFilterString(QPair<QDateTime, QDateTime> timeFilter) const;
@@ -89,8 +99,11 @@ private:
     QString createTypeIdsString() const;
     QString createDeviceIdString() const;
     QString createValuesString() const;
+    QString createCursorString() const;
 };
 
 }
 
+Q_DECLARE_METATYPE(nymeaserver::LogFilter)
+
 #endif
@@ -26,9 +26,17 @@
 #include <QCoreApplication>
 #include <QFile>
 #include <QDir>
+#include <QMetaEnum>
 
 namespace nymeaserver {
 
+// e.g. logDBMaxStatesEntries
+static QString sourceEntriesKey(Logging::LoggingSource source)
+{
+    QMetaEnum loggingSources = Logging::staticMetaObject.enumerator(Logging::staticMetaObject.indexOfEnumerator("LoggingSource"));
+    return QString("logDBMax%1Entries").arg(QString(loggingSources.valueToKey(source)).remove("LoggingSource"));
+}
+
 NymeaConfiguration::NymeaConfiguration(QObject *parent) :
     QObject(parent)
 {
@@ -201,6 +209,19 @@ NymeaConfiguration::NymeaConfiguration(QObject *parent) :
         mqttPolicies.endGroup();
     }
 
+    settings.beginGroup("StateLogPolicies");
+    foreach (const QString &stateTypeId, settings.childGroups()) {
+        settings.beginGroup(stateTypeId);
+        StateLogPolicy policy;
+        policy.stateTypeId = StateTypeId(stateTypeId);
+        policy.deadband = settings.value("deadband", 0).toDouble();
+        policy.minInterval = settings.value("minInterval", 0).toInt();
+        policy.onChangeOnly = settings.value("onChangeOnly", false).toBool();
+        m_stateLogPolicies.insert(policy.stateTypeId, policy);
+        settings.endGroup();
+    }
+    settings.endGroup();
+
     // Write defaults for log settings
     settings.beginGroup("Logs");
     settings.setValue("logDBDriver", logDBDriver());
@@ -209,6 +230,18 @@ NymeaConfiguration::NymeaConfiguration(QObject *parent) :
     settings.setValue("logDBUser", logDBUser());
     settings.setValue("logDBPassword", logDBPassword());
     settings.setValue("logDBMaxEntries", logDBMaxEntries());
+    settings.setValue("logDBFlushInterval", logDBFlushInterval());
+    settings.setValue("logDBFlushBatchSize", logDBFlushBatchSize());
+    settings.setValue("logDBMaxPendingEntries", logDBMaxPendingEntries());
+    settings.setValue("logDBMaxAge", logDBMaxAge());
+    settings.setValue("logDBRetentionBudget", logDBRetentionBudget());
+    settings.setValue("logDBArchivePath", logDBArchivePath());
+    settings.setValue("logDBArchiveMaxSize", logDBArchiveMaxSize());
+    QMetaEnum loggingSources = Logging::staticMetaObject.enumerator(Logging::staticMetaObject.indexOfEnumerator("LoggingSource"));
+    for (int i = 0; i < loggingSources.keyCount(); i++) {
+        Logging::LoggingSource source = static_cast<Logging::LoggingSource>(loggingSources.value(i));
+        settings.setValue(sourceEntriesKey(source), logDBMaxSourceEntries(source));
+    }
     settings.endGroup();
 }
 
@@ -398,6 +431,32 @@ bool NymeaConfiguration::removeMqttPolicy(const QString &clientId)
     return true;
 }
 
+/*! Returns the logging policies for state changes, indexed by their state type. */
+QHash<StateTypeId, StateLogPolicy> NymeaConfiguration::stateLogPolicies() const
+{
+    return m_stateLogPolicies;
+}
+
+/*! Adds the given logging \a policy or replaces an existing one for the same state type. */
+void NymeaConfiguration::updateStateLogPolicy(const StateLogPolicy &policy)
+{
+    m_stateLogPolicies[policy.stateTypeId] = policy;
+    storeStateLogPolicy(policy);
+    emit stateLogPolicyChanged(policy.stateTypeId);
+}
+
+/*! Removes the logging policy for the given \a stateTypeId. Returns false if there is no such policy. */
+bool NymeaConfiguration::removeStateLogPolicy(const StateTypeId &stateTypeId)
+{
+    if (!m_stateLogPolicies.contains(stateTypeId)) {
+        return false;
+    }
+    m_stateLogPolicies.remove(stateTypeId);
+    deleteStateLogPolicy(stateTypeId);
+    emit stateLogPolicyRemoved(stateTypeId);
+    return true;
+}
+
 bool NymeaConfiguration::bluetoothServerEnabled() const
 {
     NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
@@ -545,6 +604,62 @@ int NymeaConfiguration::logDBMaxEntries() const
     return settings.value("logDBMaxEntries", 200000).toInt();
 }
 
+int NymeaConfiguration::logDBFlushInterval() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBFlushInterval", 1000).toInt();
+}
+
+int NymeaConfiguration::logDBFlushBatchSize() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBFlushBatchSize", 100).toInt();
+}
+
+int NymeaConfiguration::logDBMaxPendingEntries() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBMaxPendingEntries", 10000).toInt();
+}
+
+int NymeaConfiguration::logDBMaxAge() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBMaxAge", 0).toInt();
+}
+
+int NymeaConfiguration::logDBRetentionBudget() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBRetentionBudget", 20).toInt();
+}
+
+QString NymeaConfiguration::logDBArchivePath() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBArchivePath", logDBName() + ".archive").toString();
+}
+
+int NymeaConfiguration::logDBArchiveMaxSize() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBArchiveMaxSize", 0).toInt();
+}
+
+int NymeaConfiguration::logDBMaxSourceEntries(Logging::LoggingSource source) const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value(sourceEntriesKey(source), 0).toInt();
+}
+
 QString NymeaConfiguration::sslCertificate() const
 {
     NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
@@ -699,6 +814,26 @@ void NymeaConfiguration::deleteMqttPolicy(const QString &clientId)
     settings.remove(clientId);
 }
 
+void NymeaConfiguration::storeStateLogPolicy(const StateLogPolicy &policy)
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("StateLogPolicies");
+    settings.beginGroup(policy.stateTypeId.toString());
+    settings.setValue("deadband", policy.deadband);
+    settings.setValue("minInterval", policy.minInterval);
+    settings.setValue("onChangeOnly", policy.onChangeOnly);
+    settings.endGroup();
+    settings.endGroup();
+}
+
+void NymeaConfiguration::deleteStateLogPolicy(const StateTypeId &stateTypeId)
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("StateLogPolicies");
+    settings.remove(stateTypeId.toString());
+    settings.endGroup();
+}
+
 QDebug operator <<(QDebug debug, const ServerConfiguration &configuration)
 {
     debug.nospace() << "ServerConfiguration(" << configuration.address;
@@ -21,6 +21,9 @@
 #ifndef NYMEACONFIGURATION_H
 #define NYMEACONFIGURATION_H
 
+#include "logging/logging.h"
+#include "typeutils.h"
+
 #include <QHostAddress>
 #include <QObject>
 #include <QLocale>
@@ -66,6 +69,15 @@ public:
 };
 typedef QList<MqttPolicy> MqttPolicies;
 
+class StateLogPolicy
+{
+public:
+    StateTypeId stateTypeId;
+    double deadband = 0;
+    int minInterval = 0;
+    bool onChangeOnly = false;
+};
+
 class NymeaConfiguration : public QObject
 {
     Q_OBJECT
@@ -153,6 +165,18 @@ public:
     QString logDBUser() const;
     QString logDBPassword() const;
     int logDBMaxEntries() const;
+    int logDBFlushInterval() const;
+    int logDBFlushBatchSize() const;
+    int logDBMaxPendingEntries() const;
+    int logDBMaxAge() const;
+    int logDBRetentionBudget() const;
+    QString logDBArchivePath() const;
+    int logDBArchiveMaxSize() const;
+    int logDBMaxSourceEntries(Logging::LoggingSource source) const;
+
+    QHash<StateTypeId, StateLogPolicy> stateLogPolicies() const;
+    void updateStateLogPolicy(const StateLogPolicy &policy);
+    bool removeStateLogPolicy(const StateTypeId &stateTypeId);
 
 private:
     QHash<QString, ServerConfiguration> m_tcpServerConfigs;
@@ -160,6 +184,7 @@ private:
     QHash<QString, ServerConfiguration> m_webSocketServerConfigs;
     QHash<QString, ServerConfiguration> m_mqttServerConfigs;
     QHash<QString, MqttPolicy> m_mqttPolicies;
+    QHash<StateTypeId, StateLogPolicy> m_stateLogPolicies;
 
     void setServerUuid(const QUuid &uuid);
     void setWebServerPublicFolder(const QString & path);
@@ -176,6 +201,9 @@ private:
     MqttPolicy readMqttPolicy(const QString &clientId);
     void deleteMqttPolicy(const QString &clientId);
 
+    void storeStateLogPolicy(const StateLogPolicy &policy);
+    void deleteStateLogPolicy(const StateTypeId &stateTypeId);
+
 signals:
     void serverNameChanged(const QString &serverName);
     void timeZoneChanged();
@@ -193,6 +221,9 @@ signals:
     void mqttPolicyChanged(const QString &clientId);
     void mqttPolicyRemoved(const QString &clientId);
 
+    void stateLogPolicyChanged(const StateTypeId &stateTypeId);
+    void stateLogPolicyRemoved(const StateTypeId &stateTypeId);
+
     void bluetoothServerEnabledChanged();
     void mqttBrokerEnabledChanged();
     void mqttPortChanged();
@@ -38,6 +38,11 @@
     \l{StateType} and the \a value parameter holds the new value.
 */
 
+/*! \fn void nymeaserver::NymeaCore::deviceStatesChanged(const QList<Event> &events);
+    This signal is emitted once for a batch of \l{State} changes. The \a events list holds a state change
+    \l{Event} for each of them. See \l{DeviceManager::deviceStatesChanged()}.
+*/
+
 /*! \fn void nymeaserver::NymeaCore::deviceRemoved(const DeviceId &deviceId);
     This signal is emitted when a \l{Device} with the given \a deviceId was removed.
 */
@@ -118,6 +123,7 @@
 #include "cloud/cloudtransport.h"
 
 #include <QDir>
+#include <QMetaEnum>
 
 namespace nymeaserver {
 
@@ -150,6 +156,17 @@ void NymeaCore::init() {
 
     qCDebug(dcApplication) << "Creating Log Engine";
     m_logger = new LogEngine(m_configuration->logDBDriver(), m_configuration->logDBName(), m_configuration->logDBHost(), m_configuration->logDBUser(), m_configuration->logDBPassword(), m_configuration->logDBMaxEntries(), this);
+    m_logger->setFlushPolicy(m_configuration->logDBFlushBatchSize(), m_configuration->logDBFlushInterval(), m_configuration->logDBMaxPendingEntries());
+    m_logger->setRetentionPolicy(m_configuration->logDBMaxAge(), m_configuration->logDBRetentionBudget());
+    m_logger->setArchive(m_configuration->logDBArchivePath(), m_configuration->logDBArchiveMaxSize());
+    QMetaEnum loggingSources = Logging::staticMetaObject.enumerator(Logging::staticMetaObject.indexOfEnumerator("LoggingSource"));
+    for (int i = 0; i < loggingSources.keyCount(); i++) {
+        Logging::LoggingSource source = static_cast<Logging::LoggingSource>(loggingSources.value(i));
+        m_logger->setMaxSourceEntries(source, m_configuration->logDBMaxSourceEntries(source));
+    }
+    foreach (const StateLogPolicy &policy, m_configuration->stateLogPolicies()) {
+        m_logger->setStateLogPolicy(policy);
+    }
 
     qCDebug(dcApplication()) << "Creating User Manager";
     m_userManager = new UserManager(NymeaSettings::settingsPath() + "/user-db.sqlite", this);
@@ -186,10 +203,14 @@ void NymeaCore::init() {
 
     connect(m_configuration, &NymeaConfiguration::localeChanged, this, &NymeaCore::onLocaleChanged);
     connect(m_configuration, &NymeaConfiguration::serverNameChanged, m_serverManager, &ServerManager::setServerName);
+    connect(m_configuration, &NymeaConfiguration::stateLogPolicyChanged, this, &NymeaCore::onStateLogPolicyChanged);
+    connect(m_configuration, &NymeaConfiguration::stateLogPolicyRemoved, m_logger, &LogEngine::removeStateLogPolicy);
 
     connect(m_deviceManager, &DeviceManager::pluginConfigChanged, this, &NymeaCore::pluginConfigChanged);
     connect(m_deviceManager, &DeviceManager::eventTriggered, this, &NymeaCore::gotEvent);
     connect(m_deviceManager, &DeviceManager::deviceStateChanged, this, &NymeaCore::deviceStateChanged);
+    connect(m_deviceManager, &DeviceManager::deviceStatesChanged, this, &NymeaCore::gotEvents);
+    connect(m_deviceManager, &DeviceManager::deviceStatesChanged, this, &NymeaCore::deviceStatesChanged);
     connect(m_deviceManager, &DeviceManager::deviceAdded, this, &NymeaCore::deviceAdded);
     connect(m_deviceManager, &DeviceManager::deviceChanged, this, &NymeaCore::deviceChanged);
     connect(m_deviceManager, &DeviceManager::deviceRemoved, this, &NymeaCore::deviceRemoved);
@@ -201,6 +222,9 @@ void NymeaCore::init() {
     connect(m_deviceManager, &DeviceManager::pairingFinished, this, &NymeaCore::pairingFinished);
     connect(m_deviceManager, &DeviceManager::loaded, this, &NymeaCore::deviceManagerLoaded);
 
+    connect(m_deviceManager, &DeviceManager::deviceAdded, m_ruleEngine, &RuleEngine::onDeviceAdded);
+    connect(m_deviceManager, &DeviceManager::deviceRemoved, m_ruleEngine, &RuleEngine::onDeviceRemoved);
+
     connect(m_ruleEngine, &RuleEngine::ruleAdded, this, &NymeaCore::ruleAdded);
     connect(m_ruleEngine, &RuleEngine::ruleRemoved, this, &NymeaCore::ruleRemoved);
     connect(m_ruleEngine, &RuleEngine::ruleConfigurationChanged, this, &NymeaCore::ruleConfigurationChanged);
@@ -592,12 +616,22 @@ TagsStorage *NymeaCore::tagsStorage() const
     here will be evaluated by the \l{RuleEngine} and the according \l{RuleAction}{RuleActions} are executed.*/
 void NymeaCore::gotEvent(const Event &event)
 {
-    m_logger->logEvent(event);
-    emit eventTriggered(event);
+    gotEvents(QList<Event>() << event);
+}
+
+/*! Connected to the DeviceManager's deviceStatesChanged signal. The \a events of a batch are logged together
+    and evaluated by the \l{RuleEngine} in a single pass.*/
+void NymeaCore::gotEvents(const QList<Event> &events)
+{
+    m_logger->logEvents(events);
+    foreach (const Event &event, events) {
+        emit eventTriggered(event);
+    }
 
     QList<RuleAction> actions;
-    QList<RuleAction> eventBasedActions;
-    foreach (const Rule &rule, m_ruleEngine->evaluateEvent(event)) {
+    QList<QPair<RuleAction, Event> > eventBasedActions;
+    foreach (const RuleEngine::EvaluationResult &result, m_ruleEngine->evaluateEvents(events)) {
+        const Rule &rule = result.first;
         // Event based
         if (!rule.eventDescriptors().isEmpty()) {
             m_logger->logRuleTriggered(rule);
@@ -612,7 +646,7 @@ void NymeaCore::gotEvent(const Event &event)
             // check if we have an event based action or a normal action
             foreach (const RuleAction &action, tmp) {
                 if (action.isEventBased()) {
-                    eventBasedActions.append(action);
+                    eventBasedActions.append(qMakePair(action, result.second));
                 } else {
                     actions.append(action);
                 }
@@ -629,8 +663,10 @@ void NymeaCore::gotEvent(const Event &event)
         }
     }
 
-    // Set action params, depending on the event value
-    foreach (RuleAction ruleAction, eventBasedActions) {
+    // Set action params, depending on the value of the triggering event
+    for (int i = 0; i < eventBasedActions.count(); i++) {
+        RuleAction ruleAction = eventBasedActions.at(i).first;
+        const Event &event = eventBasedActions.at(i).second;
         RuleActionParamList newParams;
         foreach (RuleActionParam ruleActionParam, ruleAction.ruleActionParams()) {
             // if this event param should be taken over in this action
@@ -685,6 +721,11 @@ void NymeaCore::onLocaleChanged()
     m_deviceManager->setLocale(m_configuration->locale());
 }
 
+void NymeaCore::onStateLogPolicyChanged(const StateTypeId &stateTypeId)
+{
+    m_logger->setStateLogPolicy(m_configuration->stateLogPolicies().value(stateTypeId));
+}
+
 /*! Return the instance of the log engine */
 LogEngine* NymeaCore::logEngine() const
 {
@@ -775,12 +816,11 @@ void NymeaCore::deviceManagerLoaded()
     // Do some houskeeping...
     qCDebug(dcApplication()) << "Starting housekeeping...";
     QDateTime startTime = QDateTime::currentDateTime();
-    foreach (const DeviceId &deviceId, m_logger->devicesInLogs()) {
-        if (!m_deviceManager->findConfiguredDevice(deviceId)) {
-            qCDebug(dcApplication()) << "Cleaning stale device entries from log DB for device id" << deviceId;
-            m_logger->removeDeviceLogs(deviceId);
-        }
+    QList<DeviceId> configuredDeviceIds;
+    foreach (Device *device, m_deviceManager->configuredDevices()) {
+        configuredDeviceIds.append(device->id());
     }
+    m_logger->removeStaleDeviceLogs(configuredDeviceIds);
 
     foreach (const DeviceId &deviceId, m_ruleEngine->devicesInRules()) {
         if (!m_deviceManager->findConfiguredDevice(deviceId)) {
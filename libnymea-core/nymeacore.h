@@ -97,6 +97,7 @@ signals:
     void pluginConfigChanged(const PluginId &id, const ParamList &config);
     void eventTriggered(const Event &event);
     void deviceStateChanged(Device *device, const QUuid &stateTypeId, const QVariant &value);
+    void deviceStatesChanged(const QList<Event> &events);
     void deviceRemoved(const DeviceId &deviceId);
     void deviceAdded(Device *device);
     void deviceChanged(Device *device);
@@ -134,8 +135,10 @@ private:
 
 private slots:
     void gotEvent(const Event &event);
+    void gotEvents(const QList<Event> &events);
     void onDateTimeChanged(const QDateTime &dateTime);
     void onLocaleChanged();
+    void onStateLogPolicyChanged(const StateTypeId &stateTypeId);
     void actionExecutionFinished(const ActionId &id, DeviceManager::DeviceError status);
     void onDeviceDisappeared(const DeviceId &deviceId);
     void deviceManagerLoaded();
@@ -118,13 +118,19 @@
 #include <QStandardPaths>
 #include <QCoreApplication>
 
+#include <algorithm>
+#include <limits>
+
 namespace nymeaserver {
 
 /*! Constructs the RuleEngine with the given \a parent. Although it wouldn't harm to have multiple RuleEngines, there is one
     instance available from \l{NymeaCore}. This one should be used instead of creating multiple ones.
  */
 RuleEngine::RuleEngine(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_nextRuleOrder(0),
+    m_evaluationPass(0),
+    m_activeRuleCount(0)
 {
 }
 
@@ -141,66 +147,130 @@ RuleEngine::~RuleEngine()
 */
 QList<Rule> RuleEngine::evaluateEvent(const Event &event)
 {
-    Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevice(event.deviceId());
-    DeviceClass deviceClass = NymeaCore::instance()->deviceManager()->findDeviceClass(device->deviceClassId());
-    EventType eventType = deviceClass.eventTypes().findById(event.eventTypeId());
-
-
-    if (event.params().count() == 0) {
-        qCDebug(dcRuleEngineDebug).nospace().noquote() << "Evaluate event: " << device->name() << " - " << eventType.name() << " (DeviceId:" << device->id().toString() << ", EventTypeId:" << eventType.id().toString() << ")";
-    } else {
-        qCDebug(dcRuleEngineDebug).nospace().noquote() << "Evaluate event: " << device->name() << " - " << eventType.name() << " (DeviceId:" << device->id().toString() << ", EventTypeId:" << eventType.id().toString() << ")" << endl << "     " << event.params();
+    QList<Rule> rules;
+    foreach (const EvaluationResult &result, evaluateEvents(QList<Event>() << event)) {
+        rules.append(result.first);
     }
+    return rules;
+}
 
-    QList<Rule> rules;
-    foreach (const RuleId &id, ruleIds()) {
-        Rule rule = m_rules.value(id);
-        if (!rule.enabled()) {
-            qCDebug(dcRuleEngineDebug()).nospace().noquote() << "Skipping rule " << rule.name() << " (" << rule.id().toString() << ") "  << " because it is disabled.";
+/*! Ask the Engine to evaluate all the rules for the given \a events in a single pass.
+
+    The states of the system are expected to reflect all \a events already, like after a batch of state
+    changes. Each affected state based \l{Rule} is evaluated once, so a rule only reports its final active
+    state for the whole batch. Event based rules are matched against every event. Returns the \l{Rule}{Rules}
+    that are triggered or change their active state, each paired with the event that triggered it. For state
+    based rules this is the last event of the batch affecting the rule.
+*/
+QList<RuleEngine::EvaluationResult> RuleEngine::evaluateEvents(const QList<Event> &events)
+{
+    DeviceManager *deviceManager = NymeaCore::instance()->deviceManager();
+
+    // Only look at the rules which can actually react on these events. Rules referencing a device/type
+    // directly are found in the device index, rules using interfaces by the interfaces of the device class.
+    m_evaluationPass++;
+    m_candidates.clear();
+    QVector<DeviceClassId> deviceClassIds(events.count());
+    for (int i = 0; i < events.count(); i++) {
+        const Event &event = events.at(i);
+        Device *device = deviceManager->findConfiguredDevice(event.deviceId());
+        if (!device) {
+            qCWarning(dcRuleEngine()) << "Ignoring event" << event.eventTypeId() << "for unknown device" << event.deviceId();
             continue;
         }
+        DeviceClass deviceClass = deviceManager->findDeviceClass(device->deviceClassId());
+        deviceClassIds[i] = deviceClass.id();
 
-        // If we have a state based on this event
-        if (containsState(rule.stateEvaluator(), event)) {
-            rule.setStatesActive(rule.stateEvaluator().evaluate());
-            m_rules[rule.id()] = rule;
+        if (dcRuleEngineDebug().isDebugEnabled()) {
+            EventType eventType = deviceClass.eventTypes().findById(event.eventTypeId());
+            if (event.params().count() == 0) {
+                qCDebug(dcRuleEngineDebug).nospace().noquote() << "Evaluate event: " << device->name() << " - " << eventType.name() << " (DeviceId:" << device->id().toString() << ", EventTypeId:" << eventType.id().toString() << ")";
+            } else {
+                qCDebug(dcRuleEngineDebug).nospace().noquote() << "Evaluate event: " << device->name() << " - " << eventType.name() << " (DeviceId:" << device->id().toString() << ", EventTypeId:" << eventType.id().toString() << ")" << endl << "     " << event.params();
+            }
+        }
+
+        QPair<QUuid, QUuid> key(event.deviceId(), event.eventTypeId());
+        QVector<int> stateRules = m_deviceStateRules.value(key);
+        addCandidates(m_deviceEventRules.value(key), true);
+        foreach (const QString &interface, deviceClass.interfaces()) {
+            stateRules += m_interfaceStateRules.value(interface);
+            addCandidates(m_interfaceEventRules.value(interface), true);
+        }
+        addCandidates(stateRules, false);
+
+        // State change events carry the StateTypeId as EventTypeId. Every changed state needs to reach the
+        // evaluators, the active state of the rules is only checked once all of them are up to date.
+        StateTypeId stateTypeId = StateTypeId::fromUuid(event.eventTypeId());
+        foreach (int slot, stateRules) {
+            RuleEntry &entry = m_rules[slot];
+            if (entry.rule.enabled()) {
+                entry.statesActive = entry.stateEvaluator.updateState(device, deviceClass, stateTypeId);
+                entry.lastStateEvent = i;
+            }
+        }
+    }
+    foreach (int slot, m_unsettledRules) {
+        if (m_rules.at(slot).evaluationPass != m_evaluationPass) {
+            m_rules[slot].evaluationPass = m_evaluationPass;
+            m_rules[slot].eventCandidate = false;
+            m_rules[slot].lastStateEvent = -1;
+            m_candidates.append(slot);
+        }
+    }
+    m_unsettledRules.clear();
+
+    // Evaluate them in the order they have been added to the engine
+    std::sort(m_candidates.begin(), m_candidates.end(), [this](int a, int b) {
+        return m_rules.at(a).order < m_rules.at(b).order;
+    });
+
+    QList<EvaluationResult> results;
+    for (int i = 0; i < m_candidates.count(); i++) {
+        int slot = m_candidates.at(i);
+        RuleEntry &entry = m_rules[slot];
+        if (!entry.rule.enabled()) {
+            qCDebug(dcRuleEngineDebug()).nospace().noquote() << "Skipping rule " << entry.rule.name() << " (" << entry.rule.id().toString() << ") "  << " because it is disabled.";
+            continue;
         }
 
         // If this rule does not base on an event, evaluate the rule
-        if (rule.eventDescriptors().isEmpty() && rule.timeDescriptor().timeEventItems().isEmpty()) {
-            if (rule.timeActive() && rule.statesActive()) {
-                if (!m_activeRules.contains(rule.id())) {
-                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") active.";
-                    rule.setActive(true);
-                    m_rules[rule.id()] = rule;
-                    m_activeRules.append(rule.id());
-                    rules.append(rule);
+        if (entry.stateBased) {
+            Event event = events.value(entry.lastStateEvent >= 0 ? entry.lastStateEvent : events.count() - 1);
+            if (entry.timeActive && entry.statesActive) {
+                if (!entry.active) {
+                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << entry.rule.name() << " (" << entry.rule.id().toString() << ") active.";
+                    entry.active = true;
+                    m_activeRuleCount++;
+                    results.append(qMakePair(ruleSnapshot(entry), event));
                 }
             } else {
-                if (m_activeRules.contains(rule.id())) {
-                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") inactive.";
-                    rule.setActive(false);
-                    m_rules[rule.id()] = rule;
-                    m_activeRules.removeAll(rule.id());
-                    rules.append(rule);
+                if (entry.active) {
+                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << entry.rule.name() << " (" << entry.rule.id().toString() << ") inactive.";
+                    entry.active = false;
+                    m_activeRuleCount--;
+                    results.append(qMakePair(ruleSnapshot(entry), event));
                 }
             }
-        } else {
+        } else if (entry.eventCandidate) {
             // Event based rule
-            if (containsEvent(rule, event, device->deviceClassId())) {
-                qCDebug(dcRuleEngineDebug()).nospace().noquote() << "Rule " << rule.name() << " (" << rule.id().toString() << ") contains event " << event.eventId();
-                if (rule.statesActive() && rule.timeActive()) {
-                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" + rule.id().toString() << ") contains event" << event.eventId() << "and all states match.";
-                    rules.append(rule);
+            for (int j = 0; j < events.count(); j++) {
+                const Event &event = events.at(j);
+                if (deviceClassIds.at(j).isNull() || !containsEvent(entry.rule, event, deviceClassIds.at(j))) {
+                    continue;
+                }
+                qCDebug(dcRuleEngineDebug()).nospace().noquote() << "Rule " << entry.rule.name() << " (" << entry.rule.id().toString() << ") contains event " << event.eventId();
+                if (entry.statesActive && entry.timeActive) {
+                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << entry.rule.name() << " (" + entry.rule.id().toString() << ") contains event" << event.eventId() << "and all states match.";
                 } else {
-                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << rule.name() << " (" + rule.id().toString() << ") contains event" << event.eventId() << "but state are not matching.";
-                    rules.append(rule);
+                    qCDebug(dcRuleEngine).nospace().noquote() << "Rule " << entry.rule.name() << " (" + entry.rule.id().toString() << ") contains event" << event.eventId() << "but state are not matching.";
                 }
+                results.append(qMakePair(ruleSnapshot(entry), event));
             }
         }
     }
 
-    return rules;
+    return results;
 }
 
 /*! Ask the Engine to evaluate all the rules for the given \a dateTime.
@@ -210,61 +280,86 @@ QList<Rule> RuleEngine::evaluateEvent(const Event &event)
 */
 QList<Rule> RuleEngine::evaluateTime(const QDateTime &dateTime)
 {
+    // If the time went backwards or the time zone changed, the schedule can't be trusted any more
+    bool evaluateAll = !m_lastEvaluationTime.isValid() || dateTime <= m_lastEvaluationTime || dateTime.timeZone() != m_lastEvaluationTime.timeZone();
+
     // Initialize the last datetime if not already set (current time -1 second)
     if (!m_lastEvaluationTime.isValid()) {
         m_lastEvaluationTime = dateTime;
         m_lastEvaluationTime = m_lastEvaluationTime.addSecs(-1);
     }
 
+    // Only look at the rules whose time descriptor may have changed since the last evaluation
+    m_timeCandidates.clear();
+    if (evaluateAll) {
+        m_timeSchedule.clear();
+        for (int slot = 0; slot < m_rules.count(); slot++) {
+            m_rules[slot].scheduled = false;
+            if (m_rules.at(slot).used && m_rules.at(slot).hasTimeDescriptor) {
+                m_timeCandidates.append(slot);
+            }
+        }
+    } else {
+        qint64 now = dateTime.toMSecsSinceEpoch();
+        while (!m_timeSchedule.isEmpty() && m_timeSchedule.firstKey() <= now) {
+            QMultiMap<qint64, int>::iterator it = m_timeSchedule.begin();
+            m_rules[it.value()].scheduled = false;
+            m_timeCandidates.append(it.value());
+            m_timeSchedule.erase(it);
+        }
+        std::sort(m_timeCandidates.begin(), m_timeCandidates.end(), [this](int a, int b) {
+            return m_rules.at(a).order < m_rules.at(b).order;
+        });
+    }
+
     QList<Rule> rules;
 
-    foreach (const Rule &r, m_rules.values()) {
-        Rule rule = m_rules.value(r.id());
-        if (!rule.enabled()) {
-            qCDebug(dcRuleEngineDebug()) << "Skipping rule" + rule.name() + "because it is disabled";
-            continue;
-        }
+    for (int i = 0; i < m_timeCandidates.count(); i++) {
+        int slot = m_timeCandidates.at(i);
+        RuleEntry &entry = m_rules[slot];
 
-        // If no timeDescriptor, do nothing
-        if (rule.timeDescriptor().isEmpty())
+        // Disabled rules get scheduled again once they are enabled
+        if (!entry.rule.enabled()) {
+            qCDebug(dcRuleEngineDebug()) << "Skipping rule" + entry.rule.name() + "because it is disabled";
             continue;
+        }
 
         // Check if this rule is based on calendarItems
-        if (!rule.timeDescriptor().calendarItems().isEmpty()) {
-            rule.setTimeActive(rule.timeDescriptor().evaluate(m_lastEvaluationTime, dateTime));
-            m_rules[rule.id()] = rule;
-
-            if (rule.timeDescriptor().timeEventItems().isEmpty() && rule.eventDescriptors().isEmpty()) {
-
-                if (rule.timeActive() && rule.statesActive()) {
-                    if (!m_activeRules.contains(rule.id())) {
-                        qCDebug(dcRuleEngine) << "Rule" << rule.id().toString() << "active.";
-                        rule.setActive(true);
-                        m_rules[rule.id()] = rule;
-                        m_activeRules.append(rule.id());
-                        rules.append(rule);
+        if (entry.hasCalendarItems) {
+            entry.timeActive = entry.rule.timeDescriptor().evaluate(m_lastEvaluationTime, dateTime);
+
+            if (entry.stateBased) {
+                if (entry.timeActive && entry.statesActive) {
+                    if (!entry.active) {
+                        qCDebug(dcRuleEngine) << "Rule" << entry.rule.id().toString() << "active.";
+                        entry.active = true;
+                        m_activeRuleCount++;
+                        rules.append(ruleSnapshot(entry));
                     }
                 } else {
-                    if (m_activeRules.contains(rule.id())) {
-                        qCDebug(dcRuleEngine) << "Rule" << rule.id().toString() << "inactive.";
-                        rule.setActive(false);
-                        m_rules[rule.id()] = rule;
-                        m_activeRules.removeAll(rule.id());
-                        rules.append(rule);
+                    if (entry.active) {
+                        qCDebug(dcRuleEngine) << "Rule" << entry.rule.id().toString() << "inactive.";
+                        entry.active = false;
+                        m_activeRuleCount--;
+                        rules.append(ruleSnapshot(entry));
                     }
                 }
             }
         }
 
-
         // If we have timeEvent items
-        if (!rule.timeDescriptor().timeEventItems().isEmpty()) {
-            bool valid = rule.timeDescriptor().evaluate(m_lastEvaluationTime, dateTime);
-            if (valid && rule.timeActive()) {
-                qCDebug(dcRuleEngine) << "Rule" << rule.id() << "time event triggert.";
-                rules.append(rule);
+        if (entry.hasTimeEventItems) {
+            bool valid = entry.rule.timeDescriptor().evaluate(m_lastEvaluationTime, dateTime);
+            if (valid && entry.timeActive) {
+                qCDebug(dcRuleEngine) << "Rule" << entry.rule.id() << "time event triggert.";
+                rules.append(ruleSnapshot(entry));
             }
         }
+
+        QDateTime nextEvaluationTime = entry.rule.timeDescriptor().nextEvaluationTime(dateTime);
+        if (nextEvaluationTime.isValid()) {
+            scheduleTimeEvaluation(slot, nextEvaluationTime.toMSecsSinceEpoch());
+        }
     }
 
     m_lastEvaluationTime = dateTime;
@@ -280,7 +375,7 @@ RuleEngine::RuleError RuleEngine::addRule(const Rule &rule, bool fromEdit)
     if (rule.id().isNull())
         return RuleErrorInvalidRuleId;
 
-    if (!findRule(rule.id()).id().isNull()) {
+    if (m_ruleSlots.contains(rule.id())) {
         qCWarning(dcRuleEngine) << "Already have a rule with this id.";
         return RuleErrorInvalidRuleId;
     }
@@ -597,7 +692,11 @@ RuleEngine::RuleError RuleEngine::editRule(const Rule &rule)
 */
 QList<Rule> RuleEngine::rules() const
 {
-    return m_rules.values();
+    QList<Rule> rules;
+    foreach (const RuleId &ruleId, m_ruleIds) {
+        rules.append(ruleSnapshot(m_rules.at(m_ruleSlots.value(ruleId))));
+    }
+    return rules;
 }
 
 /*! Returns a list of all ruleIds loaded in this Engine. */
@@ -606,6 +705,23 @@ QList<RuleId> RuleEngine::ruleIds() const
     return m_ruleIds;
 }
 
+/*! Returns the ids of all \l{Rule}{Rules} which are currently active, in the order of ruleIds().
+    Only state based rules can be active.
+*/
+QList<RuleId> RuleEngine::activeRules() const
+{
+    QList<RuleId> activeRules;
+    if (m_activeRuleCount == 0)
+        return activeRules;
+
+    foreach (const RuleId &ruleId, m_ruleIds) {
+        if (m_rules.at(m_ruleSlots.value(ruleId)).active) {
+            activeRules.append(ruleId);
+        }
+    }
+    return activeRules;
+}
+
 /*! Removes the \l{Rule} with the given \a ruleId from the Engine.
     Returns \l{RuleError} which describes whether the operation
     was successful or not. If \a fromEdit is true, the notification Rules.RuleRemoved
@@ -619,8 +735,7 @@ RuleEngine::RuleError RuleEngine::removeRule(const RuleId &ruleId, bool fromEdit
     }
 
     m_ruleIds.takeAt(index);
-    m_rules.remove(ruleId);
-    m_activeRules.removeAll(ruleId);
+    releaseRule(m_ruleSlots.take(ruleId));
 
     NymeaSettings settings(NymeaSettings::SettingsRoleRules);
     settings.beginGroup(ruleId.toString());
@@ -642,17 +757,24 @@ RuleEngine::RuleError RuleEngine::removeRule(const RuleId &ruleId, bool fromEdit
 */
 RuleEngine::RuleError RuleEngine::enableRule(const RuleId &ruleId)
 {
-    if (!m_rules.contains(ruleId)) {
+    if (!m_ruleSlots.contains(ruleId)) {
         qCWarning(dcRuleEngine) << "Rule not found. Can't enable it";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
-    if (rule.enabled())
+    int slot = m_ruleSlots.value(ruleId);
+    RuleEntry &entry = m_rules[slot];
+    if (entry.rule.enabled())
         return RuleErrorNoError;
 
-    rule.setEnabled(true);
-    m_rules[ruleId] = rule;
+    // The cached states have not been updated while the rule was disabled
+    entry.rule.setEnabled(true);
+    entry.statesActive = entry.stateEvaluator.evaluate();
+    markUnsettled(slot);
+    if (entry.hasTimeDescriptor)
+        scheduleTimeEvaluation(slot, std::numeric_limits<qint64>::min());
+
+    Rule rule = ruleSnapshot(entry);
     saveRule(rule);
     emit ruleConfigurationChanged(rule);
 
@@ -668,17 +790,17 @@ RuleEngine::RuleError RuleEngine::enableRule(const RuleId &ruleId)
 */
 RuleEngine::RuleError RuleEngine::disableRule(const RuleId &ruleId)
 {
-    if (!m_rules.contains(ruleId)) {
+    if (!m_ruleSlots.contains(ruleId)) {
         qCWarning(dcRuleEngine) << "Rule not found. Can't disable it";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
-    if (!rule.enabled())
+    RuleEntry &entry = m_rules[m_ruleSlots.value(ruleId)];
+    if (!entry.rule.enabled())
         return RuleErrorNoError;
 
-    rule.setEnabled(false);
-    m_rules[ruleId] = rule;
+    entry.rule.setEnabled(false);
+    Rule rule = ruleSnapshot(entry);
     saveRule(rule);
     emit ruleConfigurationChanged(rule);
 
@@ -695,12 +817,12 @@ RuleEngine::RuleError RuleEngine::disableRule(const RuleId &ruleId)
 RuleEngine::RuleError RuleEngine::executeActions(const RuleId &ruleId)
 {
     // check if rule exits
-    if (!m_rules.contains(ruleId)) {
+    if (!m_ruleSlots.contains(ruleId)) {
         qCWarning(dcRuleEngine) << "Not executing rule actions: rule not found.";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
+    Rule rule = ruleSnapshot(m_rules.at(m_ruleSlots.value(ruleId)));
 
     // check if rule is executable
     if (!rule.executable()) {
@@ -730,12 +852,12 @@ RuleEngine::RuleError RuleEngine::executeActions(const RuleId &ruleId)
 RuleEngine::RuleError RuleEngine::executeExitActions(const RuleId &ruleId)
 {
     // check if rule exits
-    if (!m_rules.contains(ruleId)) {
+    if (!m_ruleSlots.contains(ruleId)) {
         qCWarning(dcRuleEngine) << "Not executing rule exit actions: rule not found.";
         return RuleErrorRuleNotFound;
     }
 
-    Rule rule = m_rules.value(ruleId);
+    Rule rule = ruleSnapshot(m_rules.at(m_ruleSlots.value(ruleId)));
 
     // check if rule is executable
     if (!rule.executable()) {
@@ -757,10 +879,10 @@ RuleEngine::RuleError RuleEngine::executeExitActions(const RuleId &ruleId)
 /*! Returns the \l{Rule} with the given \a ruleId. If the \l{Rule} does not exist, it will return \l{Rule::Rule()} */
 Rule RuleEngine::findRule(const RuleId &ruleId)
 {
-    if (!m_rules.contains(ruleId))
+    if (!m_ruleSlots.contains(ruleId))
         return Rule();
 
-    return m_rules.value(ruleId);
+    return ruleSnapshot(m_rules.at(m_ruleSlots.value(ruleId)));
 }
 
 /*! Returns a list of all \l{Rule}{Rules} loaded in this Engine, which contains a \l{Device} with the given \a deviceId. */
@@ -768,7 +890,8 @@ QList<RuleId> RuleEngine::findRules(const DeviceId &deviceId) const
 {
     // Find all offending rules
     QList<RuleId> offendingRules;
-    foreach (const Rule &rule, m_rules) {
+    foreach (const RuleId &ruleId, m_ruleIds) {
+        const Rule &rule = m_rules.at(m_ruleSlots.value(ruleId)).rule;
         bool offending = false;
         foreach (const EventDescriptor &eventDescriptor, rule.eventDescriptors()) {
             if (eventDescriptor.deviceId() == deviceId) {
@@ -809,7 +932,8 @@ QList<RuleId> RuleEngine::findRules(const DeviceId &deviceId) const
 QList<DeviceId> RuleEngine::devicesInRules() const
 {
     QList<DeviceId> tmp;
-    foreach (const Rule &rule, m_rules) {
+    foreach (const RuleId &ruleId, m_ruleIds) {
+        const Rule &rule = m_rules.at(m_ruleSlots.value(ruleId)).rule;
         foreach (const EventDescriptor &descriptor, rule.eventDescriptors()) {
             if (!tmp.contains(descriptor.deviceId()) && !descriptor.deviceId().isNull()) {
                 tmp.append(descriptor.deviceId());
@@ -837,10 +961,10 @@ QList<DeviceId> RuleEngine::devicesInRules() const
 /*! Removes a \l{Device} from a \l{Rule} with the given \a id and \a deviceId. */
 void RuleEngine::removeDeviceFromRule(const RuleId &id, const DeviceId &deviceId)
 {
-    if (!m_rules.contains(id))
+    if (!m_ruleSlots.contains(id))
         return;
 
-    Rule rule = m_rules.value(id);
+    Rule rule = m_rules.at(m_ruleSlots.value(id)).rule;
 
     // remove device from eventDescriptors
     QList<EventDescriptor> eventDescriptors = rule.eventDescriptors();
@@ -889,7 +1013,8 @@ void RuleEngine::removeDeviceFromRule(const RuleId &id, const DeviceId &deviceId
     if (actions.isEmpty() && exitActions.isEmpty()) {
         // The rule doesn't have any actions any more and is useless at this point... let's remove it altogether
         qCDebug(dcRuleEngine()) << "Rule" << rule.name() << "(" + rule.id().toString() + ")" << "does not have any actions any more. Removing it.";
-        m_rules.take(id);
+        m_ruleIds.removeAll(id);
+        releaseRule(m_ruleSlots.take(id));
         emit ruleRemoved(id);
         return;
     }
@@ -901,11 +1026,65 @@ void RuleEngine::removeDeviceFromRule(const RuleId &id, const DeviceId &deviceId
     newRule.setStateEvaluator(stateEvalatuator);
     newRule.setActions(actions);
     newRule.setExitActions(exitActions);
-    m_rules[id] = newRule;
+    CompiledStateEvaluator compiledStateEvaluator(stateEvalatuator);
+    compiledStateEvaluator.evaluate();
+
+    // Keep the position in the evaluation order and the active state
+    int slot = m_ruleSlots.value(id);
+    unindexRule(rule, slot);
+    storeRule(newRule, compiledStateEvaluator, slot);
+    indexRule(newRule, slot);
+    markUnsettled(slot);
 
     // save it
     saveRule(newRule);
-    emit ruleConfigurationChanged(newRule);
+    emit ruleConfigurationChanged(ruleSnapshot(m_rules.at(slot)));
+}
+
+/*! Feeds the states of the newly added \a device to the interface based \l{StateEvaluator}{StateEvaluators}
+    of all rules, so a device whose states already match is taken into account without waiting for a state change. */
+void RuleEngine::onDeviceAdded(Device *device)
+{
+    DeviceClass deviceClass = NymeaCore::instance()->deviceManager()->findDeviceClass(device->deviceClassId());
+
+    QVector<int> ruleSlots;
+    foreach (const QString &interface, deviceClass.interfaces()) {
+        foreach (int slot, m_interfaceStateRules.value(interface)) {
+            if (!ruleSlots.contains(slot)) {
+                ruleSlots.append(slot);
+            }
+        }
+    }
+
+    foreach (int slot, ruleSlots) {
+        RuleEntry &entry = m_rules[slot];
+        if (!entry.rule.enabled())
+            continue;
+
+        foreach (const StateType &stateType, deviceClass.stateTypes()) {
+            entry.statesActive = entry.stateEvaluator.updateState(device, deviceClass, stateType.id());
+        }
+        markUnsettled(slot);
+    }
+}
+
+/*! Drops the \l{Device} with the given \a deviceId from the cached state of interface based \l{StateEvaluator}{StateEvaluators}. */
+void RuleEngine::onDeviceRemoved(const DeviceId &deviceId)
+{
+    QVector<int> ruleSlots;
+    foreach (const QVector<int> &interfaceRuleSlots, m_interfaceStateRules) {
+        foreach (int slot, interfaceRuleSlots) {
+            if (!ruleSlots.contains(slot)) {
+                ruleSlots.append(slot);
+            }
+        }
+    }
+
+    foreach (int slot, ruleSlots) {
+        RuleEntry &entry = m_rules[slot];
+        entry.statesActive = entry.stateEvaluator.removeDevice(deviceId);
+        markUnsettled(slot);
+    }
 }
 
 bool RuleEngine::containsEvent(const Rule &rule, const Event &event, const DeviceClassId &deviceClassId)
@@ -994,31 +1173,6 @@ bool RuleEngine::containsEvent(const Rule &rule, const Event &event, const Devic
     return false;
 }
 
-bool RuleEngine::containsState(const StateEvaluator &stateEvaluator, const Event &stateChangeEvent)
-{
-    if (stateEvaluator.stateDescriptor().isValid()) {
-        if (stateEvaluator.stateDescriptor().type() == StateDescriptor::TypeDevice) {
-            if (stateEvaluator.stateDescriptor().stateTypeId().toString() == stateChangeEvent.eventTypeId().toString()) {
-                return true;
-            }
-        } else {
-            Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevice(stateChangeEvent.deviceId());
-            DeviceClass deviceClass = NymeaCore::instance()->deviceManager()->findDeviceClass(device->deviceClassId());
-            if (deviceClass.interfaces().contains(stateEvaluator.stateDescriptor().interface())) {
-                return true;
-            }
-        }
-    }
-
-    foreach (const StateEvaluator &childEvaluator, stateEvaluator.childEvaluators()) {
-        if (containsState(childEvaluator, stateChangeEvent)) {
-            return true;
-        }
-    }
-
-    return false;
-}
-
 bool RuleEngine::checkEventDescriptors(const QList<EventDescriptor> eventDescriptors, const EventTypeId &eventTypeId)
 {
     foreach (const EventDescriptor eventDescriptor, eventDescriptors) {
@@ -1066,11 +1220,173 @@ QVariant::Type RuleEngine::getEventParamType(const EventTypeId &eventTypeId, con
 
 void RuleEngine::appendRule(const Rule &rule)
 {
-    Rule newRule = rule;
-    newRule.setStatesActive(newRule.stateEvaluator().evaluate());
-    qCDebug(dcRuleEngine()) << "Adding Rule:" << newRule;
-    m_rules.insert(rule.id(), newRule);
+    CompiledStateEvaluator stateEvaluator(rule.stateEvaluator());
+    stateEvaluator.evaluate();
+    int slot = storeRule(rule, stateEvaluator);
+    qCDebug(dcRuleEngine()) << "Adding Rule:" << ruleSnapshot(m_rules.at(slot));
+    m_ruleSlots.insert(rule.id(), slot);
     m_ruleIds.append(rule.id());
+    indexRule(rule, slot);
+
+    // A state based rule might already be active, let the next event settle it
+    markUnsettled(slot);
+}
+
+/* Stores the given rule in the given slot, or in a free slot if \a slot is -1. Overwriting
+   an existing slot keeps the evaluation order and the active state of the rule in it. */
+int RuleEngine::storeRule(const Rule &rule, const CompiledStateEvaluator &stateEvaluator, int slot)
+{
+    if (slot < 0) {
+        if (!m_freeSlots.isEmpty()) {
+            slot = m_freeSlots.takeLast();
+        } else {
+            slot = m_rules.count();
+            m_rules.append(RuleEntry());
+        }
+        m_rules[slot] = RuleEntry();
+        m_rules[slot].order = m_nextRuleOrder++;
+        m_rules[slot].used = true;
+    }
+
+    RuleEntry &entry = m_rules[slot];
+    entry.rule = rule;
+    entry.stateEvaluator = stateEvaluator;
+    entry.hasTimeDescriptor = !rule.timeDescriptor().isEmpty();
+    entry.hasCalendarItems = !rule.timeDescriptor().calendarItems().isEmpty();
+    entry.hasTimeEventItems = !rule.timeDescriptor().timeEventItems().isEmpty();
+    entry.stateBased = rule.eventDescriptors().isEmpty() && !entry.hasTimeEventItems;
+    entry.statesActive = stateEvaluator.result();
+    entry.timeActive = rule.timeActive();
+
+    // Evaluate the time descriptor on the next time evaluation
+    unscheduleTimeEvaluation(slot);
+    if (entry.hasTimeDescriptor)
+        scheduleTimeEvaluation(slot, std::numeric_limits<qint64>::min());
+
+    return slot;
+}
+
+void RuleEngine::releaseRule(int slot)
+{
+    unindexRule(m_rules.at(slot).rule, slot);
+    unscheduleTimeEvaluation(slot);
+    m_unsettledRules.removeAll(slot);
+    if (m_rules.at(slot).active)
+        m_activeRuleCount--;
+    m_rules[slot] = RuleEntry();
+    m_freeSlots.append(slot);
+}
+
+/* Returns a copy of the stored rule with the runtime flags of the entry applied. */
+Rule RuleEngine::ruleSnapshot(const RuleEntry &entry) const
+{
+    Rule rule = entry.rule;
+    rule.setActive(entry.active);
+    rule.setStatesActive(entry.statesActive);
+    rule.setTimeActive(entry.timeActive);
+    return rule;
+}
+
+void RuleEngine::addCandidates(const QVector<int> &ruleSlots, bool eventCandidate)
+{
+    foreach (int slot, ruleSlots) {
+        RuleEntry &entry = m_rules[slot];
+        if (entry.evaluationPass != m_evaluationPass) {
+            entry.evaluationPass = m_evaluationPass;
+            entry.eventCandidate = false;
+            entry.lastStateEvent = -1;
+            m_candidates.append(slot);
+        }
+        if (eventCandidate) {
+            entry.eventCandidate = true;
+        }
+    }
+}
+
+void RuleEngine::scheduleTimeEvaluation(int slot, qint64 time)
+{
+    RuleEntry &entry = m_rules[slot];
+    if (entry.scheduled) {
+        if (entry.scheduledTime <= time)
+            return;
+
+        m_timeSchedule.remove(entry.scheduledTime, slot);
+    }
+    entry.scheduled = true;
+    entry.scheduledTime = time;
+    m_timeSchedule.insert(time, slot);
+}
+
+void RuleEngine::unscheduleTimeEvaluation(int slot)
+{
+    RuleEntry &entry = m_rules[slot];
+    if (!entry.scheduled)
+        return;
+
+    m_timeSchedule.remove(entry.scheduledTime, slot);
+    entry.scheduled = false;
+}
+
+void RuleEngine::markUnsettled(int slot)
+{
+    if (!m_unsettledRules.contains(slot))
+        m_unsettledRules.append(slot);
+}
+
+void RuleEngine::indexRule(const Rule &rule, int slot)
+{
+    foreach (const EventDescriptor &eventDescriptor, rule.eventDescriptors()) {
+        if (eventDescriptor.type() == EventDescriptor::TypeDevice) {
+            QVector<int> &ruleSlots = m_deviceEventRules[QPair<QUuid, QUuid>(eventDescriptor.deviceId(), eventDescriptor.eventTypeId())];
+            if (!ruleSlots.contains(slot))
+                ruleSlots.append(slot);
+        } else {
+            QVector<int> &ruleSlots = m_interfaceEventRules[eventDescriptor.interface()];
+            if (!ruleSlots.contains(slot))
+                ruleSlots.append(slot);
+        }
+    }
+
+    foreach (const StateDescriptor &stateDescriptor, rule.stateEvaluator().containedStateDescriptors()) {
+        if (stateDescriptor.type() == StateDescriptor::TypeDevice) {
+            QVector<int> &ruleSlots = m_deviceStateRules[QPair<QUuid, QUuid>(stateDescriptor.deviceId(), stateDescriptor.stateTypeId())];
+            if (!ruleSlots.contains(slot))
+                ruleSlots.append(slot);
+        } else {
+            QVector<int> &ruleSlots = m_interfaceStateRules[stateDescriptor.interface()];
+            if (!ruleSlots.contains(slot))
+                ruleSlots.append(slot);
+        }
+    }
+}
+
+void RuleEngine::unindexRule(const Rule &rule, int slot)
+{
+    foreach (const EventDescriptor &eventDescriptor, rule.eventDescriptors()) {
+        if (eventDescriptor.type() == EventDescriptor::TypeDevice) {
+            QPair<QUuid, QUuid> key(eventDescriptor.deviceId(), eventDescriptor.eventTypeId());
+            m_deviceEventRules[key].removeAll(slot);
+            if (m_deviceEventRules.value(key).isEmpty())
+                m_deviceEventRules.remove(key);
+        } else {
+            m_interfaceEventRules[eventDescriptor.interface()].removeAll(slot);
+            if (m_interfaceEventRules.value(eventDescriptor.interface()).isEmpty())
+                m_interfaceEventRules.remove(eventDescriptor.interface());
+        }
+    }
+
+    foreach (const StateDescriptor &stateDescriptor, rule.stateEvaluator().containedStateDescriptors()) {
+        if (stateDescriptor.type() == StateDescriptor::TypeDevice) {
+            QPair<QUuid, QUuid> key(stateDescriptor.deviceId(), stateDescriptor.stateTypeId());
+            m_deviceStateRules[key].removeAll(slot);
+            if (m_deviceStateRules.value(key).isEmpty())
+                m_deviceStateRules.remove(key);
+        } else {
+            m_interfaceStateRules[stateDescriptor.interface()].removeAll(slot);
+            if (m_interfaceStateRules.value(stateDescriptor.interface()).isEmpty())
+                m_interfaceStateRules.remove(stateDescriptor.interface());
+        }
+    }
 }
 
 void RuleEngine::saveRule(const Rule &rule)
@@ -1513,7 +1829,6 @@ void RuleEngine::init()
         rule.setExitActions(exitActions);
         rule.setEnabled(enabled);
         rule.setExecutable(executable);
-        rule.setStatesActive(rule.stateEvaluator().evaluate());
         appendRule(rule);
         settings.endGroup();
     }
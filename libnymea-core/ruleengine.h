@@ -26,10 +26,14 @@
 #include "types/event.h"
 #include "types/deviceclass.h"
 #include "stateevaluator.h"
+#include "compiledstateevaluator.h"
 
 #include <QObject>
 #include <QList>
+#include <QMap>
+#include <QPair>
 #include <QUuid>
+#include <QVector>
 
 namespace nymeaserver {
 
@@ -72,7 +76,10 @@ public:
     ~RuleEngine();
     void init();
 
+    typedef QPair<Rule, Event> EvaluationResult;
+
     QList<Rule> evaluateEvent(const Event &event);
+    QList<EvaluationResult> evaluateEvents(const QList<Event> &events);
     QList<Rule> evaluateTime(const QDateTime &dateTime);
 
     RuleError addRule(const Rule &rule, bool fromEdit = false);
@@ -80,6 +87,7 @@ public:
 
     QList<Rule> rules() const;
     QList<RuleId> ruleIds() const;
+    QList<RuleId> activeRules() const;
 
     RuleError removeRule(const RuleId &ruleId, bool fromEdit = false);
 
@@ -95,14 +103,44 @@ public:
 
     void removeDeviceFromRule(const RuleId &id, const DeviceId &deviceId);
 
+public slots:
+    void onDeviceAdded(Device *device);
+    void onDeviceRemoved(const DeviceId &deviceId);
+
 signals:
     void ruleAdded(const Rule &rule);
     void ruleRemoved(const RuleId &ruleId);
     void ruleConfigurationChanged(const Rule &rule);
 
 private:
+    class RuleEntry
+    {
+    public:
+        Rule rule;
+        CompiledStateEvaluator stateEvaluator;
+        quint64 order = 0;
+        quint64 evaluationPass = 0;
+        qint64 scheduledTime = 0;
+        bool used = false;
+        bool scheduled = false;
+
+        // Cached from the rule when it gets stored
+        bool stateBased = false;
+        bool hasTimeDescriptor = false;
+        bool hasCalendarItems = false;
+        bool hasTimeEventItems = false;
+
+        // Runtime state, the flags of the stored rule are not kept up to date
+        bool active = false;
+        bool statesActive = false;
+        bool timeActive = false;
+
+        // Per evaluation pass
+        bool eventCandidate = false;
+        int lastStateEvent = -1; // Index of the last event updating the states
+    };
+
     bool containsEvent(const Rule &rule, const Event &event, const DeviceClassId &deviceClassId);
-    bool containsState(const StateEvaluator &stateEvaluator, const Event &stateChangeEvent);
 
     bool checkEventDescriptors(const QList<EventDescriptor> eventDescriptors, const EventTypeId &eventTypeId);
     QVariant::Type getActionParamType(const ActionTypeId &actionTypeId, const ParamTypeId &paramTypeId);
@@ -111,10 +149,35 @@ private:
     void appendRule(const Rule &rule);
     void saveRule(const Rule &rule);
 
+    int storeRule(const Rule &rule, const CompiledStateEvaluator &stateEvaluator, int slot = -1);
+    void releaseRule(int slot);
+    Rule ruleSnapshot(const RuleEntry &entry) const;
+    void addCandidates(const QVector<int> &ruleSlots, bool eventCandidate);
+    void markUnsettled(int slot);
+    void scheduleTimeEvaluation(int slot, qint64 time);
+    void unscheduleTimeEvaluation(int slot);
+
+    void indexRule(const Rule &rule, int slot);
+    void unindexRule(const Rule &rule, int slot);
+
 private:
     QList<RuleId> m_ruleIds; // Keeping a list of RuleIds to keep sorting order...
-    QHash<RuleId, Rule> m_rules; // ...but use a Hash for faster finding
-    QList<RuleId> m_activeRules;
+    QHash<QUuid, int> m_ruleSlots; // ...but use a Hash for faster finding
+    QVector<RuleEntry> m_rules; // Rules are stored in place, slots of removed rules get reused
+    QVector<int> m_freeSlots;
+
+    // Dispatch index: which rules can react on a given (deviceId, eventTypeId/stateTypeId) or interface
+    QHash<QPair<QUuid, QUuid>, QVector<int> > m_deviceEventRules;
+    QHash<QString, QVector<int> > m_interfaceEventRules;
+    QHash<QPair<QUuid, QUuid>, QVector<int> > m_deviceStateRules;
+    QHash<QString, QVector<int> > m_interfaceStateRules;
+    QVector<int> m_unsettledRules; // State based rules which need to be checked for an active change on the next event
+    QVector<int> m_candidates; // Reused by evaluateEvents() to avoid allocating on every event
+    QMultiMap<qint64, int> m_timeSchedule; // Next time (ms since epoch) at which the time descriptor of a rule needs to be evaluated
+    QVector<int> m_timeCandidates;
+    quint64 m_nextRuleOrder;
+    quint64 m_evaluationPass;
+    int m_activeRuleCount;
 
     QDateTime m_lastEvaluationTime;
 };
@@ -71,8 +71,13 @@ void BluetoothServer::sendData(const QUuid &clientId, const QByteArray &data)
     if (!client)
         return;
 
-    qCDebug(dcBluetoothServerTraffic()) << "Send data:" << qUtf8Printable(data);
-    client->write(data + '\n');
+    if (clientEncoding(clientId) == EncodingJson) {
+        qCDebug(dcBluetoothServerTraffic()) << "Send data:" << qUtf8Printable(data);
+        client->write(data + '\n');
+    } else {
+        qCDebug(dcBluetoothServerTraffic()) << "Send data:" << data.toHex();
+        client->write(data);
+    }
 }
 
 /*! Send the given \a data to the \a clients. */
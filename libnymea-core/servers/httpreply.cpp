@@ -107,12 +107,19 @@
         The \l{HttpReply} can be responded imediatly.
     \value TypeAsync
         The \l{HttpReply} is asynchron and has to be responded later.
+    \value TypeStream
+        The header of the \l{HttpReply} will be sent immediately, the payload follows in chunks
+        using \l{writeChunk()} until the reply is finished.
 */
 
 /*! \fn void nymeaserver::HttpReply::finished();
     This signal is emitted when this async \l{HttpReply} is finished.
 */
 
+/*! \fn void nymeaserver::HttpReply::chunkAvailable(const QByteArray &chunk);
+    This signal is emitted when a streaming \l{HttpReply} has a new \a chunk of payload to send.
+*/
+
 /*! \fn nymeaserver::HttpReply::HttpReply(QObject *parent);
     Construct an empty \l{HttpReply} with the given \a parent.
 */
@@ -341,6 +348,16 @@ bool HttpReply::timedOut() const
     return m_timedOut;
 }
 
+/*! Sends the given \a chunk of payload for a \l{HttpReply::TypeStream} reply. */
+void HttpReply::writeChunk(const QByteArray &chunk)
+{
+    if (chunk.isEmpty()) {
+        // An empty chunk would terminate the transfer
+        return;
+    }
+    emit chunkAvailable(chunk);
+}
+
 QByteArray HttpReply::getHttpReasonPhrase(const HttpReply::HttpStatusCode &statusCode)
 {
     QByteArray response;
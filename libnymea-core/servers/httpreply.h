@@ -71,7 +71,8 @@ public:
 
     enum Type {
         TypeSync,
-        TypeAsync
+        TypeAsync,
+        TypeStream
     };
 
     HttpReply(QObject *parent = 0);
@@ -107,6 +108,8 @@ public:
 
     bool timedOut() const;
 
+    void writeChunk(const QByteArray &chunk);
+
 private:
     HttpStatusCode m_statusCode;
     QByteArray m_reasonPhrase;
@@ -136,6 +139,7 @@ public slots:
 
 signals:
     void finished();
+    void chunkAvailable(const QByteArray &chunk);
 
 };
 
@@ -37,9 +37,9 @@
 
 #include "deviceclassesresource.h"
 #include "servers/httprequest.h"
+#include "jsonrpc/jsonwriter.h"
 #include "nymeacore.h"
 
-#include <QJsonDocument>
 
 namespace nymeaserver {
 
@@ -184,7 +184,7 @@ HttpReply *DeviceClassesResource::getDeviceClass()
     qCDebug(dcRest) << "Get device class with id " << m_deviceClass.id();
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packDeviceClass(m_deviceClass)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packDeviceClass(m_deviceClass), QJsonDocument::Indented));
     return reply;
 }
 
@@ -193,7 +193,7 @@ HttpReply *DeviceClassesResource::getActionTypes()
     qCDebug(dcRest) << "Get action types for device class" << m_deviceClass.id();
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packActionTypes(m_deviceClass)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packActionTypes(m_deviceClass), QJsonDocument::Indented));
     return reply;
 }
 
@@ -205,7 +205,7 @@ HttpReply *DeviceClassesResource::getActionType(const ActionTypeId &actionTypeId
         if (actionType.id() == actionTypeId) {
             HttpReply *reply = createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-            reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packActionType(actionType)).toJson());
+            reply->setPayload(JsonWriter::toJson(JsonTypes::packActionType(actionType), QJsonDocument::Indented));
             return reply;
         }
     }
@@ -217,7 +217,7 @@ HttpReply *DeviceClassesResource::getStateTypes()
     qCDebug(dcRest) << "Get state types for device class" << m_deviceClass.id();
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packStateTypes(m_deviceClass)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packStateTypes(m_deviceClass), QJsonDocument::Indented));
     return reply;
 }
 
@@ -229,7 +229,7 @@ HttpReply *DeviceClassesResource::getStateType(const StateTypeId &stateTypeId)
         if (stateType.id() == stateTypeId) {
             HttpReply *reply = createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-            reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packStateType(stateType)).toJson());
+            reply->setPayload(JsonWriter::toJson(JsonTypes::packStateType(stateType), QJsonDocument::Indented));
             return reply;
         }
     }
@@ -241,7 +241,7 @@ HttpReply *DeviceClassesResource::getEventTypes()
     qCDebug(dcRest) << "Get event types for device class" << m_deviceClass.id();
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packEventTypes(m_deviceClass)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packEventTypes(m_deviceClass), QJsonDocument::Indented));
     return reply;
 }
 
@@ -253,7 +253,7 @@ HttpReply *DeviceClassesResource::getEventType(const EventTypeId &eventTypeId)
         if (eventType.id() == eventTypeId) {
             HttpReply *reply = createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-            reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packEventType(eventType)).toJson());
+            reply->setPayload(JsonWriter::toJson(JsonTypes::packEventType(eventType), QJsonDocument::Indented));
             return reply;
         }
     }
@@ -293,7 +293,7 @@ void DeviceClassesResource::devicesDiscovered(const DeviceClassId &deviceClassId
 
     HttpReply *reply = m_discoverRequests.take(deviceClassId);
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packDeviceDescriptors(deviceDescriptors)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packDeviceDescriptors(deviceDescriptors), QJsonDocument::Indented));
     reply->finished();
 }
 
@@ -307,7 +307,7 @@ HttpReply *DeviceClassesResource::getDeviceClasses(const VendorId &vendorId)
 
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packSupportedDevices(vendorId)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packSupportedDevices(vendorId), QJsonDocument::Indented));
     return reply;
 }
 
@@ -40,6 +40,7 @@
 #include "servers/httpreply.h"
 #include "servers/httprequest.h"
 #include "jsonrpc/jsontypes.h"
+#include "jsonrpc/jsonwriter.h"
 #include "nymeacore.h"
 
 #include <QJsonDocument>
@@ -242,7 +243,7 @@ HttpReply *DevicesResource::getConfiguredDevices() const
     qCDebug(dcRest) << "Get all configured devices";
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packConfiguredDevices()).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packConfiguredDevices(), QJsonDocument::Indented));
     return reply;
 }
 
@@ -251,7 +252,7 @@ HttpReply *DevicesResource::getConfiguredDevice(Device *device) const
     qCDebug(dcRest) << "Get configured device with id:" << device->id().toString();
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packDevice(device)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packDevice(device), QJsonDocument::Indented));
     return reply;
 }
 
@@ -260,7 +261,7 @@ HttpReply *DevicesResource::getDeviceStateValues(Device *device) const
     qCDebug(dcRest) << "Get states of device with id:" << device->id().toString();
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packDeviceStates(device)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packDeviceStates(device), QJsonDocument::Indented));
     return reply;
 }
 
@@ -271,7 +272,7 @@ HttpReply *DevicesResource::getDeviceStateValue(Device *device, const StateTypeI
     QVariantMap stateValueMap;
     stateValueMap.insert("value", device->state(stateTypeId).value());
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(stateValueMap).toJson());
+    reply->setPayload(JsonWriter::toJson(stateValueMap, QJsonDocument::Indented));
     return reply;
 }
 
@@ -309,7 +310,7 @@ HttpReply *DevicesResource::removeDevice(Device *device, const QVariantMap &para
 
         HttpReply *reply = createErrorReply(HttpReply::BadRequest);
         reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-        reply->setPayload(QJsonDocument::fromVariant(returns).toJson());
+        reply->setPayload(JsonWriter::toJson(returns, QJsonDocument::Indented));
         return reply;
     }
 
@@ -388,7 +389,7 @@ HttpReply *DevicesResource::addConfiguredDevice(const QByteArray &payload) const
     QVariant result = JsonTypes::packDevice(NymeaCore::instance()->deviceManager()->findConfiguredDevice(newDeviceId));
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(result).toJson());
+    reply->setPayload(JsonWriter::toJson(result, QJsonDocument::Indented));
     return reply;
 }
 
@@ -447,7 +448,7 @@ HttpReply *DevicesResource::pairDevice(const QByteArray &payload) const
     returns.insert("setupMethod", JsonTypes::setupMethod().at(deviceClass.setupMethod()));
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(returns).toJson());
+    reply->setPayload(JsonWriter::toJson(returns, QJsonDocument::Indented));
     return reply;
 }
 
@@ -527,13 +528,13 @@ void DevicesResource::actionExecuted(const ActionId &actionId, DeviceManager::De
     if (status == DeviceManager::DeviceErrorNoError) {
         qCDebug(dcRest) << "Action execution finished successfully";
         reply->setHttpStatusCode(HttpReply::Ok);
-        reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+        reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     } else {
         qCDebug(dcRest) << "Action execution finished with error" << status;
         QVariantMap response;
         response.insert("error", JsonTypes::deviceErrorToString(status));
         reply->setHttpStatusCode(HttpReply::InternalServerError);
-        reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+        reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     }
 
     reply->finished();
@@ -557,16 +558,16 @@ void DevicesResource::deviceSetupFinished(Device *device, DeviceManager::DeviceE
     if (status == DeviceManager::DeviceErrorNoError) {
         qCDebug(dcRest) << "Device setup finished successfully";
         reply->setHttpStatusCode(HttpReply::Ok);
-        reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+        reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     } else {
         qCDebug(dcRest) << "Device setup finished with error" << status;
         reply->setHttpStatusCode(HttpReply::InternalServerError);
-        reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+        reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     }
 
     QVariant result = JsonTypes::packDevice(device);
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(result).toJson());
+    reply->setPayload(JsonWriter::toJson(result, QJsonDocument::Indented));
     reply->finished();
 }
 
@@ -588,11 +589,11 @@ void DevicesResource::deviceReconfigurationFinished(Device *device, DeviceManage
     if (status == DeviceManager::DeviceErrorNoError) {
         qCDebug(dcRest) << "Device reconfiguration finished successfully";
         reply->setHttpStatusCode(HttpReply::Ok);
-        reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+        reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     } else {
         qCDebug(dcRest) << "Device reconfiguration finished with error" << status;
         reply->setHttpStatusCode(HttpReply::InternalServerError);
-        reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+        reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     }
 
     reply->finished();
@@ -616,7 +617,7 @@ void DevicesResource::pairingFinished(const PairingTransactionId &pairingTransac
         qCDebug(dcRest) << "Pairing device finished with error.";
         reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
         reply->setHttpStatusCode(HttpReply::InternalServerError);
-        reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+        reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
         reply->finished();
         return;
     }
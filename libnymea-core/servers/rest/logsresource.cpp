@@ -37,11 +37,12 @@
 
 #include "logsresource.h"
 #include "servers/httprequest.h"
+#include "jsonrpc/jsonwriter.h"
 #include "loggingcategories.h"
 #include "nymeacore.h"
 #include "logging/logengine.h"
 
-#include <QJsonDocument>
+#include <QSharedPointer>
 
 namespace nymeaserver {
 
@@ -107,13 +108,27 @@ HttpReply *LogsResource::getLogEntries(const QString &filterString)
 
     LogFilter filter = JsonTypes::unpackLogFilter(filterMap);
 
-    QVariantList entries;
-    foreach (const LogEntry &entry, NymeaCore::instance()->logEngine()->logEntries(filter)) {
-        entries.append(JsonTypes::packLogEntry(entry));
-    }
-    HttpReply *reply = createSuccessReply();
+    if (filterMap.contains("cursor") && !filter.hasCursor())
+        return createErrorReply(HttpReply::BadRequest);
+
+    // Stream the JSON array chunk by chunk, large exports would not fit into memory otherwise
+    LogEntriesFetchJob *job = NymeaCore::instance()->logEngine()->fetchLogEntries(filter, true);
+    HttpReply *reply = createStreamReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(entries).toJson());
+    QSharedPointer<int> count(new int(0));
+    connect(job, &LogEntriesFetchJob::entriesAvailable, reply, [reply, count](const QList<LogEntry> &entries){
+        QByteArray chunk;
+        foreach (const LogEntry &entry, entries) {
+            chunk.append(*count == 0 ? "[" : ",");
+            chunk.append(JsonWriter::toJson(JsonTypes::packLogEntry(entry), QJsonDocument::Indented));
+            (*count)++;
+        }
+        reply->writeChunk(chunk);
+    });
+    connect(job, &LogEntriesFetchJob::finished, reply, [reply, count](){
+        reply->writeChunk(*count == 0 ? "[]" : "]");
+        reply->finished();
+    });
     return reply;
 }
 
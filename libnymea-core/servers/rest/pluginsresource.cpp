@@ -37,10 +37,10 @@
 
 #include "pluginsresource.h"
 #include "servers/httprequest.h"
+#include "jsonrpc/jsonwriter.h"
 #include "loggingcategories.h"
 #include "nymeacore.h"
 
-#include <QJsonDocument>
 
 namespace nymeaserver {
 
@@ -139,7 +139,7 @@ HttpReply *PluginsResource::getPlugins() const
     qCDebug(dcRest) << "Get plugins";
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packPlugins()).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packPlugins(), QJsonDocument::Indented));
     return reply;
 }
 
@@ -147,10 +147,10 @@ HttpReply *PluginsResource::getPlugin(const PluginId &pluginId) const
 {
     qCDebug(dcRest) << "Get plugin with id" << pluginId;
     HttpReply *reply = createSuccessReply();
-    foreach (DevicePlugin *plugin, NymeaCore::instance()->deviceManager()->plugins()) {
-        if (plugin->pluginId() == pluginId) {
+    foreach (const PluginDescription &pluginDescription, NymeaCore::instance()->deviceManager()->pluginDescriptions()) {
+        if (pluginDescription.pluginId() == pluginId) {
             reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-            reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packPlugin(plugin)).toJson());
+            reply->setPayload(JsonWriter::toJson(JsonTypes::packPlugin(pluginDescription), QJsonDocument::Indented));
             return reply;
         }
     }
@@ -173,7 +173,7 @@ HttpReply *PluginsResource::getPluginConfiguration(const PluginId &pluginId) con
 
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(configurationParamsList).toJson());
+    reply->setPayload(JsonWriter::toJson(configurationParamsList, QJsonDocument::Indented));
     return reply;
 }
 
@@ -203,12 +203,7 @@ HttpReply *PluginsResource::setPluginConfiguration(const PluginId &pluginId, con
 
 DevicePlugin *PluginsResource::findPlugin(const PluginId &pluginId) const
 {
-    foreach (DevicePlugin *plugin, NymeaCore::instance()->deviceManager()->plugins()) {
-        if (plugin->pluginId() == pluginId) {
-            return plugin;
-        }
-    }
-    return 0;
+    return NymeaCore::instance()->deviceManager()->plugin(pluginId);
 }
 
 }
@@ -61,6 +61,7 @@
 #include "servers/httprequest.h"
 #include "loggingcategories.h"
 #include "devicemanager.h"
+#include "jsonrpc/jsonwriter.h"
 
 #include <QJsonDocument>
 #include <QVariant>
@@ -113,7 +114,7 @@ HttpReply *RestResource::createDeviceErrorReply(const HttpReply::HttpStatusCode
     QVariantMap response;
     response.insert("error", JsonTypes::deviceErrorToString(deviceError));
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+    reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     return reply;
 }
 
@@ -125,7 +126,7 @@ HttpReply *RestResource::createRuleErrorReply(const HttpReply::HttpStatusCode &s
     QVariantMap response;
     response.insert("error", JsonTypes::ruleErrorToString(ruleError));
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+    reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     return reply;
 }
 
@@ -137,7 +138,7 @@ HttpReply *RestResource::createLoggingErrorReply(const HttpReply::HttpStatusCode
     QVariantMap response;
     response.insert("error", JsonTypes::loggingErrorToString(loggingError));
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(response).toJson());
+    reply->setPayload(JsonWriter::toJson(response, QJsonDocument::Indented));
     return reply;
 }
 
@@ -149,6 +150,16 @@ HttpReply *RestResource::createAsyncReply()
     return reply;
 }
 
+/*! Returns the pointer to a new created \l{HttpReply} initialized with \l{HttpReply::Ok} and \l{HttpReply::TypeStream}.
+    The payload has to be written using \l{HttpReply::writeChunk()}.
+*/
+HttpReply *RestResource::createStreamReply()
+{
+    HttpReply *reply = new HttpReply(HttpReply::Ok, HttpReply::TypeStream);
+    reply->setRawHeader("Transfer-Encoding", "chunked");
+    return reply;
+}
+
 /*! This method can be used from every \l{RestResource} in order to verify if the \a payload of a
     \l{HttpRequest} is a valid JSON document. Returns \tt true and the valid \e QVariant if there
     was no error while parsing JSON. Returns \tt false and an invalid \e QVariant if the \a payload
@@ -50,6 +50,7 @@ public:
     static HttpReply *createRuleErrorReply(const HttpReply::HttpStatusCode &statusCode, const RuleEngine::RuleError &ruleError);
     static HttpReply *createLoggingErrorReply(const HttpReply::HttpStatusCode &statusCode, const Logging::LoggingError &loggingError);
     static HttpReply *createAsyncReply();
+    static HttpReply *createStreamReply();
     static QPair<bool, QVariant> verifyPayload(const QByteArray &payload);
 
 private:
@@ -136,6 +136,22 @@ void RestServer::processHttpRequest(const QUuid &clientId, const HttpRequest &re
     RestResource *resource = m_resources.value(resourceName);
     HttpReply *reply = resource->proccessRequest(request, urlTokens);
     reply->setClientId(clientId);
+    if (reply->type() == HttpReply::TypeStream) {
+        // Send the header right away, the payload follows chunk by chunk
+        webserver->sendHttpReply(reply);
+        connect(reply, &HttpReply::chunkAvailable, this, [this, clientId](const QByteArray &chunk){
+            if (m_clientList.contains(clientId)) {
+                m_clientList.value(clientId)->sendHttpChunk(clientId, chunk);
+            }
+        });
+        connect(reply, &HttpReply::finished, this, [this, reply, clientId](){
+            if (m_clientList.contains(clientId)) {
+                m_clientList.value(clientId)->sendHttpChunk(clientId, QByteArray());
+            }
+            reply->deleteLater();
+        });
+        return;
+    }
     if (reply->type() == HttpReply::TypeAsync) {
         connect(reply, &HttpReply::finished, this, &RestServer::asyncReplyFinished);
         m_asyncReplies.insert(clientId, reply);
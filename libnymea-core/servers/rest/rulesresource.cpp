@@ -37,11 +37,11 @@
 
 #include "rulesresource.h"
 #include "servers/httprequest.h"
+#include "jsonrpc/jsonwriter.h"
 #include "typeutils.h"
 #include "loggingcategories.h"
 #include "nymeacore.h"
 
-#include <QJsonDocument>
 
 namespace nymeaserver {
 
@@ -196,7 +196,7 @@ HttpReply *RulesResource::getRules(const DeviceId &deviceId) const
 
     if (deviceId.isNull()) {
         qCDebug(dcRest) << "Get rule descriptions";
-        reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packRuleDescriptions()).toJson());
+        reply->setPayload(JsonWriter::toJson(JsonTypes::packRuleDescriptions(), QJsonDocument::Indented));
     } else {
         qCDebug(dcRest) << "Get rule descriptions which contain the device with id" << deviceId.toString();
         QList<RuleId> ruleIdsList = NymeaCore::instance()->ruleEngine()->findRules(deviceId);
@@ -207,7 +207,7 @@ HttpReply *RulesResource::getRules(const DeviceId &deviceId) const
                 ruleList.append(rule);
         }
         reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-        reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packRuleDescriptions(ruleList)).toJson());
+        reply->setPayload(JsonWriter::toJson(JsonTypes::packRuleDescriptions(ruleList), QJsonDocument::Indented));
     }
     return reply;
 }
@@ -221,7 +221,7 @@ HttpReply *RulesResource::getRuleDetails(const RuleId &ruleId) const
 
     HttpReply *reply = createSuccessReply();
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packRule(rule)).toJson());
+    reply->setPayload(JsonWriter::toJson(JsonTypes::packRule(rule), QJsonDocument::Indented));
     return reply;
 }
 
@@ -253,7 +253,7 @@ HttpReply *RulesResource::addRule(const QByteArray &payload) const
         QVariant returns = JsonTypes::packRule(NymeaCore::instance()->ruleEngine()->findRule(rule.id()));
         HttpReply *reply = createSuccessReply();
         reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-        reply->setPayload(QJsonDocument::fromVariant(returns).toJson());
+        reply->setPayload(JsonWriter::toJson(returns, QJsonDocument::Indented));
         return reply;
     }
 
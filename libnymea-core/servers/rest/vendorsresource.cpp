@@ -38,10 +38,10 @@
 
 #include "vendorsresource.h"
 #include "servers/httprequest.h"
+#include "jsonrpc/jsonwriter.h"
 #include "loggingcategories.h"
 #include "nymeacore.h"
 
-#include <QJsonDocument>
 
 namespace nymeaserver {
 
@@ -114,7 +114,7 @@ HttpReply *VendorsResource::getVendors() const
         vendorsList.append(JsonTypes::packVendor(vendor));
     }
     reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-    reply->setPayload(QJsonDocument::fromVariant(vendorsList).toJson());
+    reply->setPayload(JsonWriter::toJson(vendorsList, QJsonDocument::Indented));
     return reply;
 }
 
@@ -125,7 +125,7 @@ HttpReply *VendorsResource::getVendor(const VendorId &vendorId) const
         if (vendor.id() == vendorId) {
             HttpReply *reply = createSuccessReply();
             reply->setHeader(HttpReply::ContentTypeHeader, "application/json; charset=\"utf-8\";");
-            reply->setPayload(QJsonDocument::fromVariant(JsonTypes::packVendor(vendor)).toJson());
+            reply->setPayload(JsonWriter::toJson(JsonTypes::packVendor(vendor), QJsonDocument::Indented));
             return reply;
         }
     }
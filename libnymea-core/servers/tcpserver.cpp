@@ -119,7 +119,11 @@ void TcpServer::sendData(const QUuid &clientId, const QByteArray &data)
     QTcpSocket *client = nullptr;
     client = m_clientList.value(clientId);
     if (client) {
-        client->write(data + '\n');
+        if (clientEncoding(clientId) == EncodingJson) {
+            client->write(data + '\n');
+        } else {
+            client->write(data);
+        }
     } else {
         qWarning(dcTcpServer()) << "Client" << clientId << "unknown to this transport";
     }
@@ -146,6 +146,22 @@ void WebServer::sendHttpReply(HttpReply *reply)
     socket->write(reply->data());
 }
 
+/*! Send the given \a chunk of a streaming reply to the client with the given \a clientId using the
+    chunked transfer encoding. An empty \a chunk terminates the reply.
+
+    \sa HttpReply::TypeStream
+*/
+void WebServer::sendHttpChunk(const QUuid &clientId, const QByteArray &chunk)
+{
+    QSslSocket *socket = m_clientList.value(clientId);
+    if (!socket) {
+        qCWarning(dcWebServer()) << "Client for streaming reply not longer connected.";
+        return;
+    }
+
+    socket->write(QByteArray::number(chunk.size(), 16) + "\r\n" + chunk + "\r\n");
+}
+
 bool WebServer::verifyFile(QSslSocket *socket, const QString &fileName)
 {
     QFileInfo file(fileName);
@@ -80,6 +80,7 @@ public:
     QUrl serverUrl() const;
 
     void sendHttpReply(HttpReply *reply);
+    void sendHttpChunk(const QUuid &clientId, const QByteArray &chunk);
 
 private:
     QHash<QUuid, QSslSocket *> m_clientList;
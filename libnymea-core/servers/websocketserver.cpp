@@ -92,7 +92,12 @@ void WebSocketServer::sendData(const QUuid &clientId, const QByteArray &data)
     client = m_clientList.value(clientId);
     if (client) {
         qCDebug(dcWebSocketServerTraffic()) << "Sending data to client" << data;
-        client->sendTextMessage(data + '\n');
+        // Binary encodings are sent in binary frames, one message per frame
+        if (clientEncoding(clientId) == EncodingJson) {
+            client->sendTextMessage(data + '\n');
+        } else {
+            client->sendBinaryMessage(data);
+        }
     } else {
         qCWarning(dcWebSocketServer()) << "Client" << clientId << "unknown to this transport";
     }
@@ -172,6 +177,7 @@ void WebSocketServer::onBinaryMessageReceived(const QByteArray &data)
 {
     QWebSocket *client = qobject_cast<QWebSocket *>(sender());
     qCDebug(dcWebSocketServerTraffic()) << "Binary message from" << client->peerAddress().toString() << ":" << data;
+    emit dataAvailable(m_clientList.key(client), data);
 }
 
 void WebSocketServer::onTextMessageReceived(const QString &message)
@@ -207,6 +207,19 @@ QList<DeviceId> StateEvaluator::containedDevices() const
     return ret;
 }
 
+/*! Returns a list of all valid \l{StateDescriptor}{StateDescriptors} of this StateEvaluator and its child evaluators. */
+QList<StateDescriptor> StateEvaluator::containedStateDescriptors() const
+{
+    QList<StateDescriptor> ret;
+    if (m_stateDescriptor.isValid()) {
+        ret.append(m_stateDescriptor);
+    }
+    foreach (const StateEvaluator &childEvaluator, m_childEvaluators) {
+        ret.append(childEvaluator.containedStateDescriptors());
+    }
+    return ret;
+}
+
 /*! This method will be used to save this \l StateEvaluator to the given \a settings.
     The \a groupName will normally be the corresponding \l Rule. */
 void StateEvaluator::dumpToSettings(NymeaSettings &settings, const QString &groupName) const
@@ -51,6 +51,7 @@ public:
 
     void removeDevice(const DeviceId &deviceId);
     QList<DeviceId> containedDevices() const;
+    QList<StateDescriptor> containedStateDescriptors() const;
 
     void dumpToSettings(NymeaSettings &settings, const QString &groupName) const;
     static StateEvaluator loadFromSettings(NymeaSettings &settings, const QString &groupPrefix);
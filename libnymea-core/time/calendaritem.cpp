@@ -35,6 +35,18 @@
 
 namespace nymeaserver {
 
+// Returns the earlier of both date times, an invalid date time stands for never
+static QDateTime earliest(const QDateTime &first, const QDateTime &second)
+{
+    if (!first.isValid())
+        return second;
+
+    if (!second.isValid())
+        return first;
+
+    return second < first ? second : first;
+}
+
 /*! Construct a invalid \l{CalendarItem}. */
 CalendarItem::CalendarItem():
     m_duration(0)
@@ -132,6 +144,53 @@ bool CalendarItem::evaluate(const QDateTime &dateTime) const
     return dateTime >= m_dateTime && dateTime < m_dateTime.addSecs(duration() * 60);
 }
 
+/*! Returns the earliest point in time after the given \a dateTime at which the result of evaluate()
+    may change. The returned time can be earlier than the actual change, but never later. If the result
+    will never change again, an invalid QDateTime will be returned.
+*/
+QDateTime CalendarItem::nextChange(const QDateTime &dateTime) const
+{
+    if (m_startTime.isValid()) {
+
+        switch (m_repeatingOption.mode()) {
+        case RepeatingOption::RepeatingModeNone:
+        case RepeatingOption::RepeatingModeDaily:
+            if (duration() >= 1440)
+                return QDateTime();
+
+            return nextDailyChange(dateTime);
+        case RepeatingOption::RepeatingModeHourly:
+            if (duration() >= 60)
+                return QDateTime();
+
+            return nextHourlyChange(dateTime);
+        case RepeatingOption::RepeatingModeWeekly:
+            if (duration() >= 10080)
+                return QDateTime();
+
+            // Weekly items start on a subset of the days. The week they belong to changes at midnight.
+            return earliest(nextDailyChange(dateTime), nextMidnight(dateTime));
+        case RepeatingOption::RepeatingModeMonthly:
+            // Monthly items start on a subset of the days. The month they belong to changes at midnight.
+            return earliest(nextDailyChange(dateTime), nextMidnight(dateTime));
+        case RepeatingOption::RepeatingModeYearly:
+            return nextYearlyChange(dateTime);
+        }
+
+    }
+    if (m_repeatingOption.mode() == RepeatingOption::RepeatingModeYearly)
+        return nextYearlyChange(dateTime);
+
+    QDateTime endDateTime = m_dateTime.addSecs(duration() * 60);
+    if (m_dateTime > dateTime)
+        return m_dateTime;
+
+    if (endDateTime > dateTime)
+        return endDateTime;
+
+    return QDateTime();
+}
+
 bool CalendarItem::evaluateHourly(const QDateTime &dateTime) const
 {
     // If the duration is longer than a hour, this calendar item is always true
@@ -268,6 +327,80 @@ bool CalendarItem::evaluateYearly(const QDateTime &dateTime) const
     return false;
 }
 
+QDateTime CalendarItem::nextHourlyChange(const QDateTime &dateTime) const
+{
+    // Hourly items are evaluated in local time and the week and month days change at midnight. All time zone
+    // offsets are multiples of 15 minutes, so the start, the end and midnight can only be crossed at the same
+    // minutes of each quarter of an hour in UTC.
+    int startMinute = m_startTime.minute() % 15;
+    int endMinute = (m_startTime.minute() + duration()) % 15;
+
+    QDateTime next = dateTime.toUTC();
+    next.setTime(QTime(next.time().hour(), next.time().minute()));
+    for (int i = 0; i < 15; i++) {
+        next = next.addSecs(60);
+        int minute = next.time().minute() % 15;
+        if (minute == 0 || minute == startMinute || minute == endMinute) {
+            break;
+        }
+    }
+    return next;
+}
+
+QDateTime CalendarItem::nextDailyChange(const QDateTime &dateTime) const
+{
+    // The item can only start at the start time of a day, and end the duration after it
+    qint64 length = duration() * 60;
+
+    QDateTime nextStartDateTime = dateTime;
+    nextStartDateTime.setTime(m_startTime);
+    if (nextStartDateTime <= dateTime) {
+        nextStartDateTime = dateTime.addDays(1);
+        nextStartDateTime.setTime(m_startTime);
+    }
+
+    // The next end belongs to the first start after dateTime - duration
+    QDateTime endReference = dateTime.addSecs(-length);
+    QDateTime nextEndDateTime = endReference;
+    nextEndDateTime.setTime(m_startTime);
+    if (nextEndDateTime <= endReference) {
+        nextEndDateTime = endReference.addDays(1);
+        nextEndDateTime.setTime(m_startTime);
+    }
+    nextEndDateTime = nextEndDateTime.addSecs(length);
+
+    return earliest(nextStartDateTime, nextEndDateTime);
+}
+
+QDateTime CalendarItem::nextMidnight(const QDateTime &dateTime) const
+{
+    QDateTime midnight = dateTime.addDays(1);
+    midnight.setTime(QTime(0, 0));
+    return midnight;
+}
+
+QDateTime CalendarItem::nextYearlyChange(const QDateTime &dateTime) const
+{
+    QDateTime next;
+    for (int year = dateTime.date().year() - 1; year <= dateTime.date().year() + 1; year++) {
+        QDateTime startDateTime = dateTime;
+        startDateTime.setDate(QDate(year, m_dateTime.date().month(), m_dateTime.date().day()));
+        startDateTime.setTime(m_dateTime.time());
+        if (!startDateTime.isValid()) {
+            // I.e. the 29th of february, there is no boundary we could rely on. Check again next time.
+            return dateTime.addSecs(1);
+        }
+
+        QDateTime endDateTime = startDateTime.addSecs(duration() * 60);
+        if (startDateTime > dateTime)
+            next = earliest(next, startDateTime);
+
+        if (endDateTime > dateTime)
+            next = earliest(next, endDateTime);
+    }
+    return next;
+}
+
 /*! Print a CalendarItem to QDebug. */
 QDebug operator<<(QDebug dbg, const CalendarItem &calendarItem)
 {
@@ -46,6 +46,7 @@ public:
 
     bool isValid() const;
     bool evaluate(const QDateTime &dateTime) const;
+    QDateTime nextChange(const QDateTime &dateTime) const;
 
 private:
     QDateTime m_dateTime;
@@ -61,6 +62,11 @@ private:
     bool evaluateMonthly(const QDateTime &dateTime) const;
     bool evaluateYearly(const QDateTime &dateTime) const;
 
+    QDateTime nextHourlyChange(const QDateTime &dateTime) const;
+    QDateTime nextDailyChange(const QDateTime &dateTime) const;
+    QDateTime nextMidnight(const QDateTime &dateTime) const;
+    QDateTime nextYearlyChange(const QDateTime &dateTime) const;
+
 };
 
 QDebug operator<<(QDebug dbg, const CalendarItem &calendarItem);
@@ -35,9 +35,30 @@
 #include "timedescriptor.h"
 
 #include <QDebug>
+#include <QTimeZone>
 
 namespace nymeaserver {
 
+// Returns the earlier of both date times, an invalid date time stands for never
+static QDateTime earliest(const QDateTime &first, const QDateTime &second)
+{
+    if (!first.isValid())
+        return second;
+
+    if (!second.isValid())
+        return first;
+
+    return second < first ? second : first;
+}
+
+static QDateTime nextTransition(const QTimeZone &timeZone, const QDateTime &dateTime)
+{
+    if (!timeZone.isValid() || !timeZone.hasTransitions())
+        return QDateTime();
+
+    return timeZone.nextTransition(dateTime).atUtc;
+}
+
 /*! Constructs an invalid \l{TimeDescriptor}.*/
 TimeDescriptor::TimeDescriptor()
 {
@@ -107,6 +128,31 @@ bool TimeDescriptor::evaluate(const QDateTime &lastEvaluationTime, const QDateTi
     return false;
 }
 
+/*! Returns the earliest point in time after the given \a dateTime at which evaluate() may return
+    a different result than for \a dateTime. The \l{CalendarItem}{CalendarItems} may change their state
+    and the \l{TimeEventItem}{TimeEventItems} may happen at the earliest at that time. Until then the result
+    of the evaluation stays the same. If nothing will change any more, an invalid QDateTime will be returned.
+*/
+QDateTime TimeDescriptor::nextEvaluationTime(const QDateTime &dateTime) const
+{
+    if (isEmpty())
+        return QDateTime();
+
+    QDateTime next;
+    foreach (const CalendarItem &calendarItem, m_calendarItems) {
+        next = earliest(next, calendarItem.nextChange(dateTime));
+    }
+
+    foreach (const TimeEventItem &timeEventItem, m_timeEventItems) {
+        next = earliest(next, timeEventItem.nextOccurrence(dateTime));
+    }
+
+    // The local time jumps at daylight saving time transitions, look again at each of them
+    next = earliest(next, nextTransition(dateTime.timeZone(), dateTime));
+    next = earliest(next, nextTransition(QTimeZone::systemTimeZone(), dateTime));
+    return next;
+}
+
 /*! Print a TimeDescriptor including the full lists of CalendarItems and TimeEventItems to QDebug. */
 QDebug operator<<(QDebug dbg, const TimeDescriptor &timeDescriptor)
 {
@@ -41,6 +41,7 @@ public:
     bool isEmpty() const;
 
     bool evaluate(const QDateTime &lastEvaluationTime, const QDateTime &dateTime) const;
+    QDateTime nextEvaluationTime(const QDateTime &dateTime) const;
 
 //    void dumpToSettings(NymeaSettings &settings, const QString &groupName) const;
 //    static TimeDescriptor loadFromSettings(NymeaSettings &settings, const QString &groupPrefix);
@@ -134,6 +134,63 @@ bool TimeEventItem::evaluate(const QDateTime &lastEvaluationTime, const QDateTim
     return lastEvaluationTime < m_dateTime && m_dateTime <= dateTime;
 }
 
+/*! Returns the earliest point in time after the given \a dateTime at which evaluate() may return true.
+    The returned time can be earlier than the actual event, but never later. If this \l{TimeEventItem}
+    will never happen again, an invalid QDateTime will be returned.
+*/
+QDateTime TimeEventItem::nextOccurrence(const QDateTime &dateTime) const
+{
+    if (m_time.isValid()) {
+        switch (m_repeatingOption.mode()) {
+        case RepeatingOption::RepeatingModeNone:
+        case RepeatingOption::RepeatingModeDaily:
+        case RepeatingOption::RepeatingModeWeekly:
+        case RepeatingOption::RepeatingModeMonthly: {
+            // Weekly and monthly events happen on a subset of the days
+            QDateTime next = dateTime;
+            next.setTime(m_time);
+            if (next <= dateTime) {
+                next = dateTime.addDays(1);
+                next.setTime(m_time);
+            }
+            return next;
+        }
+        case RepeatingOption::RepeatingModeHourly: {
+            // All time zone offsets are multiples of 15 minutes, so the event happens at the same minute
+            // of a quarter of an hour in UTC
+            QDateTime minuteStart = dateTime.toUTC();
+            minuteStart.setTime(QTime(minuteStart.time().hour(), minuteStart.time().minute()));
+            QDateTime next;
+            for (int i = 0; i <= 15; i++) {
+                next = minuteStart.addSecs(i * 60 + m_time.second());
+                if (next > dateTime && next.time().minute() % 15 == m_time.minute() % 15) {
+                    break;
+                }
+            }
+            return next;
+        }
+        case RepeatingOption::RepeatingModeYearly:
+            return QDateTime();
+        }
+    }
+
+    if (m_repeatingOption.mode() == RepeatingOption::RepeatingModeYearly) {
+        for (int year = dateTime.date().year() - 1; year <= dateTime.date().year() + 1; year++) {
+            QDateTime adjustedTime = m_dateTime;
+            adjustedTime.setDate(QDate(year, m_dateTime.date().month(), m_dateTime.date().day()));
+            if (adjustedTime.isValid() && adjustedTime > dateTime) {
+                return adjustedTime;
+            }
+        }
+        return QDateTime();
+    }
+
+    if (m_dateTime > dateTime)
+        return m_dateTime;
+
+    return QDateTime();
+}
+
 /*! Print a TimeEvent to QDebug. */
 QDebug operator<<(QDebug dbg, const TimeEventItem &timeEventItem)
 {
@@ -46,6 +46,7 @@ public:
     bool isValid() const;
 
     bool evaluate(const QDateTime &lastEvaluationTime, const QDateTime &dateTime) const;
+    QDateTime nextOccurrence(const QDateTime &dateTime) const;
 
 private:
     QDateTime m_dateTime;
@@ -67,6 +67,17 @@
     client violates the protocol. Transports should immediately abort the connection to the client.
 */
 
+/*! \enum nymeaserver::TransportInterface::Encoding
+
+    The encoding of the messages exchanged with a client. Clients start with JSON and can switch to another
+    encoding using \c JSONRPC.Hello.
+
+    \value EncodingJson
+        Messages are JSON documents. Transports terminate each message with a newline.
+    \value EncodingCbor
+        Messages are CBOR items, see \l{CborCodec}. Transports send them as they are, without any separator.
+*/
+
 /*! \fn void nymeaserver::TransportInterface::dataAvailable(const QUuid &clientId, const QByteArray &data);
     This signal is emitted when valid \a data from the client with the given \a clientId are available.
 
@@ -85,6 +96,9 @@ TransportInterface::TransportInterface(const ServerConfiguration &config, QObjec
     QObject(parent),
     m_config(config)
 {
+    connect(this, &TransportInterface::clientDisconnected, this, [this](const QUuid &clientId) {
+        m_clientEncodings.remove(clientId);
+    });
 }
 
 /*! Set the ServerConfiguration of this TransportInterface to the given \a config. */
@@ -99,6 +113,31 @@ ServerConfiguration TransportInterface::configuration() const
     return m_config;
 }
 
+/*! Returns true if this TransportInterface can carry messages in the given \a encoding. All transports
+    support \l{EncodingJson}, the default implementation supports all encodings.
+*/
+bool TransportInterface::supportsEncoding(TransportInterface::Encoding encoding) const
+{
+    Q_UNUSED(encoding)
+    return true;
+}
+
+/*! Sets the \a encoding used for all further messages to and from the client with the given \a clientId. */
+void TransportInterface::setClientEncoding(const QUuid &clientId, TransportInterface::Encoding encoding)
+{
+    if (encoding == EncodingJson) {
+        m_clientEncodings.remove(clientId);
+    } else {
+        m_clientEncodings.insert(clientId, encoding);
+    }
+}
+
+/*! Returns the encoding used for the client with the given \a clientId. */
+TransportInterface::Encoding TransportInterface::clientEncoding(const QUuid &clientId) const
+{
+    return m_clientEncodings.value(clientId, EncodingJson);
+}
+
 /*! Set the name of this TransportInterface to the given \a serverName. */
 void TransportInterface::setServerName(const QString &serverName)
 {
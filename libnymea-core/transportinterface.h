@@ -25,6 +25,7 @@
 #include <QString>
 #include <QList>
 #include <QUuid>
+#include <QHash>
 
 #include "nymeaconfiguration.h"
 
@@ -34,6 +35,12 @@ class TransportInterface : public QObject
 {
     Q_OBJECT
 public:
+    enum Encoding {
+        EncodingJson,
+        EncodingCbor
+    };
+    Q_ENUM(Encoding)
+
     explicit TransportInterface(const ServerConfiguration &config, QObject *parent = nullptr);
     virtual ~TransportInterface() = 0;
 
@@ -45,6 +52,10 @@ public:
     void setConfiguration(const ServerConfiguration &config);
     ServerConfiguration configuration() const;
 
+    virtual bool supportsEncoding(Encoding encoding) const;
+    void setClientEncoding(const QUuid &clientId, Encoding encoding);
+    Encoding clientEncoding(const QUuid &clientId) const;
+
 protected:
     QString m_serverName;
 
@@ -60,6 +71,7 @@ public slots:
 
 private:
     ServerConfiguration m_config;
+    QHash<QUuid, Encoding> m_clientEncodings;
 };
 
 }
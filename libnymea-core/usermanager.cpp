@@ -58,6 +58,11 @@
     \sa requestPushButtonAuth
 */
 
+/*! \fn void nymeaserver::UserManager::tokensRemoved();
+    This signal is emitted when tokens have been removed, either explicitly or along with their user. Tokens which
+    have been verified before need to be verified again.
+*/
+
 #include "usermanager.h"
 #include "nymeasettings.h"
 #include "loggingcategories.h"
@@ -103,6 +108,8 @@ UserManager::UserManager(const QString &dbName, QObject *parent):
     m_pushButtonDBusService = new PushButtonDBusService("/io/guh/nymead/UserManager", this);
     connect(m_pushButtonDBusService, &PushButtonDBusService::pushButtonPressed, this, &UserManager::onPushButtonPressed);
     m_pushButtonTransaction = qMakePair<int, QString>(-1, QString());
+
+    m_initRequired = queryInitRequired();
 }
 
 /*! Will return true if the database is working fine but doesn't have any information on users whatsoever.
@@ -110,6 +117,11 @@ UserManager::UserManager(const QString &dbName, QObject *parent):
  *  This may be used to determine whether a first-time setup is required.
  */
 bool UserManager::initRequired() const
+{
+    return m_initRequired;
+}
+
+bool UserManager::queryInitRequired() const
 {
     QString getTokensQuery = QString("SELECT id, username, creationdate, deviceName FROM tokens;");
     QSqlQuery result = m_db.exec(getTokensQuery);
@@ -165,6 +177,7 @@ UserManager::UserError UserManager::createUser(const QString &username, const QS
         qCWarning(dcUserManager) << "Error creating user:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
         return UserErrorBackendError;
     }
+    m_initRequired = false;
     return UserErrorNoError;
 }
 
@@ -187,6 +200,7 @@ UserManager::UserError UserManager::removeUser(const QString &username)
         m_db.exec(dropTokensQuery);
     }
 
+    onTokensRemoved();
     return UserErrorNoError;
 }
 
@@ -233,6 +247,7 @@ QByteArray UserManager::authenticate(const QString &username, const QString &pas
         qCWarning(dcUserManager) << "Error storing token in DB:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
         return QByteArray();
     }
+    m_initRequired = false;
     return token;
 }
 
@@ -334,12 +349,17 @@ UserManager::UserError UserManager::removeToken(const QUuid &tokenId)
     }
 
     qCDebug(dcUserManager) << "Token" << tokenId << "removed from DB";
+    onTokensRemoved();
     return UserErrorNoError;
 }
 
-/*! Returns true, if the given \a token is valid. */
+/*! Returns true, if the given \a token is valid. Tokens are only looked up in the database on their first use,
+    until any token gets removed. */
 bool UserManager::verifyToken(const QByteArray &token)
 {
+    if (m_verifiedTokens.contains(token)) {
+        return true;
+    }
     if (!validateToken(token)) {
         qCWarning(dcUserManager) << "Token failed character validation" << token;
         return false;
@@ -356,6 +376,7 @@ bool UserManager::verifyToken(const QByteArray &token)
         return false;
     }
     //qCDebug(dcUserManager) << "Token authorized for user" << result.value("username").toString();
+    m_verifiedTokens.insert(token);
     return true;
 }
 
@@ -405,6 +426,14 @@ void UserManager::rotate(const QString &dbName)
     }
 }
 
+void UserManager::onTokensRemoved()
+{
+    // Removals can't be mapped to single cached tokens, verify them all again
+    m_verifiedTokens.clear();
+    m_initRequired = queryInitRequired();
+    emit tokensRemoved();
+}
+
 bool UserManager::validateUsername(const QString &username) const
 {
     QRegExp validator("(^[a-zA-Z0-9_\\.+-]+@[a-zA-Z0-9-_]+\\.[a-zA-Z]+$)");
@@ -456,6 +485,7 @@ void UserManager::onPushButtonPressed()
         emit pushButtonAuthFinished(m_pushButtonTransaction.first, false, QByteArray());
     } else {
         qCDebug(dcUserManager()) << "PushButton Auth succeeded.";
+        m_initRequired = false;
         emit pushButtonAuthFinished(m_pushButtonTransaction.first, true, token);
     }
 
@@ -25,6 +25,7 @@
 
 #include <QObject>
 #include <QSqlDatabase>
+#include <QSet>
 
 namespace nymeaserver {
 
@@ -66,6 +67,7 @@ public:
 
 signals:
     void pushButtonAuthFinished(int transactionId, bool success, const QByteArray &token);
+    void tokensRemoved();
 
 private:
     bool initDB();
@@ -73,6 +75,8 @@ private:
     bool validateUsername(const QString &username) const;
     bool validatePassword(const QString &password) const;
     bool validateToken(const QByteArray &token) const;
+    bool queryInitRequired() const;
+    void onTokensRemoved();
 
 private slots:
     void onPushButtonPressed();
@@ -83,6 +87,10 @@ private:
     int m_pushButtonTransactionIdCounter = 0;
     QPair<int, QString> m_pushButtonTransaction;
 
+    // Verified tokens and the setup state are cached, the DB is only queried again when tokens or users got removed
+    QSet<QByteArray> m_verifiedTokens;
+    bool m_initRequired = false;
+
 };
 }
 Q_DECLARE_METATYPE(nymeaserver::UserManager::UserError)
@@ -32,6 +32,11 @@
 
     It is also responsible for loading Plugins and managing common hardware resources between
     \l{DevicePlugin}{device plugins}.
+
+    At startup the metadata of all installed plugins is read and parsed in parallel without loading
+    the plugin libraries. Only plugins which are needed right away, because there are configured
+    devices for them or they provide auto created devices, are loaded immediately. All other plugins
+    are loaded as soon as they are used for the first time.
 */
 
 
@@ -123,6 +128,19 @@
 /*! \fn void DeviceManager::deviceStateChanged(Device *device, const QUuid &stateTypeId, const QVariant &value);
     This signal is emitted when the \l{State} of a \a device changed. The \a stateTypeId parameter describes the
     \l{StateType} and the \a value parameter holds the new value.
+
+    Changes committed together in a \l{Device::beginStateBatch()}{state batch} are emitted right before
+    \l{deviceStatesChanged()} is emitted for all of them.
+*/
+
+/*! \fn void DeviceManager::deviceStatesChanged(const QList<Event> &events);
+    This signal is emitted whenever \l{State}{States} changed. The \a events list holds one state change
+    \l{Event} per change, in the order they happened. A change outside of a \l{Device::beginStateBatch()}{state batch}
+    is emitted on its own right away, all changes of a batch are emitted together when it is committed.
+    The \l{EventTypeId} of such an event equals the \l{StateTypeId} and its only \l{Param} holds the new value.
+
+    State changes are not emitted with \l{eventTriggered()}, so rule evaluation and logging can process
+    all changes a plugin made in one go.
 */
 
 /*! \fn void DeviceManager::deviceDisappeared(const DeviceId &deviceId);
@@ -180,6 +198,7 @@
 #include "plugin/deviceplugin.h"
 #include "typeutils.h"
 #include "nymeasettings.h"
+#include "devicestatejournal.h"
 #include "unistd.h"
 
 #include "plugintimer.h"
@@ -192,6 +211,29 @@
 #include <QCoreApplication>
 #include <QStandardPaths>
 #include <QDir>
+#include <QFile>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
+
+class PluginMetaDataParser: public QRunnable
+{
+public:
+    PluginMetaDataParser(DeviceManager::ParsedPlugin *parsedPlugin, const QLocale &locale) :
+        m_parsedPlugin(parsedPlugin),
+        m_locale(locale)
+    {
+    }
+
+    void run() override
+    {
+        DeviceManager::parsePluginMetaData(*m_parsedPlugin, m_locale);
+    }
+
+private:
+    DeviceManager::ParsedPlugin *m_parsedPlugin;
+    QLocale m_locale;
+};
 
 /*! Constructs the DeviceManager with the given \a{hardwareManager}, \a locale and \a parent. There should only be one DeviceManager in the system created by \l{nymeaserver::NymeaCore}.
  *  Use \c nymeaserver::NymeaCore::instance()->deviceManager() instead to access the DeviceManager. */
@@ -207,6 +249,8 @@ DeviceManager::DeviceManager(HardwareManager *hardwareManager, const QLocale &lo
         m_supportedInterfaces.insert(interface.name(), interface);
     }
 
+    initDeviceStateJournal();
+
     // Give hardware a chance to start up before loading plugins etc.
     QMetaObject::invokeMethod(this, "loadPlugins", Qt::QueuedConnection);
     QMetaObject::invokeMethod(this, "loadConfiguredDevices", Qt::QueuedConnection);
@@ -219,10 +263,6 @@ DeviceManager::DeviceManager(HardwareManager *hardwareManager, const QLocale &lo
 /*! Destructor of the DeviceManager. Each loaded \l{DevicePlugin} will be deleted. */
 DeviceManager::~DeviceManager()
 {
-    foreach (Device *device, m_configuredDevices) {
-        storeDeviceStates(device);
-    }
-
     foreach (DevicePlugin *plugin, m_devicePlugins) {
         if (plugin->parent() == this) {
             qCDebug(dcDeviceManager()) << "Deleting plugin" << plugin->pluginName();
@@ -283,9 +323,21 @@ void DeviceManager::registerStaticPlugin(DevicePlugin *plugin, const QJsonObject
         qCWarning(dcDeviceManager()) << "Failed to verify plugin metadata. Not loading static plugin:" << plugin->pluginName();
         return;
     }
+    QElapsedTimer timer;
+    timer.start();
+
     plugin->setParent(this);
     plugin->setMetaData(metaData);
+    plugin->setLocale(m_locale);
+    plugin->loadMetaData();
+    registerPluginMetaData(plugin->supportedVendors(), plugin->supportedDevices());
+
+    PluginLoadInfo loadInfo(plugin->pluginId(), plugin->pluginName(), QString());
+    loadInfo.setMetaDataTime(timer.restart());
     loadPlugin(plugin);
+    loadInfo.setInitTime(timer.elapsed());
+    loadInfo.setLoaded(true);
+    m_pluginLoadInfos.insert(plugin->pluginId(), loadInfo);
 }
 
 /*! Set the \a locale of all plugins and reload the translated strings. */
@@ -293,34 +345,33 @@ void DeviceManager::setLocale(const QLocale &locale)
 {
     qCDebug(dcDeviceManager()) << "Setting locale:" << locale;
     m_locale = locale;
+
+    // Reload all plugin meta data, including the plugins which are not loaded yet
+    QList<ParsedPlugin> parsedPlugins = m_deferredPlugins.values();
     foreach (DevicePlugin *plugin, m_devicePlugins.values()) {
-        QCoreApplication::removeTranslator(plugin->translator());
-        plugin->setLocale(m_locale);
-        QCoreApplication::installTranslator(plugin->translator());
-        plugin->loadMetaData();
+        ParsedPlugin parsedPlugin;
+        parsedPlugin.metaData = plugin->m_metaData;
+        parsedPlugins.append(parsedPlugin);
     }
-
-    // Reload all plugin meta data
+    parsePluginsMetaData(parsedPlugins, m_locale);
 
     m_supportedVendors.clear();
     m_supportedDevices.clear();
+    m_vendorDeviceMap.clear();
 
-    foreach (DevicePlugin *plugin, m_devicePlugins.values()) {
-
-        foreach (const Vendor &vendor, plugin->supportedVendors()) {
-            if (m_supportedVendors.contains(vendor.id()))
-                continue;
-
-            m_supportedVendors.insert(vendor.id(), vendor);
-        }
-
-        foreach (const DeviceClass &deviceClass, plugin->supportedDevices()) {
-            if (!m_supportedVendors.contains(deviceClass.vendorId())) {
-                qCWarning(dcDeviceManager) << "Vendor not found. Ignoring device. VendorId:" << deviceClass.vendorId() << "DeviceClass:" << deviceClass.name() << deviceClass.id();
-                continue;
-            }
-            m_supportedDevices.insert(deviceClass.id(), deviceClass);
+    foreach (const ParsedPlugin &parsedPlugin, parsedPlugins) {
+        PluginId pluginId = PluginId(parsedPlugin.metaData.value("id").toString());
+        DevicePlugin *plugin = m_devicePlugins.value(pluginId);
+        if (plugin) {
+            QCoreApplication::removeTranslator(plugin->translator());
+            plugin->setLocale(m_locale);
+            QCoreApplication::installTranslator(plugin->translator());
+            plugin->m_supportedDevices = parsedPlugin.deviceClasses;
+            plugin->m_configurationDescription = parsedPlugin.configurationDescription;
+        } else {
+            m_deferredPlugins.insert(pluginId, parsedPlugin);
         }
+        registerPluginMetaData(parsedPlugin.vendors, parsedPlugin.deviceClasses);
     }
 
     emit languageUpdated();
@@ -335,23 +386,49 @@ HardwareManager *DeviceManager::hardwareManager() const
     return m_hardwareManager;
 }
 
-/*! Returns all the \l{DevicePlugin}{DevicePlugins} loaded in the system. */
-QList<DevicePlugin *> DeviceManager::plugins() const
+/*! Returns all the \l{DevicePlugin}{DevicePlugins} installed in the system. Plugins which have
+    not been needed so far will be loaded by this call. Use \l{pluginDescriptions()} to list the plugins
+    without loading them. */
+QList<DevicePlugin *> DeviceManager::plugins()
 {
+    foreach (const PluginId &pluginId, m_deferredPlugins.keys()) {
+        ensurePluginLoaded(pluginId);
+    }
     return m_devicePlugins.values();
 }
 
-/*! Returns the \l{DevicePlugin} with the given \a id. Null if the id couldn't be found. */
-DevicePlugin *DeviceManager::plugin(const PluginId &id) const
+/*! Returns the \l{DevicePlugin} with the given \a id. Null if the id couldn't be found.
+    If the plugin has not been needed so far it will be loaded by this call. */
+DevicePlugin *DeviceManager::plugin(const PluginId &id)
+{
+    return ensurePluginLoaded(id);
+}
+
+/*! Returns the \l{PluginDescription} of all the plugins installed in the system. Unlike \l{plugins()},
+    this doesn't load plugins which have not been needed so far. */
+QList<PluginDescription> DeviceManager::pluginDescriptions() const
+{
+    QList<PluginDescription> descriptions;
+    foreach (DevicePlugin *plugin, m_devicePlugins) {
+        descriptions.append(PluginDescription(plugin->pluginId(), plugin->pluginName(), plugin->pluginDisplayName(), plugin->configurationDescription()));
+    }
+    foreach (const ParsedPlugin &parsedPlugin, m_deferredPlugins) {
+        descriptions.append(PluginDescription(PluginId(parsedPlugin.metaData.value("id").toString()), parsedPlugin.metaData.value("name").toString(), parsedPlugin.displayName, parsedPlugin.configurationDescription));
+    }
+    return descriptions;
+}
+
+/*! Returns the \l{PluginLoadInfo} with the startup statistics of all plugins in the system. */
+QList<PluginLoadInfo> DeviceManager::pluginLoadInfos() const
 {
-    return m_devicePlugins.value(id);
+    return m_pluginLoadInfos.values();
 }
 
 /*! Returns a certain \l{DeviceError} and sets the configuration of the plugin with the given \a pluginId
  *  and the given \a pluginConfig. */
 DeviceManager::DeviceError DeviceManager::setPluginConfig(const PluginId &pluginId, const ParamList &pluginConfig)
 {
-    DevicePlugin *plugin = m_devicePlugins.value(pluginId);
+    DevicePlugin *plugin = ensurePluginLoaded(pluginId);
     if (!plugin) {
         qCWarning(dcDeviceManager()) << "Could not set plugin configuration. There is no plugin with id" << pluginId.toString();
         return DeviceErrorPluginNotFound;
@@ -428,7 +505,7 @@ DeviceManager::DeviceError DeviceManager::discoverDevices(const DeviceClassId &d
     if (result != DeviceErrorNoError) {
         return result;
     }
-    DevicePlugin *plugin = m_devicePlugins.value(deviceClass.pluginId());
+    DevicePlugin *plugin = ensurePluginLoaded(deviceClass.pluginId());
     if (!plugin) {
         return DeviceErrorPluginNotFound;
     }
@@ -510,7 +587,7 @@ DeviceManager::DeviceError DeviceManager::reconfigureDevice(const DeviceId &devi
         return DeviceErrorDeviceClassNotFound;
     }
 
-    DevicePlugin *plugin = m_devicePlugins.value(deviceClass.pluginId());
+    DevicePlugin *plugin = ensurePluginLoaded(deviceClass.pluginId());
     if (!plugin) {
         return DeviceErrorPluginNotFound;
     }
@@ -668,7 +745,7 @@ DeviceManager::DeviceError DeviceManager::pairDevice(const PairingTransactionId
     if (deviceClass.setupMethod() == DeviceClass::SetupMethodDisplayPin) {
         DeviceDescriptor deviceDescriptor = m_discoveredDevices.value(deviceDescriptorId);
 
-        DevicePlugin *plugin = m_devicePlugins.value(m_supportedDevices.value(deviceClassId).pluginId());
+        DevicePlugin *plugin = ensurePluginLoaded(m_supportedDevices.value(deviceClassId).pluginId());
         if (!plugin) {
             qCWarning(dcDeviceManager()) << "Can't find a plugin for this device class";
             return DeviceErrorPluginNotFound;
@@ -695,7 +772,7 @@ DeviceManager::DeviceError DeviceManager::confirmPairing(const PairingTransactio
         DeviceClassId deviceClassId = pairingInfo.deviceClassId();
         DeviceDescriptor deviceDescriptor = m_discoveredDevices.value(pairingInfo.deviceDescriptorId());
 
-        DevicePlugin *plugin = m_devicePlugins.value(m_supportedDevices.value(deviceClassId).pluginId());
+        DevicePlugin *plugin = ensurePluginLoaded(m_supportedDevices.value(deviceClassId).pluginId());
 
         if (!plugin) {
             qCWarning(dcDeviceManager) << "Can't find a plugin for this device class";
@@ -738,13 +815,11 @@ DeviceManager::DeviceError DeviceManager::addConfiguredDeviceInternal(const Devi
         return result;
     }
 
-    foreach(Device *device, m_configuredDevices) {
-        if (device->id() == id) {
-            return DeviceErrorDuplicateUuid;
-        }
+    if (m_configuredDevices.contains(id)) {
+        return DeviceErrorDuplicateUuid;
     }
 
-    DevicePlugin *plugin = m_devicePlugins.value(deviceClass.pluginId());
+    DevicePlugin *plugin = ensurePluginLoaded(deviceClass.pluginId());
     if (!plugin) {
         return DeviceErrorPluginNotFound;
     }
@@ -770,7 +845,7 @@ DeviceManager::DeviceError DeviceManager::addConfiguredDeviceInternal(const Devi
         break;
     }
 
-    m_configuredDevices.insert(device->id(), device);
+    insertConfiguredDevice(device);
     storeConfiguredDevices();
     postSetupDevice(device);
 
@@ -784,7 +859,7 @@ DeviceManager::DeviceError DeviceManager::addConfiguredDeviceInternal(const Devi
  *  Returns \l{DeviceError} to inform about the result. */
 DeviceManager::DeviceError DeviceManager::removeConfiguredDevice(const DeviceId &deviceId)
 {
-    Device *device = m_configuredDevices.take(deviceId);
+    Device *device = takeConfiguredDevice(deviceId);
     if (!device) {
         return DeviceErrorDeviceNotFound;
     }
@@ -798,8 +873,7 @@ DeviceManager::DeviceError DeviceManager::removeConfiguredDevice(const DeviceId
     settings.remove("");
     settings.endGroup();
 
-    NymeaSettings stateCache(NymeaSettings::SettingsRoleDeviceStates);
-    stateCache.remove(deviceId.toString());
+    m_stateJournal->removeDevice(deviceId);
 
     emit deviceRemoved(deviceId);
 
@@ -809,12 +883,7 @@ DeviceManager::DeviceError DeviceManager::removeConfiguredDevice(const DeviceId
 /*! Returns the \l{Device} with the given \a id. Null if the id couldn't be found. */
 Device *DeviceManager::findConfiguredDevice(const DeviceId &id) const
 {
-    foreach (Device *device, m_configuredDevices) {
-        if (device->id() == id) {
-            return device;
-        }
-    }
-    return nullptr;
+    return m_configuredDevices.value(id);
 }
 
 /*! Returns all configured \{Device}{Devices} in the system. */
@@ -826,50 +895,26 @@ QList<Device *> DeviceManager::configuredDevices() const
 /*! Returns all \l{Device}{Devices} matching the \l{DeviceClass} referred by \a deviceClassId. */
 QList<Device *> DeviceManager::findConfiguredDevices(const DeviceClassId &deviceClassId) const
 {
-    QList<Device*> ret;
-    foreach (Device *device, m_configuredDevices) {
-        if (device->deviceClassId() == deviceClassId) {
-            ret << device;
-        }
-    }
-    return ret;
+    return m_deviceClassIndex.value(deviceClassId);
 }
 
 /*! Returns all \l{Device}{Devices} with the given \a interface. See also \l{Interfaces for DeviceClasses}{interfaces}. */
 QList<Device *> DeviceManager::findConfiguredDevices(const QString &interface) const
 {
-    QList<Device*> ret;
-    foreach (Device *device, m_configuredDevices) {
-        DeviceClass dc = m_supportedDevices.value(device->deviceClassId());
-        if (dc.interfaces().contains(interface)) {
-            ret.append(device);
-        }
-    }
-    return ret;
+    return m_interfaceIndex.value(interface);
 }
 
 /*! Returns all child \l{Device}{Devices} of the \l{Device} with the given \a id. */
 QList<Device *> DeviceManager::findChildDevices(const DeviceId &id) const
 {
-    QList<Device *> ret;
-    foreach (Device *d, m_configuredDevices) {
-        if (d->parentId() == id) {
-            ret.append(d);
-        }
-    }
-    return ret;
+    return m_parentIndex.value(id);
 }
 
 /*! For conveninece, this returns the \l{DeviceClass} with the id given by \a deviceClassId.
  *  Note: The returned \l{DeviceClass} may be invalid. */
 DeviceClass DeviceManager::findDeviceClass(const DeviceClassId &deviceClassId) const
 {
-    foreach (const DeviceClass &deviceClass, m_supportedDevices) {
-        if (deviceClass.id() == deviceClassId) {
-            return deviceClass;
-        }
-    }
-    return DeviceClass();
+    return m_supportedDevices.value(deviceClassId);
 }
 
 /*! Verify if the given \a params matches the given \a paramTypes. Ith \a requireAll
@@ -998,34 +1043,33 @@ DeviceManager::DeviceError DeviceManager::verifyParam(const ParamType &paramType
  *  its \l{DevicePlugin}. Then will dispatch the execution to the \l{DevicePlugin}.*/
 DeviceManager::DeviceError DeviceManager::executeAction(const Action &action)
 {
+    Device *device = m_configuredDevices.value(action.deviceId());
+    if (!device) {
+        return DeviceErrorDeviceNotFound;
+    }
+
     Action finalAction = action;
-    foreach (Device *device, m_configuredDevices) {
-        if (action.deviceId() == device->id()) {
-            // found device
-
-            // Make sure this device has an action type with this id
-            DeviceClass deviceClass = findDeviceClass(device->deviceClassId());
-            bool found = false;
-            foreach (const ActionType &actionType, deviceClass.actionTypes()) {
-                if (actionType.id() == action.actionTypeId()) {
-                    ParamList finalParams = action.params();
-                    DeviceError paramCheck = verifyParams(actionType.paramTypes(), finalParams);
-                    if (paramCheck != DeviceErrorNoError) {
-                        return paramCheck;
-                    }
-                    finalAction.setParams(finalParams);
-                    found = true;
-                    continue;
-                }
-            }
-            if (!found) {
-                return DeviceErrorActionTypeNotFound;
-            }
 
-            return m_devicePlugins.value(device->pluginId())->executeAction(device, finalAction);
+    // Make sure this device has an action type with this id
+    DeviceClass deviceClass = findDeviceClass(device->deviceClassId());
+    bool found = false;
+    foreach (const ActionType &actionType, deviceClass.actionTypes()) {
+        if (actionType.id() == action.actionTypeId()) {
+            ParamList finalParams = action.params();
+            DeviceError paramCheck = verifyParams(actionType.paramTypes(), finalParams);
+            if (paramCheck != DeviceErrorNoError) {
+                return paramCheck;
+            }
+            finalAction.setParams(finalParams);
+            found = true;
+            break;
         }
     }
-    return DeviceErrorDeviceNotFound;
+    if (!found) {
+        return DeviceErrorActionTypeNotFound;
+    }
+
+    return m_devicePlugins.value(device->pluginId())->executeAction(device, finalAction);
 }
 
 /*! Centralized time tick for the NymeaTimer resource. Ticks every second. */
@@ -1036,6 +1080,7 @@ void DeviceManager::timeTick()
 
 void DeviceManager::loadPlugins()
 {
+    QList<ParsedPlugin> parsedPlugins;
     foreach (const QString &path, pluginSearchDirs()) {
         QDir dir(path);
         qCDebug(dcDeviceManager) << "Loading plugins from:" << dir.absolutePath();
@@ -1050,59 +1095,124 @@ void DeviceManager::loadPlugins()
             if (!fi.exists())
                 continue;
 
+            ParsedPlugin parsedPlugin;
+            parsedPlugin.fileName = fi.absoluteFilePath();
+            parsedPlugins.append(parsedPlugin);
+        }
+    }
 
-            QPluginLoader loader;
-            loader.setFileName(fi.absoluteFilePath());
-            loader.setLoadHints(QLibrary::ResolveAllSymbolsHint);
+    // The metadata can be read without loading the plugin libraries, so parse all of them in parallel
+    QElapsedTimer timer;
+    timer.start();
+    parsePluginsMetaData(parsedPlugins, m_locale);
+    qCDebug(dcDeviceManager()) << "Parsed the metadata of" << parsedPlugins.count() << "plugins in" << timer.elapsed() << "ms";
 
-            if (!loader.load()) {
-                qCWarning(dcDeviceManager) << "Could not load plugin data of" << entry << "\n" << loader.errorString();
-                continue;
-            }
+    // Plugins with configured devices are needed right away, everything else can wait until it is used
+    QSet<DeviceClassId> configuredDeviceClassIds;
+    NymeaSettings settings(NymeaSettings::SettingsRoleDevices);
+    settings.beginGroup("DeviceConfig");
+    foreach (const QString &idString, settings.childGroups()) {
+        configuredDeviceClassIds.insert(DeviceClassId(settings.value(idString + "/deviceClassId").toString()));
+    }
+    settings.endGroup();
 
-            DevicePlugin *pluginIface = qobject_cast<DevicePlugin *>(loader.instance());
-            if (!pluginIface) {
-                qCWarning(dcDeviceManager) << "Could not get plugin instance of" << entry;
-                continue;
-            }
-            pluginIface->setParent(this);
+    foreach (const ParsedPlugin &parsedPlugin, parsedPlugins) {
+        if (!parsedPlugin.valid) {
+            qCWarning(dcDeviceManager) << "Could not load plugin data of" << parsedPlugin.fileName;
+            continue;
+        }
 
-            if (!verifyPluginMetadata(loader.metaData().value("MetaData").toObject()))
-                continue;
+        PluginId pluginId = PluginId(parsedPlugin.metaData.value("id").toString());
+        QString pluginName = parsedPlugin.metaData.value("name").toString();
+        if (m_pluginLoadInfos.contains(pluginId)) {
+            qCWarning(dcDeviceManager) << "Plugin" << pluginName << "has already been found in" << m_pluginLoadInfos.value(pluginId).fileName() << "Ignoring" << parsedPlugin.fileName;
+            continue;
+        }
+
+        PluginLoadInfo loadInfo(pluginId, pluginName, parsedPlugin.fileName);
+        loadInfo.setMetaDataTime(parsedPlugin.parseTime);
+        m_pluginLoadInfos.insert(pluginId, loadInfo);
 
-            pluginIface->setMetaData(loader.metaData().value("MetaData").toObject());
+        registerPluginMetaData(parsedPlugin.vendors, parsedPlugin.deviceClasses);
+        m_deferredPlugins.insert(pluginId, parsedPlugin);
 
-            loadPlugin(pluginIface);
+        bool required = false;
+        foreach (const DeviceClass &deviceClass, parsedPlugin.deviceClasses) {
+            if (configuredDeviceClassIds.contains(deviceClass.id()) || deviceClass.createMethods().testFlag(DeviceClass::CreateMethodAuto)) {
+                required = true;
+                break;
+            }
+        }
+
+        if (required) {
+            ensurePluginLoaded(pluginId);
+        } else {
+            qCDebug(dcDeviceManager) << "**** Not loading plugin" << pluginName << "until it is needed";
         }
     }
 }
 
-void DeviceManager::loadPlugin(DevicePlugin *pluginIface)
+DevicePlugin *DeviceManager::ensurePluginLoaded(const PluginId &pluginId)
 {
-    pluginIface->setLocale(m_locale);
-    qApp->installTranslator(pluginIface->translator());
+    if (!m_deferredPlugins.contains(pluginId)) {
+        return m_devicePlugins.value(pluginId);
+    }
 
-    pluginIface->initPlugin(this);
+    ParsedPlugin parsedPlugin = m_deferredPlugins.take(pluginId);
 
-    qCDebug(dcDeviceManager) << "**** Loaded plugin" << pluginIface->pluginName();
-    foreach (const Vendor &vendor, pluginIface->supportedVendors()) {
-        qCDebug(dcDeviceManager) << "* Loaded vendor:" << vendor.name();
-        if (m_supportedVendors.contains(vendor.id()))
-            continue;
+    QElapsedTimer timer;
+    timer.start();
 
-        m_supportedVendors.insert(vendor.id(), vendor);
+    QPluginLoader loader;
+    loader.setFileName(parsedPlugin.fileName);
+    loader.setLoadHints(QLibrary::ResolveAllSymbolsHint);
+
+    DevicePlugin *pluginIface = nullptr;
+    if (loader.load()) {
+        pluginIface = qobject_cast<DevicePlugin *>(loader.instance());
+        if (!pluginIface) {
+            qCWarning(dcDeviceManager) << "Could not get plugin instance of" << parsedPlugin.fileName;
+        }
+    } else {
+        qCWarning(dcDeviceManager) << "Could not load plugin data of" << parsedPlugin.fileName << "\n" << loader.errorString();
     }
 
-    foreach (const DeviceClass &deviceClass, pluginIface->supportedDevices()) {
-        if (!m_supportedVendors.contains(deviceClass.vendorId())) {
-            qCWarning(dcDeviceManager) << "Vendor not found. Ignoring device. VendorId:" << deviceClass.vendorId() << "DeviceClass:" << deviceClass.name() << deviceClass.id();
-            continue;
+    if (!pluginIface) {
+        // Drop what has been registered from the metadata, the plugin is not usable
+        foreach (const DeviceClass &deviceClass, parsedPlugin.deviceClasses) {
+            m_supportedDevices.remove(deviceClass.id());
+            m_vendorDeviceMap[deviceClass.vendorId()].removeAll(deviceClass.id());
         }
-        m_vendorDeviceMap[deviceClass.vendorId()].append(deviceClass.id());
-        m_supportedDevices.insert(deviceClass.id(), deviceClass);
-        qCDebug(dcDeviceManager) << "* Loaded device class:" << deviceClass.name();
+        m_pluginLoadInfos.remove(pluginId);
+        return nullptr;
     }
 
+    PluginLoadInfo loadInfo = m_pluginLoadInfos.value(pluginId);
+    loadInfo.setLoadTime(timer.restart());
+
+    // The metadata has already been parsed, hand it over instead of parsing it again
+    pluginIface->setParent(this);
+    pluginIface->setMetaData(parsedPlugin.metaData);
+    pluginIface->m_supportedDevices = parsedPlugin.deviceClasses;
+    pluginIface->m_configurationDescription = parsedPlugin.configurationDescription;
+    pluginIface->setLocale(m_locale);
+
+    loadPlugin(pluginIface);
+
+    loadInfo.setInitTime(timer.elapsed());
+    loadInfo.setLoaded(true);
+    m_pluginLoadInfos.insert(pluginId, loadInfo);
+    return pluginIface;
+}
+
+void DeviceManager::loadPlugin(DevicePlugin *pluginIface)
+{
+    qApp->installTranslator(pluginIface->translator());
+
+    pluginIface->initPlugin(this);
+
+    qCDebug(dcDeviceManager) << "**** Loaded plugin" << pluginIface->pluginName();
+
     NymeaSettings settings(NymeaSettings::SettingsRolePlugins);
     settings.beginGroup("PluginConfig");
     ParamList params;
@@ -1167,7 +1277,7 @@ void DeviceManager::loadConfiguredDevices()
         // We always add the device to the list in this case. If its in the storedDevices
         // it means that it was working at some point so lets still add it as there might
         // be rules associated with this device.
-        m_configuredDevices.insert(device->id(), device);
+        insertConfiguredDevice(device);
     }
     settings.endGroup();
 
@@ -1280,7 +1390,7 @@ void DeviceManager::slotDeviceSetupFinished(Device *device, DeviceManager::Devic
     // A device might be in here already if loaded from storedDevices. If it's not in the configuredDevices,
     // lets add it now.
     if (!m_configuredDevices.contains(device->id())) {
-        m_configuredDevices.insert(device->id(), device);
+        insertConfiguredDevice(device);
         emit deviceAdded(device);
         storeConfiguredDevices();
     }
@@ -1296,6 +1406,8 @@ void DeviceManager::slotDeviceSetupFinished(Device *device, DeviceManager::Devic
     }
 
     connect(device, SIGNAL(stateValueChanged(QUuid,QVariant)), this, SLOT(slotDeviceStateValueChanged(QUuid,QVariant)));
+    connect(device, SIGNAL(stateBatchCommitted()), this, SLOT(flushStateChanges()));
+    storeDeviceStates(device);
 
     device->setupCompleted();
     emit deviceSetupFinished(device, DeviceManager::DeviceErrorNoError);
@@ -1341,7 +1453,7 @@ void DeviceManager::slotPairingFinished(const PairingTransactionId &pairingTrans
     }
 
     DeviceClass deviceClass = findDeviceClass(deviceClassId);
-    DevicePlugin *plugin = m_devicePlugins.value(deviceClass.pluginId());
+    DevicePlugin *plugin = ensurePluginLoaded(deviceClass.pluginId());
     if (!plugin) {
         qCWarning(dcDeviceManager) << "Cannot find a plugin for this device class!";
         emit pairingFinished(pairingTransactionId, DeviceErrorPluginNotFound, deviceClass.pluginId().toString());
@@ -1376,7 +1488,7 @@ void DeviceManager::slotPairingFinished(const PairingTransactionId &pairingTrans
         break;
     }
 
-    m_configuredDevices.insert(device->id(), device);
+    insertConfiguredDevice(device);
     emit deviceAdded(device);
     storeConfiguredDevices();
     emit deviceSetupFinished(device, DeviceError::DeviceErrorNoError);
@@ -1391,7 +1503,7 @@ void DeviceManager::onAutoDevicesAppeared(const DeviceClassId &deviceClassId, co
         return;
     }
 
-    DevicePlugin *plugin = m_devicePlugins.value(deviceClass.pluginId());
+    DevicePlugin *plugin = ensurePluginLoaded(deviceClass.pluginId());
     if (!plugin) {
         return;
     }
@@ -1418,7 +1530,7 @@ void DeviceManager::onAutoDevicesAppeared(const DeviceClassId &deviceClassId, co
             break;
         case DeviceSetupStatusSuccess:
             qCDebug(dcDeviceManager) << "Device setup complete.";
-            m_configuredDevices.insert(device->id(), device);
+            insertConfiguredDevice(device);
             storeConfiguredDevices();
             emit deviceSetupFinished(device, DeviceError::DeviceErrorNoError);
             emit deviceAdded(device);
@@ -1464,12 +1576,10 @@ void DeviceManager::onLoaded()
 
 void DeviceManager::cleanupDeviceStateCache()
 {
-    NymeaSettings settings(NymeaSettings::SettingsRoleDeviceStates);
-    foreach (const QString &entry, settings.childGroups()) {
-        DeviceId deviceId(entry);
+    foreach (const DeviceId &deviceId, m_stateJournal->devices()) {
         if (!m_configuredDevices.contains(deviceId)) {
             qCDebug(dcDeviceManager()) << "Device ID" << deviceId << "not found in configured devices. Cleaning up stale device state cache.";
-            settings.remove(entry);
+            m_stateJournal->removeDevice(deviceId);
         }
     }
 }
@@ -1480,11 +1590,45 @@ void DeviceManager::slotDeviceStateValueChanged(const QUuid &stateTypeId, const
     if (!device) {
         return;
     }
+
+    if (m_cachedStateTypes.contains(StateTypeId::fromUuid(stateTypeId))) {
+        m_stateJournal->setValue(device->id(), StateTypeId::fromUuid(stateTypeId), value);
+    }
+
+    Param valueParam(ParamTypeId::fromUuid(stateTypeId), value);
+    Event event(EventTypeId::fromUuid(stateTypeId), device->id(), ParamList() << valueParam, true);
+
+    // Changes of a committed batch are processed together once the device finished committing
+    if (device->m_committingStateBatch) {
+        m_pendingStateChanges.append(event);
+        return;
+    }
+
     emit deviceStateChanged(device, stateTypeId, value);
+    emit deviceStatesChanged(QList<Event>() << event);
+}
 
-    Param valueParam(ParamTypeId(stateTypeId.toString()), value);
-    Event event(EventTypeId(stateTypeId.toString()), device->id(), ParamList() << valueParam, true);
-    emit eventTriggered(event);
+void DeviceManager::flushStateChanges()
+{
+    // Reacting on the changes may change states again, those must not end up in this list
+    QList<Event> pendingStateChanges = m_pendingStateChanges;
+    m_pendingStateChanges.clear();
+
+    QList<Event> events;
+    events.reserve(pendingStateChanges.count());
+    foreach (const Event &event, pendingStateChanges) {
+        Device *device = m_configuredDevices.value(event.deviceId());
+        if (!device) {
+            // Removed in the meantime
+            continue;
+        }
+        emit deviceStateChanged(device, event.eventTypeId(), event.params().first().value());
+        events.append(event);
+    }
+
+    if (!events.isEmpty()) {
+        emit deviceStatesChanged(events);
+    }
 }
 
 bool DeviceManager::verifyPluginMetadata(const QJsonObject &data)
@@ -1502,10 +1646,72 @@ bool DeviceManager::verifyPluginMetadata(const QJsonObject &data)
     return true;
 }
 
+void DeviceManager::parsePluginMetaData(ParsedPlugin &parsedPlugin, const QLocale &locale)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Reading the metadata of a plugin file does not load the library
+    if (parsedPlugin.metaData.isEmpty()) {
+        QPluginLoader loader(parsedPlugin.fileName);
+        parsedPlugin.metaData = loader.metaData().value("MetaData").toObject();
+    }
+
+    parsedPlugin.valid = verifyPluginMetadata(parsedPlugin.metaData);
+    if (parsedPlugin.valid) {
+        // The parsing only depends on the metadata and the translations, a bare plugin object will do
+        DevicePlugin parser;
+        parser.setMetaData(parsedPlugin.metaData);
+        parser.setLocale(locale);
+        parser.loadMetaData();
+        parsedPlugin.displayName = parser.pluginDisplayName();
+        parsedPlugin.vendors = parser.supportedVendors();
+        parsedPlugin.deviceClasses = parser.supportedDevices();
+        parsedPlugin.configurationDescription = parser.configurationDescription();
+    }
+
+    parsedPlugin.parseTime = timer.elapsed();
+}
+
+void DeviceManager::parsePluginsMetaData(QList<ParsedPlugin> &parsedPlugins, const QLocale &locale)
+{
+    QThreadPool threadPool;
+    for (int i = 0; i < parsedPlugins.count(); i++) {
+        threadPool.start(new PluginMetaDataParser(&parsedPlugins[i], locale));
+    }
+    threadPool.waitForDone();
+}
+
+void DeviceManager::registerPluginMetaData(const QList<Vendor> &vendors, const QList<DeviceClass> &deviceClasses)
+{
+    foreach (const Vendor &vendor, vendors) {
+        qCDebug(dcDeviceManager) << "* Loaded vendor:" << vendor.name();
+        if (m_supportedVendors.contains(vendor.id()))
+            continue;
+
+        m_supportedVendors.insert(vendor.id(), vendor);
+    }
+
+    foreach (const DeviceClass &deviceClass, deviceClasses) {
+        if (!m_supportedVendors.contains(deviceClass.vendorId())) {
+            qCWarning(dcDeviceManager) << "Vendor not found. Ignoring device. VendorId:" << deviceClass.vendorId() << "DeviceClass:" << deviceClass.name() << deviceClass.id();
+            continue;
+        }
+        m_vendorDeviceMap[deviceClass.vendorId()].append(deviceClass.id());
+        m_supportedDevices.insert(deviceClass.id(), deviceClass);
+        foreach (const StateType &stateType, deviceClass.stateTypes()) {
+            if (stateType.cached()) {
+                m_cachedStateTypes.insert(stateType.id());
+            }
+        }
+        qCDebug(dcDeviceManager) << "* Loaded device class:" << deviceClass.name();
+    }
+}
+
 DeviceManager::DeviceSetupStatus DeviceManager::setupDevice(Device *device)
 {
     DeviceClass deviceClass = findDeviceClass(device->deviceClassId());
-    DevicePlugin *plugin = m_devicePlugins.value(deviceClass.pluginId());
+    DevicePlugin *plugin = ensurePluginLoaded(deviceClass.pluginId());
 
     if (!plugin) {
         qCWarning(dcDeviceManager) << "Can't find a plugin for this device" << device->id();
@@ -1526,6 +1732,8 @@ DeviceManager::DeviceSetupStatus DeviceManager::setupDevice(Device *device)
     }
 
     connect(device, SIGNAL(stateValueChanged(QUuid,QVariant)), this, SLOT(slotDeviceStateValueChanged(QUuid,QVariant)));
+    connect(device, SIGNAL(stateBatchCommitted()), this, SLOT(flushStateChanges()));
+    storeDeviceStates(device);
 
     device->setupCompleted();
     return status;
@@ -1534,49 +1742,115 @@ DeviceManager::DeviceSetupStatus DeviceManager::setupDevice(Device *device)
 void DeviceManager::postSetupDevice(Device *device)
 {
     DeviceClass deviceClass = findDeviceClass(device->deviceClassId());
-    DevicePlugin *plugin = m_devicePlugins.value(deviceClass.pluginId());
+    DevicePlugin *plugin = ensurePluginLoaded(deviceClass.pluginId());
 
     plugin->postSetupDevice(device);
 }
 
-void DeviceManager::loadDeviceStates(Device *device)
+void DeviceManager::insertConfiguredDevice(Device *device)
+{
+    m_configuredDevices.insert(device->id(), device);
+
+    // Secondary indexes for the find methods, kept in sync with m_configuredDevices
+    m_deviceClassIndex[device->deviceClassId()].append(device);
+    if (!device->parentId().isNull()) {
+        m_parentIndex[device->parentId()].append(device);
+    }
+    foreach (const QString &interface, m_supportedDevices.value(device->deviceClassId()).interfaces()) {
+        m_interfaceIndex[interface].append(device);
+    }
+}
+
+Device *DeviceManager::takeConfiguredDevice(const DeviceId &deviceId)
+{
+    Device *device = m_configuredDevices.take(deviceId);
+    if (!device) {
+        return nullptr;
+    }
+
+    QList<Device *> &classDevices = m_deviceClassIndex[device->deviceClassId()];
+    classDevices.removeAll(device);
+    if (classDevices.isEmpty()) {
+        m_deviceClassIndex.remove(device->deviceClassId());
+    }
+    if (!device->parentId().isNull()) {
+        QList<Device *> &childDevices = m_parentIndex[device->parentId()];
+        childDevices.removeAll(device);
+        if (childDevices.isEmpty()) {
+            m_parentIndex.remove(device->parentId());
+        }
+    }
+    // Don't rely on the device class here, it might have been reloaded in the meantime
+    QHash<QString, QList<Device *> >::iterator it = m_interfaceIndex.begin();
+    while (it != m_interfaceIndex.end()) {
+        it->removeAll(device);
+        if (it->isEmpty()) {
+            it = m_interfaceIndex.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return device;
+}
+
+void DeviceManager::initDeviceStateJournal()
 {
+    QString legacyFileName = NymeaSettings(NymeaSettings::SettingsRoleDeviceStates).fileName();
+    QString fileNameBase = legacyFileName;
+    if (fileNameBase.endsWith(".conf")) {
+        fileNameBase.chop(5);
+    }
+
+    m_stateJournal = new DeviceStateJournal(fileNameBase, this);
+    bool migrate = !QFile::exists(m_stateJournal->snapshotFileName()) && QFile::exists(legacyFileName);
+    m_stateJournal->open();
+
+    if (!migrate) {
+        return;
+    }
+
+    // Import the cached states stored in the settings by previous versions. The settings file is left in place.
+    qCDebug(dcDeviceManager()) << "Migrating cached device states from" << legacyFileName;
     NymeaSettings settings(NymeaSettings::SettingsRoleDeviceStates);
-    settings.beginGroup(device->id().toString());
+    foreach (const QString &deviceIdString, settings.childGroups()) {
+        DeviceId deviceId(deviceIdString);
+        settings.beginGroup(deviceIdString);
+        // Pre 0.9.0 way of storing states
+        foreach (const QString &stateTypeIdString, settings.childKeys()) {
+            m_stateJournal->setValue(deviceId, StateTypeId(stateTypeIdString), settings.value(stateTypeIdString));
+        }
+        foreach (const QString &stateTypeIdString, settings.childGroups()) {
+            settings.beginGroup(stateTypeIdString);
+            QVariant value = settings.value("value");
+            value.convert(settings.value("type").toInt());
+            m_stateJournal->setValue(deviceId, StateTypeId(stateTypeIdString), value);
+            settings.endGroup();
+        }
+        settings.endGroup();
+    }
+    m_stateJournal->compact();
+}
+
+void DeviceManager::loadDeviceStates(Device *device)
+{
     DeviceClass deviceClass = m_supportedDevices.value(device->deviceClassId());
     foreach (const StateType &stateType, deviceClass.stateTypes()) {
-        if (stateType.cached()) {
-            QVariant value;
-            // First try to load new style
-            if (settings.childGroups().contains(stateType.id().toString())) {
-                settings.beginGroup(stateType.id().toString());
-                value = settings.value("value", stateType.defaultValue());
-                value.convert(settings.value("type").toInt());
-                settings.endGroup();
-            } else { // Try to fall back to the pre 0.9.0 way of storing states
-                value = settings.value(stateType.id().toString(), stateType.defaultValue());
-            }
-            device->setStateValue(stateType.id(), value);
+        if (stateType.cached() && m_stateJournal->contains(device->id(), stateType.id())) {
+            device->setStateValue(stateType.id(), m_stateJournal->value(device->id(), stateType.id()));
         } else {
             device->setStateValue(stateType.id(), stateType.defaultValue());
         }
     }
-    settings.endGroup();
 }
 
 void DeviceManager::storeDeviceStates(Device *device)
 {
-    NymeaSettings settings(NymeaSettings::SettingsRoleDeviceStates);
-    settings.beginGroup(device->id().toString());
+    // Plugins may have set states during the setup, before we started listening for changes
     DeviceClass deviceClass = m_supportedDevices.value(device->deviceClassId());
     foreach (const StateType &stateType, deviceClass.stateTypes()) {
         if (stateType.cached()) {
-            settings.beginGroup(stateType.id().toString());
-            settings.setValue("type", static_cast<int>(device->stateValue(stateType.id()).type()));
-            settings.setValue("value", device->stateValue(stateType.id()));
-            settings.endGroup();
+            m_stateJournal->setValue(device->id(), stateType.id(), device->stateValue(stateType.id()));
         }
     }
-    settings.endGroup();
 }
 
@@ -28,6 +28,8 @@
 
 #include "plugin/device.h"
 #include "plugin/devicedescriptor.h"
+#include "plugin/pluginloadinfo.h"
+#include "plugin/plugindescription.h"
 
 #include "types/deviceclass.h"
 #include "types/interface.h"
@@ -39,6 +41,8 @@
 #include <QTimer>
 #include <QLocale>
 #include <QPluginLoader>
+#include <QSet>
+#include <QJsonObject>
 
 #include "hardwaremanager.h"
 
@@ -46,12 +50,14 @@ class Device;
 class DevicePlugin;
 class DevicePairingInfo;
 class HardwareManager;
+class DeviceStateJournal;
 
 class LIBNYMEA_EXPORT DeviceManager : public QObject
 {
     Q_OBJECT
 
     friend class DevicePlugin;
+    friend class PluginMetaDataParser;
 
 public:
     enum DeviceError {
@@ -100,8 +106,10 @@ public:
 
     HardwareManager *hardwareManager() const;
 
-    QList<DevicePlugin*> plugins() const;
-    DevicePlugin* plugin(const PluginId &id) const;
+    QList<DevicePlugin*> plugins();
+    DevicePlugin* plugin(const PluginId &id);
+    QList<PluginDescription> pluginDescriptions() const;
+    QList<PluginLoadInfo> pluginLoadInfos() const;
     DeviceError setPluginConfig(const PluginId &pluginId, const ParamList &pluginConfig);
 
     QList<Vendor> supportedVendors() const;
@@ -142,6 +150,7 @@ signals:
     void pluginConfigChanged(const PluginId &id, const ParamList &config);
     void eventTriggered(const Event &event);
     void deviceStateChanged(Device *device, const QUuid &stateTypeId, const QVariant &value);
+    void deviceStatesChanged(const QList<Event> &events);
     void deviceRemoved(const DeviceId &deviceId);
     void deviceDisappeared(const DeviceId &deviceId);
     void deviceAdded(Device *device);
@@ -172,12 +181,31 @@ private slots:
 
     // Only connect this to Devices. It will query the sender()
     void slotDeviceStateValueChanged(const QUuid &stateTypeId, const QVariant &value);
+    void flushStateChanges();
 
 private:
-    bool verifyPluginMetadata(const QJsonObject &data);
+    struct ParsedPlugin {
+        QString fileName;
+        QJsonObject metaData;
+        bool valid = false;
+        QString displayName;
+        QList<Vendor> vendors;
+        QList<DeviceClass> deviceClasses;
+        QList<ParamType> configurationDescription;
+        qint64 parseTime = 0;
+    };
+
+    static bool verifyPluginMetadata(const QJsonObject &data);
+    static void parsePluginMetaData(ParsedPlugin &parsedPlugin, const QLocale &locale);
+    static void parsePluginsMetaData(QList<ParsedPlugin> &parsedPlugins, const QLocale &locale);
+    void registerPluginMetaData(const QList<Vendor> &vendors, const QList<DeviceClass> &deviceClasses);
+    DevicePlugin *ensurePluginLoaded(const PluginId &pluginId);
     DeviceError addConfiguredDeviceInternal(const DeviceClassId &deviceClassId, const QString &name, const ParamList &params, const DeviceId id = DeviceId::createDeviceId());
     DeviceSetupStatus setupDevice(Device *device);
     void postSetupDevice(Device *device);
+    void insertConfiguredDevice(Device *device);
+    Device *takeConfiguredDevice(const DeviceId &deviceId);
+    void initDeviceStateJournal();
     void storeDeviceStates(Device *device);
     void loadDeviceStates(Device *device);
 
@@ -191,9 +219,17 @@ private:
     QHash<VendorId, QList<DeviceClassId> > m_vendorDeviceMap;
     QHash<DeviceClassId, DeviceClass> m_supportedDevices;
     QHash<DeviceId, Device*> m_configuredDevices;
+    QHash<DeviceClassId, QList<Device *> > m_deviceClassIndex;
+    QHash<DeviceId, QList<Device *> > m_parentIndex;
+    QHash<QString, QList<Device *> > m_interfaceIndex;
     QHash<DeviceDescriptorId, DeviceDescriptor> m_discoveredDevices;
+    QSet<StateTypeId> m_cachedStateTypes;
+    QList<Event> m_pendingStateChanges;
+    DeviceStateJournal *m_stateJournal = nullptr;
 
     QHash<PluginId, DevicePlugin*> m_devicePlugins;
+    QHash<PluginId, ParsedPlugin> m_deferredPlugins;
+    QHash<PluginId, PluginLoadInfo> m_pluginLoadInfos;
 
     QHash<QUuid, DevicePairingInfo> m_pairingsJustAdd;
     QHash<QUuid, DevicePairingInfo> m_pairingsDiscovery;
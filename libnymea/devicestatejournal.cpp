@@ -0,0 +1,378 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class DeviceStateJournal
+    \brief Persists the values of cached \l{State}{States} continuously.
+
+    \ingroup devices
+    \inmodule libnymea
+
+    The DeviceStateJournal keeps the last known value of each cached \l{State} in memory and persists changes
+    as they happen. Every change is appended as a small binary record to a journal file. Appended records are
+    buffered for \l{flushInterval()} milliseconds and then written and synced to disk in one go, so a burst of
+    state changes costs a single write.
+
+    Once the journal holds more than \l{compactThreshold()} records it is compacted: the complete set of values
+    is written to a snapshot file, which atomically replaces the previous one, and the journal is truncated.
+
+    On \l{open()} the snapshot is loaded and the journal is replayed on top of it. Each journal record carries
+    its length and a checksum, so a record torn by a power loss or crash is detected and dropped together with
+    everything behind it, while all records before it are recovered.
+*/
+
+#include "devicestatejournal.h"
+#include "loggingcategories.h"
+
+#include <QDataStream>
+#include <QSaveFile>
+
+#include <unistd.h>
+
+static const quint32 snapshotMagic = 0x6e795353; // "nySS"
+static const quint32 journalMagic = 0x6e79534a;  // "nySJ"
+static const quint32 formatVersion = 1;
+static const int recordHeaderSize = sizeof(quint32) + sizeof(quint16);
+
+/*! Constructs a DeviceStateJournal with the given \a parent. The snapshot and journal files will be
+    named after \a fileNameBase with the suffixes \tt{.snapshot} and \tt{.journal}. Call \l{open()} before use.
+*/
+DeviceStateJournal::DeviceStateJournal(const QString &fileNameBase, QObject *parent) :
+    QObject(parent),
+    m_snapshotFileName(fileNameBase + ".snapshot"),
+    m_journalFileName(fileNameBase + ".journal"),
+    m_journal(m_journalFileName)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(1000);
+    connect(&m_flushTimer, &QTimer::timeout, this, &DeviceStateJournal::flush);
+}
+
+/*! Destroys the DeviceStateJournal. Buffered records are written to disk. */
+DeviceStateJournal::~DeviceStateJournal()
+{
+    flush();
+}
+
+/*! Returns the file name of the snapshot. */
+QString DeviceStateJournal::snapshotFileName() const
+{
+    return m_snapshotFileName;
+}
+
+/*! Returns the file name of the journal. */
+QString DeviceStateJournal::journalFileName() const
+{
+    return m_journalFileName;
+}
+
+/*! Returns the number of journal records after which the journal will be compacted into the snapshot. */
+int DeviceStateJournal::compactThreshold() const
+{
+    return m_compactThreshold;
+}
+
+/*! Sets the number of journal \a records after which the journal will be compacted into the snapshot. */
+void DeviceStateJournal::setCompactThreshold(int records)
+{
+    m_compactThreshold = records;
+}
+
+/*! Returns the time in milliseconds records are buffered before they are written to the journal. */
+int DeviceStateJournal::flushInterval() const
+{
+    return m_flushTimer.interval();
+}
+
+/*! Sets the time in milliseconds records are buffered before they are written to the journal to \a msecs. */
+void DeviceStateJournal::setFlushInterval(int msecs)
+{
+    m_flushTimer.setInterval(msecs);
+}
+
+/*! Loads the snapshot, replays the journal and compacts both into a fresh snapshot. Returns false if the
+    journal could not be opened for writing. Values recovered before the error are available nevertheless.
+*/
+bool DeviceStateJournal::open()
+{
+    m_states.clear();
+    m_pending.clear();
+
+    loadSnapshot();
+    int records = replayJournal();
+    qCDebug(dcDeviceManager()) << "Loaded cached states of" << m_states.count() << "devices." << records << "journal records replayed.";
+
+    return compact();
+}
+
+/*! Returns the ids of all devices with cached state values. */
+QList<DeviceId> DeviceStateJournal::devices() const
+{
+    return m_states.keys();
+}
+
+/*! Returns true if a value for the state with the given \a stateTypeId of the device with the given \a deviceId is stored. */
+bool DeviceStateJournal::contains(const DeviceId &deviceId, const StateTypeId &stateTypeId) const
+{
+    return m_states.value(deviceId).contains(stateTypeId);
+}
+
+/*! Returns the stored value for the state with the given \a stateTypeId of the device with the given \a deviceId. */
+QVariant DeviceStateJournal::value(const DeviceId &deviceId, const StateTypeId &stateTypeId) const
+{
+    return m_states.value(deviceId).value(stateTypeId);
+}
+
+/*! Stores \a value for the state with the given \a stateTypeId of the device with the given \a deviceId.
+    Nothing is written if the stored value is the same already.
+*/
+void DeviceStateJournal::setValue(const DeviceId &deviceId, const StateTypeId &stateTypeId, const QVariant &value)
+{
+    QHash<StateTypeId, QVariant> &deviceStates = m_states[deviceId];
+    QHash<StateTypeId, QVariant>::const_iterator it = deviceStates.constFind(stateTypeId);
+    if (it != deviceStates.constEnd() && it.value().type() == value.type() && it.value() == value) {
+        return;
+    }
+    deviceStates.insert(stateTypeId, value);
+
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << static_cast<quint8>(RecordTypeSetValue) << static_cast<QUuid>(deviceId) << static_cast<QUuid>(stateTypeId) << value;
+    appendRecord(record);
+}
+
+/*! Removes all stored values of the device with the given \a deviceId. */
+void DeviceStateJournal::removeDevice(const DeviceId &deviceId)
+{
+    if (m_states.remove(deviceId) == 0) {
+        return;
+    }
+
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << static_cast<quint8>(RecordTypeRemoveDevice) << static_cast<QUuid>(deviceId);
+    appendRecord(record);
+}
+
+/*! Writes all buffered records to the journal and syncs it to disk. */
+void DeviceStateJournal::flush()
+{
+    m_flushTimer.stop();
+    if (m_pending.isEmpty()) {
+        return;
+    }
+
+    writePending();
+
+    if (m_journalRecords >= m_compactThreshold) {
+        compact();
+    }
+}
+
+/*! Writes all stored values to a new snapshot, which atomically replaces the old one, and truncates the journal.
+    Returns false if the snapshot or the journal could not be written.
+*/
+bool DeviceStateJournal::compact()
+{
+    // Records still buffered must reach the journal first. If we crash between replacing the snapshot and
+    // truncating the journal, replaying the journal on top of the new snapshot yields the same values.
+    m_flushTimer.stop();
+    writePending();
+
+    QSaveFile snapshot(m_snapshotFileName);
+    if (!snapshot.open(QIODevice::WriteOnly)) {
+        qCWarning(dcDeviceManager()) << "Could not open state snapshot" << m_snapshotFileName << snapshot.errorString();
+        return false;
+    }
+
+    QDataStream stream(&snapshot);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << snapshotMagic << formatVersion << static_cast<quint32>(m_states.count());
+    for (QHash<DeviceId, QHash<StateTypeId, QVariant> >::const_iterator it = m_states.constBegin(); it != m_states.constEnd(); ++it) {
+        stream << static_cast<QUuid>(it.key()) << static_cast<quint32>(it.value().count());
+        for (QHash<StateTypeId, QVariant>::const_iterator stateIt = it.value().constBegin(); stateIt != it.value().constEnd(); ++stateIt) {
+            stream << static_cast<QUuid>(stateIt.key()) << stateIt.value();
+        }
+    }
+
+    if (!snapshot.commit()) {
+        qCWarning(dcDeviceManager()) << "Could not write state snapshot" << m_snapshotFileName << snapshot.errorString();
+        return false;
+    }
+
+    m_journal.close();
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(dcDeviceManager()) << "Could not open state journal" << m_journalFileName << m_journal.errorString();
+        return false;
+    }
+
+    QDataStream journalStream(&m_journal);
+    journalStream << journalMagic << formatVersion;
+    m_journal.flush();
+    m_journalRecords = 0;
+    return true;
+}
+
+void DeviceStateJournal::writePending()
+{
+    if (m_pending.isEmpty()) {
+        return;
+    }
+
+    if (!m_journal.isOpen()) {
+        qCWarning(dcDeviceManager()) << "State journal" << m_journalFileName << "is not open. Dropping" << m_pending.size() << "bytes of state changes.";
+        m_pending.clear();
+        return;
+    }
+
+    if (m_journal.write(m_pending) != m_pending.size() || !m_journal.flush()) {
+        qCWarning(dcDeviceManager()) << "Error writing state journal" << m_journalFileName << m_journal.errorString();
+    }
+    ::fdatasync(m_journal.handle());
+    m_pending.clear();
+}
+
+bool DeviceStateJournal::loadSnapshot()
+{
+    QFile snapshot(m_snapshotFileName);
+    if (!snapshot.exists()) {
+        return true;
+    }
+    if (!snapshot.open(QIODevice::ReadOnly)) {
+        qCWarning(dcDeviceManager()) << "Could not open state snapshot" << m_snapshotFileName << snapshot.errorString();
+        return false;
+    }
+
+    QDataStream stream(&snapshot);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic, version, deviceCount;
+    stream >> magic >> version >> deviceCount;
+    if (stream.status() != QDataStream::Ok || magic != snapshotMagic || version != formatVersion) {
+        qCWarning(dcDeviceManager()) << "Ignoring invalid state snapshot" << m_snapshotFileName;
+        return false;
+    }
+
+    for (quint32 i = 0; i < deviceCount; i++) {
+        QUuid deviceId;
+        quint32 stateCount;
+        stream >> deviceId >> stateCount;
+        QHash<StateTypeId, QVariant> &deviceStates = m_states[DeviceId::fromUuid(deviceId)];
+        for (quint32 j = 0; j < stateCount && stream.status() == QDataStream::Ok; j++) {
+            QUuid stateTypeId;
+            QVariant value;
+            stream >> stateTypeId >> value;
+            deviceStates.insert(StateTypeId::fromUuid(stateTypeId), value);
+        }
+        if (stream.status() != QDataStream::Ok) {
+            // The snapshot is replaced atomically, so this only happens on a damaged file system.
+            qCWarning(dcDeviceManager()) << "State snapshot" << m_snapshotFileName << "is corrupt. Some cached states are lost.";
+            return false;
+        }
+    }
+    return true;
+}
+
+int DeviceStateJournal::replayJournal()
+{
+    QFile journal(m_journalFileName);
+    if (!journal.exists()) {
+        return 0;
+    }
+    if (!journal.open(QIODevice::ReadOnly)) {
+        qCWarning(dcDeviceManager()) << "Could not open state journal" << m_journalFileName << journal.errorString();
+        return 0;
+    }
+
+    // The journal never grows beyond the compact threshold, read it in one go
+    QByteArray data = journal.readAll();
+    QDataStream headerStream(data);
+    quint32 magic, version;
+    headerStream >> magic >> version;
+    if (headerStream.status() != QDataStream::Ok || magic != journalMagic || version != formatVersion) {
+        if (!data.isEmpty()) {
+            qCWarning(dcDeviceManager()) << "Ignoring invalid state journal" << m_journalFileName;
+        }
+        return 0;
+    }
+
+    int records = 0;
+    int pos = 2 * sizeof(quint32);
+    while (pos < data.size()) {
+        if (data.size() - pos < recordHeaderSize) {
+            break;
+        }
+        QDataStream recordHeader(QByteArray::fromRawData(data.constData() + pos, recordHeaderSize));
+        quint32 length;
+        quint16 checksum;
+        recordHeader >> length >> checksum;
+        if (length > static_cast<quint32>(data.size() - pos - recordHeaderSize)) {
+            break;
+        }
+        const char *payload = data.constData() + pos + recordHeaderSize;
+        if (qChecksum(payload, length) != checksum) {
+            break;
+        }
+
+        QDataStream stream(QByteArray::fromRawData(payload, length));
+        stream.setVersion(QDataStream::Qt_5_6);
+        quint8 type;
+        QUuid deviceId;
+        stream >> type >> deviceId;
+        if (type == RecordTypeSetValue) {
+            QUuid stateTypeId;
+            QVariant value;
+            stream >> stateTypeId >> value;
+            if (stream.status() != QDataStream::Ok) {
+                break;
+            }
+            m_states[DeviceId::fromUuid(deviceId)].insert(StateTypeId::fromUuid(stateTypeId), value);
+        } else if (type == RecordTypeRemoveDevice) {
+            m_states.remove(DeviceId::fromUuid(deviceId));
+        } else {
+            break;
+        }
+
+        pos += recordHeaderSize + length;
+        records++;
+    }
+
+    if (pos < data.size()) {
+        qCWarning(dcDeviceManager()) << "State journal" << m_journalFileName << "has a damaged tail, probably from an unclean shutdown." << data.size() - pos << "bytes dropped.";
+    }
+    return records;
+}
+
+void DeviceStateJournal::appendRecord(const QByteArray &record)
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream << static_cast<quint32>(record.size()) << qChecksum(record.constData(), record.size());
+    m_pending.append(header);
+    m_pending.append(record);
+    m_journalRecords++;
+
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
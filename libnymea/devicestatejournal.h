@@ -0,0 +1,86 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef DEVICESTATEJOURNAL_H
+#define DEVICESTATEJOURNAL_H
+
+#include <QObject>
+#include <QHash>
+#include <QFile>
+#include <QTimer>
+#include <QVariant>
+
+#include "libnymea.h"
+#include "typeutils.h"
+
+class LIBNYMEA_EXPORT DeviceStateJournal : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DeviceStateJournal(const QString &fileNameBase, QObject *parent = nullptr);
+    ~DeviceStateJournal();
+
+    QString snapshotFileName() const;
+    QString journalFileName() const;
+
+    int compactThreshold() const;
+    void setCompactThreshold(int records);
+
+    int flushInterval() const;
+    void setFlushInterval(int msecs);
+
+    bool open();
+
+    QList<DeviceId> devices() const;
+    bool contains(const DeviceId &deviceId, const StateTypeId &stateTypeId) const;
+    QVariant value(const DeviceId &deviceId, const StateTypeId &stateTypeId) const;
+
+    void setValue(const DeviceId &deviceId, const StateTypeId &stateTypeId, const QVariant &value);
+    void removeDevice(const DeviceId &deviceId);
+
+public slots:
+    void flush();
+    bool compact();
+
+private:
+    enum RecordType {
+        RecordTypeSetValue = 1,
+        RecordTypeRemoveDevice = 2
+    };
+
+    bool loadSnapshot();
+    int replayJournal();
+    void appendRecord(const QByteArray &record);
+    void writePending();
+
+    QString m_snapshotFileName;
+    QString m_journalFileName;
+    QFile m_journal;
+    QTimer m_flushTimer;
+    QByteArray m_pending;
+    int m_journalRecords = 0;
+    int m_compactThreshold = 1000;
+
+    QHash<DeviceId, QHash<StateTypeId, QVariant> > m_states;
+};
+
+#endif // DEVICESTATEJOURNAL_H
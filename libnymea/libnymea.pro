@@ -19,10 +19,13 @@ HEADERS += devicemanager.h \
         typeutils.h \
         loggingcategories.h \
         nymeasettings.h \
+        devicestatejournal.h \
         plugin/device.h \
         plugin/deviceplugin.h \
         plugin/devicedescriptor.h \
         plugin/devicepairinginfo.h \
+        plugin/pluginloadinfo.h \
+        plugin/plugindescription.h \
         hardware/gpio.h \
         hardware/gpiomonitor.h \
         hardware/pwm.h \
@@ -78,10 +81,13 @@ HEADERS += devicemanager.h \
 SOURCES += devicemanager.cpp \
         loggingcategories.cpp \
         nymeasettings.cpp \
+        devicestatejournal.cpp \
         plugin/device.cpp \
         plugin/deviceplugin.cpp \
         plugin/devicedescriptor.cpp \
         plugin/devicepairinginfo.cpp \
+        plugin/pluginloadinfo.cpp \
+        plugin/plugindescription.cpp \
         hardware/gpio.cpp \
         hardware/gpiomonitor.cpp \
         hardware/pwm.cpp \
@@ -38,6 +38,11 @@
     This signal is emitted when the \l{State} with the given \a stateTypeId changed.
     The \a value parameter describes the new value of the State.
 */
+
+/*! \fn void Device::stateBatchCommitted()
+    This signal is emitted by \l{commitStateBatch()} after \l{stateValueChanged()} has been emitted for all
+    changes of the batch.
+*/
 #include "device.h"
 #include "types/event.h"
 #include "loggingcategories.h"
@@ -154,61 +159,138 @@ bool Device::hasParam(const ParamTypeId &paramTypeId) const
 void Device::setStates(const QList<State> &states)
 {
     m_states = states;
+    m_batchedStates.clear();
+    m_stateIndexes.clear();
+    m_stateIndexes.reserve(m_states.count());
+    for (int i = 0; i < m_states.count(); i++) {
+        m_stateIndexes.insert(m_states.at(i).stateTypeId(), i);
+    }
 }
 
 /*! Returns true, a \l{State} with the given \a stateTypeId exists for this Device. */
 bool Device::hasState(const StateTypeId &stateTypeId) const
 {
-    foreach (const State &state, m_states) {
-        if (state.stateTypeId() == stateTypeId) {
-            return true;
-        }
-    }
-    return false;
+    return m_stateIndexes.contains(stateTypeId);
 }
 
 /*! For convenience, this finds the \l{State} matching the given \a stateTypeId and returns the current valie in this Device. */
 QVariant Device::stateValue(const StateTypeId &stateTypeId) const
 {
-    foreach (const State &state, m_states) {
-        if (state.stateTypeId() == stateTypeId) {
-            return state.value();
-        }
-    }
-    return QVariant();
+    return stateValue(stateIndex(stateTypeId));
 }
 
 /*! For convenience, this finds the \l{State} matching the given \a stateTypeId in this Device and sets the current value to \a value. */
 void Device::setStateValue(const StateTypeId &stateTypeId, const QVariant &value)
 {
-    for (int i = 0; i < m_states.count(); ++i) {
-        if (m_states.at(i).stateTypeId() == stateTypeId) {
-            if (m_states.at(i).value() == value)
-                return;
+    int index = stateIndex(stateTypeId);
+    if (index < 0) {
+        qCWarning(dcDeviceManager) << "Failed setting state for" << m_name << value;
+        return;
+    }
+    setStateValue(index, value);
+}
+
+/*! Returns the index of the \l{State} with the given \a stateTypeId, or -1 if this Device has no such state.
+
+    The states of a Device are ordered like the \l{StateType}{StateTypes} in \l{DeviceClass::stateTypes()}, so the
+    index of a state is the same for all devices of a \l{DeviceClass}. Plugins updating states frequently can resolve
+    the index once and use \l{setStateValue(int, const QVariant &)} from then on.
+*/
+int Device::stateIndex(const StateTypeId &stateTypeId) const
+{
+    return m_stateIndexes.value(stateTypeId, -1);
+}
+
+/*! Returns the current value of the \l{State} at the given \a stateIndex. See \l{stateIndex()}. */
+QVariant Device::stateValue(int stateIndex) const
+{
+    if (stateIndex < 0 || stateIndex >= m_states.count()) {
+        return QVariant();
+    }
+    return m_states.at(stateIndex).value();
+}
+
+/*! Sets the current value of the \l{State} at the given \a stateIndex to \a value. See \l{stateIndex()}. */
+void Device::setStateValue(int stateIndex, const QVariant &value)
+{
+    if (stateIndex < 0 || stateIndex >= m_states.count()) {
+        qCWarning(dcDeviceManager) << "Failed setting state for" << m_name << "invalid state index" << stateIndex;
+        return;
+    }
+
+    State &state = m_states[stateIndex];
+    if (state.value() == value) {
+        return;
+    }
+
+    // TODO: check min/max value + possible values
+    //       to prevent an invalid state type from the plugin side
+
+    if (m_stateBatchDepth > 0) {
+        if (!m_batchedStates.contains(stateIndex)) {
+            m_batchedStates.insert(stateIndex, state.value());
+        }
+        state.setValue(value);
+        return;
+    }
+
+    state.setValue(value);
+    emit stateValueChanged(state.stateTypeId(), value);
+}
 
+/*! Starts a batch of state changes. Until the matching \l{commitStateBatch()} the new values are stored but
+    \l{stateValueChanged()} is not emitted. Plugins updating many states at once, e.g. from a single poll,
+    should wrap the updates in a batch:
 
-            // TODO: check min/max value + possible values
-            //       to prevent an invalid state type from the plugin side
+    \code
+    device->beginStateBatch();
+    device->setStateValue(temperatureStateTypeId, temperature);
+    device->setStateValue(humidityStateTypeId, humidity);
+    device->commitStateBatch();
+    \endcode
 
-            State newState(stateTypeId, m_id);
-            newState.setValue(value);
-            m_states[i] = newState;
-            emit stateValueChanged(stateTypeId, value);
-            return;
+    Batches can be nested, only the outermost commit emits the changes.
+*/
+void Device::beginStateBatch()
+{
+    m_stateBatchDepth++;
+}
+
+/*! Ends a batch of state changes started with \l{beginStateBatch()}. \l{stateValueChanged()} is emitted once
+    for each \l{State} whose value differs from the value it had when the batch was started, followed by
+    \l{stateBatchCommitted()}.
+*/
+void Device::commitStateBatch()
+{
+    if (m_stateBatchDepth == 0) {
+        qCWarning(dcDeviceManager) << "Committing a state batch for" << m_name << "without a matching beginStateBatch()";
+        return;
+    }
+    if (--m_stateBatchDepth > 0) {
+        return;
+    }
+
+    QMap<int, QVariant> batchedStates = m_batchedStates;
+    m_batchedStates.clear();
+    m_committingStateBatch = true;
+    for (QMap<int, QVariant>::const_iterator it = batchedStates.constBegin(); it != batchedStates.constEnd(); ++it) {
+        const State &state = m_states.at(it.key());
+        if (state.value() != it.value()) {
+            emit stateValueChanged(state.stateTypeId(), state.value());
         }
     }
-    qCWarning(dcDeviceManager) << "Failed setting state for" << m_name << value;
+    m_committingStateBatch = false;
+    emit stateBatchCommitted();
 }
 
 /*! Returns the \l{State} with the given \a stateTypeId of this Device. */
 State Device::state(const StateTypeId &stateTypeId) const
 {
-    for (int i = 0; i < m_states.count(); ++i) {
-        if (m_states.at(i).stateTypeId() == stateTypeId) {
-            return m_states.at(i);
-        }
+    int index = stateIndex(stateTypeId);
+    if (index < 0) {
+        return State(StateTypeId(), DeviceId());
     }
-    return State(StateTypeId(), DeviceId());
+    return m_states.at(index);
 }
 
 /*! Returns the \l{DeviceId} of the parent Device from Device. If the parentId
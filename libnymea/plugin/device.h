@@ -34,6 +34,8 @@
 #include <QObject>
 #include <QUuid>
 #include <QVariant>
+#include <QHash>
+#include <QMap>
 
 class LIBNYMEA_EXPORT Device: public QObject
 {
@@ -63,8 +65,15 @@ public:
     QVariant stateValue(const StateTypeId &stateTypeId) const;
     void setStateValue(const StateTypeId &stateTypeId, const QVariant &value);
 
+    int stateIndex(const StateTypeId &stateTypeId) const;
+    QVariant stateValue(int stateIndex) const;
+    void setStateValue(int stateIndex, const QVariant &value);
+
     State state(const StateTypeId &stateTypeId) const;
 
+    void beginStateBatch();
+    void commitStateBatch();
+
     DeviceId parentId() const;
     void setParentId(const DeviceId &parentId);
 
@@ -73,6 +82,7 @@ public:
 
 signals:
     void stateValueChanged(const QUuid &stateTypeId, const QVariant &value);
+    void stateBatchCommitted();
     void nameChanged();
 
 private:
@@ -90,6 +100,10 @@ private:
     QString m_name;
     ParamList m_params;
     QList<State> m_states;
+    QHash<StateTypeId, int> m_stateIndexes;
+    int m_stateBatchDepth = 0;
+    QMap<int, QVariant> m_batchedStates; // State index, value before the batch
+    bool m_committingStateBatch = false;
     bool m_setupComplete = false;
     bool m_autoCreated = false;
 };
@@ -290,7 +290,6 @@ QList<ParamType> DevicePlugin::configurationDescription() const
 void DevicePlugin::initPlugin(DeviceManager *deviceManager)
 {
     m_deviceManager = deviceManager;
-    loadMetaData();
 }
 
 QPair<bool, QList<ParamType> > DevicePlugin::parseParamTypes(const QJsonArray &array) const
@@ -0,0 +1,76 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class PluginDescription
+    \brief Describes a \l{DevicePlugin} without requiring the plugin to be loaded.
+
+    \ingroup devices
+    \inmodule libnymea
+
+    Plugins which are not needed at startup are not loaded by the \l{DeviceManager}. Their description
+    is taken from the parsed plugin metadata, so listing the installed plugins doesn't load them.
+
+    \sa DeviceManager::pluginDescriptions()
+*/
+
+#include "plugindescription.h"
+
+/*! Construct an empty PluginDescription. */
+PluginDescription::PluginDescription()
+{
+
+}
+
+/*! Construct a PluginDescription for the plugin with the given \a pluginId, \a name, translated \a displayName and \a configurationDescription. */
+PluginDescription::PluginDescription(const PluginId &pluginId, const QString &name, const QString &displayName, const QList<ParamType> &configurationDescription) :
+    m_pluginId(pluginId),
+    m_name(name),
+    m_displayName(displayName),
+    m_configurationDescription(configurationDescription)
+{
+
+}
+
+/*! Returns the id of the plugin. */
+PluginId PluginDescription::pluginId() const
+{
+    return m_pluginId;
+}
+
+/*! Returns the name of the plugin. */
+QString PluginDescription::name() const
+{
+    return m_name;
+}
+
+/*! Returns the translated display name of the plugin. */
+QString PluginDescription::displayName() const
+{
+    return m_displayName;
+}
+
+/*! Returns the param types of the plugin configuration. */
+QList<ParamType> PluginDescription::configurationDescription() const
+{
+    return m_configurationDescription;
+}
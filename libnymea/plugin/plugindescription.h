@@ -0,0 +1,50 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef PLUGINDESCRIPTION_H
+#define PLUGINDESCRIPTION_H
+
+#include "libnymea.h"
+#include "typeutils.h"
+#include "types/paramtype.h"
+
+#include <QString>
+
+class LIBNYMEA_EXPORT PluginDescription
+{
+public:
+    PluginDescription();
+    PluginDescription(const PluginId &pluginId, const QString &name, const QString &displayName, const QList<ParamType> &configurationDescription);
+
+    PluginId pluginId() const;
+    QString name() const;
+    QString displayName() const;
+    QList<ParamType> configurationDescription() const;
+
+private:
+    PluginId m_pluginId;
+    QString m_name;
+    QString m_displayName;
+    QList<ParamType> m_configurationDescription;
+};
+
+#endif // PLUGINDESCRIPTION_H
@@ -0,0 +1,121 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*!
+    \class PluginLoadInfo
+    \brief Holds the startup statistics of a \l{DevicePlugin}.
+
+    \ingroup devices
+    \inmodule libnymea
+
+    The \l{DeviceManager} records for every plugin how long it took to parse its metadata, to load the
+    plugin library and to initialize the plugin. Plugins without configured devices are not loaded
+    before they are needed, in which case \l{loaded()} returns false and only the metadata time is set.
+
+    All times are in milliseconds.
+
+    \sa DeviceManager::pluginLoadInfos()
+*/
+
+#include "pluginloadinfo.h"
+
+/*! Construct an empty PluginLoadInfo. */
+PluginLoadInfo::PluginLoadInfo()
+{
+
+}
+
+/*! Construct a PluginLoadInfo for the plugin with the given \a pluginId and \a pluginName loaded from \a fileName.
+    The \a fileName is empty for statically registered plugins. */
+PluginLoadInfo::PluginLoadInfo(const PluginId &pluginId, const QString &pluginName, const QString &fileName) :
+    m_pluginId(pluginId),
+    m_pluginName(pluginName),
+    m_fileName(fileName)
+{
+
+}
+
+/*! Returns the id of the plugin. */
+PluginId PluginLoadInfo::pluginId() const
+{
+    return m_pluginId;
+}
+
+/*! Returns the name of the plugin. */
+QString PluginLoadInfo::pluginName() const
+{
+    return m_pluginName;
+}
+
+/*! Returns the file name of the plugin library. */
+QString PluginLoadInfo::fileName() const
+{
+    return m_fileName;
+}
+
+/*! Returns the time it took to read, verify and parse the plugin metadata. */
+qint64 PluginLoadInfo::metaDataTime() const
+{
+    return m_metaDataTime;
+}
+
+/*! Sets the time it took to read, verify and parse the plugin metadata to \a metaDataTime. */
+void PluginLoadInfo::setMetaDataTime(qint64 metaDataTime)
+{
+    m_metaDataTime = metaDataTime;
+}
+
+/*! Returns the time it took to load the plugin library and create the plugin instance. */
+qint64 PluginLoadInfo::loadTime() const
+{
+    return m_loadTime;
+}
+
+/*! Sets the time it took to load the plugin library and create the plugin instance to \a loadTime. */
+void PluginLoadInfo::setLoadTime(qint64 loadTime)
+{
+    m_loadTime = loadTime;
+}
+
+/*! Returns the time it took to configure and initialize the plugin. */
+qint64 PluginLoadInfo::initTime() const
+{
+    return m_initTime;
+}
+
+/*! Sets the time it took to configure and initialize the plugin to \a initTime. */
+void PluginLoadInfo::setInitTime(qint64 initTime)
+{
+    m_initTime = initTime;
+}
+
+/*! Returns true if the plugin has been loaded, false if loading it has been deferred until it is needed. */
+bool PluginLoadInfo::loaded() const
+{
+    return m_loaded;
+}
+
+/*! Sets the \a loaded flag of the plugin. */
+void PluginLoadInfo::setLoaded(bool loaded)
+{
+    m_loaded = loaded;
+}
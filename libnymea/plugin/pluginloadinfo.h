@@ -0,0 +1,63 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Lesser General Public             *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2.1 of the License, or (at your option) any later version.     *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Lesser General Public License for more details.                        *
+ *                                                                         *
+ *  You should have received a copy of the GNU Lesser General Public       *
+ *  License along with this library; If not, see                           *
+ *  <http://www.gnu.org/licenses/>.                                        *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef PLUGINLOADINFO_H
+#define PLUGINLOADINFO_H
+
+#include "libnymea.h"
+#include "typeutils.h"
+
+#include <QString>
+
+class LIBNYMEA_EXPORT PluginLoadInfo
+{
+public:
+    PluginLoadInfo();
+    PluginLoadInfo(const PluginId &pluginId, const QString &pluginName, const QString &fileName);
+
+    PluginId pluginId() const;
+    QString pluginName() const;
+    QString fileName() const;
+
+    qint64 metaDataTime() const;
+    void setMetaDataTime(qint64 metaDataTime);
+
+    qint64 loadTime() const;
+    void setLoadTime(qint64 loadTime);
+
+    qint64 initTime() const;
+    void setInitTime(qint64 initTime);
+
+    bool loaded() const;
+    void setLoaded(bool loaded);
+
+private:
+    PluginId m_pluginId;
+    QString m_pluginName;
+    QString m_fileName;
+    qint64 m_metaDataTime = 0;
+    qint64 m_loadTime = 0;
+    qint64 m_initTime = 0;
+    bool m_loaded = false;
+};
+
+#endif // PLUGINLOADINFO_H
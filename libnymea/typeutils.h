@@ -35,9 +35,9 @@ public: \
     type##Id(const QString &uuid): QUuid(uuid) {} \
     type##Id(): QUuid() {} \
     static type##Id create##type##Id() { return type##Id(QUuid::createUuid().toString()); } \
-    static type##Id fromUuid(const QUuid &uuid) { return type##Id(uuid.toString()); } \
+    static type##Id fromUuid(const QUuid &uuid) { type##Id id; static_cast<QUuid &>(id) = uuid; return id; } \
     bool operator==(const type##Id &other) const { \
-        return toString() == other.toString(); \
+        return QUuid::operator==(other); \
     } \
 }; \
 Q_DECLARE_METATYPE(type##Id);
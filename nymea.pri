@@ -6,7 +6,7 @@ NYMEA_PLUGINS_PATH=/usr/lib/$$system('dpkg-architecture -q DEB_HOST_MULTIARCH')/
 
 # define protocol versions
 JSON_PROTOCOL_VERSION_MAJOR=1
-JSON_PROTOCOL_VERSION_MINOR=12
+JSON_PROTOCOL_VERSION_MINOR=19
 REST_API_VERSION=1
 
 DEFINES += NYMEA_VERSION_STRING=\\\"$${NYMEA_VERSION_STRING}\\\" \
@@ -32,6 +32,8 @@ class TestDevices : public NymeaTestBase
 private slots:
     void getPlugins();
 
+    void pluginLoadInfos();
+
     void getPluginConfig_data();
     void getPluginConfig();
 
@@ -112,6 +114,33 @@ void TestDevices::getPlugins()
     QCOMPARE(found, true);
 }
 
+void TestDevices::pluginLoadInfos()
+{
+    bool found = false;
+    foreach (const PluginLoadInfo &loadInfo, NymeaCore::instance()->deviceManager()->pluginLoadInfos()) {
+        if (loadInfo.pluginId() == mockPluginId) {
+            found = true;
+            // The mock plugin has auto devices, it must not be deferred
+            QVERIFY2(loadInfo.loaded(), "Mock plugin has not been loaded.");
+            QVERIFY2(loadInfo.fileName().contains("libnymea_devicepluginmock"), "Unexpected mock plugin file name.");
+            QVERIFY(loadInfo.metaDataTime() >= 0);
+            QVERIFY(loadInfo.loadTime() >= 0);
+            QVERIFY(loadInfo.initTime() >= 0);
+        }
+    }
+    QVERIFY2(found, "No load information for the mock plugin.");
+
+    found = false;
+    foreach (const PluginDescription &pluginDescription, NymeaCore::instance()->deviceManager()->pluginDescriptions()) {
+        if (pluginDescription.pluginId() == mockPluginId) {
+            found = true;
+            QCOMPARE(pluginDescription.name(), QString("mockDevice"));
+            QCOMPARE(pluginDescription.configurationDescription().count(), 2);
+        }
+    }
+    QVERIFY2(found, "No description for the mock plugin.");
+}
+
 void TestDevices::getPluginConfig_data()
 {
     QTest::addColumn<PluginId>("pluginId");
@@ -582,6 +611,10 @@ void TestDevices::parentChildDevices()
     }
     QVERIFY2(!childDeviceId.isNull(), "Could not find child device");
 
+    QList<Device *> childDevices = NymeaCore::instance()->deviceManager()->findChildDevices(parentDeviceId);
+    QCOMPARE(childDevices.count(), 1);
+    QCOMPARE(childDevices.first()->id(), childDeviceId);
+
     // Try to remove the child device
     params.clear();
     params.insert("deviceId", childDeviceId.toString());
@@ -623,6 +656,12 @@ void TestDevices::parentChildDevices()
         }
     }
     QVERIFY2(!found, "Could not find child device.");
+
+    // the lookup indexes need to be updated too
+    QVERIFY(NymeaCore::instance()->deviceManager()->findChildDevices(parentDeviceId).isEmpty());
+    foreach (Device *device, NymeaCore::instance()->deviceManager()->findConfiguredDevices(mockChildDeviceClassId)) {
+        QVERIFY(device->id() != childDeviceId);
+    }
 }
 
 void TestDevices::getActionTypes_data()
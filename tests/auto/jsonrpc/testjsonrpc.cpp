@@ -23,6 +23,9 @@
 #include "../../utils/pushbuttonagent.h"
 #include "nymeacore.h"
 #include "servers/mocktcpserver.h"
+#include "jsonrpc/jsonvalidator.h"
+#include "jsonrpc/cborcodec.h"
+#include "jsonrpc/jsonwriter.h"
 
 using namespace nymeaserver;
 
@@ -56,6 +59,13 @@ private slots:
 
     void stateChangeEmitsNotifications();
 
+    void notificationFilter();
+
+    void notificationFilterAddedDevice();
+
+    void batchedStateChanges();
+    void batchedStateChangesFiltered();
+
     void pluginConfigChangeEmitsNotification();
 
     /*
@@ -98,6 +108,24 @@ private slots:
 
     void testGarbageData();
 
+    void testCborEncoding();
+
+    void testJsonWriter_data();
+    void testJsonWriter();
+
+    void testJsonPackers();
+
+    void benchmarkPipelinedRequests();
+
+    void benchmarkParamValidation_data();
+    void benchmarkParamValidation();
+
+    void benchmarkJsonSerialization_data();
+    void benchmarkJsonSerialization();
+
+    void benchmarkJsonPackers_data();
+    void benchmarkJsonPackers();
+
 private:
     QStringList extractRefs(const QVariant &variant);
 
@@ -921,6 +949,240 @@ void TestJSONRPC::stateChangeEmitsNotifications()
     QCOMPARE(response.toMap().value("params").toMap().value("value").toInt(), newVal);
 }
 
+void TestJSONRPC::notificationFilter()
+{
+    QCOMPARE(enableNotifications(), true);
+
+    QNetworkAccessManager nam;
+    QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+
+    auto setMockState = [&](int value) {
+        QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockIntStateId.toString()).arg(value)));
+        QNetworkReply *reply = nam.get(request);
+        connect(reply, SIGNAL(finished()), reply, SLOT(deleteLater()));
+        QSignalSpy replySpy(reply, SIGNAL(finished()));
+        replySpy.wait();
+    };
+
+    // Subscribe to another device only
+    QVariantMap params;
+    params.insert("deviceIds", QVariantList() << QUuid::createUuid());
+    QVariant response = injectAndWait("JSONRPC.SetNotificationFilter", params);
+    QCOMPARE(response.toMap().value("status").toString(), QString("success"));
+    QCOMPARE(response.toMap().value("params").toMap().value("deviceIds").toList().count(), 1);
+    QCOMPARE(response.toMap().value("params").toMap().value("coalesceInterval").toInt(), 0);
+
+    clientSpy.clear();
+    setMockState(11);
+    clientSpy.wait(500);
+    QVERIFY2(checkNotifications(clientSpy, "Devices.StateChanged").isEmpty(), "Got a Devices.StateChanged notification for a device not subscribed to");
+    QVERIFY2(!checkNotifications(clientSpy, "Logging.LogEntryAdded").isEmpty(), "Notifications without a deviceId should not be filtered");
+
+    // Subscribe to the Devices namespace of the mock device, unknown namespaces are dropped
+    params.clear();
+    params.insert("namespaces", QVariantList() << "Devices" << "Unknown");
+    params.insert("deviceIds", QVariantList() << m_mockDeviceId);
+    response = injectAndWait("JSONRPC.SetNotificationFilter", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("namespaces").toList(), QVariantList() << "Devices");
+
+    clientSpy.clear();
+    setMockState(12);
+    clientSpy.wait(500);
+    QVariantList stateChangedVariants = checkNotifications(clientSpy, "Devices.StateChanged");
+    QCOMPARE(stateChangedVariants.count(), 1);
+    QCOMPARE(stateChangedVariants.first().toMap().value("params").toMap().value("value").toInt(), 12);
+    QVERIFY2(checkNotifications(clientSpy, "Logging.LogEntryAdded").isEmpty(), "Got a notification from a namespace not subscribed to");
+
+    // Repeated changes of the same state get merged into the latest one
+    params.insert("coalesceInterval", 1000);
+    response = injectAndWait("JSONRPC.SetNotificationFilter", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("coalesceInterval").toInt(), 1000);
+
+    clientSpy.clear();
+    setMockState(13);
+    setMockState(14);
+    setMockState(15);
+    QVERIFY(checkNotifications(clientSpy, "Devices.StateChanged").isEmpty());
+    clientSpy.wait(1500);
+    stateChangedVariants = checkNotifications(clientSpy, "Devices.StateChanged");
+    QCOMPARE(stateChangedVariants.count(), 1);
+    QCOMPARE(stateChangedVariants.first().toMap().value("params").toMap().value("value").toInt(), 15);
+
+    // Reset the filter
+    response = injectAndWait("JSONRPC.SetNotificationFilter");
+    QCOMPARE(response.toMap().value("params").toMap().contains("deviceIds"), false);
+    QCOMPARE(response.toMap().value("params").toMap().value("coalesceInterval").toInt(), 0);
+
+    QCOMPARE(disableNotifications(), true);
+}
+
+void TestJSONRPC::notificationFilterAddedDevice()
+{
+    QCOMPARE(enableNotifications(), true);
+
+    // Subscribe to a device which doesn't exist yet
+    DeviceId deviceId = DeviceId::createDeviceId();
+    QVariantMap params;
+    params.insert("deviceIds", QVariantList() << deviceId);
+    QVariant response = injectAndWait("JSONRPC.SetNotificationFilter", params);
+    QCOMPARE(response.toMap().value("status").toString(), QString("success"));
+
+    ParamList deviceParams;
+    deviceParams.append(Param(httpportParamTypeId, m_mockDevice1Port + 1));
+    QCOMPARE(NymeaCore::instance()->deviceManager()->addConfiguredDevice(mockDeviceClassId, "Added mock device", deviceParams, deviceId), DeviceManager::DeviceErrorNoError);
+    Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevice(deviceId);
+    QVERIFY(device);
+    Device *mockDevice = NymeaCore::instance()->deviceManager()->findConfiguredDevice(m_mockDeviceId);
+    QVERIFY(mockDevice);
+
+    // Only the subscribed device gets through
+    QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    device->setStateValue(mockIntStateId, device->stateValue(mockIntStateId).toInt() + 1);
+    mockDevice->setStateValue(mockIntStateId, mockDevice->stateValue(mockIntStateId).toInt() + 1);
+    clientSpy.wait(500);
+    QVariantList stateChangedVariants = checkNotifications(clientSpy, "Devices.StateChanged");
+    QCOMPARE(stateChangedVariants.count(), 1);
+    QCOMPARE(stateChangedVariants.first().toMap().value("params").toMap().value("deviceId").toUuid(), QUuid(deviceId));
+
+    QCOMPARE(NymeaCore::instance()->deviceManager()->removeConfiguredDevice(deviceId), DeviceManager::DeviceErrorNoError);
+
+    // The removed device is dropped from the filter, the others still don't pass
+    clientSpy.clear();
+    mockDevice->setStateValue(mockIntStateId, mockDevice->stateValue(mockIntStateId).toInt() + 1);
+    clientSpy.wait(500);
+    QVERIFY(checkNotifications(clientSpy, "Devices.StateChanged").isEmpty());
+
+    response = injectAndWait("JSONRPC.SetNotificationFilter");
+    QCOMPARE(response.toMap().value("status").toString(), QString("success"));
+    QCOMPARE(disableNotifications(), true);
+}
+
+void TestJSONRPC::batchedStateChanges()
+{
+    QCOMPARE(enableNotifications(), true);
+
+    QVariantMap params;
+    params.insert("batchStateChanges", true);
+    QVariant response = injectAndWait("JSONRPC.SetNotificationFilter", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("batchStateChanges").toBool(), true);
+
+    Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevice(m_mockDeviceId);
+    QVERIFY(device);
+    int intValue = device->stateValue(mockIntStateId).toInt() + 1;
+    bool boolValue = !device->stateValue(mockBoolStateId).toBool();
+
+    // Changes within a batch are emitted on commit, the last value wins
+    QSignalSpy deviceSpy(device, &Device::stateValueChanged);
+    qRegisterMetaType<QList<Event> >();
+    QSignalSpy statesChangedSpy(NymeaCore::instance()->deviceManager(), &DeviceManager::deviceStatesChanged);
+    device->beginStateBatch();
+    device->setStateValue(mockIntStateId, intValue - 1000);
+    device->setStateValue(mockIntStateId, intValue);
+    device->setStateValue(mockBoolStateId, boolValue);
+    QCOMPARE(deviceSpy.count(), 0);
+    device->commitStateBatch();
+    QCOMPARE(deviceSpy.count(), 2);
+    // The DeviceManager hands the whole batch on synchronously
+    QCOMPARE(statesChangedSpy.count(), 1);
+    QCOMPARE(statesChangedSpy.first().first().value<QList<Event> >().count(), 2);
+
+    // A state set back to its original value within a batch doesn't change
+    deviceSpy.clear();
+    device->beginStateBatch();
+    device->setStateValue(mockBoolStateId, !boolValue);
+    device->setStateValue(mockBoolStateId, boolValue);
+    device->commitStateBatch();
+    QCOMPARE(deviceSpy.count(), 0);
+
+    // All changes of a batch arrive in one notification
+    QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    clientSpy.wait(500);
+    QVERIFY2(checkNotifications(clientSpy, "Devices.StateChanged").isEmpty(), "Got Devices.StateChanged with batchStateChanges enabled");
+    QVariantList statesChangedVariants = checkNotifications(clientSpy, "Devices.StatesChanged");
+    QCOMPARE(statesChangedVariants.count(), 1);
+    QVariantList states = statesChangedVariants.first().toMap().value("params").toMap().value("states").toList();
+    QCOMPARE(states.count(), 2);
+    foreach (const QVariant &state, states) {
+        QCOMPARE(state.toMap().value("deviceId").toUuid(), QUuid(m_mockDeviceId));
+        if (state.toMap().value("stateTypeId").toUuid() == mockIntStateId) {
+            QCOMPARE(state.toMap().value("value").toInt(), intValue);
+        } else {
+            QCOMPARE(state.toMap().value("stateTypeId").toUuid(), QUuid(mockBoolStateId));
+            QCOMPARE(state.toMap().value("value").toBool(), boolValue);
+        }
+    }
+
+    // Without batching, each change is sent on its own
+    response = injectAndWait("JSONRPC.SetNotificationFilter");
+    QCOMPARE(response.toMap().value("params").toMap().value("batchStateChanges").toBool(), false);
+
+    clientSpy.clear();
+    device->setStateValue(mockIntStateId, intValue + 1);
+    device->setStateValue(mockBoolStateId, !boolValue);
+    clientSpy.wait(500);
+    QVERIFY(checkNotifications(clientSpy, "Devices.StatesChanged").isEmpty());
+    QCOMPARE(checkNotifications(clientSpy, "Devices.StateChanged").count(), 2);
+
+    QCOMPARE(disableNotifications(), true);
+}
+
+void TestJSONRPC::batchedStateChangesFiltered()
+{
+    // Two clients only interested in the int state and one without a filter, all batching state changes
+    QUuid secondClientId = QUuid::createUuid();
+    QUuid unfilteredClientId = QUuid::createUuid();
+    m_mockTcpServer->clientConnected(secondClientId);
+    m_mockTcpServer->clientConnected(unfilteredClientId);
+
+    QVariantMap notificationParams;
+    notificationParams.insert("enabled", true);
+    QVariantMap filterParams;
+    filterParams.insert("batchStateChanges", true);
+    QVariantMap stateTypeFilterParams = filterParams;
+    stateTypeFilterParams.insert("stateTypeIds", QVariantList() << mockIntStateId);
+    foreach (const QUuid &clientId, QList<QUuid>() << m_clientId << secondClientId << unfilteredClientId) {
+        QVERIFY(injectAndWait("JSONRPC.SetNotificationStatus", notificationParams, clientId).toMap().value("params").toMap().value("enabled").toBool());
+        QVariant response = injectAndWait("JSONRPC.SetNotificationFilter", clientId == unfilteredClientId ? filterParams : stateTypeFilterParams, clientId);
+        QCOMPARE(response.toMap().value("status").toString(), QString("success"));
+    }
+
+    Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevice(m_mockDeviceId);
+    QVERIFY(device);
+    int intValue = device->stateValue(mockIntStateId).toInt() + 1;
+
+    QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    device->beginStateBatch();
+    device->setStateValue(mockIntStateId, intValue);
+    device->setStateValue(mockBoolStateId, !device->stateValue(mockBoolStateId).toBool());
+    device->commitStateBatch();
+    clientSpy.wait(500);
+
+    QHash<QUuid, QByteArray> statesChangedData;
+    for (int i = 0; i < clientSpy.count(); i++) {
+        QVariantMap notification = QJsonDocument::fromJson(clientSpy.at(i).at(1).toByteArray()).toVariant().toMap();
+        if (notification.value("notification").toString() == "Devices.StatesChanged") {
+            QVERIFY2(!statesChangedData.contains(clientSpy.at(i).at(0).toUuid()), "Got more than one Devices.StatesChanged for a client");
+            statesChangedData.insert(clientSpy.at(i).at(0).toUuid(), clientSpy.at(i).at(1).toByteArray());
+        }
+    }
+    QCOMPARE(statesChangedData.count(), 3);
+
+    // The filtered clients get the same subset of the batch
+    QCOMPARE(statesChangedData.value(m_clientId), statesChangedData.value(secondClientId));
+    QVariantList states = QJsonDocument::fromJson(statesChangedData.value(m_clientId)).toVariant().toMap().value("params").toMap().value("states").toList();
+    QCOMPARE(states.count(), 1);
+    QCOMPARE(states.first().toMap().value("stateTypeId").toUuid(), QUuid(mockIntStateId));
+    QCOMPARE(states.first().toMap().value("value").toInt(), intValue);
+
+    states = QJsonDocument::fromJson(statesChangedData.value(unfilteredClientId)).toVariant().toMap().value("params").toMap().value("states").toList();
+    QCOMPARE(states.count(), 2);
+
+    m_mockTcpServer->clientDisconnected(secondClientId);
+    m_mockTcpServer->clientDisconnected(unfilteredClientId);
+    QCOMPARE(injectAndWait("JSONRPC.SetNotificationFilter").toMap().value("status").toString(), QString("success"));
+    QCOMPARE(disableNotifications(), true);
+}
+
 void TestJSONRPC::pluginConfigChangeEmitsNotification()
 {
     QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
@@ -1233,6 +1495,15 @@ void TestJSONRPC::testDataFragmentation_data()
     packets.clear();
     packets.append("{\"id\": 555, \"method\": \"JSONRPC.Hello\"}\n{\"id\": 5556, \"metho");
     QTest::newRow("next packet start appended") << packets;
+
+    packets.clear();
+    packets.append("{\"id\": 555, \"method\": \"JSONRPC.Hello\"}{\"id\": 5556, \"metho");
+    QTest::newRow("next packet start appended without newline") << packets;
+
+    packets.clear();
+    packets.append("{\"id\": 555, \"token\": \"{{\\\"}\", \"met");
+    packets.append("hod\": \"JSONRPC.Hello\"}\n");
+    QTest::newRow("braces and quotes in strings") << packets;
 }
 
 void TestJSONRPC::testDataFragmentation()
@@ -1270,6 +1541,379 @@ void TestJSONRPC::testGarbageData()
 
 }
 
+void TestJSONRPC::testCborEncoding()
+{
+    QVariantList devices = injectAndWait("Devices.GetConfiguredDevices").toMap().value("params").toMap().value("devices").toList();
+    QVERIFY(!devices.isEmpty());
+
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    QUuid clientId = QUuid::createUuid();
+    m_mockTcpServer->clientConnected(clientId);
+
+    // The reply to Hello is still JSON
+    spy.clear();
+    m_mockTcpServer->injectData(clientId, "{\"id\": 1, \"method\": \"JSONRPC.Hello\", \"params\": {\"encoding\": \"EncodingCbor\"}}\n");
+    QCOMPARE(spy.count(), 1);
+    QVariantMap response = QJsonDocument::fromJson(spy.first().at(1).toByteArray()).toVariant().toMap();
+    QCOMPARE(response.value("status").toString(), QStringLiteral("success"));
+    QCOMPARE(response.value("params").toMap().value("encoding").toString(), QStringLiteral("EncodingCbor"));
+
+    // Two requests, split at an arbitrary position
+    QVariantMap request;
+    request.insert("id", 2);
+    request.insert("token", m_apiToken);
+    request.insert("method", "Devices.GetConfiguredDevices");
+    QByteArray data = CborCodec::encode(request);
+    request.insert("id", 3);
+    request.insert("method", "JSONRPC.Version");
+    data.append(CborCodec::encode(request));
+
+    spy.clear();
+    m_mockTcpServer->injectData(clientId, data.left(20));
+    QCOMPARE(spy.count(), 0);
+    m_mockTcpServer->injectData(clientId, data.mid(20));
+    QCOMPARE(spy.count(), 2);
+
+    QByteArray reply = spy.at(0).at(1).toByteArray();
+    QVariant decoded;
+    int pos = 0;
+    QCOMPARE(CborCodec::decode(reply, &pos, &decoded), CborCodec::DecodeResultOk);
+    QCOMPARE(pos, reply.size());
+    response = decoded.toMap();
+    QCOMPARE(response.value("id").toInt(), 2);
+    QCOMPARE(response.value("status").toString(), QStringLiteral("success"));
+    QVariantList cborDevices = response.value("params").toMap().value("devices").toList();
+    QCOMPARE(cborDevices.count(), devices.count());
+    for (int i = 0; i < devices.count(); i++) {
+        QUuid deviceId = devices.at(i).toMap().value("id").toUuid();
+        QCOMPARE(cborDevices.at(i).toMap().value("id").toUuid(), deviceId);
+        QCOMPARE(cborDevices.at(i).toMap().value("name").toString(), devices.at(i).toMap().value("name").toString());
+        // UUIDs are sent as raw bytes
+        QVERIFY(reply.contains(deviceId.toRfc4122()));
+        QVERIFY(!reply.contains(deviceId.toString().toUtf8()));
+    }
+
+    pos = 0;
+    QCOMPARE(CborCodec::decode(spy.at(1).at(1).toByteArray(), &pos, &decoded), CborCodec::DecodeResultOk);
+    QCOMPARE(decoded.toMap().value("id").toInt(), 3);
+    QCOMPARE(decoded.toMap().value("params").toMap().value("protocol version").toString(), QString(JSON_PROTOCOL_VERSION));
+
+    // Invalid data can't be recovered from but is reported
+    spy.clear();
+    m_mockTcpServer->injectData(clientId, QByteArray(1, static_cast<char>(0xff)));
+    QCOMPARE(spy.count(), 1);
+    pos = 0;
+    QCOMPARE(CborCodec::decode(spy.first().at(1).toByteArray(), &pos, &decoded), CborCodec::DecodeResultOk);
+    QCOMPARE(decoded.toMap().value("status").toString(), QStringLiteral("error"));
+
+    m_mockTcpServer->clientDisconnected(clientId);
+
+    // CBOR data received together with the Hello message isn't lost
+    clientId = QUuid::createUuid();
+    m_mockTcpServer->clientConnected(clientId);
+    spy.clear();
+    m_mockTcpServer->injectData(clientId, "{\"id\": 1, \"method\": \"JSONRPC.Hello\", \"params\": {\"encoding\": \"EncodingCbor\"}}\n" + CborCodec::encode(request));
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(QJsonDocument::fromJson(spy.at(0).at(1).toByteArray()).toVariant().toMap().value("id").toInt(), 1);
+    pos = 0;
+    QCOMPARE(CborCodec::decode(spy.at(1).at(1).toByteArray(), &pos, &decoded), CborCodec::DecodeResultOk);
+    QCOMPARE(decoded.toMap().value("id").toInt(), 3);
+    QCOMPARE(decoded.toMap().value("status").toString(), QStringLiteral("success"));
+
+    m_mockTcpServer->clientDisconnected(clientId);
+}
+
+void TestJSONRPC::testJsonWriter_data()
+{
+    QTest::addColumn<QVariant>("value");
+
+    QVariantMap nested;
+    nested.insert("emptyMap", QVariantMap());
+    nested.insert("emptyList", QVariantList());
+    nested.insert("list", QVariantList() << QVariantMap() << QVariantList() << "a" << 1);
+
+    QVariantHash hash;
+    hash.insert("b", 1);
+    hash.insert("a", 2);
+    hash.insert("c", 3);
+
+    QTest::newRow("escapes") << QVariant(QString("quote \" backslash \\ slash / newline \n tab \t bell \x07 umlaut \u00fc"));
+    QTest::newRow("numbers") << QVariant(QVariantList() << 0 << -42 << 3.5 << 1e-7 << 12345678.0 << -0.25 << qlonglong(1) << 7u);
+    QTest::newRow("bool and null") << QVariant(QVariantList() << true << false << QVariant());
+    QTest::newRow("nested") << QVariant(nested);
+    QTest::newRow("string list") << QVariant(QStringList() << "one" << "two");
+    QTest::newRow("hash") << QVariant(hash);
+}
+
+void TestJSONRPC::testJsonWriter()
+{
+    QFETCH(QVariant, value);
+
+    QVariantMap map;
+    map.insert("value", value);
+    QCOMPARE(JsonWriter::toJson(map), QJsonDocument::fromVariant(map).toJson(QJsonDocument::Compact));
+    QCOMPARE(JsonWriter::toJson(map, QJsonDocument::Indented), QJsonDocument::fromVariant(map).toJson(QJsonDocument::Indented));
+    QCOMPARE(JsonWriter::toJson(QVariantList() << map, QJsonDocument::Indented), QJsonDocument::fromVariant(QVariantList() << map).toJson(QJsonDocument::Indented));
+}
+
+void TestJSONRPC::testJsonPackers()
+{
+    // The direct packers need to write exactly what the QVariantMap packers produce
+    foreach (const DeviceClass &deviceClass, NymeaCore::instance()->deviceManager()->supportedDevices()) {
+        JsonWriter writer;
+        JsonTypes::writeDeviceClass(writer, deviceClass);
+        QCOMPARE(writer.data(), JsonWriter::toJson(JsonTypes::packDeviceClass(deviceClass)));
+    }
+
+    QList<Device *> devices = NymeaCore::instance()->deviceManager()->configuredDevices();
+    QVERIFY(!devices.isEmpty());
+    foreach (Device *device, devices) {
+        JsonWriter writer;
+        JsonTypes::writeDevice(writer, device);
+        QCOMPARE(writer.data(), JsonWriter::toJson(JsonTypes::packDevice(device)));
+    }
+
+    // Replies with a data writer are sent exactly like the packed ones
+    QVariantMap params;
+    params.insert("devices", JsonTypes::packConfiguredDevices());
+    QVariantMap response;
+    response.insert("id", 1);
+    response.insert("status", "success");
+    response.insert("params", params);
+
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    m_mockTcpServer->injectData(m_clientId, "{\"id\": 1, \"token\": \"" + m_apiToken + "\", \"method\": \"Devices.GetConfiguredDevices\"}\n");
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().at(1).toByteArray(), JsonWriter::toJson(response));
+}
+
+void TestJSONRPC::benchmarkPipelinedRequests()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    // 10000 requests sent back to back, arriving in chunks which split the requests at arbitrary positions
+    QByteArray requests;
+    for (int i = 0; i < 10000; i++) {
+        requests.append(QString("{\"id\": %1, \"method\": \"JSONRPC.Hello\"}\n").arg(i).toUtf8());
+    }
+    QList<QByteArray> chunks;
+    for (int i = 0; i < requests.size(); i += 1400) {
+        chunks.append(requests.mid(i, 1400));
+    }
+
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    QBENCHMARK {
+        spy.clear();
+        foreach (const QByteArray &chunk, chunks) {
+            m_mockTcpServer->injectData(m_clientId, chunk);
+        }
+    }
+    QCOMPARE(spy.count(), 10000);
+}
+
+void TestJSONRPC::benchmarkParamValidation_data()
+{
+    QTest::addColumn<bool>("compiled");
+
+    QTest::newRow("template") << false;
+    QTest::newRow("compiled") << true;
+}
+
+void TestJSONRPC::benchmarkParamValidation()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(bool, compiled);
+
+    QVariant response = injectAndWait("JSONRPC.Introspect");
+    QVariantMap paramsTemplate = response.toMap().value("params").toMap().value("methods").toMap().value("Rules.AddRule").toMap().value("params").toMap();
+    QVERIFY(!paramsTemplate.isEmpty());
+
+    QVariantMap stateDescriptor;
+    stateDescriptor.insert("stateTypeId", mockIntStateId);
+    stateDescriptor.insert("deviceId", m_mockDeviceId);
+    stateDescriptor.insert("operator", JsonTypes::valueOperatorToString(Types::ValueOperatorLess));
+    stateDescriptor.insert("value", "20");
+
+    QVariantMap childEvaluator;
+    childEvaluator.insert("stateDescriptor", stateDescriptor);
+
+    QVariantMap stateEvaluator;
+    stateEvaluator.insert("operator", JsonTypes::stateOperatorToString(Types::StateOperatorAnd));
+    stateEvaluator.insert("childEvaluators", QVariantList() << childEvaluator << childEvaluator);
+
+    QVariantMap ruleActionParam;
+    ruleActionParam.insert("paramTypeId", mockActionParam1ParamTypeId);
+    ruleActionParam.insert("value", 5);
+
+    QVariantMap action;
+    action.insert("actionTypeId", mockActionIdWithParams);
+    action.insert("deviceId", m_mockDeviceId);
+    action.insert("ruleActionParams", QVariantList() << ruleActionParam);
+
+    QVariantMap eventDescriptor;
+    eventDescriptor.insert("eventTypeId", mockEvent1Id);
+    eventDescriptor.insert("deviceId", m_mockDeviceId);
+    eventDescriptor.insert("paramDescriptors", QVariantList());
+
+    QVariantMap params;
+    params.insert("name", "Benchmark rule");
+    params.insert("actions", QVariantList() << action);
+    params.insert("exitActions", QVariantList() << action);
+    params.insert("eventDescriptors", QVariantList() << eventDescriptor);
+    params.insert("stateEvaluator", stateEvaluator);
+
+    QVariantMap invalidParams = params;
+    invalidParams.insert("unknownKey", true);
+
+    // Both ways need to come to the same result
+    JsonValidator validator(paramsTemplate);
+    QCOMPARE(validator.validate(params), JsonTypes::validateMap(paramsTemplate, params));
+    QCOMPARE(validator.validate(invalidParams), JsonTypes::validateMap(paramsTemplate, invalidParams));
+
+    QPair<bool, QString> result;
+    if (compiled) {
+        QBENCHMARK {
+            result = validator.validate(params);
+        }
+    } else {
+        QBENCHMARK {
+            result = JsonTypes::validateMap(paramsTemplate, params);
+        }
+    }
+    QVERIFY2(result.first, qUtf8Printable(result.second));
+}
+
+void TestJSONRPC::benchmarkJsonSerialization_data()
+{
+    QTest::addColumn<bool>("writer");
+
+    QTest::newRow("QJsonDocument") << false;
+    QTest::newRow("JsonWriter") << true;
+}
+
+void TestJSONRPC::benchmarkJsonSerialization()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(bool, writer);
+
+    // A system with 200 device classes and 500 configured devices, made up from the mock ones
+    QVariantList mockDeviceClasses = injectAndWait("Devices.GetSupportedDevices").toMap().value("params").toMap().value("deviceClasses").toList();
+    QVariantList mockDevices = injectAndWait("Devices.GetConfiguredDevices").toMap().value("params").toMap().value("devices").toList();
+    QVERIFY(!mockDeviceClasses.isEmpty());
+    QVERIFY(!mockDevices.isEmpty());
+
+    QVariantList deviceClasses;
+    for (int i = 0; i < 200; i++) {
+        QVariantMap deviceClass = mockDeviceClasses.at(i % mockDeviceClasses.count()).toMap();
+        deviceClass.insert("id", QUuid::createUuid().toString());
+        deviceClasses.append(deviceClass);
+    }
+    QVariantList devices;
+    for (int i = 0; i < 500; i++) {
+        QVariantMap device = mockDevices.at(i % mockDevices.count()).toMap();
+        device.insert("id", QUuid::createUuid().toString());
+        device.insert("name", QString("Device %1").arg(i));
+        devices.append(device);
+    }
+
+    QVariantMap params;
+    params.insert("deviceClasses", deviceClasses);
+    params.insert("devices", devices);
+    QVariantMap response;
+    response.insert("id", 1);
+    response.insert("status", "success");
+    response.insert("params", params);
+
+    // Both ways need to produce the same data
+    QCOMPARE(JsonWriter::toJson(response), QJsonDocument::fromVariant(response).toJson(QJsonDocument::Compact));
+
+    QByteArray data;
+    if (writer) {
+        QBENCHMARK {
+            data = JsonWriter::toJson(response);
+        }
+    } else {
+        QBENCHMARK {
+            data = QJsonDocument::fromVariant(response).toJson(QJsonDocument::Compact);
+        }
+    }
+    QVERIFY(!data.isEmpty());
+}
+
+void TestJSONRPC::benchmarkJsonPackers_data()
+{
+    QTest::addColumn<bool>("writer");
+
+    QTest::newRow("QVariantMap") << false;
+    QTest::newRow("JsonWriter") << true;
+}
+
+void TestJSONRPC::benchmarkJsonPackers()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(bool, writer);
+
+    // 200 device classes and 500 configured devices, made up from the mock ones
+    QList<DeviceClass> mockDeviceClasses = NymeaCore::instance()->deviceManager()->supportedDevices();
+    QList<Device *> mockDevices = NymeaCore::instance()->deviceManager()->configuredDevices();
+    QVERIFY(!mockDeviceClasses.isEmpty());
+    QVERIFY(!mockDevices.isEmpty());
+
+    QList<DeviceClass> deviceClasses;
+    for (int i = 0; i < 200; i++) {
+        deviceClasses.append(mockDeviceClasses.at(i % mockDeviceClasses.count()));
+    }
+    QList<Device *> devices;
+    for (int i = 0; i < 500; i++) {
+        devices.append(mockDevices.at(i % mockDevices.count()));
+    }
+
+    QByteArray data;
+    if (writer) {
+        QBENCHMARK {
+            JsonWriter jsonWriter;
+            jsonWriter.beginObject();
+            jsonWriter.writeKey("deviceClasses");
+            jsonWriter.beginArray();
+            foreach (const DeviceClass &deviceClass, deviceClasses) {
+                JsonTypes::writeDeviceClass(jsonWriter, deviceClass);
+            }
+            jsonWriter.endArray();
+            jsonWriter.writeKey("devices");
+            JsonTypes::writeDevices(jsonWriter, devices);
+            jsonWriter.endObject();
+            data = jsonWriter.data();
+        }
+    } else {
+        QBENCHMARK {
+            QVariantList deviceClassList;
+            foreach (const DeviceClass &deviceClass, deviceClasses) {
+                deviceClassList.append(JsonTypes::packDeviceClass(deviceClass));
+            }
+            QVariantList deviceList;
+            foreach (Device *device, devices) {
+                deviceList.append(JsonTypes::packDevice(device));
+            }
+            QVariantMap params;
+            params.insert("deviceClasses", deviceClassList);
+            params.insert("devices", deviceList);
+            data = JsonWriter::toJson(params);
+        }
+    }
+    QVERIFY(!data.isEmpty());
+}
+
 #include "testjsonrpc.moc"
 
 QTEST_MAIN(TestJSONRPC)
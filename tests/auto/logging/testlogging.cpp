@@ -23,8 +23,13 @@
 #include "nymeacore.h"
 #include "nymeasettings.h"
 #include "logging/logvaluetool.h"
+#include "logging/logengine.h"
+#include "logging/logfilter.h"
 #include "servers/mocktcpserver.h"
 
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
 using namespace nymeaserver;
 
 class TestLogging : public NymeaTestBase
@@ -32,6 +37,8 @@ class TestLogging : public NymeaTestBase
     Q_OBJECT
 
 private:
+    LogEngine *m_benchmarkEngine = nullptr;
+    void prepareBenchmarkDatabase();
 
 private slots:
     void initLogs();
@@ -58,6 +65,12 @@ private slots:
 
     void testLimits();
 
+    void aggregatedStateValues();
+    void stateLogPolicy();
+
+    void benchmarkQueries_data();
+    void benchmarkQueries();
+
     // this has to be the last test
     void removeDevice();
 };
@@ -641,6 +654,218 @@ void TestLogging::testLimits()
     QCOMPARE(response.value("params").toMap().value("logEntries").toList().count(), 10);
 }
 
+void TestLogging::aggregatedStateValues()
+{
+    clearLoggingDatabase();
+
+    // Produce a few numeric state changes
+    QNetworkAccessManager nam;
+    QList<int> values = QList<int>() << 1011 << 1033 << 1022;
+    foreach (int value, values) {
+        QSignalSpy spy(&nam, SIGNAL(finished(QNetworkReply*)));
+        QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockIntStateId.toString()).arg(value)));
+        QNetworkReply *reply = nam.get(request);
+        connect(reply, SIGNAL(finished()), reply, SLOT(deleteLater()));
+        spy.wait();
+    }
+
+    QDateTime now = QDateTime::currentDateTime();
+    QVariantMap params;
+    params.insert("deviceId", m_mockDeviceId);
+    params.insert("stateTypeId", mockIntStateId);
+    params.insert("startDate", now.addSecs(-60).toTime_t());
+    params.insert("endDate", now.addSecs(60).toTime_t());
+
+    // Daily buckets are served from the rollups
+    params.insert("bucketSize", 86400);
+    QVariant response = injectAndWait("Logging.GetAggregatedStateValues", params);
+    verifyLoggingError(response);
+    QVariantList aggregates = response.toMap().value("params").toMap().value("aggregates").toList();
+    QVERIFY2(aggregates.count() >= 1 && aggregates.count() <= 2, "Unexpected number of daily buckets");
+
+    int count = 0;
+    double minimum = 0;
+    double maximum = 0;
+    foreach (const QVariant &aggregateVariant, aggregates) {
+        QVariantMap aggregate = aggregateVariant.toMap();
+        minimum = count == 0 ? aggregate.value("minimum").toDouble() : qMin(minimum, aggregate.value("minimum").toDouble());
+        maximum = count == 0 ? aggregate.value("maximum").toDouble() : qMax(maximum, aggregate.value("maximum").toDouble());
+        count += aggregate.value("count").toInt();
+    }
+    QCOMPARE(count, 3);
+    QCOMPARE(minimum, 1011.0);
+    QCOMPARE(maximum, 1033.0);
+    QCOMPARE(aggregates.last().toMap().value("last").toDouble(), 1022.0);
+    if (aggregates.count() == 1) {
+        QCOMPARE(aggregates.first().toMap().value("average").toDouble(), 1022.0);
+    }
+
+    // Odd bucket sizes are aggregated from the raw entries
+    params.insert("bucketSize", 7);
+    response = injectAndWait("Logging.GetAggregatedStateValues", params);
+    verifyLoggingError(response);
+    aggregates = response.toMap().value("params").toMap().value("aggregates").toList();
+    count = 0;
+    foreach (const QVariant &aggregateVariant, aggregates) {
+        count += aggregateVariant.toMap().value("count").toInt();
+    }
+    QCOMPARE(count, 3);
+    QCOMPARE(aggregates.last().toMap().value("last").toDouble(), 1022.0);
+
+    params.insert("bucketSize", 0);
+    response = injectAndWait("Logging.GetAggregatedStateValues", params);
+    verifyLoggingError(response, Logging::LoggingErrorInvalidFilterParameter);
+}
+
+void TestLogging::stateLogPolicy()
+{
+    clearLoggingDatabase();
+
+    QVariantMap policy;
+    policy.insert("stateTypeId", mockIntStateId);
+    policy.insert("deadband", 10);
+    QVariantMap params;
+    params.insert("policy", policy);
+    QVariant response = injectAndWait("Configuration.SetStateLogPolicy", params);
+    verifyConfigurationError(response);
+
+    response = injectAndWait("Configuration.GetStateLogPolicies");
+    QVariantList policies = response.toMap().value("params").toMap().value("stateLogPolicies").toList();
+    QCOMPARE(policies.count(), 1);
+    QCOMPARE(policies.first().toMap().value("stateTypeId").toUuid(), QUuid(mockIntStateId));
+    QCOMPARE(policies.first().toMap().value("deadband").toDouble(), 10.0);
+
+    // Changes within the deadband of the last logged value are dropped
+    QNetworkAccessManager nam;
+    QList<int> values = QList<int>() << 100 << 105 << 120 << 125;
+    foreach (int value, values) {
+        QSignalSpy spy(&nam, SIGNAL(finished(QNetworkReply*)));
+        QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockIntStateId.toString()).arg(value)));
+        QNetworkReply *reply = nam.get(request);
+        connect(reply, SIGNAL(finished()), reply, SLOT(deleteLater()));
+        spy.wait();
+    }
+
+    params.clear();
+    params.insert("deviceIds", QVariantList() << m_mockDeviceId);
+    params.insert("typeIds", QVariantList() << mockIntStateId);
+    params.insert("loggingSources", QVariantList() << JsonTypes::loggingSourceToString(Logging::LoggingSourceStates));
+    response = injectAndWait("Logging.GetLogEntries", params);
+    verifyLoggingError(response);
+    QVariantList logEntries = response.toMap().value("params").toMap().value("logEntries").toList();
+    QCOMPARE(logEntries.count(), 2);
+
+    params.clear();
+    params.insert("stateTypeId", mockIntStateId);
+    response = injectAndWait("Configuration.DeleteStateLogPolicy", params);
+    verifyConfigurationError(response);
+
+    response = injectAndWait("Configuration.DeleteStateLogPolicy", params);
+    verifyConfigurationError(response, NymeaConfiguration::ConfigurationErrorInvalidId);
+}
+
+void TestLogging::prepareBenchmarkDatabase()
+{
+    if (m_benchmarkEngine) {
+        return;
+    }
+
+    QString dbName = "/tmp/nymea-test/nymead-benchmark.sqlite";
+    int entryCount = 1000000;
+
+    // The test organization limits the log database to 20 entries
+    QString organizationName = QCoreApplication::instance()->organizationName();
+    QCoreApplication::instance()->setOrganizationName("nymea-benchmark");
+
+    if (!QFile::exists(dbName)) {
+        // Let the LogEngine create the schema and fill it in one transaction
+        delete new LogEngine("QSQLITE", dbName);
+
+        qDebug() << "Filling benchmark database with" << entryCount << "entries. This will take a while.";
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "benchmark");
+            db.setDatabaseName(dbName);
+            QVERIFY(db.open());
+            QVERIFY(db.transaction());
+            QSqlQuery query(db);
+            query.prepare("INSERT INTO entries (timestamp, loggingLevel, sourceType, typeId, deviceId, value, loggingEventType, active, errorCode) "
+                          "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);");
+            uint startTime = QDateTime(QDate(2018, 1, 1), QTime(0, 0), Qt::UTC).toTime_t();
+            for (int i = 0; i < entryCount; i++) {
+                query.addBindValue(startTime + i * 30);
+                query.addBindValue(Logging::LoggingLevelInfo);
+                query.addBindValue(i % 2 ? Logging::LoggingSourceStates : Logging::LoggingSourceEvents);
+                query.addBindValue(QUuid(0x2000 + i % 10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0).toRfc4122());
+                query.addBindValue(QUuid(0x1000 + i % 50, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0).toRfc4122());
+                query.addBindValue(LogValueTool::serializeValue(i));
+                query.addBindValue(Logging::LoggingEventTypeTrigger);
+                query.addBindValue(false);
+                query.addBindValue(0);
+                QVERIFY(query.exec());
+            }
+            QVERIFY(db.commit());
+            db.close();
+        }
+        QSqlDatabase::removeDatabase("benchmark");
+    }
+
+    m_benchmarkEngine = new LogEngine("QSQLITE", dbName, "127.0.0.1", QString(), QString(), -1);
+    QCoreApplication::instance()->setOrganizationName(organizationName);
+}
+
+void TestLogging::benchmarkQueries_data()
+{
+    QTest::addColumn<LogFilter>("filter");
+
+    QDateTime startTime = QDateTime(QDate(2018, 3, 1), QTime(0, 0), Qt::UTC);
+
+    LogFilter latest;
+    latest.setLimit(100);
+    QTest::newRow("latest 100") << latest;
+
+    LogFilter device;
+    device.addDeviceId(DeviceId::fromUuid(QUuid(0x1000 + 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)));
+    device.setLimit(100);
+    QTest::newRow("device, latest 100") << device;
+
+    LogFilter deviceDay;
+    deviceDay.addDeviceId(DeviceId::fromUuid(QUuid(0x1000 + 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)));
+    deviceDay.addTimeFilter(startTime, startTime.addDays(1));
+    QTest::newRow("device, one day") << deviceDay;
+
+    LogFilter typeId;
+    typeId.addTypeId(QUuid(0x2000 + 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+    typeId.setLimit(100);
+    QTest::newRow("type id, latest 100") << typeId;
+
+    LogFilter source;
+    source.addLoggingSource(Logging::LoggingSourceEvents);
+    source.setLimit(100);
+    QTest::newRow("source, latest 100") << source;
+
+    LogFilter day;
+    day.addTimeFilter(startTime, startTime.addDays(1));
+    QTest::newRow("one day") << day;
+}
+
+void TestLogging::benchmarkQueries()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(LogFilter, filter);
+
+    prepareBenchmarkDatabase();
+    QVERIFY(m_benchmarkEngine);
+
+    int count = 0;
+    QBENCHMARK {
+        count = m_benchmarkEngine->logEntries(filter).count();
+    }
+    QVERIFY(count > 0);
+}
+
 void TestLogging::removeDevice()
 {
     // enable notifications
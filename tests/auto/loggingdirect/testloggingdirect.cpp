@@ -31,6 +31,12 @@ public:
     TestLoggingDirect(QObject* parent = nullptr);
 
 private slots:
+    void writeBehind();
+    void fetchLogEntries();
+    void fetchWithCursor();
+    void retention();
+    void archive();
+
     void benchmarkDB_data();
     void benchmarkDB();
 
@@ -46,6 +52,216 @@ TestLoggingDirect::TestLoggingDirect(QObject *parent): QObject(parent)
     QCoreApplication::instance()->setOrganizationName("nymea-test");
 }
 
+void TestLoggingDirect::writeBehind()
+{
+    engine->setFlushPolicy(10, 60000, 100);
+    engine->clearDatabase();
+
+    QSignalSpy addedSpy(engine, &LogEngine::logEntryAdded);
+    for (int i = 0; i < 25; i++) {
+        engine->logSystemEvent(QDateTime::currentDateTime(), true);
+    }
+
+    // Notifications are not held back
+    QCOMPARE(addedSpy.count(), 25);
+
+    // Reading flushes pending entries
+    QCOMPARE(engine->logEntries().count(), 25);
+    QCOMPARE(engine->droppedEntries(), 0);
+
+    engine->setFlushPolicy(100, 1000, 10000);
+    engine->clearDatabase();
+}
+
+void TestLoggingDirect::fetchLogEntries()
+{
+    engine->clearDatabase();
+    for (int i = 0; i < 5; i++) {
+        engine->logSystemEvent(QDateTime::currentDateTime(), true);
+    }
+
+    LogFilter filter;
+    filter.setLimit(3);
+    LogEntriesFetchJob *job = engine->fetchLogEntries(filter);
+    QList<LogEntry> entries;
+    connect(job, &LogEntriesFetchJob::finished, this, [&entries, job](){ entries = job->entries(); });
+    QSignalSpy finishedSpy(job, &LogEntriesFetchJob::finished);
+    QVERIFY(finishedSpy.wait());
+    QCOMPARE(entries.count(), 3);
+
+    engine->clearDatabase();
+}
+
+void TestLoggingDirect::fetchWithCursor()
+{
+    engine->clearDatabase();
+    for (int i = 0; i < 5; i++) {
+        engine->logSystemEvent(QDateTime::currentDateTime(), i % 2 == 0);
+    }
+    QList<LogEntry> allEntries = engine->logEntries();
+    QCOMPARE(allEntries.count(), 5);
+
+    LogFilter filter;
+    filter.setLimit(3);
+    LogEntriesFetchJob *job = engine->fetchLogEntries(filter);
+    QList<LogEntry> entries;
+    QString nextCursor;
+    connect(job, &LogEntriesFetchJob::finished, this, [&entries, &nextCursor, job](){ entries = job->entries(); nextCursor = job->nextCursor(); });
+    QSignalSpy finishedSpy(job, &LogEntriesFetchJob::finished);
+    QVERIFY(finishedSpy.wait());
+    QCOMPARE(entries.count(), 3);
+    QVERIFY(!nextCursor.isEmpty());
+
+    // The second page continues right after the last entry of the first one
+    QVERIFY(filter.setCursor(nextCursor));
+    job = engine->fetchLogEntries(filter);
+    connect(job, &LogEntriesFetchJob::finished, this, [&entries, &nextCursor, job](){ entries = job->entries(); nextCursor = job->nextCursor(); });
+    QSignalSpy secondFinishedSpy(job, &LogEntriesFetchJob::finished);
+    QVERIFY(secondFinishedSpy.wait());
+    QCOMPARE(entries.count(), 2);
+    QVERIFY(nextCursor.isEmpty());
+    QCOMPARE(entries.last().timestamp(), allEntries.last().timestamp());
+    QCOMPARE(entries.last().active(), allEntries.last().active());
+
+    QVERIFY(!filter.setCursor("invalid"));
+    QVERIFY(!filter.hasCursor());
+
+    engine->clearDatabase();
+}
+
+void TestLoggingDirect::retention()
+{
+    engine->clearDatabase();
+    engine->setMaxLogEntries(20, 0);
+
+    // Per source quota
+    engine->setMaxSourceEntries(Logging::LoggingSourceSystem, 5);
+    for (int i = 0; i < 10; i++) {
+        engine->logSystemEvent(QDateTime::currentDateTime(), true);
+    }
+    QTRY_COMPARE(engine->logEntries().count(), 5);
+    engine->setMaxSourceEntries(Logging::LoggingSourceSystem, 0);
+
+    // Overall limit
+    for (int i = 0; i < 30; i++) {
+        engine->logSystemEvent(QDateTime::currentDateTime(), true);
+    }
+    QTRY_COMPARE(engine->logEntries().count(), 20);
+
+    // Maximum age
+    engine->clearDatabase();
+    for (int i = 0; i < 3; i++) {
+        engine->logSystemEvent(QDateTime::currentDateTime().addDays(-10), true);
+    }
+    engine->logSystemEvent(QDateTime::currentDateTime(), false);
+    engine->logSystemEvent(QDateTime::currentDateTime(), false);
+    QCOMPARE(engine->logEntries().count(), 5);
+    engine->setRetentionPolicy(7, 20);
+    QTRY_COMPARE(engine->logEntries().count(), 2);
+    foreach (const LogEntry &entry, engine->logEntries()) {
+        QVERIFY(!entry.active());
+    }
+
+    engine->setRetentionPolicy(0, 20);
+    engine->setMaxLogEntries(20, 100);
+    engine->clearDatabase();
+}
+
+void TestLoggingDirect::archive()
+{
+    QString archivePath = "/tmp/nymea-test/nymea.sqlite.archive";
+    engine->setArchive(archivePath, 1);
+    engine->clearDatabase();
+    engine->setMaxLogEntries(10, 0);
+
+    QDateTime start = QDateTime::currentDateTime().addSecs(-60);
+    for (int i = 0; i < 30; i++) {
+        engine->logSystemEvent(start.addSecs(i), i % 3 == 0);
+    }
+
+    // Trimmed entries are moved to the archive and still show up in queries
+    QTRY_VERIFY(!QDir(archivePath).entryList(QStringList() << "segment-*.nla", QDir::Files).isEmpty());
+    QList<LogEntry> entries = engine->logEntries();
+    QCOMPARE(entries.count(), 30);
+    for (int i = 0; i < entries.count(); i++) {
+        QCOMPARE(entries.at(i).timestamp().toTime_t(), start.addSecs(29 - i).toTime_t());
+        QCOMPARE(entries.at(i).active(), (29 - i) % 3 == 0);
+    }
+
+    // Filters, offsets and cursors work across the database and the archive
+    LogFilter filter;
+    filter.addTimeFilter(start.addSecs(5), start.addSecs(24));
+    QCOMPARE(engine->logEntries(filter).count(), 20);
+
+    filter = LogFilter();
+    filter.setLimit(7);
+    filter.setOffset(10);
+    entries = engine->logEntries(filter);
+    QCOMPARE(entries.count(), 7);
+    QCOMPARE(entries.first().timestamp().toTime_t(), start.addSecs(19).toTime_t());
+
+    filter = LogFilter();
+    filter.setLimit(8);
+    QList<LogEntry> pagedEntries;
+    QString nextCursor;
+    do {
+        if (!nextCursor.isEmpty()) {
+            QVERIFY(filter.setCursor(nextCursor));
+        }
+        LogEntriesFetchJob *job = engine->fetchLogEntries(filter);
+        connect(job, &LogEntriesFetchJob::finished, this, [&pagedEntries, &nextCursor, job](){ pagedEntries.append(job->entries()); nextCursor = job->nextCursor(); });
+        QSignalSpy finishedSpy(job, &LogEntriesFetchJob::finished);
+        QVERIFY(finishedSpy.wait());
+    } while (!nextCursor.isEmpty());
+    QCOMPARE(pagedEntries.count(), 30);
+    QCOMPARE(pagedEntries.last().timestamp().toTime_t(), start.toTime_t());
+
+    // Segments are loaded again when reopening the archive
+    engine->setArchive(archivePath, 0);
+    QTRY_COMPARE(engine->logEntries().count(), 10);
+    engine->setArchive(archivePath, 1);
+    QCOMPARE(engine->logEntries().count(), 30);
+
+    engine->clearDatabase();
+    QTRY_VERIFY(QDir(archivePath).entryList(QStringList() << "segment-*.nla", QDir::Files).isEmpty());
+
+    // Rows written after archiving the whole table don't reuse the row ids of the archived ones
+    engine->setMaxLogEntries(20, 100);
+    QDateTime old = QDateTime::currentDateTime().addDays(-10);
+    for (int i = 0; i < 3; i++) {
+        engine->logSystemEvent(old, true);
+    }
+    QTRY_COMPARE(engine->logEntries().count(), 3);
+    engine->setRetentionPolicy(7, 20);
+    QTRY_VERIFY(!QDir(archivePath).entryList(QStringList() << "segment-*.nla", QDir::Files).isEmpty());
+    engine->setRetentionPolicy(0, 20);
+    for (int i = 0; i < 3; i++) {
+        engine->logSystemEvent(old, false);
+    }
+    QTRY_COMPARE(engine->logEntries().count(), 6);
+
+    filter = LogFilter();
+    filter.setLimit(2);
+    pagedEntries.clear();
+    nextCursor.clear();
+    do {
+        if (!nextCursor.isEmpty()) {
+            QVERIFY(filter.setCursor(nextCursor));
+        }
+        LogEntriesFetchJob *job = engine->fetchLogEntries(filter);
+        connect(job, &LogEntriesFetchJob::finished, this, [&pagedEntries, &nextCursor, job](){ pagedEntries.append(job->entries()); nextCursor = job->nextCursor(); });
+        QSignalSpy finishedSpy(job, &LogEntriesFetchJob::finished);
+        QVERIFY(finishedSpy.wait());
+    } while (!nextCursor.isEmpty());
+    QCOMPARE(pagedEntries.count(), 6);
+    for (int i = 0; i < pagedEntries.count(); i++) {
+        QCOMPARE(pagedEntries.at(i).active(), i >= 3);
+    }
+
+    engine->clearDatabase();
+    engine->setArchive(archivePath, 0);
+}
+
 void TestLoggingDirect::benchmarkDB_data() {
     QTest::addColumn<int>("prefill");
     QTest::addColumn<int>("maxSize");
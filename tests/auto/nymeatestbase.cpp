@@ -114,6 +114,10 @@ void NymeaTestBase::initTestCase()
     pluginSettings.clear();
     NymeaSettings statesSettings(NymeaSettings::SettingsRoleDeviceStates);
     statesSettings.clear();
+    QString statesFileNameBase = statesSettings.fileName();
+    statesFileNameBase.chop(QString(".conf").length());
+    QFile::remove(statesFileNameBase + ".snapshot");
+    QFile::remove(statesFileNameBase + ".journal");
 
     // Reset to default settings
     NymeaSettings nymeadSettings(NymeaSettings::SettingsRoleGlobal);
@@ -20,6 +20,7 @@
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "nymeatestbase.h"
+#include "nymeacore.h"
 #include "nymeasettings.h"
 #include "servers/mocktcpserver.h"
 
@@ -88,6 +89,7 @@ private slots:
     void testChildEvaluator();
 
     void testStateChange();
+    void testGetActiveRules();
 
     void enableDisableRule();
 
@@ -111,9 +113,14 @@ private slots:
 
     void testInterfaceBasedStateRule();
 
+    void testInterfaceBasedStateRuleDeviceAdded();
+
     void testHousekeeping_data();
     void testHousekeeping();
 
+    void benchmarkEvaluateEvent_data();
+    void benchmarkEvaluateEvent();
+
 };
 
 void TestRules::cleanupMockHistory() {
@@ -1701,6 +1708,72 @@ void TestRules::testStateChange() {
     reply->deleteLater();
 }
 
+void TestRules::testGetActiveRules()
+{
+    QNetworkAccessManager nam;
+    QSignalSpy spy(&nam, SIGNAL(finished(QNetworkReply*)));
+
+    // Make sure the state does not match yet
+    QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockIntStateId.toString()).arg(30)));
+    QNetworkReply *reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    // Add a state based rule
+    QVariantMap addRuleParams;
+    QVariantMap stateEvaluator;
+    QVariantMap stateDescriptor;
+    stateDescriptor.insert("deviceId", m_mockDeviceId);
+    stateDescriptor.insert("operator", JsonTypes::valueOperatorToString(Types::ValueOperatorGreaterOrEqual));
+    stateDescriptor.insert("stateTypeId", mockIntStateId);
+    stateDescriptor.insert("value", 42);
+    stateEvaluator.insert("stateDescriptor", stateDescriptor);
+    addRuleParams.insert("stateEvaluator", stateEvaluator);
+    addRuleParams.insert("name", "TestRule");
+
+    QVariantList actions;
+    QVariantMap action;
+    action.insert("actionTypeId", mockActionIdNoParams);
+    action.insert("deviceId", m_mockDeviceId);
+    actions.append(action);
+    addRuleParams.insert("actions", actions);
+    QVariant response = injectAndWait("Rules.AddRule", addRuleParams);
+    verifyRuleError(response);
+    RuleId ruleId = RuleId(response.toMap().value("params").toMap().value("ruleId").toString());
+
+    response = injectAndWait("Rules.GetActiveRules");
+    QVERIFY2(response.toMap().value("params").toMap().value("ruleIds").toList().isEmpty(), "Rule should not be active.");
+
+    // Activate the rule
+    spy.clear();
+    request.setUrl(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockIntStateId.toString()).arg(42)));
+    reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    verifyRuleExecuted(mockActionIdNoParams);
+
+    response = injectAndWait("Rules.GetActiveRules");
+    QVariantList activeRules = response.toMap().value("params").toMap().value("ruleIds").toList();
+    QCOMPARE(activeRules.count(), 1);
+    QCOMPARE(activeRules.first().toUuid(), QUuid(ruleId));
+
+    cleanupMockHistory();
+
+    // Deactivate the rule
+    spy.clear();
+    request.setUrl(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockIntStateId.toString()).arg(30)));
+    reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    response = injectAndWait("Rules.GetActiveRules");
+    QVERIFY2(response.toMap().value("params").toMap().value("ruleIds").toList().isEmpty(), "Rule should not be active any more.");
+}
+
 void TestRules::testStateEvaluator_data()
 {
     QTest::addColumn<DeviceId>("deviceId");
@@ -2808,6 +2881,87 @@ void TestRules::testInterfaceBasedStateRule()
     verifyRuleExecuted(mockActionIdPower);
 }
 
+void TestRules::testInterfaceBasedStateRuleDeviceAdded()
+{
+    QNetworkAccessManager nam;
+    QSignalSpy spy(&nam, SIGNAL(finished(QNetworkReply*)));
+
+    // Make sure the existing mock device doesn't match
+    QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockBatteryCriticalStateId.toString()).arg(true)));
+    QNetworkReply *reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    QVariantMap powerAction;
+    powerAction.insert("interface", "light");
+    powerAction.insert("interfaceAction", "power");
+    QVariantMap powerActionParam;
+    powerActionParam.insert("paramName", "power");
+    powerActionParam.insert("value", true);
+    powerAction.insert("ruleActionParams", QVariantList() << powerActionParam);
+
+    QVariantMap stateDescriptor;
+    stateDescriptor.insert("interface", "battery");
+    stateDescriptor.insert("interfaceState", "batteryCritical");
+    stateDescriptor.insert("value", false);
+    stateDescriptor.insert("operator", "ValueOperatorEquals");
+
+    QVariantMap stateEvaluator;
+    stateEvaluator.insert("stateDescriptor", stateDescriptor);
+
+    QVariantMap params;
+    params.insert("name", "TestInterfaceBasedStateRuleDeviceAdded");
+    params.insert("enabled", true);
+    params.insert("stateEvaluator", stateEvaluator);
+    params.insert("actions", QVariantList() << powerAction);
+    QVariant response = injectAndWait("Rules.AddRule", params);
+    verifyRuleError(response);
+    RuleId ruleId = RuleId(response.toMap().value("params").toMap().value("ruleId").toString());
+
+    params.clear();
+    params.insert("ruleId", ruleId);
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("active").toBool(), false);
+
+    // Add a device which matches the rule right away
+    params.clear();
+    params.insert("deviceClassId", mockDeviceClassId);
+    params.insert("name", "Battery mock");
+    QVariantMap httpParam;
+    httpParam.insert("paramTypeId", httpportParamTypeId);
+    httpParam.insert("value", 6668);
+    params.insert("deviceParams", QVariantList() << httpParam);
+    response = injectAndWait("Devices.AddConfiguredDevice", params);
+    verifyDeviceError(response);
+    DeviceId deviceId = DeviceId(response.toMap().value("params").toMap().value("deviceId").toString());
+
+    // Any evaluation pass has to pick up the new device, even if none of its states changed
+    spy.clear();
+    request = QNetworkRequest(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockIntStateId.toString()).arg(42)));
+    reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+
+    params.clear();
+    params.insert("ruleId", ruleId);
+    response = injectAndWait("Rules.GetRuleDetails", params);
+    QCOMPARE(response.toMap().value("params").toMap().value("rule").toMap().value("active").toBool(), true);
+
+    params.clear();
+    params.insert("deviceId", deviceId);
+    response = injectAndWait("Devices.RemoveConfiguredDevice", params);
+    verifyDeviceError(response);
+
+    spy.clear();
+    request = QNetworkRequest(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockDevice1Port).arg(mockBatteryCriticalStateId.toString()).arg(false)));
+    reply = nam.get(request);
+    spy.wait();
+    QCOMPARE(spy.count(), 1);
+    reply->deleteLater();
+}
+
 void TestRules::testHousekeeping_data()
 {
     QTest::addColumn<bool>("testAction");
@@ -2915,5 +3069,49 @@ void TestRules::testHousekeeping()
     }
 }
 
+void TestRules::benchmarkEvaluateEvent_data()
+{
+    QTest::addColumn<int>("ruleCount");
+
+    QTest::newRow("10 rules") << 10;
+    QTest::newRow("100 rules") << 100;
+    QTest::newRow("1000 rules") << 1000;
+}
+
+void TestRules::benchmarkEvaluateEvent()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(int, ruleCount);
+
+    RuleEngine *ruleEngine = NymeaCore::instance()->ruleEngine();
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    // One rule reacting on the benchmarked event, all others listening to something else
+    QList<RuleId> ruleIds;
+    for (int i = 0; i < ruleCount; i++) {
+        Rule rule;
+        rule.setId(RuleId::createRuleId());
+        rule.setName(QString("Benchmark rule %1").arg(i));
+        rule.setEnabled(true);
+        rule.setEventDescriptors(QList<EventDescriptor>() << EventDescriptor(i == 0 ? mockEvent1Id : mockEvent2Id, m_mockDeviceId));
+        rule.setActions(QList<RuleAction>() << RuleAction(mockActionIdNoParams, m_mockDeviceId));
+        QCOMPARE(ruleEngine->addRule(rule), RuleEngine::RuleErrorNoError);
+        ruleIds.append(rule.id());
+    }
+
+    Event event(mockEvent1Id, m_mockDeviceId);
+    QBENCHMARK {
+        QCOMPARE(ruleEngine->evaluateEvent(event).count(), 1);
+    }
+
+    foreach (const RuleId &ruleId, ruleIds) {
+        ruleEngine->removeRule(ruleId);
+    }
+    QLoggingCategory::setFilterRules("*.debug=false\nTests.debug=true\nRuleEngine.debug=true\nRuleEngineDebug.debug=true\nMockDevice.*=true");
+}
+
 #include "testrules.moc"
 QTEST_MAIN(TestRules)
@@ -0,0 +1,331 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                                                                         *
+ *  Copyright (C) 2019 guh GmbH                                            *
+ *                                                                         *
+ *  This file is part of nymea.                                            *
+ *                                                                         *
+ *  nymea is free software: you can redistribute it and/or modify          *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation, version 2 of the License.                *
+ *                                                                         *
+ *  nymea is distributed in the hope that it will be useful,               *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *  You should have received a copy of the GNU General Public License      *
+ *  along with nymea. If not, see <http://www.gnu.org/licenses/>.          *
+ *                                                                         *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "nymeatestbase.h"
+#include "nymeacore.h"
+#include "ruleengine.h"
+#include "time/timedescriptor.h"
+
+#include <QTimeZone>
+
+#include <pthread.h>
+
+using namespace nymeaserver;
+
+Q_DECLARE_METATYPE(TimeDescriptor)
+
+// Count the heap allocations of the test thread by interposing the glibc allocator
+static bool s_countAllocations = false;
+static int s_allocationCount = 0;
+static pthread_t s_countingThread;
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static inline void countAllocation()
+{
+    if (s_countAllocations && pthread_equal(pthread_self(), s_countingThread)) {
+        s_allocationCount++;
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+static void startCountingAllocations()
+{
+    s_allocationCount = 0;
+    s_countingThread = pthread_self();
+    s_countAllocations = true;
+}
+
+static int stopCountingAllocations()
+{
+    s_countAllocations = false;
+    return s_allocationCount;
+}
+
+class TestRulesDirect: public NymeaTestBase
+{
+    Q_OBJECT
+
+private:
+    QList<RuleId> addStateRules(int count);
+    void removeRules(const QList<RuleId> &ruleIds);
+
+private slots:
+    void initTestCase();
+
+    void evaluateEventAllocations_data();
+    void evaluateEventAllocations();
+
+    void evaluateTimeAllocations_data();
+    void evaluateTimeAllocations();
+
+    void nextEvaluationTime_data();
+    void nextEvaluationTime();
+};
+
+void TestRulesDirect::initTestCase()
+{
+    NymeaTestBase::initTestCase();
+    QLoggingCategory::setFilterRules("*.debug=false\nTests.debug=true");
+}
+
+QList<RuleId> TestRulesDirect::addStateRules(int count)
+{
+    // Event based rules with a state condition: each change of the int state updates them, but none of them triggers
+    QList<RuleId> ruleIds;
+    for (int i = 0; i < count; i++) {
+        Rule rule;
+        rule.setId(RuleId::createRuleId());
+        rule.setName(QString("Allocation rule %1").arg(i));
+        rule.setEnabled(true);
+        rule.setEventDescriptors(QList<EventDescriptor>() << EventDescriptor(mockEvent1Id, m_mockDeviceId));
+        rule.setStateEvaluator(StateEvaluator(StateDescriptor(mockIntStateId, m_mockDeviceId, i, Types::ValueOperatorGreater)));
+        rule.setActions(QList<RuleAction>() << RuleAction(mockActionIdNoParams, m_mockDeviceId));
+        if (NymeaCore::instance()->ruleEngine()->addRule(rule) != RuleEngine::RuleErrorNoError) {
+            qCWarning(dcTests()) << "Could not add rule" << rule.name();
+            continue;
+        }
+        ruleIds.append(rule.id());
+    }
+    return ruleIds;
+}
+
+void TestRulesDirect::removeRules(const QList<RuleId> &ruleIds)
+{
+    foreach (const RuleId &ruleId, ruleIds) {
+        NymeaCore::instance()->ruleEngine()->removeRule(ruleId);
+    }
+}
+
+void TestRulesDirect::evaluateEventAllocations_data()
+{
+    QTest::addColumn<int>("ruleCount");
+
+    QTest::newRow("10 rules") << 10;
+    QTest::newRow("100 rules") << 100;
+    QTest::newRow("1000 rules") << 1000;
+}
+
+void TestRulesDirect::evaluateEventAllocations()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(int, ruleCount);
+
+    RuleEngine *ruleEngine = NymeaCore::instance()->ruleEngine();
+    Event event(EventTypeId::fromUuid(mockIntStateId), m_mockDeviceId, ParamList() << Param(ParamTypeId::fromUuid(mockIntStateId), 0), true);
+
+    // Measure with a single rule first. The first pass settles new rules and grows the reused buffers.
+    QList<RuleId> ruleIds = addStateRules(1);
+    QCOMPARE(ruleIds.count(), 1);
+    ruleEngine->evaluateEvent(event);
+    startCountingAllocations();
+    QList<Rule> rules = ruleEngine->evaluateEvent(event);
+    int singleRuleAllocations = stopCountingAllocations();
+    QCOMPARE(rules.count(), 0);
+
+    ruleIds.append(addStateRules(ruleCount - 1));
+    QCOMPARE(ruleIds.count(), ruleCount);
+    ruleEngine->evaluateEvent(event);
+    startCountingAllocations();
+    rules = ruleEngine->evaluateEvent(event);
+    int allocations = stopCountingAllocations();
+    QCOMPARE(rules.count(), 0);
+
+    qCDebug(dcTests()) << "Allocations per event with" << ruleCount << "rules:" << allocations << "(" << singleRuleAllocations << "with a single rule)";
+    QVERIFY2(allocations == singleRuleAllocations, "Evaluating an event allocates memory for each rule.");
+
+    QBENCHMARK {
+        ruleEngine->evaluateEvent(event);
+    }
+
+    removeRules(ruleIds);
+}
+
+void TestRulesDirect::evaluateTimeAllocations_data()
+{
+    QTest::addColumn<int>("ruleCount");
+
+    QTest::newRow("10 rules") << 10;
+    QTest::newRow("100 rules") << 100;
+    QTest::newRow("1000 rules") << 1000;
+}
+
+void TestRulesDirect::evaluateTimeAllocations()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(int, ruleCount);
+
+    RuleEngine *ruleEngine = NymeaCore::instance()->ruleEngine();
+    QDateTime dateTime = QDateTime::currentDateTime();
+
+    QList<RuleId> ruleIds = addStateRules(1);
+    QCOMPARE(ruleIds.count(), 1);
+    ruleEngine->evaluateTime(dateTime);
+    startCountingAllocations();
+    QList<Rule> rules = ruleEngine->evaluateTime(dateTime);
+    int singleRuleAllocations = stopCountingAllocations();
+    QCOMPARE(rules.count(), 0);
+
+    ruleIds.append(addStateRules(ruleCount - 1));
+    QCOMPARE(ruleIds.count(), ruleCount);
+    startCountingAllocations();
+    rules = ruleEngine->evaluateTime(dateTime);
+    int allocations = stopCountingAllocations();
+    QCOMPARE(rules.count(), 0);
+
+    qCDebug(dcTests()) << "Allocations per time evaluation with" << ruleCount << "rules:" << allocations << "(" << singleRuleAllocations << "with a single rule)";
+    QVERIFY2(allocations == singleRuleAllocations, "Evaluating the time allocates memory for each rule.");
+
+    QBENCHMARK {
+        ruleEngine->evaluateTime(dateTime);
+    }
+
+    removeRules(ruleIds);
+}
+
+void TestRulesDirect::nextEvaluationTime_data()
+{
+    QTest::addColumn<TimeDescriptor>("timeDescriptor");
+
+    QList<CalendarItem> calendarItems;
+    CalendarItem calendarItem;
+    TimeDescriptor timeDescriptor;
+
+    calendarItem.setStartTime(QTime(8, 0));
+    calendarItem.setDuration(30);
+    calendarItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeDaily));
+    timeDescriptor.setCalendarItems(QList<CalendarItem>() << calendarItem);
+    QTest::newRow("calendar, daily") << timeDescriptor;
+
+    calendarItem.setStartTime(QTime(23, 30));
+    calendarItem.setDuration(60);
+    calendarItem.setRepeatingOption(RepeatingOption());
+    timeDescriptor.setCalendarItems(QList<CalendarItem>() << calendarItem);
+    QTest::newRow("calendar, over midnight") << timeDescriptor;
+
+    calendarItem.setStartTime(QTime(2, 15));
+    calendarItem.setDuration(10);
+    calendarItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeHourly, QList<int>() << 2 << 7));
+    timeDescriptor.setCalendarItems(QList<CalendarItem>() << calendarItem);
+    QTest::newRow("calendar, hourly") << timeDescriptor;
+
+    calendarItem.setStartTime(QTime(22, 0));
+    calendarItem.setDuration(180);
+    calendarItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeWeekly, QList<int>() << 1 << 3 << 7));
+    timeDescriptor.setCalendarItems(QList<CalendarItem>() << calendarItem);
+    QTest::newRow("calendar, weekly") << timeDescriptor;
+
+    calendarItem.setStartTime(QTime(6, 0));
+    calendarItem.setDuration(2880);
+    calendarItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeMonthly, QList<int>(), QList<int>() << 1 << 30 << 31));
+    timeDescriptor.setCalendarItems(QList<CalendarItem>() << calendarItem);
+    QTest::newRow("calendar, monthly") << timeDescriptor;
+
+    calendarItem.setStartTime(QTime());
+    calendarItem.setDateTime(QDateTime(QDate(2017, 3, 28), QTime(12, 0)));
+    calendarItem.setDuration(90);
+    calendarItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeYearly));
+    timeDescriptor.setCalendarItems(QList<CalendarItem>() << calendarItem);
+    QTest::newRow("calendar, yearly") << timeDescriptor;
+
+    calendarItem.setDateTime(QDateTime(QDate(2019, 3, 30), QTime(20, 0)));
+    calendarItem.setRepeatingOption(RepeatingOption());
+    timeDescriptor.setCalendarItems(QList<CalendarItem>() << calendarItem);
+    QTest::newRow("calendar, once") << timeDescriptor;
+
+    timeDescriptor.setCalendarItems(QList<CalendarItem>());
+
+    TimeEventItem timeEventItem;
+    timeEventItem.setTime(QTime(2, 30));
+    timeEventItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeDaily));
+    timeDescriptor.setTimeEventItems(QList<TimeEventItem>() << timeEventItem);
+    QTest::newRow("time event, daily") << timeDescriptor;
+
+    timeEventItem.setTime(QTime(0, 42));
+    timeEventItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeHourly));
+    timeDescriptor.setTimeEventItems(QList<TimeEventItem>() << timeEventItem);
+    QTest::newRow("time event, hourly") << timeDescriptor;
+
+    timeEventItem.setTime(QTime(7, 0));
+    timeEventItem.setRepeatingOption(RepeatingOption(RepeatingOption::RepeatingModeWeekly, QList<int>() << 2 << 6));
+    timeDescriptor.setTimeEventItems(QList<TimeEventItem>() << timeEventItem);
+    QTest::newRow("time event, weekly") << timeDescriptor;
+
+    timeEventItem.setTime(QTime());
+    timeEventItem.setDateTime(QDateTime(QDate(2019, 3, 31), QTime(11, 11)).toTime_t());
+    timeEventItem.setRepeatingOption(RepeatingOption());
+    timeDescriptor.setTimeEventItems(QList<TimeEventItem>() << timeEventItem);
+    QTest::newRow("time event, once") << timeDescriptor;
+}
+
+void TestRulesDirect::nextEvaluationTime()
+{
+    QFETCH(TimeDescriptor, timeDescriptor);
+
+    // Two weeks in minute steps, including a daylight saving time change and a month change
+    QDateTime lastDateTime = QDateTime(QDate(2019, 3, 24), QTime(0, 0, 30), QTimeZone("Europe/Vienna"));
+    QDateTime nextEvaluationTime = timeDescriptor.nextEvaluationTime(lastDateTime);
+    bool lastResult = timeDescriptor.evaluate(lastDateTime.addSecs(-60), lastDateTime);
+    bool calendarBased = !timeDescriptor.calendarItems().isEmpty();
+
+    for (int i = 1; i < 14 * 24 * 60; i++) {
+        QDateTime dateTime = lastDateTime.addSecs(60);
+        bool result = timeDescriptor.evaluate(lastDateTime, dateTime);
+
+        if (!nextEvaluationTime.isValid() || dateTime < nextEvaluationTime) {
+            // Nothing is allowed to change before the scheduled time
+            bool expectedResult = calendarBased ? lastResult : false;
+            QVERIFY2(result == expectedResult, QString("Evaluation changed at %1 but was scheduled for %2")
+                     .arg(dateTime.toString(Qt::ISODate)).arg(nextEvaluationTime.toString(Qt::ISODate)).toUtf8());
+        } else {
+            nextEvaluationTime = timeDescriptor.nextEvaluationTime(dateTime);
+            lastResult = result;
+        }
+        lastDateTime = dateTime;
+    }
+}
+
+#include "testrulesdirect.moc"
+QTEST_MAIN(TestRulesDirect)
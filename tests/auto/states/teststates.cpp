@@ -21,6 +21,9 @@
 
 #include "nymeatestbase.h"
 #include "nymeacore.h"
+#include "devicestatejournal.h"
+
+#include <QTemporaryDir>
 
 using namespace nymeaserver;
 
@@ -35,6 +38,13 @@ private slots:
     void getStateValue();
 
     void save_load_states();
+
+    void stateIndexes();
+
+    void stateJournal();
+
+    void benchmarkStateUpdates_data();
+    void benchmarkStateUpdates();
 };
 
 void TestStates::getStateTypes()
@@ -130,5 +140,130 @@ void TestStates::save_load_states()
     QCOMPARE(response.toMap().value("params").toMap().value("value").toBool(), mockDeviceClass.getStateType(mockBoolStateId).defaultValue().toBool());
 }
 
+void TestStates::stateIndexes()
+{
+    DeviceClass mockDeviceClass = NymeaCore::instance()->deviceManager()->findDeviceClass(mockDeviceClassId);
+    Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevices(mockDeviceClassId).first();
+
+    // Indexes follow the order of the state types in the device class
+    for (int i = 0; i < mockDeviceClass.stateTypes().count(); i++) {
+        StateTypeId stateTypeId = mockDeviceClass.stateTypes().at(i).id();
+        QCOMPARE(device->stateIndex(stateTypeId), i);
+        QCOMPARE(device->stateValue(i), device->stateValue(stateTypeId));
+    }
+
+    QCOMPARE(device->stateIndex(StateTypeId::createStateTypeId()), -1);
+    QVERIFY(!device->stateValue(-1).isValid());
+    QVERIFY(!device->stateValue(mockDeviceClass.stateTypes().count()).isValid());
+
+    QSignalSpy spy(device, &Device::stateValueChanged);
+    int index = device->stateIndex(mockIntStateId);
+    int newValue = device->stateValue(index).toInt() + 1;
+    device->setStateValue(index, newValue);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().at(0).toUuid(), QUuid(mockIntStateId));
+    QCOMPARE(device->stateValue(mockIntStateId).toInt(), newValue);
+
+    // Setting the same value again doesn't emit
+    device->setStateValue(index, newValue);
+    QCOMPARE(spy.count(), 1);
+}
+
+void TestStates::stateJournal()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString fileNameBase = dir.path() + "/devicestates";
+
+    DeviceId deviceId = DeviceId::createDeviceId();
+    DeviceId removedDeviceId = DeviceId::createDeviceId();
+    StateTypeId intStateTypeId = StateTypeId::createStateTypeId();
+    StateTypeId stringStateTypeId = StateTypeId::createStateTypeId();
+
+    {
+        DeviceStateJournal journal(fileNameBase);
+        QVERIFY(journal.open());
+        journal.setValue(deviceId, intStateTypeId, 23);
+        journal.setValue(deviceId, intStateTypeId, 42);
+        journal.setValue(deviceId, stringStateTypeId, QString("nymea"));
+        journal.setValue(removedDeviceId, intStateTypeId, 1);
+        journal.removeDevice(removedDeviceId);
+        journal.flush();
+
+        // Simulate a crash: the journal is never compacted and the last record is torn
+        QFile journalFile(journal.journalFileName());
+        QVERIFY(journalFile.open(QIODevice::WriteOnly | QIODevice::Append));
+        QDataStream stream(&journalFile);
+        stream << static_cast<quint32>(64) << static_cast<quint16>(0) << static_cast<quint8>(1);
+    }
+
+    {
+        DeviceStateJournal journal(fileNameBase);
+        QVERIFY(journal.open());
+        QCOMPARE(journal.value(deviceId, intStateTypeId), QVariant(42));
+        QCOMPARE(journal.value(deviceId, stringStateTypeId), QVariant(QString("nymea")));
+        QVERIFY(!journal.contains(removedDeviceId, intStateTypeId));
+        QCOMPARE(journal.devices(), QList<DeviceId>() << deviceId);
+
+        // Opening compacts everything into the snapshot
+        QCOMPARE(QFileInfo(journal.journalFileName()).size(), 8);
+
+        // Exceeding the threshold compacts as well
+        journal.setCompactThreshold(2);
+        journal.setValue(deviceId, intStateTypeId, 43);
+        journal.setValue(deviceId, intStateTypeId, 44);
+        journal.flush();
+        QCOMPARE(QFileInfo(journal.journalFileName()).size(), 8);
+    }
+
+    DeviceStateJournal journal(fileNameBase);
+    QVERIFY(journal.open());
+    QCOMPARE(journal.value(deviceId, intStateTypeId), QVariant(44));
+}
+
+void TestStates::benchmarkStateUpdates_data()
+{
+    QTest::addColumn<bool>("byIndex");
+    QTest::addColumn<bool>("notify");
+
+    QTest::newRow("by stateTypeId") << false << false;
+    QTest::newRow("by index") << true << false;
+    QTest::newRow("by index, with notifications") << true << true;
+}
+
+void TestStates::benchmarkStateUpdates()
+{
+    if (qgetenv("WITH_BENCHMARK").isEmpty()) {
+        QSKIP("Skipping benchmark tests: export WITH_BENCHMARK=1 to enable it.");
+    }
+
+    QFETCH(bool, byIndex);
+    QFETCH(bool, notify);
+
+    Device *device = NymeaCore::instance()->deviceManager()->findConfiguredDevices(mockDeviceClassId).first();
+    int stateIndex = device->stateIndex(mockIntStateId);
+    QVERIFY(stateIndex >= 0);
+
+    // Without notifications only the state storage in the Device is measured
+    QSignalBlocker blocker(device);
+    if (notify) {
+        blocker.unblock();
+    }
+
+    // 10000 state changes, every update changes the value
+    int value = device->stateValue(stateIndex).toInt();
+    QBENCHMARK {
+        for (int i = 0; i < 10000; i++) {
+            value++;
+            if (byIndex) {
+                device->setStateValue(stateIndex, value);
+            } else {
+                device->setStateValue(mockIntStateId, value);
+            }
+        }
+    }
+    QCOMPARE(device->stateValue(mockIntStateId).toInt(), value);
+}
+
 #include "teststates.moc"
 QTEST_MAIN(TestStates)
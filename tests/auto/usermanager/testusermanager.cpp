@@ -36,6 +36,8 @@ private slots:
     void createUser_data();
     void createUser();
 
+    void verifyTokenCache();
+
 private:
     LogEngine *engine;
 };
@@ -96,5 +98,39 @@ void TestUsermanager::createUser()
 
 }
 
+void TestUsermanager::verifyTokenCache()
+{
+    UserManager *userManager = NymeaCore::instance()->userManager();
+    foreach (const QString &user, userManager->users()) {
+        userManager->removeUser(user);
+    }
+    userManager->removeUser("");
+    QVERIFY(userManager->initRequired());
+
+    QCOMPARE(userManager->createUser("foo@bar.baz", "Bla1234*"), UserManager::UserErrorNoError);
+    QVERIFY(!userManager->initRequired());
+
+    QByteArray token = userManager->authenticate("foo@bar.baz", "Bla1234*", "testdevice");
+    QVERIFY(!token.isEmpty());
+    QVERIFY(userManager->verifyToken(token));
+    QVERIFY(userManager->verifyToken(token));
+    QVERIFY(!userManager->verifyToken("invalid"));
+
+    // Removing the token must not leave it in the cache
+    QSignalSpy tokensRemovedSpy(userManager, &UserManager::tokensRemoved);
+    QList<TokenInfo> tokens = userManager->tokens("foo@bar.baz");
+    QCOMPARE(tokens.count(), 1);
+    QCOMPARE(userManager->removeToken(tokens.first().id()), UserManager::UserErrorNoError);
+    QCOMPARE(tokensRemovedSpy.count(), 1);
+    QVERIFY(!userManager->verifyToken(token));
+
+    // Same for tokens removed along with their user
+    token = userManager->authenticate("foo@bar.baz", "Bla1234*", "testdevice");
+    QVERIFY(userManager->verifyToken(token));
+    QCOMPARE(userManager->removeUser("foo@bar.baz"), UserManager::UserErrorNoError);
+    QVERIFY(!userManager->verifyToken(token));
+    QVERIFY(userManager->initRequired());
+}
+
 #include "testusermanager.moc"
 QTEST_MAIN(TestUsermanager)